@@ -7,27 +7,32 @@
  * ----------------------------------------------------------------------------
  */
 
-#include <cerrno>    // for errno
-#include <csignal>   // for sigaction, SIG...
-#include <cstdlib>   // for strtol, strtod
-#include <cstring>   // for strerror, strs...
-#include <exception> // for exception
-#include <iostream>  // for operator<<
-#include <string>    // for string, operat...
-#include <thread>    // for this_thread
-#include <utility>   // for cmp...
-#include <vector>    // for vector
-
-#include <fcntl.h>       // for open, O_CREAT
-#include <getopt.h>      // for required_argument
-#include <linux/sched.h> // for SCHED_FIFO
-#include <sched.h>       // for pid_t, __sched...
-#include <span>          // for span
-#include <sys/stat.h>    // for S_IRGRP, S_IROTH
-#include <unistd.h>      // for close
+#include <algorithm>   // for max
+#include <cerrno>      // for errno
+#include <csignal>     // for sigaction, SIG...
+#include <cstdlib>     // for strtol, strtod
+#include <cstring>     // for strerror, strs...
+#include <exception>   // for exception
+#include <iostream>    // for operator<<
+#include <string>      // for string, operat...
+#include <string_view> // for string_view
+#include <thread>      // for this_thread
+#include <tuple>       // for ignore
+#include <utility>     // for cmp...
+#include <vector>      // for vector
+
+#include <fcntl.h>        // for open, O_CREAT
+#include <getopt.h>       // for required_argument
+#include <linux/sched.h>  // for SCHED_FIFO
+#include <sched.h>        // for pid_t, __sched...
+#include <span>           // for span
+#include <sys/resource.h> // for getrlimit, setrlimit
+#include <sys/stat.h>     // for S_IRGRP, S_IROTH
+#include <unistd.h>       // for close
 
 #include "migration/migration.hpp"                    // for balance, add_pids
 #include "migration/migration_var.hpp"                // for max_thread_mig...
+#include "migration/performance/decay.hpp"            // for half_life
 #include "migration/strategies/memory_mig_strats.hpp" // for print_strategies
 #include "migration/strategies/thread_mig_strats.hpp" // for print_strategies
 #include "migration/tickets.hpp"                      // for read_tickets_file
@@ -35,7 +40,9 @@
 #include "samples/perf_event/perf_event.hpp"          // for end, init, rea...
 #include "samples/samples.hpp"                        // for PIDs_to_filter
 #include "system_info/memory_info.hpp"                // for update_memory_...
+#include "system_info/node_array.hpp"                 // for node_array, n_nodes
 #include "system_info/system_info.hpp"                // for detect_system
+#include "utils/proc.hpp"                             // for meminfo
 #include "utils/string.hpp"                           // for percentage
 #include "utils/time.hpp"                             // for time_until
 #include "utils/types.hpp"                            // for real_t, time_p...
@@ -84,6 +91,11 @@ namespace {
 	char * file_read_tickets;
 	char * file_write_tickets;
 
+	bool        calibrate_system = false;
+	std::string calibration_file = system_info::calibration::DEFAULT_FILE;
+
+	struct rlimit nofile_limit {}; // Limit of open files before raising it (restored for the child process)
+
 	// Capture the child process signal to make a clean end (closing auxiliary files, free memory, etc.)
 	void clean_end(int signal, siginfo_t * siginfo, [[maybe_unused]] void * context) {
 		if (siginfo != nullptr && std::cmp_equal(signal, SIGCHLD) &&
@@ -200,6 +212,9 @@ namespace {
 
 			if (redirect_stderr) { redirect_output(child_stderr, STDERR_FILENO); }
 
+			// The child does not need the open files limit raised for the /proc files of its threads
+			if (std::cmp_greater(nofile_limit.rlim_cur, 0)) { setrlimit(RLIMIT_NOFILE, &nofile_limit); }
+
 			int err = {};
 			if (shell_mode) {
 				err = execl("/bin/sh", "sh", "-c", command_str.data(), static_cast<char *>(nullptr));
@@ -264,6 +279,35 @@ namespace {
 		return true;
 	}
 
+	// The /proc/<tid>/stat files of the monitored threads are kept open, so raise the soft limit of open files up to
+	// the hard one (files that cannot be kept open are opened on every read anyway)
+	void raise_open_files_limit() {
+		if (std::cmp_not_equal(getrlimit(RLIMIT_NOFILE, &nofile_limit), 0)) {
+			if (verbose::print_with_lvl(verbose::LVL1)) {
+				std::cerr << "Error getting the limit of open files (" << strerror(errno) << ")." << '\n';
+			}
+			nofile_limit = {};
+			return;
+		}
+
+		if (nofile_limit.rlim_cur >= nofile_limit.rlim_max) { return; }
+
+		struct rlimit raised = nofile_limit;
+		raised.rlim_cur      = nofile_limit.rlim_max;
+
+		if (std::cmp_not_equal(setrlimit(RLIMIT_NOFILE, &raised), 0)) {
+			if (verbose::print_with_lvl(verbose::LVL1)) {
+				std::cerr << "Limit of open files could not be raised (" << strerror(errno) << ")." << '\n';
+			}
+			return;
+		}
+
+		if (verbose::print_with_lvl(verbose::LVL2)) {
+			std::cout << "Limit of open files raised from " << nofile_limit.rlim_cur << " to " << raised.rlim_cur
+			          << '\n';
+		}
+	}
+
 	void setup_output_files() {
 		// Prepare output files
 		const auto now_str = utils::time::now_string();
@@ -296,9 +340,27 @@ namespace {
 	}
 
 	auto main_loop(const std::span<char * const> child_args) -> int {
+		raise_open_files_limit();
+
 		// Get system info
 		system_info::detect_system();
 
+		// Per-node data is stored inline for the number of nodes chosen at build time
+		if (!system_info::node_array<int>::fits()) {
+			std::cerr << "thanos was built for up to " << system_info::MAX_INLINE_NODES
+			          << " NUMA nodes, but the system has " << system_info::n_nodes()
+			          << ". Rebuild it with -DMAX_NODES=0 (or a bigger value)." << '\n';
+			return EXIT_FAILURE;
+		}
+
+		// Measure (or load) the latency/bandwidth between nodes before the child starts to use them
+		if (calibrate_system) { std::ignore = system_info::calibrate(calibration_file); }
+
+		// Find the best chunk size for page migrations in this machine
+		if (migration::memory::portion_memory_migrations > 0) {
+			std::ignore = migration::memory::executor.autotune_chunk_pages();
+		}
+
 		// Change priority (if required)
 		if (use_rt_scheduling) { change_sched_priority(); }
 
@@ -330,6 +392,27 @@ namespace {
 			try {
 				const auto current_time = hres_clock::now();
 
+				// Threads created or finished since the last iteration (without waiting for the next update)
+				const auto [new_pids, finished_pids] = system_info::process_events(child_process);
+
+				if (!finished_pids.empty()) {
+					migration::remove_invalid_pids(finished_pids);
+
+					for (const auto & pid : finished_pids) {
+						samples::erase_PID_to_filter(pid);
+					}
+
+					if (std::cmp_greater(migration::thread::max_thread_migrations, 0)) { migration::balance(); }
+				}
+
+				if (!new_pids.empty()) {
+					migration::add_pids(new_pids);
+
+					for (const auto & pid : new_pids) {
+						samples::insert_PID_to_filter(pid);
+					}
+				}
+
 				if (utils::time::time_until(last_proc_update, current_time) > secs_update_proc) {
 					last_proc_update = current_time;
 
@@ -359,7 +442,6 @@ namespace {
 					last_mem_update = current_time;
 
 					memory_info::update_memory_regions(samples::PIDs_to_filter);
-					if (memory_info::fake_thp_enabled()) { memory_info::update_fake_thps(); }
 				}
 
 				if (!samples::rotate_enabled_counters()) {
@@ -413,18 +495,27 @@ namespace {
 		std::cout << "Usage: " << program_name << " [options] <program_to_migrate>" << '\n';
 		std::cout << "Options:" << '\n'
 		          << '\t' << "[-h] [--help]" << '\n'
+		          << '\t' << "[-A max_regions] [--adaptive-regions]: integer >= 0. 0 = no adaptive region tracking"
+		          << '\n'
 		          << '\t' << "[-b secs_between_balance] [--thread-balance secs]: real number > 0" << '\n'
 		          << '\t' << "[-c] [--chart-threads]" << '\n'
 		          << '\t' << "[-C] [--chart-memory]" << '\n'
 		          << '\t' << "[-e[stderr_child]] [--stderr-child]" << '\n'
 		          << '\t' << "[-f freq_instructions] [--freq-instr]: integer in the interval (0, 1000]" << '\n'
 		          << '\t' << "[-F freq_memory] [--freq-memory]: integer in the interval (0, 1000]" << '\n'
+		          << '\t' << "[-G link_GBps] [--mig-bandwidth]: real >= 0. 0 = no limit for memory migrations" << '\n'
+		          << '\t' << "[--mig-inbound=links]: real >= 0. Links' worth of migrations to a node. 0 = no limit"
+		          << '\n'
+		          << '\t' << "[-H half_life_secs] [--half-life]: real >= 0. 0 = no decay of page/thread statistics"
+		          << '\n'
 		          << '\t' << "[-i file_tickets_read] [--tickets-read filename]" << '\n'
+		          << '\t' << "[-k hot_pages_per_node] [--hot-pages]: integer >= 0. 0 = track every sampled page" << '\n'
 		          << '\t' << "[-I file_tickets_write] [--tickets-write filename]" << '\n'
 		          << '\t' << "[-l minimum_latency] [--min-latency]: integer > 0" << '\n'
 		          << '\t' << "[-m max_thread_migrations_per_iter] [--max-thread-migs]: integer >= 0" << '\n'
 		          << '\t' << "[-M portion_memory_migrations_per_iter] [--max-memory-migs]: real within [0, 1]" << '\n'
 		          << '\t' << "[-o[stdout_child]] [--stdout-child]" << '\n'
+		          << '\t' << "[-p pages_per_sec] [--mig-rate]: integer >= 0. 0 = no limit for memory migrations" << '\n'
 		          << '\t' << "[-P memory_prefetch_size] [--memory-prefetch]: integer >= 0" << '\n'
 		          << '\t' << "[-r sampling_rate_in_secs] [--rate-sampling]: real number > 0" << '\n'
 		          << '\t' << "[-R real_time_scheduling] [--real-time-sched]" << '\n'
@@ -433,11 +524,16 @@ namespace {
 		          << '\t' << "[-t seconds_between_thread_migs] [--thread-time]: real number > 0" << '\n'
 		          << '\t' << "[-T seconds_between_memory_migs] [--memory-time]: real number > 0" << '\n'
 		          << '\t' << "[--thp[=n_pages]]: opt integer >= 0. 0 = disable \"fake\" transparent huge pages." << '\n'
+		          << '\t' << "[--huge-pages=policy]: \"whole\" or \"split\" (per base page) huge pages" << '\n'
+		          << '\t' << "[--calibrate[=file]]: measure latency/bandwidth between nodes. Cached in the file ("
+		          << system_info::calibration::DEFAULT_FILE << " by default)" << '\n'
 		          << '\t' << "[-u secs_update_proc] [--sec-update-proc]: real number > 0" << '\n'
 		          << '\t' << "[-U secs_update_mem] [--sec-update-mem]: real number > 0" << '\n'
 		          << '\t' << "[-v verbose_lvl] [--verbose]: integer within [" << verbose::NO_VERBOSE << ", "
 		          << verbose::LVL_MAX << "]" << '\n'
-		          << '\t' << "[-W wait_before_migr] [--wait-before-mig]: real >= 0" << '\n';
+		          << '\t' << "[-W wait_before_migr] [--wait-before-mig]: real >= 0" << '\n'
+		          << '\t' << "[-z horizon_secs] [--mig-horizon]: real >= 0. 0 = no cost/benefit check of memory migs"
+		          << '\n';
 		std::cout << "Thread migration strategies:" << '\n';
 		migration::thread::print_strategies(std::cout, "\t");
 		std::cout << "Memory migration strategies:" << '\n';
@@ -452,40 +548,56 @@ int main(const int argc, char * const argv[]) {
 
 	/* clang-format off */
 	static const std::vector<struct option> long_options = {
-		{"help",            no_argument,        nullptr, 'h' },
-		{"thread-balance",  required_argument,  nullptr, 'b' },
-		{"chart-threads",   no_argument,        nullptr, 'c' },
-		{"chart-memory",    no_argument,        nullptr, 'C' },
-		{"stderr-child",    optional_argument,  nullptr, 'e' },
-		{"freq-instr",      required_argument,  nullptr, 'f' },
-		{"freq-memory",     required_argument,  nullptr, 'F' },
-		{"tickets-read",    required_argument,  nullptr, 'i' },
-		{"tickets-write",   required_argument,  nullptr, 'I' },
-		{"min-latency",     required_argument,  nullptr, 'l' },
-		{"max-thread-migs", required_argument,  nullptr, 'm' },
-		{"max-memory-migs", required_argument,  nullptr, 'M' },
-		{"stdout-child",    optional_argument,  nullptr, 'o' },
-		{"memory-prefetch", optional_argument,  nullptr, 'P' },
-		{"rate-sampling",   required_argument,  nullptr, 'r' },
-		{"real-time-sched", optional_argument,  nullptr, 'R' },
-		{"thread-strategy", required_argument,  nullptr, 's' },
-		{"memory-strategy", required_argument,  nullptr, 'S' },
-		{"thread-time",     required_argument,  nullptr, 't' },
-		{"memory-time",     required_argument,  nullptr, 'T' },
-		{"thp",             optional_argument,  nullptr, '1' },
-		{"shell",           no_argument,        nullptr, 'B' },
-		{"sec-update-proc", required_argument,  nullptr, 'u' },
-		{"sec-update-mem",  required_argument,  nullptr, 'U' },
-		{"verbose",         required_argument,  nullptr, 'v' },
-		{"wait-before-mig", required_argument,  nullptr, 'W' },
-		{nullptr,           0,                  nullptr,  0  }
+		{"help",             no_argument,        nullptr, 'h' },
+		{"adaptive-regions", required_argument,  nullptr, 'A' },
+		{"thread-balance",   required_argument,  nullptr, 'b' },
+		{"chart-threads",    no_argument,        nullptr, 'c' },
+		{"chart-memory",     no_argument,        nullptr, 'C' },
+		{"stderr-child",     optional_argument,  nullptr, 'e' },
+		{"freq-instr",       required_argument,  nullptr, 'f' },
+		{"freq-memory",      required_argument,  nullptr, 'F' },
+		{"mig-bandwidth",    required_argument,  nullptr, 'G' },
+		{"half-life",        required_argument,  nullptr, 'H' },
+		{"tickets-read",     required_argument,  nullptr, 'i' },
+		{"tickets-write",    required_argument,  nullptr, 'I' },
+		{"hot-pages",        required_argument,  nullptr, 'k' },
+		{"min-latency",      required_argument,  nullptr, 'l' },
+		{"max-thread-migs",  required_argument,  nullptr, 'm' },
+		{"max-memory-migs",  required_argument,  nullptr, 'M' },
+		{"stdout-child",     optional_argument,  nullptr, 'o' },
+		{"memory-prefetch",  optional_argument,  nullptr, 'P' },
+		{"mig-rate",         required_argument,  nullptr, 'p' },
+		{"mig-horizon",      required_argument,  nullptr, 'z' },
+		{"rate-sampling",    required_argument,  nullptr, 'r' },
+		{"real-time-sched",  optional_argument,  nullptr, 'R' },
+		{"thread-strategy",  required_argument,  nullptr, 's' },
+		{"memory-strategy",  required_argument,  nullptr, 'S' },
+		{"thread-time",      required_argument,  nullptr, 't' },
+		{"memory-time",      required_argument,  nullptr, 'T' },
+		{"thp",              optional_argument,  nullptr, '1' },
+		{"huge-pages",       required_argument,  nullptr, '2' },
+		{"calibrate",        optional_argument,  nullptr, '3' },
+		{"mig-inbound",      required_argument,  nullptr, '4' },
+		{"shell",            no_argument,        nullptr, 'B' },
+		{"sec-update-proc",  required_argument,  nullptr, 'u' },
+		{"sec-update-mem",   required_argument,  nullptr, 'U' },
+		{"verbose",          required_argument,  nullptr, 'v' },
+		{"wait-before-mig",  required_argument,  nullptr, 'W' },
+		{nullptr,            0,                  nullptr,  0  }
 	};
 	/* clang-format on */
 
-	static const char * short_options = "+hb:BcCe::f:F:i:I:l:m:M:o::P:r:R::s:S:t:T:u:U:v:w:W:";
+	static const char * short_options = "+hA:b:BcCe::f:F:G:H:i:I:k:l:m:M:o::p:P:r:R::s:S:t:T:u:U:v:w:W:z:";
 
 	while ((c = getopt_long(argc, argv, short_options, long_options.data(), nullptr)) != -1) {
 		switch (c) {
+			case 'A':
+				migration::memory::access_regions.max_regions(std::stoul(optarg));
+				if (verbose::print_with_lvl(verbose::DEFAULT_LVL)) {
+					std::cout << "Max. adaptive regions tracked: " << migration::memory::access_regions.max_regions()
+					          << '\n';
+				}
+				break;
 			case 'b':
 				secs_between_balance = std::stof(optarg);
 				if (verbose::print_with_lvl(verbose::DEFAULT_LVL)) {
@@ -536,6 +648,20 @@ int main(const int argc, char * const argv[]) {
 					std::cout << "Memory sampling frequency: " << samples::mem_frequency << '\n';
 				}
 				break;
+			case 'G':
+				migration::memory::link_bandwidth = std::max(std::stof(optarg), real_t());
+				if (verbose::print_with_lvl(verbose::DEFAULT_LVL)) {
+					std::cout << "Bandwidth for memory migrations per link: " << migration::memory::link_bandwidth
+					          << " GB/s" << '\n';
+				}
+				break;
+			case 'H':
+				performance::decay::half_life = std::max(std::stof(optarg), real_t());
+				if (verbose::print_with_lvl(verbose::DEFAULT_LVL)) {
+					std::cout << "Half-life of page/thread statistics: " << performance::decay::half_life << " s"
+					          << '\n';
+				}
+				break;
 			case 'i':
 				file_read_tickets = optarg;
 				if (verbose::print_with_lvl(verbose::DEFAULT_LVL)) {
@@ -548,6 +674,12 @@ int main(const int argc, char * const argv[]) {
 					std::cout << "File to write tickets values: " << file_write_tickets << '\n';
 				}
 				break;
+			case 'k':
+				migration::memory::hot_pages.resize(std::stoul(optarg));
+				if (verbose::print_with_lvl(verbose::DEFAULT_LVL)) {
+					std::cout << "Hot pages tracked per node: " << migration::memory::hot_pages.top_k() << '\n';
+				}
+				break;
 			case 'l':
 				samples::minimum_latency = std::stoi(optarg);
 				if (verbose::print_with_lvl(verbose::DEFAULT_LVL)) {
@@ -589,6 +721,13 @@ int main(const int argc, char * const argv[]) {
 					}
 				}
 				break;
+			case 'p':
+				migration::memory::executor.rate_limit(std::stoul(optarg));
+				if (verbose::print_with_lvl(verbose::DEFAULT_LVL)) {
+					std::cout << "Memory migrations rate limit: " << migration::memory::executor.rate_limit()
+					          << " pages/s" << '\n';
+				}
+				break;
 			case 'P':
 				migration::memory::memory_prefetch_size = std::stol(optarg);
 				if (verbose::print_with_lvl(verbose::DEFAULT_LVL)) {
@@ -652,9 +791,7 @@ int main(const int argc, char * const argv[]) {
 						std::cout << "Memory info from /proc will be updated every " << secs_update_mem << " s" << '\n';
 					}
 				} else {
-					const auto thp_size_str =
-					    utils::cmd::exec("grep 'Hugepagesize:' /proc/meminfo | awk '{print($2)}'");
-					const auto thp_size_kB = std::stol(thp_size_str);
+					const auto thp_size_kB = static_cast<long>(utils::proc::meminfo("Hugepagesize").value_or(0));
 					const auto pagesize    = memory_info::pagesize;
 
 					const auto thp_size_n_pages = thp_size_kB * 1024 / pagesize;
@@ -667,6 +804,39 @@ int main(const int argc, char * const argv[]) {
 					}
 				}
 				break;
+			case '2':
+				if (std::string_view(optarg) == "split") {
+					memory_info::huge_page_policy(memory_info::huge_page_policy_t::SPLIT);
+				} else if (std::string_view(optarg) == "whole") {
+					memory_info::huge_page_policy(memory_info::huge_page_policy_t::WHOLE);
+				} else {
+					std::cerr << "Unknown huge pages policy: " << optarg << " (expected \"whole\" or \"split\")"
+					          << '\n';
+					exit(EXIT_FAILURE);
+				}
+				if (verbose::print_with_lvl(verbose::DEFAULT_LVL)) {
+					std::cout << "Huge pages tracked and migrated "
+					          << (memory_info::huge_page_policy() == memory_info::huge_page_policy_t::SPLIT ?
+					                  "per base page" :
+					                  "as a whole")
+					          << '\n';
+				}
+				break;
+			case '3':
+				calibrate_system = true;
+				if (optarg != nullptr) { calibration_file = optarg; }
+				if (verbose::print_with_lvl(verbose::DEFAULT_LVL)) {
+					std::cout << "Latency/bandwidth between nodes will be calibrated (cached in " << calibration_file
+					          << ")" << '\n';
+				}
+				break;
+			case '4':
+				migration::memory::inbound_links = std::max(std::stof(optarg), real_t());
+				if (verbose::print_with_lvl(verbose::DEFAULT_LVL)) {
+					std::cout << "Bandwidth for memory migrations to each node: " << migration::memory::inbound_links
+					          << " links" << '\n';
+				}
+				break;
 			case 'u':
 				secs_update_proc = std::stof(optarg);
 				if (verbose::print_with_lvl(verbose::DEFAULT_LVL)) {
@@ -692,6 +862,13 @@ int main(const int argc, char * const argv[]) {
 					std::cout << "Seconds before starting migrations: " << secs_before_migr << '\n';
 				}
 				break;
+			case 'z':
+				migration::memory::cost_model.horizon(std::stof(optarg));
+				if (verbose::print_with_lvl(verbose::DEFAULT_LVL)) {
+					std::cout << "Horizon of the memory migrations cost model: "
+					          << migration::memory::cost_model.horizon() << " s" << '\n';
+				}
+				break;
 			case 'h':
 			case '?':
 				usage(args[0]);
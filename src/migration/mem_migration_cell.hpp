@@ -11,12 +11,14 @@
 #define THANOS_MEM_MIGRATION_CELL_HPP
 
 #include <iostream>    // for operator<<, basic_ostream::op...
+#include <span>        // for span
 #include <string>      // for operator<<, char_traits
 #include <sys/types.h> // for pid_t, size_t
 #include <utility>     // for move
 #include <vector>      // for vector
 
-#include "system_info/memory_info.hpp" // for move_pages
+#include "system_info/memory_info.hpp" // for move_pages, page_size
+#include "system_info/system_info.hpp" // for account_memory_migration
 #include "utils/string.hpp"            // for percentage, to_string_hex
 #include "utils/types.hpp"             // for real_t, node_t, addr_t
 #include "utils/verbose.hpp"           // for LVL4, lvl
@@ -41,6 +43,10 @@ namespace migration {
 		                   std::vector<real_t> ratios) :
 		    addr_(std::move(addr)), pid_(pid), src_(src), dst_(dst), ratios_(std::move(ratios)){};
 
+		mem_migration_cell(std::vector<addr_t> addr, const pid_t pid, const node_t src, const node_t dst,
+		                   const std::span<const real_t> ratios) :
+		    addr_(std::move(addr)), pid_(pid), src_(src), dst_(dst), ratios_(ratios.begin(), ratios.end()){};
+
 		[[nodiscard]] inline auto addr() const -> auto & {
 			return addr_;
 		}
@@ -53,6 +59,10 @@ namespace migration {
 			return pid_;
 		}
 
+		[[nodiscard]] inline auto src() const -> node_t {
+			return src_;
+		}
+
 		[[nodiscard]] inline auto dst() const -> node_t {
 			return dst_;
 		}
@@ -66,6 +76,10 @@ namespace migration {
 			bool success = memory_info::move_pages(addr_, pid_, dst_);
 
 			if (success) {
+				for (const auto addr : addr_) {
+					system_info::account_memory_migration(pid_, src_, dst_, memory_info::page_size(addr));
+				}
+
 				if (verbose::print_with_lvl(verbose::LVL4)) {
 					if (std::cmp_greater(addr_.size(), 1)) {
 						std::cout << "Migrated " << addr_.size() << " memory pages starting from ";
@@ -10,10 +10,14 @@
 #ifndef THANOS_MIGRATION_HPP
 #define THANOS_MIGRATION_HPP
 
+#include <algorithm>     // for ranges::transform
 #include <array>         // for array
+#include <cstring>       // for strerror
 #include <cstdint>       // for int64_t
 #include <features.h>    // for __glibc_unlikely
 #include <iostream>      // for operator<<
+#include <ranges>        // for ranges::iota_view
+#include <span>          // for span
 #include <string>        // for operator<<
 #include <sys/types.h>   // for size_t, pid_t
 #include <type_traits>   // for add_const<>::type
@@ -29,6 +33,7 @@
 #include "migration/strategies/thread_strategy.hpp"   // for Istrategy
 #include "migration/utils/inst_sample.hpp"            // for inst_sample_t
 #include "migration/utils/mem_sample.hpp"             // for memory_data_ce...
+#include "migration/utils/mem_sample_aggregator.hpp"  // for memory_sample_...
 #include "migration/utils/reqs_sample.hpp"            // for reqs_sample_t
 #include "migration/utils/times.hpp"                  // for get_time_value
 #include "samples/samples.hpp"                        // for pebs, NUM_GROUPS
@@ -71,12 +76,57 @@ namespace migration {
 
 		inline void clear_data() {
 			perf_table.clear_it();
+			hot_pages.clear_it();
 			num_mem_samples_it = 0;
+
+			// End of the aggregation interval of the region tracker
+			access_regions.adapt(memory_info::details::memory_regions);
+			access_regions.clear_it();
+		}
+
+		// Account the migrations completed by the executor since the last call
+		inline void collect_migration_results() {
+			migration_stats stats;
+
+			for (const auto & result : executor.collect()) {
+				stats.add(result);
+
+				// Keep the per-node memory usage of the process up to date without reading its numa_maps
+				const auto page_bytes = result.addresses.empty() ? size_t() : result.bytes / result.addresses.size();
+				for (size_t i = 0; i < result.statuses.size(); ++i) {
+					if (result.statuses[i] == result.dst) {
+						system_info::account_memory_migration(result.pid, result.sources[i], result.dst, page_bytes);
+					}
+				}
+
+				access_regions.migrated(result.addresses, result.statuses, result.dst);
+			}
+
+			total_migrations += stats.migrated();
+
+			cost_model.observe(stats.gbs());
+
+			if (stats.jobs() > 0 && verbose::print_with_lvl(verbose::LVL2)) {
+				std::cout << "Migrated " << stats.migrated() << " memory pages of " << stats.pages() << " ("
+				          << stats.failed() << " failed) in " << stats.jobs() << " chunks: "
+				          << utils::string::to_string(static_cast<real_t>(stats.bytes()) / real_t(1 << 20), 2)
+				          << " MiB at " << utils::string::to_string(stats.gbs(), 2) << " GB/s. "
+				          << executor.pending_pages() << " pages still pending." << '\n';
+
+				for (const auto & [error, pages] : stats.errors()) {
+					std::cout << "\t" << pages << " pages not migrated: " << strerror(error) << '\n';
+				}
+
+				std::cout << executor.blacklisted_pages() << " pages blacklisted (" << executor.skipped_pages()
+				          << " submissions skipped so far)." << '\n';
+			}
 		}
 
 		inline auto perform_strategy(const time_point & current_time) -> bool {
 			migration::memory::last_mig_time = current_time;
 
+			collect_migration_results();
+
 			if (verbose::print_with_lvl(verbose::LVL4)) {
 				std::cout << "Gathered " << num_mem_samples_it << " memory samples." << '\n';
 				if (verbose::print_with_lvl(verbose::LVL_MAX)) {
@@ -104,6 +154,16 @@ namespace migration {
 				          << utils::string::to_string(performance::mempages_table::threshold_enough_info(), 0)
 				          << " samples: " << utils::string::to_string(pages_enough_info, 0) << " ("
 				          << utils::string::percentage(pages_enough_info, total_pages, 2) << "%)" << '\n';
+
+				if (hot_pages.enabled()) {
+					std::cout << "#Hot pages tracked: " << utils::string::to_string(hot_pages.size(), 0) << " (top-"
+					          << hot_pages.top_k() << " per node)" << '\n';
+				} else if (access_regions.enabled()) {
+					std::cout << "#Regions tracked: " << access_regions.size() << " (max. "
+					          << access_regions.max_regions() << "). Splits: " << access_regions.splits()
+					          << ". Merges: " << access_regions.merges()
+					          << ". Samples out of regions: " << access_regions.untracked() << '\n';
+				}
 			}
 
 			// Perform strategy
@@ -182,6 +242,9 @@ namespace migration {
 	} // namespace thread
 
 	inline void end() {
+		memory::executor.stop();
+		memory::collect_migration_results();
+
 		if (verbose::print_with_lvl(verbose::LVL1)) {
 			std::cout << thread::total_migrations << " (" << thread::total_migrations_undone
 			          << ") thread migrations done (undone)." << '\n';
@@ -191,8 +254,8 @@ namespace migration {
 	}
 
 	template<typename Map>
-	static auto process_memory_sample(const samples::pebs & sample, const real_t ageing_factor, Map & page_node_map)
-	    -> bool {
+	static auto process_memory_sample(const samples::pebs & sample, const mem_region * region, Map & page_node_map,
+	                                  memory_sample_aggregator & aggregator) -> bool {
 		// IMPORTANT!!!!
 		// As memory samples are not trustable given its nature (out-of-order execution, 1 sample = 1 address, ...)
 		// it is considered sample[i].value = 1 no matter what.
@@ -200,15 +263,16 @@ namespace migration {
 		                  std::is_same<typename Map::mapped_type, node_t>::value,
 		              "Use a map of the form Map<addr_t, node_t>");
 
-		auto page_size = memory_info::page_size(sample.sample_addr);
+		// Huge pages (if tracked as a whole) are a single page
+		auto page_size = memory_info::page_size(sample.sample_addr, region);
 
-		auto page_addr   = memory_info::page_from_addr(sample.sample_addr);
-		auto region_addr = memory_info::page_from_addr(sample.sample_addr);
+		auto page_addr   = memory_info::page_from_addr(sample.sample_addr, page_size);
+		auto region_addr = page_addr;
 
 		if (memory_info::fake_thp_enabled()) {
-			const auto thp_opt = memory_info::fake_thp_from_address(sample.sample_addr);
+			const auto thp_opt = memory_info::fake_thp_from_address(sample.sample_addr, region);
 			if (thp_opt.has_value()) {
-				const auto & thp = thp_opt.value().get();
+				const auto & thp = thp_opt.value();
 
 				region_addr = thp.start();
 				page_size   = thp.n_pages() * memory_info::pagesize;
@@ -237,15 +301,42 @@ namespace migration {
 		                     static_cast<tim_t>(sample.time_running), reqs, sample.sample_addr, region_addr,
 		                     static_cast<lat_t>(sample.weight), page_size, sample.dsrc, page_node);
 
-		thread::perf_table.add_data(data);
-		++thread::num_mem_samples_it;
-
-		memory::perf_table.add_data(data, ageing_factor);
-		++memory::num_mem_samples_it;
+		aggregator.add(data);
 
 		return true;
 	}
 
+	// Insert the aggregated memory samples in the performance tables: a single update per entry
+	inline void flush_memory_samples(const memory_sample_aggregator & aggregator) {
+		static std::vector<memory_sample_t> batch;
+		batch.clear();
+		batch.reserve(aggregator.size());
+
+		for (const auto & entry : aggregator) {
+			const auto & data = batch.emplace_back(entry.to_sample());
+
+			thread::perf_table.add_data(data);
+		}
+
+		if (memory::hot_pages.enabled()) {
+			// Fixed-memory tracking: the exhaustive table is not populated
+			for (const auto & data : batch) {
+				memory::hot_pages.add_data(data);
+			}
+		} else if (memory::access_regions.enabled()) {
+			// Per-region tracking: the exhaustive table is not populated either
+			for (const auto & data : batch) {
+				memory::access_regions.add_data(data);
+			}
+		} else {
+			// The memory table distributes the batch among its shards
+			memory::perf_table.add_data(batch);
+		}
+
+		thread::num_mem_samples_it += aggregator.samples();
+		memory::num_mem_samples_it += aggregator.samples();
+	}
+
 	inline auto process_req_sample(const samples::pebs & sample) -> bool {
 		reqs_sample_t data(static_cast<cpu_t>(sample.cpu), sample.pid, sample.tid,
 		                   static_cast<tim_t>(sample.time_running), static_cast<req_t>(sample.value));
@@ -283,14 +374,18 @@ namespace migration {
 	// Pre-compute a map to know where is located each page -> map[addr] = node;
 	// Making a single call to retrieve this information for several pages at a time
 	// should be more efficient than a call for each page.
-	static auto pages_node_map(const std::vector<samples::pebs> & samples) -> umap<addr_t, node_t> {
+	static auto pages_node_map(const std::vector<samples::pebs> & samples, std::span<const mem_region *> regions)
+	    -> umap<addr_t, node_t> {
 		static size_t last_map_size = 0;
 
 		umap<pid_t, uset<addr_t>> pid_pages_map;
 
-		for (const auto & sample : samples) {
+		for (const auto i : std::ranges::iota_view(size_t(), samples.size())) {
+			const auto & sample = samples[i];
+
 			if (sample.is_mem_sample()) {
-				const auto page_addr = memory_info::page_from_addr(sample.sample_addr);
+				const auto page_size = memory_info::page_size(sample.sample_addr, regions[i]);
+				const auto page_addr = memory_info::page_from_addr(sample.sample_addr, page_size);
 				pid_pages_map[sample.tid].insert(page_addr);
 			}
 		}
@@ -319,27 +414,43 @@ namespace migration {
 		size_t total_reqs  = 0;
 		size_t total_mem   = 0;
 
+		// Events represented by the memory samples of the batch, to weight them in the cost model
+		uint64_t mem_period = 0;
+
 		size_t discarded       = 0;
 		size_t discarded_inst  = 0;
 		size_t discarded_flops = 0;
 		size_t discarded_reqs  = 0;
 		size_t discarded_mem   = 0;
 
+		// Memory regions of the samples, looked up once for the whole batch (kept between calls)
+		static std::vector<addr_t>             addresses;
+		static std::vector<const mem_region *> regions;
+
+		addresses.resize(samples.size());
+		regions.resize(samples.size());
+
+		std::ranges::transform(samples, addresses.begin(), [](const auto & sample) { return sample.sample_addr; });
+		memory_info::regions_from_addresses(addresses, regions);
+
 		// Map storing page -> node correspondence
-		auto page_node_map = pages_node_map(samples);
+		auto page_node_map = pages_node_map(samples, regions);
 
 		// Pages with non-valid information (probably kernel pages)
 		uset<addr_t> discarded_pages;
 
-		const auto secs_since_last_memory_mig = utils::time::time_until_now(memory::last_mig_time);
-		const auto secs_to_next_mig = std::max(memory::min_time_between_migrations - secs_since_last_memory_mig, {});
-		const auto ageing_factor    = real_t(1.0) / (1 + secs_to_next_mig);
+		// Memory samples are collapsed per page before being inserted in the tables (memory kept between calls)
+		static memory_sample_aggregator aggregator;
+		aggregator.clear();
+
+		for (const auto i : std::ranges::iota_view(size_t(), samples.size())) {
+			const auto & sample = samples[i];
 
-		for (const auto & sample : samples) {
 			switch (sample.type()) {
 				case samples::MEM_SAMPLE:
 					++total_mem;
-					if (!process_memory_sample(sample, ageing_factor, page_node_map)) {
+					mem_period += sample.period;
+					if (!process_memory_sample(sample, regions[i], page_node_map, aggregator)) {
 						++discarded;
 						++discarded_mem;
 						if (verbose::print_with_lvl(verbose::LVL_MAX)) {
@@ -372,6 +483,12 @@ namespace migration {
 			}
 		}
 
+		flush_memory_samples(aggregator);
+
+		if (std::cmp_greater(total_mem, 0)) {
+			memory::cost_model.sample_period(static_cast<real_t>(mem_period) / static_cast<real_t>(total_mem));
+		}
+
 		if (verbose::print_with_lvl(verbose::DEFAULT_LVL)) {
 			std::cout << "Processed " << samples.size() << " samples. " << discarded << " discarded ("
 			          << utils::string::percentage(discarded, samples.size()) << "%):" << '\n';
@@ -384,7 +501,8 @@ namespace migration {
 			std::cout << '\t' << total_reqs << " REQS samples processed. " << discarded_reqs << " discarded ("
 			          << utils::string::percentage(discarded_reqs, total_reqs) << "%)" << '\n';
 			std::cout << '\t' << total_mem << " MEM samples processed. " << discarded_mem << " discarded ("
-			          << utils::string::percentage(discarded_mem, total_mem) << "%)" << '\n';
+			          << utils::string::percentage(discarded_mem, total_mem) << "%). " << aggregator.size()
+			          << " aggregated entries." << '\n';
 
 			if (verbose::print_with_lvl(verbose::LVL_MAX)) {
 				std::cout << "Discarded memory pages:" << '\n';
@@ -416,9 +534,6 @@ namespace migration {
 	inline void print_memory_info_header(std::ofstream & memory_file) {
 		memory_file << "Timestamp" << ';' << "Address" << ';' << "Node" << ';' << "PrefNode" << ';' << "InPrefNode"
 		            << ';';
-		for (const auto & node : system_info::nodes()) {
-			memory_file << "ReqsNode" << utils::string::to_string(node, 0) << ';';
-		}
 		for (const auto & node : system_info::nodes()) {
 			memory_file << "AgedReqsNode" << utils::string::to_string(node, 0) << ';';
 		}
@@ -480,9 +595,6 @@ namespace migration {
 			memory_file << utils::string::to_string(node, 0) << ';';
 			memory_file << utils::string::to_string(pref_node, 0) << ';';
 			memory_file << (node == pref_node ? 1 : 0) << ';';
-			for (const auto & reqs : info.raw_accesses()) {
-				memory_file << utils::string::to_string(reqs, 0) << ';';
-			}
 			for (const auto & reqs : info.node_accesses()) {
 				memory_file << utils::string::to_string(reqs, 2) << ';';
 			}
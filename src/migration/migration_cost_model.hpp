@@ -0,0 +1,192 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <r.laso@usc.es> wrote this file. As long as you retain this notice you
+ * can do whatever you want with this stuff. If we meet some day, and you think
+ * this stuff is worth it, you can buy me a beer in return Ruben Laso
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef THANOS_MIGRATION_COST_MODEL_HPP
+#define THANOS_MIGRATION_COST_MODEL_HPP
+
+#include <algorithm>   // for clamp, max
+#include <fstream>     // for ifstream
+#include <numbers>     // for ln2
+#include <sys/types.h> // for size_t
+
+#include "migration/performance/adaptive_regions.hpp" // for adaptive_regions::region
+#include "migration/performance/decay.hpp"            // for half_life, now
+#include "migration/performance/mempages_table.hpp"   // for memtable_details::row
+#include "system_info/system_info.hpp"                // for distance_factor, calibrated
+#include "utils/types.hpp"                            // for real_t, node_t, tim_t, lat_t
+
+namespace migration::memory {
+	// Estimates whether a page migration pays off:
+	// - Cost: time to copy the page, from the measured move_pages throughput, scaled by the distance between nodes.
+	// - Benefit: remote accesses that become local (access rate * gain in local ratio) times the latency saved per
+	//   access, during the predicted remaining lifetime of the access pattern (as long as it has lasted so far, within
+	//   [interval, horizon]).
+	// Only migrations with positive net value are approved, so pages that are hot only briefly are not moved around.
+	class migration_cost_model {
+	public:
+		static constexpr real_t DEFAULT_HORIZON       = 10;   // Seconds. 0 = every migration is approved
+		static constexpr real_t DEFAULT_THROUGHPUT    = 1;    // GB/s until move_pages throughput is measured
+		static constexpr real_t THROUGHPUT_WEIGHT     = 0.25; // Weight of new throughput measurements
+		static constexpr real_t DEFAULT_CYCLES_PER_NS = 2;    // If the CPU frequency cannot be read from sysfs
+
+	private:
+		real_t horizon_       = DEFAULT_HORIZON;
+		real_t throughput_    = DEFAULT_THROUGHPUT;  // GB/s = bytes/ns
+		real_t sample_period_ = 1;                   // Memory accesses represented by each sample
+		real_t cycles_per_ns_ = cpu_cycles_per_ns(); // Sampled latencies are measured in core cycles
+
+		size_t approved_ = 0;
+		size_t rejected_ = 0;
+
+		// Latency of a remote access relative to a local one
+		[[nodiscard]] static inline auto distance_factor(const node_t src, const node_t dst) -> real_t {
+			if (src < 0 || dst < 0) { return 1; }
+			return system_info::distance_factor(src, dst);
+		}
+
+		// Time of copying between the nodes relative to a local copy: the measured bandwidth if the system was
+		// calibrated, the SLIT distance otherwise
+		[[nodiscard]] static inline auto copy_factor(const node_t src, const node_t dst) -> real_t {
+			if (src < 0 || dst < 0) { return 1; }
+			if (!system_info::calibrated()) { return distance_factor(src, dst); }
+
+			const auto bandwidth = system_info::bandwidth_factor(dst, src);
+			return bandwidth > 0 ? 1 / bandwidth : distance_factor(src, dst);
+		}
+
+		// Base (or maximum) frequency of the CPUs, in GHz
+		[[nodiscard]] static auto cpu_cycles_per_ns() -> real_t {
+			for (const auto * const file : { "/sys/devices/system/cpu/cpu0/cpufreq/base_frequency",
+			                                 "/sys/devices/system/cpu/cpu0/cpufreq/cpuinfo_max_freq" }) {
+				std::ifstream ifs(file);
+				real_t        khz = 0;
+				if (ifs >> khz && khz > 0) { return khz / 1e6F; }
+			}
+
+			return DEFAULT_CYCLES_PER_NS;
+		}
+
+		// Nanoseconds saved by making local_gain of samples_per_sec (of av_latency cycles) local instead of remote,
+		// during the predicted remaining lifetime of the pattern
+		[[nodiscard]] inline auto saved_time(const real_t samples_per_sec, const real_t local_gain,
+		                                     const lat_t av_latency, const real_t lifetime, const node_t src,
+		                                     const node_t dst, const real_t interval) const -> real_t {
+			if (local_gain <= 0) { return 0; }
+
+			const auto accesses_per_sec = samples_per_sec * sample_period_;
+
+			// The average latency is (mostly) the one of remote accesses, as the memory is not local for most of them
+			const auto remote_latency = static_cast<real_t>(av_latency) / cycles_per_ns_;
+			const auto saved_latency  = remote_latency * (1 - 1 / distance_factor(src, dst));
+
+			// The pattern is expected to last as long as it has lasted so far
+			const auto remaining = std::clamp(lifetime, interval, std::max(interval, horizon_));
+
+			return accesses_per_sec * local_gain * saved_latency * remaining;
+		}
+
+	public:
+		[[nodiscard]] inline auto horizon() const {
+			return horizon_;
+		}
+
+		inline void horizon(const real_t secs) {
+			horizon_ = std::max(secs, real_t());
+		}
+
+		[[nodiscard]] inline auto enabled() const {
+			return horizon_ > 0;
+		}
+
+		[[nodiscard]] inline auto throughput() const {
+			return throughput_;
+		}
+
+		[[nodiscard]] inline auto approved() const {
+			return approved_;
+		}
+
+		[[nodiscard]] inline auto rejected() const {
+			return rejected_;
+		}
+
+		[[nodiscard]] inline auto sample_period() const {
+			return sample_period_;
+		}
+
+		// Current period of the memory event (average over the last batch of samples). With frequency-based sampling
+		// the kernel adjusts the period, so the accesses represented by a sample change over time
+		inline void sample_period(const real_t period) {
+			if (period <= 0) { return; }
+			sample_period_ = period;
+		}
+
+		// Account a new move_pages throughput measurement (in GB/s)
+		inline void observe(const real_t gbs) {
+			if (gbs <= 0) { return; }
+			throughput_ = THROUGHPUT_WEIGHT * gbs + (1 - THROUGHPUT_WEIGHT) * throughput_;
+		}
+
+		// Nanoseconds to move "bytes" from src to dst
+		[[nodiscard]] inline auto cost(const size_t bytes, const node_t src, const node_t dst) const -> real_t {
+			return static_cast<real_t>(bytes) / throughput_ * copy_factor(src, dst);
+		}
+
+		// Nanoseconds saved by moving a page (with the given statistics) from src to dst
+		[[nodiscard]] inline auto benefit(const performance::memtable_details::row & info, const node_t src,
+		                                  const node_t dst, const real_t interval, const tim_t now) const -> real_t {
+			const auto lifetime = static_cast<real_t>(now - info.first_seen()) / 1e9F;
+
+			if (lifetime <= 0) { return 0; }
+
+			// With exponential decay, the decayed counter converges to rate * half_life / ln(2)
+			const auto half_life       = performance::decay::half_life;
+			const auto samples_per_sec = half_life > 0 ? info.hotness() * std::numbers::ln2_v<real_t> / half_life :
+			                                             static_cast<real_t>(info.samples_count()) / lifetime;
+
+			// Accesses from dst become local, while the ones from src become remote
+			const auto src_ratio  = src >= 0 ? info.ratio(src) : real_t();
+			const auto local_gain = info.ratio(dst) - src_ratio;
+
+			return saved_time(samples_per_sec, local_gain, info.av_latency(), lifetime, src, dst, interval);
+		}
+
+		// Nanoseconds saved by moving a whole region (of the adaptive tracker) from src to dst
+		[[nodiscard]] inline auto benefit(const performance::adaptive_regions::region & region, const node_t src,
+		                                  const node_t dst, const real_t interval, const tim_t now) const -> real_t {
+			const auto lifetime = static_cast<real_t>(now - region.first_seen()) / 1e9F;
+
+			if (region.first_seen() == 0 || lifetime <= 0 || interval <= 0) { return 0; }
+
+			// Region accesses are aged by AGING_FACTOR every interval, so they converge to the samples of an interval
+			// divided by (1 - AGING_FACTOR) (an underestimation for regions younger than a few intervals)
+			const auto samples_per_sec =
+			    region.accesses() * (1 - performance::adaptive_regions::AGING_FACTOR) / interval;
+
+			const auto ratios     = region.ratios();
+			const auto src_ratio  = src >= 0 ? ratios[src] : real_t();
+			const auto local_gain = ratios[dst] - src_ratio;
+
+			return saved_time(samples_per_sec, local_gain, region.av_latency(), lifetime, src, dst, interval);
+		}
+
+		// Approve (or not) a migration, keeping count of the decisions
+		inline auto approve(const real_t net_value) -> bool {
+			if (net_value > 0) {
+				++approved_;
+				return true;
+			}
+
+			++rejected_;
+			return false;
+		}
+	};
+} // namespace migration::memory
+
+#endif /* end of include guard: THANOS_MIGRATION_COST_MODEL_HPP */
@@ -0,0 +1,442 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <r.laso@usc.es> wrote this file. As long as you retain this notice you
+ * can do whatever you want with this stuff. If we meet some day, and you think
+ * this stuff is worth it, you can buy me a beer in return Ruben Laso
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef THANOS_MIGRATION_EXECUTOR_HPP
+#define THANOS_MIGRATION_EXECUTOR_HPP
+
+#include <algorithm>          // for min, max, count_if
+#include <atomic>             // for atomic
+#include <chrono>             // for duration_cast, nanoseconds
+#include <condition_variable> // for condition_variable
+#include <deque>              // for deque
+#include <iostream>           // for cerr
+#include <memory>             // for unique_ptr, make_unique
+#include <mutex>              // for mutex, lock_guard, unique_lock
+#include <numeric>            // for accumulate
+#include <numa.h>             // for numa_run_on_node
+#include <sys/mman.h>         // for mmap, munmap
+#include <sys/types.h>        // for pid_t, size_t
+#include <thread>             // for thread, sleep_for
+#include <tuple>              // for ignore
+#include <unistd.h>           // for getpid
+#include <utility>            // for move, cmp_less, exchange
+#include <vector>             // for vector
+
+#include "migration/mem_migration_cell.hpp" // for mem_migration_cell
+#include "migration/page_blacklist.hpp"     // for page_blacklist
+#include "migration/performance/decay.hpp"  // for now
+#include "system_info/memory_info.hpp"      // for move_pages, page_size
+#include "system_info/system_info.hpp"      // for max_node, nodes
+#include "utils/string.hpp"                 // for to_string
+#include "utils/types.hpp"                  // for addr_t, node_t, tim_t, umap, map
+#include "utils/verbose.hpp"                // for print_with_lvl, DEFAULT_LVL
+
+namespace migration::memory {
+	// Outcome of a chunk of pages moved by a worker
+	struct migration_result {
+		pid_t               pid = 0;
+		node_t              dst = -1;
+		std::vector<addr_t> addresses{};
+		std::vector<node_t> sources{};  // sources[i] = node of addresses[i] when it was submitted
+		std::vector<int>    statuses{}; // statuses[i] = node of addresses[i] after the call, or -errno
+		size_t              bytes = 0;  // Bytes of the pages requested
+		tim_t               nsecs = 0;  // Time spent in the move_pages call
+
+		[[nodiscard]] inline auto n_migrated() const -> size_t {
+			return static_cast<size_t>(
+			    std::count_if(statuses.begin(), statuses.end(), [&](const int status) { return status == dst; }));
+		}
+	};
+
+	// Aggregated results gathered by the decision thread
+	class migration_stats {
+	private:
+		size_t jobs_     = 0;
+		size_t pages_    = 0;
+		size_t migrated_ = 0;
+		size_t bytes_    = 0; // Bytes actually migrated
+		tim_t  nsecs_    = 0;
+
+		map<int, size_t> errors_{}; // errors_[errno] = pages that could not be moved because of errno
+
+	public:
+		inline void add(const migration_result & result) {
+			const auto migrated = result.n_migrated();
+
+			for (const auto status : result.statuses) {
+				if (status < 0) { ++errors_[-status]; }
+			}
+
+			++jobs_;
+			pages_ += result.addresses.size();
+			migrated_ += migrated;
+			if (!result.addresses.empty()) { bytes_ += result.bytes / result.addresses.size() * migrated; }
+			nsecs_ += result.nsecs;
+		}
+
+		[[nodiscard]] inline auto jobs() const {
+			return jobs_;
+		}
+
+		[[nodiscard]] inline auto pages() const {
+			return pages_;
+		}
+
+		[[nodiscard]] inline auto migrated() const {
+			return migrated_;
+		}
+
+		[[nodiscard]] inline auto failed() const {
+			return pages_ - migrated_;
+		}
+
+		[[nodiscard]] inline auto bytes() const {
+			return bytes_;
+		}
+
+		[[nodiscard]] inline auto errors() const -> const auto & {
+			return errors_;
+		}
+
+		[[nodiscard]] inline auto secs() const -> real_t {
+			return static_cast<real_t>(nsecs_) / 1e9F;
+		}
+
+		// Achieved throughput, as seen by the workers (time spent in move_pages)
+		[[nodiscard]] inline auto gbs() const -> real_t {
+			if (nsecs_ <= 0) { return 0; }
+			return static_cast<real_t>(bytes_) / static_cast<real_t>(nsecs_);
+		}
+	};
+
+	// Moves pages in the background, so the decision loop never blocks on page copies.
+	// There is one worker thread per destination node, running on that node (the kernel allocates the destination
+	// pages and copies them from there). Migrations are split in chunks of at most chunk_pages() pages (see
+	// autotune_chunk_pages) and every worker is paced to its share of the pages/s limit. Results are handed back to
+	// the decision thread through collect().
+	// Pages that fail are blacklisted (with exponential backoff), so they are not submitted again every interval.
+	class migration_executor {
+	public:
+		static constexpr size_t DEFAULT_CHUNK_PAGES = 1024;
+		static constexpr size_t MIN_CHUNK_PAGES     = 16;
+		static constexpr size_t MAX_CHUNK_PAGES     = 8192;
+
+	private:
+		struct job {
+			pid_t               pid = 0;
+			std::vector<addr_t> addresses{};
+			std::vector<node_t> sources{};
+			size_t              bytes = 0; // Computed by the decision thread, which owns the memory regions info
+		};
+
+		struct worker {
+			node_t node = -1;
+
+			std::mutex              mtx{};
+			std::condition_variable cv{};
+			std::deque<job>         jobs{};
+
+			std::thread thread{};
+		};
+
+		std::vector<std::unique_ptr<worker>> workers_{};
+		std::vector<worker *>                node_workers_{}; // node_workers_[node] = worker of the node (if any)
+
+		std::atomic<bool>   stop_{ false };
+		std::atomic<size_t> pending_pages_{ 0 };
+
+		size_t pages_per_sec_ = 0; // 0 = no limit
+		size_t chunk_pages_   = DEFAULT_CHUNK_PAGES;
+
+		page_blacklist blacklist_{}; // Only used by the decision thread
+		size_t         skipped_ = 0; // Pages not submitted because they are blacklisted
+
+		std::mutex                    results_mtx_{};
+		std::vector<migration_result> results_{};
+
+		inline void run(worker & w) {
+			if (numa_run_on_node(w.node) < 0 && verbose::print_with_lvl(verbose::LVL1)) {
+				std::cerr << "Could not run the migration worker on node " << w.node << '\n';
+			}
+
+			// Pages/s allowed for this worker (rounded up, as 0 would mean no limit)
+			const auto rate =
+			    pages_per_sec_ > 0 ? std::max<size_t>(1, (pages_per_sec_ + workers_.size() - 1) / workers_.size()) : 0;
+
+			while (true) {
+				job j;
+				{
+					std::unique_lock lock(w.mtx);
+					w.cv.wait(lock, [&] { return stop_ || !w.jobs.empty(); });
+
+					if (w.jobs.empty()) { return; } // Stopped and drained
+
+					j = std::move(w.jobs.front());
+					w.jobs.pop_front();
+				}
+
+				migration_result result;
+				result.pid       = j.pid;
+				result.dst       = w.node;
+				result.addresses = std::move(j.addresses);
+				result.sources   = std::move(j.sources);
+				result.bytes     = j.bytes;
+
+				const auto beg = hres_clock::now();
+
+				// On error, statuses are filled with -errno
+				const std::vector<int> nodes(result.addresses.size(), w.node);
+				std::ignore = memory_info::move_pages(result.addresses, result.pid, nodes, result.statuses);
+
+				const auto end = hres_clock::now();
+
+				result.nsecs = std::chrono::duration_cast<std::chrono::nanoseconds>(end - beg).count();
+
+				pending_pages_ -= result.addresses.size();
+
+				// Pace the worker: a chunk of N pages must take, at least, N / rate seconds
+				if (rate > 0) {
+					const auto min_time = std::chrono::nanoseconds(
+					    static_cast<tim_t>(result.addresses.size() * 1'000'000'000ULL / rate));
+					const auto elapsed = end - beg;
+					if (elapsed < min_time) { std::this_thread::sleep_for(min_time - elapsed); }
+				}
+
+				const std::lock_guard lock(results_mtx_);
+				results_.emplace_back(std::move(result));
+			}
+		}
+
+		// Only the nodes of the system (the allowed ones) get a worker: node IDs may have gaps
+		inline void start() {
+			const auto & nodes = system_info::nodes();
+
+			workers_.reserve(nodes.size());
+			node_workers_.assign(system_info::max_node() + 1, nullptr);
+
+			for (const auto & node : nodes) {
+				auto w  = std::make_unique<worker>();
+				w->node = node;
+
+				node_workers_[node] = w.get();
+				workers_.emplace_back(std::move(w));
+			}
+
+			for (auto & w : workers_) {
+				w->thread = std::thread([this, &w = *w] { run(w); });
+			}
+		}
+
+		inline void enqueue(const node_t dst, job j) {
+			if (std::cmp_less(dst, 0) || std::cmp_greater_equal(dst, node_workers_.size()) ||
+			    node_workers_[dst] == nullptr) {
+				return;
+			}
+
+			auto & w = *node_workers_[dst];
+
+			j.bytes = std::accumulate(
+			    j.addresses.begin(), j.addresses.end(), size_t(),
+			    [](const size_t acc, const addr_t addr) { return acc + memory_info::page_size(addr); });
+
+			pending_pages_ += j.addresses.size();
+			{
+				const std::lock_guard lock(w.mtx);
+				w.jobs.push_back(std::move(j));
+			}
+			w.cv.notify_one();
+		}
+
+	public:
+		migration_executor() = default;
+
+		migration_executor(const migration_executor &)                     = delete;
+		migration_executor(migration_executor &&)                          = delete;
+		auto operator=(const migration_executor &) -> migration_executor & = delete;
+		auto operator=(migration_executor &&) -> migration_executor &      = delete;
+
+		~migration_executor() {
+			stop();
+		}
+
+		// Max. pages/s moved by all the workers. 0 = no limit. To be set before the first submit
+		inline void rate_limit(const size_t pages_per_sec) {
+			pages_per_sec_ = pages_per_sec;
+		}
+
+		[[nodiscard]] inline auto rate_limit() const {
+			return pages_per_sec_;
+		}
+
+		[[nodiscard]] inline auto chunk_pages() const {
+			return chunk_pages_;
+		}
+
+		// Pages queued or being moved
+		[[nodiscard]] inline auto pending_pages() const -> size_t {
+			return pending_pages_;
+		}
+
+		[[nodiscard]] inline auto blacklisted_pages() const {
+			return blacklist_.size();
+		}
+
+		[[nodiscard]] inline auto skipped_pages() const {
+			return skipped_;
+		}
+
+		// Find the chunk size with the best move_pages throughput, moving a buffer of our own back and forth
+		// between nodes. To be called at startup, before the first submit
+		inline auto autotune_chunk_pages() -> size_t {
+			static constexpr size_t CALIBRATION_PAGES = MAX_CHUNK_PAGES;
+
+			const auto pagesize = static_cast<size_t>(memory_info::pagesize);
+			const auto bytes    = CALIBRATION_PAGES * pagesize;
+
+			void * buffer = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (buffer == MAP_FAILED) { return chunk_pages_; }
+
+			std::vector<addr_t> addresses(CALIBRATION_PAGES);
+			for (size_t i = 0; i < CALIBRATION_PAGES; ++i) {
+				addresses[i]                          = reinterpret_cast<addr_t>(buffer) + i * pagesize;
+				*reinterpret_cast<char *>(addresses[i]) = 1; // Populate the page
+			}
+
+			const auto & nodes = system_info::nodes();
+
+			real_t best_rate = 0;
+			size_t dst_idx   = 0;
+
+			std::vector<int> statuses;
+
+			for (size_t chunk = MIN_CHUNK_PAGES; chunk <= MAX_CHUNK_PAGES; chunk *= 2) {
+				// Alternate the destination, so pages are actually copied in every round (if there are several nodes)
+				dst_idx        = (dst_idx + 1) % nodes.size();
+				const auto dst = nodes[dst_idx];
+
+				size_t moved = 0;
+
+				const auto beg = hres_clock::now();
+				for (size_t first = 0; first < CALIBRATION_PAGES; first += chunk) {
+					const auto last = std::min(first + chunk, CALIBRATION_PAGES);
+
+					const std::vector<addr_t> pages(addresses.begin() + first, addresses.begin() + last);
+					if (memory_info::move_pages(pages, getpid(), std::vector<int>(pages.size(), dst), statuses)) {
+						moved += static_cast<size_t>(std::count(statuses.begin(), statuses.end(), dst));
+					}
+				}
+				const auto end = hres_clock::now();
+
+				const auto secs = std::chrono::duration<real_t>(end - beg).count();
+				const auto rate = secs > 0 ? static_cast<real_t>(moved) / secs : real_t();
+
+				if (rate > best_rate) {
+					best_rate    = rate;
+					chunk_pages_ = chunk;
+				}
+			}
+
+			munmap(buffer, bytes);
+
+			if (verbose::print_with_lvl(verbose::LVL1)) {
+				std::cout << "Memory migrations in chunks of " << chunk_pages_ << " pages ("
+				          << utils::string::to_string(best_rate, 0) << " pages/s)" << '\n';
+			}
+
+			return chunk_pages_;
+		}
+
+		// Queue the migrations (grouped by destination and PID, in chunks). Returns the number of pages queued
+		inline auto submit(const std::vector<mem_migration_cell> & migrations) -> size_t {
+			if (stop_) { return 0; }
+
+			if (workers_.empty()) { start(); }
+
+			// chunks[dst][pid] = addresses (and their current nodes)
+			umap<node_t, umap<pid_t, job>> chunks;
+
+			size_t queued = 0;
+
+			const auto now = performance::decay::now();
+
+			for (const auto & migration : migrations) {
+				auto & chunk = chunks[migration.dst()][migration.pid()];
+
+				for (const auto addr : migration.addr()) {
+					if (blacklist_.blocked(migration.pid(), addr, now)) {
+						++skipped_;
+						continue;
+					}
+
+					chunk.pid = migration.pid();
+					chunk.addresses.emplace_back(addr);
+					chunk.sources.emplace_back(migration.src());
+
+					if (chunk.addresses.size() == chunk_pages_) {
+						queued += chunk.addresses.size();
+						enqueue(migration.dst(), std::exchange(chunk, {}));
+					}
+				}
+			}
+
+			for (auto & [dst, pid_chunks] : chunks) {
+				for (auto & [pid, chunk] : pid_chunks) {
+					if (chunk.addresses.empty()) { continue; }
+					queued += chunk.addresses.size();
+					enqueue(dst, std::move(chunk));
+				}
+			}
+
+			return queued;
+		}
+
+		// Results of the chunks completed since the last call. Failed pages are blacklisted, migrated ones forgiven
+		[[nodiscard]] inline auto collect() -> std::vector<migration_result> {
+			std::vector<migration_result> results;
+			{
+				const std::lock_guard lock(results_mtx_);
+				results = std::exchange(results_, {});
+			}
+
+			const auto now = performance::decay::now();
+
+			for (const auto & result : results) {
+				for (size_t i = 0; i < result.addresses.size(); ++i) {
+					if (result.statuses[i] < 0) {
+						blacklist_.fail(result.pid, result.addresses[i], now);
+					} else if (result.statuses[i] == result.dst) {
+						blacklist_.forgive(result.pid, result.addresses[i]);
+					}
+				}
+			}
+
+			blacklist_.prune(now);
+
+			return results;
+		}
+
+		// Wait for the queued migrations and join the workers
+		inline void stop() {
+			if (stop_.exchange(true)) { return; }
+
+			for (auto & w : workers_) {
+				{
+					const std::lock_guard lock(w->mtx);
+				}
+				w->cv.notify_all();
+			}
+
+			for (auto & w : workers_) {
+				if (w->thread.joinable()) { w->thread.join(); }
+			}
+		}
+	};
+} // namespace migration::memory
+
+#endif /* end of include guard: THANOS_MIGRATION_EXECUTOR_HPP */
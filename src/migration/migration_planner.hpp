@@ -0,0 +1,198 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <r.laso@usc.es> wrote this file. As long as you retain this notice you
+ * can do whatever you want with this stuff. If we meet some day, and you think
+ * this stuff is worth it, you can buy me a beer in return Ruben Laso
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef THANOS_MIGRATION_PLANNER_HPP
+#define THANOS_MIGRATION_PLANNER_HPP
+
+#include <algorithm>   // for make_heap, pop_heap, clamp, max
+#include <numeric>     // for accumulate
+#include <sys/types.h> // for size_t
+#include <tuple>       // for tuple, get
+#include <utility>     // for cmp_less, cmp_greater_equal
+#include <vector>      // for vector
+
+#include "migration/mem_migration_cell.hpp" // for mem_migration_cell
+#include "system_info/memory_info.hpp"      // for page_size
+#include "system_info/system_info.hpp"      // for max_node, nodes, bandwidth_factor
+#include "utils/types.hpp"                  // for addr_t, real_t, node_t
+
+namespace migration::memory {
+	// Set of memory migrations selected for an interval, ready to be executed
+	class migration_plan {
+	private:
+		std::vector<mem_migration_cell> migrations_{};
+
+		size_t              n_nodes_ = 0;
+		std::vector<size_t> link_bytes_{};    // link_bytes_[src * n_nodes_ + dst] = bytes moved from src to dst
+		std::vector<size_t> inbound_bytes_{}; // inbound_bytes_[dst] = bytes moved to dst
+
+		size_t bytes_    = 0;
+		size_t rejected_ = 0; // Candidates left out because of the budgets
+
+	public:
+		migration_plan() :
+		    n_nodes_(system_info::max_node() + 1),
+		    link_bytes_(n_nodes_ * n_nodes_, 0),
+		    inbound_bytes_(n_nodes_, 0) {
+		}
+
+		[[nodiscard]] inline auto migrations() const -> const auto & {
+			return migrations_;
+		}
+
+		[[nodiscard]] inline auto size() const {
+			return migrations_.size();
+		}
+
+		[[nodiscard]] inline auto empty() const {
+			return migrations_.empty();
+		}
+
+		[[nodiscard]] inline auto bytes() const {
+			return bytes_;
+		}
+
+		[[nodiscard]] inline auto rejected() const {
+			return rejected_;
+		}
+
+		[[nodiscard]] inline auto link_bytes(const node_t src, const node_t dst) const {
+			return link_bytes_[static_cast<size_t>(src) * n_nodes_ + static_cast<size_t>(dst)];
+		}
+
+		[[nodiscard]] inline auto inbound_bytes(const node_t dst) const {
+			return inbound_bytes_[dst];
+		}
+
+		inline void add(const mem_migration_cell & migration, const size_t bytes) {
+			if (std::cmp_greater_equal(migration.src(), 0)) {
+				link_bytes_[static_cast<size_t>(migration.src()) * n_nodes_ + static_cast<size_t>(migration.dst())] +=
+				    bytes;
+			}
+			inbound_bytes_[migration.dst()] += bytes;
+			bytes_ += bytes;
+
+			migrations_.emplace_back(migration);
+		}
+
+		inline void reject() {
+			++rejected_;
+		}
+	};
+
+	// Selects the best migrations of an interval, limited by number of migrations and by bytes:
+	// - Each src -> dst link can move up to its own budget. If the system was calibrated, the budget of each link is
+	//   scaled by its measured bandwidth (relative to local accesses), so slow links move less.
+	// - Each destination node can receive up to its inbound budget, a share of the sum of its incoming links (by
+	//   default, as much as a single link), so inbound traffic is spread across destinations instead of flooding a
+	//   single node through all its links at once.
+	// A budget of 0 means no limit.
+	class migration_planner {
+	public:
+		// tuple = [address, score, migration_cell]
+		using candidate_t = std::tuple<addr_t, real_t, mem_migration_cell>;
+
+	private:
+		size_t              n_nodes_ = 0;
+		std::vector<size_t> link_budget_{};    // link_budget_[src * n_nodes_ + dst]
+		std::vector<size_t> inbound_budget_{}; // inbound_budget_[dst]
+
+		[[nodiscard]] static inline auto bytes_of(const mem_migration_cell & migration) -> size_t {
+			return std::accumulate(migration.addr().begin(), migration.addr().end(), size_t(),
+			                       [](const size_t acc, const addr_t addr) { return acc + memory_info::page_size(addr); });
+		}
+
+		[[nodiscard]] inline auto link_budget(const node_t src, const node_t dst) const {
+			return link_budget_[static_cast<size_t>(src) * n_nodes_ + static_cast<size_t>(dst)];
+		}
+
+	public:
+		// No limits
+		migration_planner() :
+		    n_nodes_(system_info::max_node() + 1), link_budget_(n_nodes_ * n_nodes_, 0), inbound_budget_(n_nodes_, 0) {
+		}
+
+		// Budgets for an interval of "secs" seconds with links of "link_gbs" GB/s. Each destination can receive up to
+		// "inbound_links" times the average budget of its incoming links (0 = only limited by the links)
+		[[nodiscard]] static inline auto from_bandwidth(const real_t link_gbs, const real_t inbound_links,
+		                                                const real_t secs) -> migration_planner {
+			migration_planner planner;
+
+			if (link_gbs <= 0 || secs <= 0) { return planner; }
+
+			const auto link_bytes = link_gbs * real_t(1e9) * secs;
+
+			for (const auto & dst : system_info::nodes()) {
+				size_t incoming = 0;
+				size_t n_links  = 0;
+
+				for (const auto & src : system_info::nodes()) {
+					if (src == dst) { continue; }
+
+					const auto budget = std::max(size_t(1), static_cast<size_t>(
+					                                            link_bytes * system_info::bandwidth_factor(src, dst)));
+
+					planner.link_budget_[static_cast<size_t>(src) * planner.n_nodes_ + static_cast<size_t>(dst)] =
+					    budget;
+
+					incoming += budget;
+					++n_links;
+				}
+
+				if (inbound_links > 0 && n_links > 0) {
+					const auto average = static_cast<real_t>(incoming) / static_cast<real_t>(n_links);
+					planner.inbound_budget_[dst] =
+					    std::clamp(static_cast<size_t>(average * inbound_links), size_t(1), incoming);
+				}
+			}
+
+			return planner;
+		}
+
+		// Top-K selection: the candidates are popped from a heap by score, so only the selected ones are ordered
+		[[nodiscard]] inline auto plan(std::vector<candidate_t> & candidates, const size_t n_migrations) const
+		    -> migration_plan {
+			migration_plan plan;
+
+			const auto cmp = [](const candidate_t & a, const candidate_t & b) {
+				return std::get<1>(a) < std::get<1>(b);
+			};
+
+			std::make_heap(candidates.begin(), candidates.end(), cmp);
+
+			auto end = candidates.end();
+
+			while (end != candidates.begin() && std::cmp_less(plan.size(), n_migrations)) {
+				std::pop_heap(candidates.begin(), end, cmp);
+				--end;
+
+				const auto & migration = std::get<2>(*end);
+				const auto   bytes     = bytes_of(migration);
+
+				const bool has_src = std::cmp_greater_equal(migration.src(), 0);
+				const auto link    = has_src ? link_budget(migration.src(), migration.dst()) : size_t();
+				const auto inbound = inbound_budget_[migration.dst()];
+
+				const bool link_full    = link > 0 && plan.link_bytes(migration.src(), migration.dst()) + bytes > link;
+				const bool inbound_full = inbound > 0 && plan.inbound_bytes(migration.dst()) + bytes > inbound;
+
+				if (link_full || inbound_full) {
+					plan.reject();
+					continue;
+				}
+
+				plan.add(migration, bytes);
+			}
+
+			return plan;
+		}
+	};
+} // namespace migration::memory
+
+#endif /* end of include guard: THANOS_MIGRATION_PLANNER_HPP */
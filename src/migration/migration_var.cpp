@@ -10,11 +10,16 @@
 #include "migration_var.hpp"
 
 #include "migration_cell.hpp"               // for migration_cell
+#include "performance/decay.hpp"            // for half_life, DEFAULT_HALF_LIFE
 #include "performance/performance.hpp"      // for PERFORMANCE_INVALID_VALUE
 #include "strategies/memory_mig_strats.hpp" // for DEFAULT_STRATEGY, strate...
 #include "strategies/thread_mig_strats.hpp" // for DEFAULT_STRATEGY, strate...
 #include "types.hpp"                        // for hres_clock, real_t, time...
 
+namespace performance::decay {
+	real_t half_life = DEFAULT_HALF_LIFE;
+} // namespace performance::decay
+
 namespace migration {
 	namespace memory {
 		strategy_t strategy = DEFAULT_STRATEGY;
@@ -28,8 +33,19 @@ namespace migration {
 
 		performance::mempages_table perf_table;
 
+		performance::hot_pages_sketch hot_pages;
+
+		performance::adaptive_regions access_regions;
+
 		real_t portion_memory_migrations = DEFAULT_PORTION_MEM_MIGS;
 		size_t memory_prefetch_size      = DEFAULT_MEMORY_PREFETCH;
+
+		real_t link_bandwidth = DEFAULT_LINK_BANDWIDTH;
+		real_t inbound_links  = DEFAULT_INBOUND_LINKS;
+
+		migration_executor executor;
+
+		migration_cost_model cost_model;
 	} // namespace memory
 
 	namespace thread {
@@ -14,8 +14,12 @@
 #include <vector>  // for vector
 
 #include "migration/migration_cell.hpp"               // for migration_cell
+#include "migration/migration_cost_model.hpp"         // for migration_cost_model
+#include "migration/migration_executor.hpp"           // for migration_executor
 #include "migration/strategies/memory_mig_strats.hpp" // for strategy_t
 #include "migration/strategies/thread_mig_strats.hpp" // for strategy_t
+#include "performance/adaptive_regions.hpp"           // for adaptive_regions
+#include "performance/hot_pages_sketch.hpp"           // for hot_pages_sketch
 #include "performance/mempages_table.hpp"             // for mempages_table
 #include "performance/tid_perf_table.hpp"             // for tid_perf_table
 #include "utils/types.hpp"                            // for real_t, time_p...
@@ -33,12 +37,33 @@ namespace migration {
 
 		extern performance::mempages_table perf_table;
 
+		// Fixed-memory hotness tracker. If enabled (top-K > 0), it replaces perf_table for TMMA and LMMA
+		extern performance::hot_pages_sketch hot_pages;
+
+		// Adaptive-granularity region tracker. If enabled (budget > 0) and hot_pages is not, it replaces perf_table
+		// for TMMA and LMMA
+		extern performance::adaptive_regions access_regions;
+
 		static constexpr real_t DEFAULT_PORTION_MEM_MIGS = 1.0;
 		static constexpr size_t DEFAULT_MEMORY_PREFETCH  = 8;
 
 		extern real_t portion_memory_migrations;
 		extern size_t memory_prefetch_size;
 
+		static constexpr real_t DEFAULT_LINK_BANDWIDTH = 0;
+
+		extern real_t link_bandwidth; // GB/s that page migrations can use on each node-to-node link. 0 = no limit
+
+		static constexpr real_t DEFAULT_INBOUND_LINKS = 1;
+
+		extern real_t inbound_links; // Links' worth of bandwidth each node can receive at once. 0 = only link limits
+
+		// Background workers that perform the page migrations
+		extern migration_executor executor;
+
+		// Cost/benefit estimation to approve the migrations
+		extern migration_cost_model cost_model;
+
 	} // namespace memory
 
 	namespace thread {
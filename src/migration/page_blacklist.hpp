@@ -0,0 +1,93 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <r.laso@usc.es> wrote this file. As long as you retain this notice you
+ * can do whatever you want with this stuff. If we meet some day, and you think
+ * this stuff is worth it, you can buy me a beer in return Ruben Laso
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef THANOS_PAGE_BLACKLIST_HPP
+#define THANOS_PAGE_BLACKLIST_HPP
+
+#include <algorithm>   // for min
+#include <sys/types.h> // for pid_t, size_t
+
+#include "utils/types.hpp" // for addr_t, tim_t, fast_umap, umap
+
+namespace migration::memory {
+	// Pages that could not be migrated are not tried again until their backoff expires.
+	// The backoff doubles with every consecutive failure (up to MAX_BACKOFF) and the page is forgiven once it is
+	// migrated or after MAX_BACKOFF without new failures.
+	class page_blacklist {
+	public:
+		static constexpr tim_t BASE_BACKOFF = 1'000'000'000LL;  // 1 second (in ns)
+		static constexpr tim_t MAX_BACKOFF  = 64'000'000'000LL; // 64 seconds (in ns)
+
+	private:
+		struct entry {
+			size_t failures = 0;
+			tim_t  retry_at = 0;
+		};
+
+		umap<pid_t, fast_umap<addr_t, entry>> entries_{};
+
+		size_t size_ = 0;
+
+	public:
+		[[nodiscard]] inline auto size() const {
+			return size_;
+		}
+
+		[[nodiscard]] inline auto blocked(const pid_t pid, const addr_t page, const tim_t now) const -> bool {
+			const auto pid_it = entries_.find(pid);
+			if (pid_it == entries_.end()) { return false; }
+
+			const auto it = pid_it->second.find(page);
+			if (it == pid_it->second.end()) { return false; }
+
+			return now < it->second.retry_at;
+		}
+
+		inline void fail(const pid_t pid, const addr_t page, const tim_t now) {
+			auto & pages = entries_[pid];
+
+			const auto [it, inserted] = pages.try_emplace(page);
+			if (inserted) { ++size_; }
+
+			auto & e = it->second;
+
+			const auto shift   = std::min(e.failures, size_t(6)); // 2^6 = MAX_BACKOFF / BASE_BACKOFF
+			const auto backoff = std::min(BASE_BACKOFF << shift, MAX_BACKOFF);
+
+			++e.failures;
+			e.retry_at = now + backoff;
+		}
+
+		inline void forgive(const pid_t pid, const addr_t page) {
+			const auto pid_it = entries_.find(pid);
+			if (pid_it == entries_.end()) { return; }
+
+			if (pid_it->second.erase(page) > 0) { --size_; }
+			if (pid_it->second.empty()) { entries_.erase(pid_it); }
+		}
+
+		// Remove pages that have not failed for MAX_BACKOFF after their last backoff expired
+		inline void prune(const tim_t now) {
+			for (auto pid_it = entries_.begin(); pid_it != entries_.end();) {
+				auto & pages = pid_it->second;
+
+				size_ -= std::erase_if(pages,
+				                       [&](const auto & item) { return now > item.second.retry_at + MAX_BACKOFF; });
+
+				if (pages.empty()) {
+					pid_it = entries_.erase(pid_it);
+				} else {
+					++pid_it;
+				}
+			}
+		}
+	};
+} // namespace migration::memory
+
+#endif /* end of include guard: THANOS_PAGE_BLACKLIST_HPP */
@@ -0,0 +1,492 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <r.laso@usc.es> wrote this file. As long as you retain this notice you
+ * can do whatever you want with this stuff. If we meet some day, and you think
+ * this stuff is worth it, you can buy me a beer in return Ruben Laso
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef THANOS_ADAPTIVE_REGIONS_HPP
+#define THANOS_ADAPTIVE_REGIONS_HPP
+
+#include <algorithm>   // for max, max_element, upper_bound
+#include <cmath>       // for abs
+#include <limits>      // for numeric_limits
+#include <numeric>     // for accumulate
+#include <span>        // for span
+#include <sys/types.h> // for size_t, pid_t
+#include <utility>     // for cmp_less
+#include <vector>      // for vector
+
+#include "migration/performance/decay.hpp"   // for now
+#include "migration/utils/mem_sample.hpp"    // for memory_sample_t
+#include "samples/perf_event/perf_event.hpp" // for minimum_latency
+#include "system_info/memory_info.hpp"       // for pagesize
+#include "system_info/node_array.hpp"        // for node_array, n_nodes
+#include "system_info/system_info.hpp"       // for node_from_cpu
+#include "utils/types.hpp"                   // for addr_t, req_t, lat_t, tim_t
+
+namespace performance {
+	// Access tracking with adaptive granularity (in the spirit of DAMON), to be used instead of the per-page tables.
+	// Tracking starts with one region per (writable) memory region of /proc/<pid>/maps. At every adaptation:
+	// - Neighbour regions with similar statistics (per-node access ratios and access density) are merged.
+	// - Regions whose accesses are spread among nodes (or too big to be migrated at once) are split in halves.
+	// - The number of regions is kept within a budget, merging the most similar neighbours first.
+	// Hence, cold gigabytes cost a single region, while hot areas get finer resolution. Migrations apply per region.
+	class adaptive_regions {
+	public:
+		static constexpr real_t SAMPLES_ENOUGH_INFO = 10;
+		static constexpr real_t SPLIT_MAX_RATIO     = 0.75; // Regions whose busiest node has a lower ratio are split
+		static constexpr real_t MERGE_DISTANCE      = 0.1;  // Max. distance between neighbours to be merged
+		static constexpr real_t AGING_FACTOR        = 0.5;  // Weight of past accesses kept at every adaptation
+
+		static constexpr size_t MAX_MIGRATION_BYTES = 64UL << 20; // Bigger regions are split before being migrated
+
+		class region {
+		private:
+			addr_t begin_;
+			addr_t end_;
+			pid_t  pid_;
+			node_t node_ = -1; // Node in which the (last sampled) pages of the region are located
+
+			system_info::node_array<real_t> accesses_{}; // accesses_[node] = (aged) accesses from node
+
+			real_t latency_sum_ = 0;
+			real_t latency_ctr_ = 0;
+
+			tim_t first_seen_ = 0; // Time of the first sample since the region was created or migrated
+
+		public:
+			region(const addr_t begin, const addr_t end, const pid_t pid) : begin_(begin), end_(end), pid_(pid) {
+			}
+
+			[[nodiscard]] inline auto begin() const {
+				return begin_;
+			}
+
+			[[nodiscard]] inline auto end() const {
+				return end_;
+			}
+
+			[[nodiscard]] inline auto bytes() const {
+				return end_ - begin_;
+			}
+
+			[[nodiscard]] inline auto pid() const {
+				return pid_;
+			}
+
+			[[nodiscard]] inline auto node() const {
+				return node_;
+			}
+
+			[[nodiscard]] inline auto contains(const addr_t addr) const {
+				return begin_ <= addr && addr < end_;
+			}
+
+			[[nodiscard]] inline auto accesses() const -> real_t {
+				return std::accumulate(accesses_.begin(), accesses_.end(), real_t());
+			}
+
+			[[nodiscard]] inline auto enough_info() const {
+				return accesses() >= SAMPLES_ENOUGH_INFO;
+			}
+
+			// Accesses per byte
+			[[nodiscard]] inline auto density() const {
+				return accesses() / static_cast<real_t>(bytes());
+			}
+
+			[[nodiscard]] inline auto ratios() const -> std::vector<real_t> {
+				const auto total = accesses();
+
+				std::vector<real_t> ratios(accesses_.begin(), accesses_.end());
+				for (auto & ratio : ratios) {
+					ratio = total > 0 ? ratio / total : 0;
+				}
+				return ratios;
+			}
+
+			[[nodiscard]] inline auto preferred_node() const -> node_t {
+				return static_cast<node_t>(std::max_element(accesses_.begin(), accesses_.end()) - accesses_.begin());
+			}
+
+			[[nodiscard]] inline auto first_seen() const {
+				return first_seen_;
+			}
+
+			[[nodiscard]] inline auto av_latency() const -> lat_t {
+				return latency_ctr_ > 0 ? static_cast<lat_t>(latency_sum_ / latency_ctr_) : samples::minimum_latency;
+			}
+
+			// Pages of the region (to be migrated)
+			[[nodiscard]] inline auto pages() const -> std::vector<addr_t> {
+				std::vector<addr_t> pages;
+				pages.reserve(bytes() / memory_info::pagesize);
+
+				for (auto page = begin_; page < end_; page += memory_info::pagesize) {
+					pages.emplace_back(page);
+				}
+
+				return pages;
+			}
+
+			inline void add_data(const memory_sample_t & sample, const node_t src) {
+				const auto reqs = static_cast<real_t>(sample.reqs());
+
+				accesses_[src] += reqs;
+				latency_sum_ += static_cast<real_t>(sample.latency()) * reqs;
+				latency_ctr_ += reqs;
+
+				node_ = sample.page_node();
+
+				if (first_seen_ == 0) { first_seen_ = decay::now(); }
+			}
+
+			inline void age(const real_t factor) {
+				for (auto & accesses : accesses_) {
+					accesses *= factor;
+				}
+				latency_sum_ *= factor;
+				latency_ctr_ *= factor;
+			}
+
+			// The pages of the region have been moved to node
+			inline void migrated(const node_t node) {
+				node_ = node;
+				accesses_.fill(0);
+				latency_sum_ = 0;
+				latency_ctr_ = 0;
+				first_seen_  = 0;
+			}
+
+			// Distance between the statistics of two regions: max. difference of access ratios plus relative
+			// difference of density. Regions without enough information are close only to each other.
+			[[nodiscard]] inline auto distance(const region & other) const -> real_t {
+				if (!enough_info() && !other.enough_info()) { return 0; }
+				if (!enough_info() || !other.enough_info()) { return std::numeric_limits<real_t>::max(); }
+
+				const auto ratios       = this->ratios();
+				const auto other_ratios = other.ratios();
+
+				real_t ratio_diff = 0;
+				for (size_t node = 0; node < ratios.size(); ++node) {
+					ratio_diff = std::max(ratio_diff, std::abs(ratios[node] - other_ratios[node]));
+				}
+
+				const auto max_density = std::max(density(), other.density());
+				const auto density_diff =
+				    max_density > 0 ? std::abs(density() - other.density()) / max_density : real_t();
+
+				return ratio_diff + density_diff;
+			}
+
+			// Absorb the contiguous region "next"
+			inline void merge(const region & next) {
+				end_ = next.end_;
+
+				for (size_t node = 0; node < accesses_.size(); ++node) {
+					accesses_[node] += next.accesses_[node];
+				}
+				latency_sum_ += next.latency_sum_;
+				latency_ctr_ += next.latency_ctr_;
+
+				if (node_ < 0) { node_ = next.node_; }
+				if (first_seen_ == 0 || (next.first_seen_ != 0 && next.first_seen_ < first_seen_)) {
+					first_seen_ = next.first_seen_;
+				}
+			}
+
+			// Split the region at addr: this region keeps [begin, addr) and the returned one gets [addr, end). The
+			// statistics are shared in proportion to the size of each part
+			[[nodiscard]] inline auto split(const addr_t addr) -> region {
+				region next(*this);
+
+				const auto share = static_cast<real_t>(end_ - addr) / static_cast<real_t>(bytes());
+
+				next.begin_ = addr;
+				next.age(share);
+
+				end_ = addr;
+				age(1 - share);
+
+				return next;
+			}
+
+			// Keep only [begin, end) of the region (with its share of the statistics)
+			inline void clip(const addr_t begin, const addr_t end) {
+				if (begin > begin_) { *this = split(begin); }
+				if (end < end_) { static_cast<void>(split(end)); }
+			}
+
+			// Contiguous neighbours of the same process
+			[[nodiscard]] inline auto adjacent(const region & next) const {
+				return end_ == next.begin_ && pid_ == next.pid_;
+			}
+		};
+
+	private:
+		size_t max_regions_ = 0;
+
+		std::vector<region> regions_{}; // Sorted by start address
+
+		size_t splits_    = 0;
+		size_t merges_    = 0;
+		size_t untracked_ = 0; // Samples out of the tracked regions
+
+		system_info::node_array<lat_t> node_latencies_{ samples::minimum_latency };
+		system_info::node_array<req_t> node_accesses_{};
+
+		req_t accesses_   = 0;
+		lat_t av_latency_ = samples::minimum_latency;
+
+		[[nodiscard]] inline auto find(const addr_t addr) -> region * {
+			auto it = std::upper_bound(regions_.begin(), regions_.end(), addr,
+			                           [](const addr_t a, const region & r) { return a < r.begin(); });
+
+			if (it == regions_.begin()) { return nullptr; }
+
+			--it;
+			return it->contains(addr) ? &*it : nullptr;
+		}
+
+		// Merge every pair of neighbours closer than "distance"
+		inline void merge_pass(const real_t distance) {
+			if (regions_.empty()) { return; }
+
+			size_t last = 0;
+
+			for (size_t i = 1; i < regions_.size(); ++i) {
+				if (regions_[last].adjacent(regions_[i]) && regions_[last].distance(regions_[i]) <= distance) {
+					regions_[last].merge(regions_[i]);
+					++merges_;
+				} else {
+					regions_[++last] = regions_[i];
+				}
+			}
+
+			regions_.erase(regions_.begin() + static_cast<ptrdiff_t>(last + 1), regions_.end());
+		}
+
+		// Split (in halves) the regions with accesses spread among nodes, or too big to be migrated to their
+		// preferred node. While there is room for twice as many regions, any accessed region is split to look for
+		// hot spots inside it
+		inline void split_pass() {
+			const bool explore = regions_.size() * 2 < max_regions_;
+
+			std::vector<region> regions;
+			regions.reserve(std::min(regions_.size() * 2, max_regions_));
+
+			auto room = max_regions_ > regions_.size() ? max_regions_ - regions_.size() : 0;
+
+			for (auto & r : regions_) {
+				const auto n_pages = r.bytes() / memory_info::pagesize;
+
+				bool split = false;
+
+				if (room > 0 && n_pages >= 2 && r.enough_info()) {
+					const auto ratios    = r.ratios();
+					const auto pref_node = r.preferred_node();
+
+					const bool uneven   = ratios[pref_node] < SPLIT_MAX_RATIO;
+					const bool too_big  = r.bytes() > MAX_MIGRATION_BYTES && pref_node != r.node();
+					const bool accessed = explore && r.accesses() > 0;
+
+					split = uneven || too_big || accessed;
+				}
+
+				if (!split) {
+					regions.emplace_back(r);
+					continue;
+				}
+
+				const auto middle = r.begin() + n_pages / 2 * memory_info::pagesize;
+
+				auto next = r.split(middle);
+				regions.emplace_back(r);
+				regions.emplace_back(next);
+
+				++splits_;
+				--room;
+			}
+
+			regions_.swap(regions);
+		}
+
+	public:
+		adaptive_regions() = default;
+
+		[[nodiscard]] inline auto enabled() const {
+			return max_regions_ > 0;
+		}
+
+		// Budget of regions. 0 disables the tracker
+		inline void max_regions(const size_t max_regions) {
+			max_regions_ = max_regions;
+			if (max_regions_ == 0) { regions_.clear(); }
+		}
+
+		[[nodiscard]] inline auto max_regions() const {
+			return max_regions_;
+		}
+
+		[[nodiscard]] inline auto size() const {
+			return regions_.size();
+		}
+
+		[[nodiscard]] inline auto begin() const {
+			return regions_.begin();
+		}
+
+		[[nodiscard]] inline auto end() const {
+			return regions_.end();
+		}
+
+		[[nodiscard]] inline auto splits() const {
+			return splits_;
+		}
+
+		[[nodiscard]] inline auto merges() const {
+			return merges_;
+		}
+
+		[[nodiscard]] inline auto untracked() const {
+			return untracked_;
+		}
+
+		[[nodiscard]] inline auto accesses() const {
+			return accesses_;
+		}
+
+		[[nodiscard]] inline auto av_latency() const {
+			return av_latency_;
+		}
+
+		[[nodiscard]] inline auto av_latency(const node_t node) const {
+			return node_latencies_[node];
+		}
+
+		[[nodiscard]] inline auto node_min_av_latency() const -> node_t {
+			const auto latencies = node_latencies_.span();
+			return static_cast<node_t>(std::min_element(latencies.begin(), latencies.end()) - latencies.begin());
+		}
+
+		inline void add_data(const memory_sample_t & sample) {
+			if (!enabled()) { return; }
+
+			auto * r = find(sample.addr());
+
+			if (r == nullptr) {
+				++untracked_;
+				return;
+			}
+
+			const auto src     = system_info::node_from_cpu(sample.cpu());
+			const auto dst     = sample.page_node();
+			const auto latency = sample.latency();
+			const auto reqs    = sample.reqs();
+
+			r->add_data(sample, src);
+
+			node_latencies_[dst] =
+			    (node_accesses_[dst] * node_latencies_[dst] + latency * reqs) / (node_accesses_[dst] + reqs);
+			node_accesses_[dst] += reqs;
+
+			av_latency_ = (av_latency_ * accesses_ + latency * reqs) / (accesses_ + reqs);
+			accesses_ += reqs;
+		}
+
+		// Follow the memory regions of the processes (Map = ordered container of [address, mem_region]): regions
+		// out of them are dropped (or clipped) and uncovered areas start as a single region
+		template<typename Map>
+		inline void sync(const Map & memory_regions) {
+			std::vector<region> regions;
+			regions.reserve(regions_.size());
+
+			size_t old = 0;
+
+			for (const auto & [address, vma] : memory_regions) {
+				if (!vma.read() || !vma.write()) { continue; }
+
+				const auto b   = vma.begin();
+				const auto e   = vma.end();
+				const auto pid = vma.pid();
+
+				while (old < regions_.size() && regions_[old].end() <= b) {
+					++old;
+				}
+
+				auto cursor = b;
+
+				for (auto i = old; i < regions_.size() && regions_[i].begin() < e; ++i) {
+					const auto & r = regions_[i];
+
+					if (r.pid() != pid || r.end() <= cursor) { continue; }
+
+					auto clipped = r;
+					clipped.clip(cursor, e);
+
+					if (cursor < clipped.begin()) { regions.emplace_back(cursor, clipped.begin(), pid); }
+
+					cursor = clipped.end();
+					regions.emplace_back(clipped);
+				}
+
+				if (cursor < e) { regions.emplace_back(cursor, e, pid); }
+			}
+
+			regions_.swap(regions);
+		}
+
+		// End of an aggregation interval: merge similar neighbours, split uneven regions, enforce the budget and
+		// age the statistics
+		template<typename Map>
+		inline void adapt(const Map & memory_regions) {
+			if (!enabled()) { return; }
+
+			sync(memory_regions);
+
+			merge_pass(MERGE_DISTANCE);
+
+			if (regions_.size() < max_regions_) { split_pass(); }
+
+			// Budget exceeded: merge increasingly different neighbours (distances are at most 2 with enough info)
+			for (auto distance = MERGE_DISTANCE * 2; regions_.size() > max_regions_ && distance <= 4; distance *= 2) {
+				merge_pass(distance);
+			}
+			if (regions_.size() > max_regions_) { merge_pass(std::numeric_limits<real_t>::max()); }
+
+			for (auto & r : regions_) {
+				r.age(AGING_FACTOR);
+			}
+		}
+
+		// move_pages reported the status of "pages" (statuses[i] = node of pages[i], or -errno): the regions with pages
+		// actually moved to node start over from there
+		inline void migrated(const std::span<const addr_t> pages, const std::span<const int> statuses,
+		                     const node_t node) {
+			if (!enabled()) { return; }
+
+			const region * last = nullptr;
+
+			for (size_t i = 0; i < pages.size() && i < statuses.size(); ++i) {
+				if (statuses[i] != node || (last != nullptr && last->contains(pages[i]))) { continue; }
+
+				auto * r = find(pages[i]);
+				if (r != nullptr) { r->migrated(node); }
+				last = r;
+			}
+		}
+
+		// End of an aggregation interval: the per-node latencies start over (the regions age in adapt())
+		inline void clear_it() {
+			accesses_   = 0;
+			av_latency_ = samples::minimum_latency;
+			node_latencies_.fill(samples::minimum_latency);
+			node_accesses_.fill(0);
+		}
+	};
+} // namespace performance
+
+#endif /* end of include guard: THANOS_ADAPTIVE_REGIONS_HPP */
@@ -0,0 +1,139 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <r.laso@usc.es> wrote this file. As long as you retain this notice you
+ * can do whatever you want with this stuff. If we meet some day, and you think
+ * this stuff is worth it, you can buy me a beer in return Ruben Laso
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef THANOS_CANDIDATE_QUEUE_HPP
+#define THANOS_CANDIDATE_QUEUE_HPP
+
+#include <optional>    // for optional
+#include <sys/types.h> // for size_t
+#include <utility>     // for pair, swap
+#include <vector>      // for vector
+
+#include "migration/performance/flat_page_table.hpp" // for flat_page_table
+#include "utils/types.hpp"                           // for addr_t, real_t
+
+namespace performance {
+	// Indexed max-priority queue of migration candidates (pages) by score.
+	// The score of a page can be increased, decreased or removed at any time in O(log M), so candidates can be kept
+	// up to date as samples arrive, and the best N are obtained in O(N log M) without scanning the whole table.
+	class candidate_queue {
+	public:
+		using value_type = std::pair<addr_t, real_t>; // { page, score }
+
+	private:
+		std::vector<value_type> heap_{};      // Max-heap by score
+		flat_page_table<size_t> positions_{}; // positions_[page] = index of the page in heap_ (no per-entry allocs)
+
+		inline void swap_entries(const size_t i, const size_t j) {
+			std::swap(heap_[i], heap_[j]);
+			positions_.at(heap_[i].first) = i;
+			positions_.at(heap_[j].first) = j;
+		}
+
+		inline void sift_up(size_t i) {
+			while (i > 0) {
+				const auto parent = (i - 1) / 2;
+				if (heap_[parent].second >= heap_[i].second) { break; }
+				swap_entries(i, parent);
+				i = parent;
+			}
+		}
+
+		inline void sift_down(size_t i) {
+			while (true) {
+				const auto left  = 2 * i + 1;
+				const auto right = left + 1;
+
+				auto largest = i;
+
+				if (left < heap_.size() && heap_[left].second > heap_[largest].second) { largest = left; }
+				if (right < heap_.size() && heap_[right].second > heap_[largest].second) { largest = right; }
+
+				if (largest == i) { break; }
+
+				swap_entries(i, largest);
+				i = largest;
+			}
+		}
+
+	public:
+		[[nodiscard]] inline auto size() const {
+			return heap_.size();
+		}
+
+		[[nodiscard]] inline auto empty() const {
+			return heap_.empty();
+		}
+
+		[[nodiscard]] inline auto contains(const addr_t page) const {
+			return positions_.contains(page);
+		}
+
+		// Best candidate (if any)
+		[[nodiscard]] inline auto top() const -> std::optional<value_type> {
+			if (heap_.empty()) { return std::nullopt; }
+			return heap_.front();
+		}
+
+		// Insert the page, or change its score if it is already in the queue
+		inline void update(const addr_t page, const real_t score) {
+			const auto it = positions_.find(page);
+
+			if (it == positions_.end()) {
+				heap_.emplace_back(page, score);
+				positions_.try_emplace(page, heap_.size() - 1);
+				sift_up(heap_.size() - 1);
+				return;
+			}
+
+			const auto i   = it->second;
+			const auto old = heap_[i].second;
+
+			heap_[i].second = score;
+
+			if (score > old) {
+				sift_up(i);
+			} else if (score < old) {
+				sift_down(i);
+			}
+		}
+
+		// Invalidate the page (e.g., it is no longer a candidate or it has been migrated)
+		inline void erase(const addr_t page) {
+			const auto it = positions_.find(page);
+			if (it == positions_.end()) { return; }
+
+			const auto i    = it->second;
+			const auto last = heap_.size() - 1;
+
+			if (i != last) { swap_entries(i, last); }
+
+			positions_.erase(page);
+			heap_.pop_back();
+
+			if (i < heap_.size()) {
+				sift_down(i);
+				sift_up(i);
+			}
+		}
+
+		inline auto pop() -> std::optional<value_type> {
+			auto best = top();
+			if (best.has_value()) { erase(best->first); }
+			return best;
+		}
+
+		inline void clear() {
+			heap_.clear();
+			positions_.clear();
+		}
+	};
+} // namespace performance
+
+#endif /* end of include guard: THANOS_CANDIDATE_QUEUE_HPP */
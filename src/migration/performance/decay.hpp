@@ -0,0 +1,44 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <r.laso@usc.es> wrote this file. As long as you retain this notice you
+ * can do whatever you want with this stuff. If we meet some day, and you think
+ * this stuff is worth it, you can buy me a beer in return Ruben Laso
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef THANOS_DECAY_HPP
+#define THANOS_DECAY_HPP
+
+#include <chrono> // for duration_cast, nanoseconds
+#include <cmath>  // for exp2
+
+#include "utils/types.hpp" // for real_t, tim_t, hres_clock
+
+// Lazy exponential decay of counters. Instead of aging every counter periodically, each counter (or group of
+// counters) stores the time of its last update, and it is decayed when it is read or written.
+namespace performance::decay {
+	static constexpr real_t DEFAULT_HALF_LIFE = 2.0;
+
+	extern real_t half_life; // Seconds for a counter to lose half of its value. 0 = no decay
+
+	// Timestamp (in nanoseconds) to be stored with the counters
+	[[nodiscard]] inline auto now() -> tim_t {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(hres_clock::now().time_since_epoch()).count();
+	}
+
+	// Factor to multiply a counter last updated at "last" to bring it to time "when"
+	[[nodiscard]] inline auto factor(const tim_t last, const tim_t when) -> real_t {
+		if (half_life <= 0 || when <= last) { return 1; }
+
+		const auto elapsed = static_cast<real_t>(when - last) / 1e9F; // 10^9 as times are measured in nanoseconds
+
+		return std::exp2(-elapsed / half_life);
+	}
+
+	[[nodiscard]] inline auto factor(const tim_t last) -> real_t {
+		return factor(last, now());
+	}
+} // namespace performance::decay
+
+#endif /* end of include guard: THANOS_DECAY_HPP */
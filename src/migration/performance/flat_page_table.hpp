@@ -0,0 +1,313 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <r.laso@usc.es> wrote this file. As long as you retain this notice you
+ * can do whatever you want with this stuff. If we meet some day, and you think
+ * this stuff is worth it, you can buy me a beer in return Ruben Laso
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef THANOS_FLAT_PAGE_TABLE_HPP
+#define THANOS_FLAT_PAGE_TABLE_HPP
+
+#include <algorithm>   // for fill, max, min
+#include <bit>         // for bit_ceil
+#include <cstddef>     // for ptrdiff_t
+#include <cstdint>     // for uint64_t
+#include <iterator>    // for forward_iterator_tag
+#include <stdexcept>   // for out_of_range
+#include <sys/types.h> // for size_t
+#include <type_traits> // for conditional_t
+#include <utility>     // for pair, cmp_less
+#include <vector>      // for vector
+
+#include "utils/types.hpp" // for addr_t
+
+namespace performance {
+	// Open addressing hash table (linear probing) keyed by page address.
+	// The probe arrays only hold the keys and a 32-bit index into a dense vector of entries, so empty slots cost 12
+	// bytes instead of a whole row, and probing only touches a few cache lines of keys. Deletions use backward
+	// shifting in the probe arrays (no tombstones) and swap-remove in the entries, so entries stay contiguous and
+	// any of them can be accessed in O(1) by its index (useful to pick random entries).
+	// Address 0 is never a valid page and marks an empty slot.
+	template<typename Row>
+	class flat_page_table {
+	public:
+		using value_type = std::pair<addr_t, Row>;
+
+	private:
+		static constexpr addr_t EMPTY_KEY    = 0;
+		static constexpr size_t MIN_CAPACITY = 64;
+
+		// Max. load factor is MAX_LOAD_NUM / MAX_LOAD_DEN
+		static constexpr size_t MAX_LOAD_NUM = 3;
+		static constexpr size_t MAX_LOAD_DEN = 4;
+
+		std::vector<addr_t>     keys_{};    // keys_[slot] = page in the slot (or EMPTY_KEY)
+		std::vector<uint32_t>   index_{};   // index_[slot] = position of the entry of keys_[slot] in entries_
+		std::vector<value_type> entries_{}; // Dense: entries_[i] = { page, row }
+		size_t                  mask_ = 0;
+
+		[[nodiscard]] static inline auto hash(const addr_t page) -> size_t {
+			// Fibonacci hashing. Pages are aligned, so low bits of the address carry no information
+			const uint64_t h = (page >> 12) * 0x9E3779B97F4A7C15ULL;
+			return static_cast<size_t>(h ^ (h >> 32));
+		}
+
+		[[nodiscard]] inline auto home(const addr_t page) const -> size_t {
+			return hash(page) & mask_;
+		}
+
+		// Slot containing the page or the (empty) slot where it should be inserted
+		[[nodiscard]] inline auto probe(const addr_t page) const -> size_t {
+			auto slot = home(page);
+			while (keys_[slot] != EMPTY_KEY && keys_[slot] != page) {
+				slot = (slot + 1) & mask_;
+			}
+			return slot;
+		}
+
+		inline void rehash(const size_t capacity) {
+			keys_.assign(capacity, EMPTY_KEY);
+			index_.assign(capacity, 0);
+			mask_ = capacity - 1;
+
+			for (size_t i = 0; i < entries_.size(); ++i) {
+				const auto slot = probe(entries_[i].first);
+				keys_[slot]     = entries_[i].first;
+				index_[slot]    = static_cast<uint32_t>(i);
+			}
+		}
+
+		inline void erase_slot(size_t slot) {
+			const auto removed = index_[slot];
+
+			// Backward shift deletion: move back the following keys of the cluster that would not be reachable
+			auto next = (slot + 1) & mask_;
+
+			while (keys_[next] != EMPTY_KEY) {
+				const auto ideal = home(keys_[next]);
+
+				// The key in "next" can be moved to "slot" if its ideal slot is not in the interval (slot, next]
+				const bool movable = (slot <= next) ? (ideal <= slot || ideal > next) : (ideal <= slot && ideal > next);
+
+				if (movable) {
+					keys_[slot]  = keys_[next];
+					index_[slot] = index_[next];
+					slot         = next;
+				}
+
+				next = (next + 1) & mask_;
+			}
+
+			keys_[slot] = EMPTY_KEY;
+
+			// Swap-remove: the last entry fills the gap
+			if (removed + 1 != entries_.size()) {
+				entries_[removed]                    = std::move(entries_.back());
+				index_[probe(entries_[removed].first)] = removed;
+			}
+			entries_.pop_back();
+		}
+
+	public:
+		template<bool Const>
+		class basic_iterator {
+		private:
+			using table_t = std::conditional_t<Const, const flat_page_table, flat_page_table>;
+
+			table_t * table_ = nullptr;
+			size_t    index_ = 0;
+
+		public:
+			using iterator_category = std::forward_iterator_tag;
+			using value_type        = flat_page_table::value_type;
+			using difference_type   = std::ptrdiff_t;
+			using reference         = std::conditional_t<Const, const value_type &, value_type &>;
+			using pointer           = std::conditional_t<Const, const value_type *, value_type *>;
+
+			basic_iterator() = default;
+
+			basic_iterator(table_t * table, const size_t index) : table_(table), index_(index) {
+			}
+
+			// Position of the entry (see at_index)
+			[[nodiscard]] inline auto index() const {
+				return index_;
+			}
+
+			[[nodiscard]] inline auto operator*() const -> reference {
+				return table_->entries_[index_];
+			}
+
+			[[nodiscard]] inline auto operator->() const -> pointer {
+				return &table_->entries_[index_];
+			}
+
+			inline auto operator++() -> basic_iterator & {
+				++index_;
+				return *this;
+			}
+
+			inline auto operator++(int) -> basic_iterator {
+				auto old = *this;
+				++(*this);
+				return old;
+			}
+
+			[[nodiscard]] friend inline auto operator==(const basic_iterator & a, const basic_iterator & b) -> bool {
+				return a.index_ == b.index_;
+			}
+		};
+
+		using iterator       = basic_iterator<false>;
+		using const_iterator = basic_iterator<true>;
+
+		flat_page_table() {
+			rehash(MIN_CAPACITY);
+		}
+
+		[[nodiscard]] inline auto begin() -> iterator {
+			return { this, 0 };
+		}
+
+		[[nodiscard]] inline auto end() -> iterator {
+			return { this, entries_.size() };
+		}
+
+		[[nodiscard]] inline auto begin() const -> const_iterator {
+			return { this, 0 };
+		}
+
+		[[nodiscard]] inline auto end() const -> const_iterator {
+			return { this, entries_.size() };
+		}
+
+		[[nodiscard]] inline auto size() const {
+			return entries_.size();
+		}
+
+		[[nodiscard]] inline auto empty() const {
+			return entries_.empty();
+		}
+
+		// Number of slots of the probe arrays (occupied or not)
+		[[nodiscard]] inline auto capacity() const {
+			return keys_.size();
+		}
+
+		// Entry in position "index" (in [0, size()))
+		[[nodiscard]] inline auto at_index(const size_t index) -> value_type & {
+			return entries_[index];
+		}
+
+		[[nodiscard]] inline auto at_index(const size_t index) const -> const value_type & {
+			return entries_[index];
+		}
+
+		inline void reserve(const size_t n) {
+			const auto capacity = std::max(MIN_CAPACITY, std::bit_ceil(n * MAX_LOAD_DEN / MAX_LOAD_NUM + 1));
+			if (capacity > keys_.size()) { rehash(capacity); }
+			entries_.reserve(n);
+		}
+
+		inline void clear() {
+			std::fill(keys_.begin(), keys_.end(), EMPTY_KEY);
+			entries_.clear();
+		}
+
+		[[nodiscard]] inline auto contains(const addr_t page) const -> bool {
+			return keys_[probe(page)] == page;
+		}
+
+		[[nodiscard]] inline auto find(const addr_t page) -> iterator {
+			const auto slot = probe(page);
+			return keys_[slot] == page ? iterator{ this, index_[slot] } : end();
+		}
+
+		[[nodiscard]] inline auto find(const addr_t page) const -> const_iterator {
+			const auto slot = probe(page);
+			return keys_[slot] == page ? const_iterator{ this, index_[slot] } : end();
+		}
+
+		// As std::unordered_map::at: throws if the page is not in the table
+		[[nodiscard]] inline auto at(const addr_t page) -> Row & {
+			const auto slot = probe(page);
+			if (keys_[slot] != page) { throw std::out_of_range("flat_page_table::at: page not in the table"); }
+			return entries_[index_[slot]].second;
+		}
+
+		[[nodiscard]] inline auto at(const addr_t page) const -> const Row & {
+			const auto slot = probe(page);
+			if (keys_[slot] != page) { throw std::out_of_range("flat_page_table::at: page not in the table"); }
+			return entries_[index_[slot]].second;
+		}
+
+		// Returns the row for the page, inserting Row(args...) if the page is not in the table
+		template<typename... Args>
+		inline auto try_emplace(const addr_t page, Args &&... args) -> Row & {
+			auto slot = probe(page);
+
+			if (keys_[slot] == page) { return entries_[index_[slot]].second; }
+
+			if ((entries_.size() + 1) * MAX_LOAD_DEN > keys_.size() * MAX_LOAD_NUM) {
+				rehash(keys_.size() * 2);
+				slot = probe(page);
+			}
+
+			keys_[slot]  = page;
+			index_[slot] = static_cast<uint32_t>(entries_.size());
+
+			return entries_.emplace_back(page, Row(std::forward<Args>(args)...)).second;
+		}
+
+		inline auto erase(const addr_t page) -> size_t {
+			const auto slot = probe(page);
+
+			if (keys_[slot] != page) { return 0; }
+
+			erase_slot(slot);
+			return 1;
+		}
+
+		template<typename Pred>
+		inline auto erase_if(Pred && pred) -> size_t {
+			// Entries are moved when erasing, so gather the pages first
+			std::vector<addr_t> to_remove;
+
+			for (const auto & entry : entries_) {
+				if (pred(entry)) { to_remove.emplace_back(entry.first); }
+			}
+
+			for (const auto & page : to_remove) {
+				erase(page);
+			}
+
+			return to_remove.size();
+		}
+
+		// Like erase_if, but only checking the entries [first, first + n), to spread the work among calls.
+		// Returns the position where the next call should start.
+		template<typename Pred>
+		inline auto erase_if(const size_t first, const size_t n, Pred && pred) -> size_t {
+			std::vector<addr_t> to_remove;
+
+			const auto start = first < entries_.size() ? first : 0;
+			const auto last  = std::min(entries_.size(), start + n);
+
+			for (size_t i = start; i < last; ++i) {
+				if (pred(entries_[i])) { to_remove.emplace_back(entries_[i].first); }
+			}
+
+			for (const auto & page : to_remove) {
+				erase(page);
+			}
+
+			// Removed entries were filled with the last ones, so the next call goes on from the first one not checked
+			const auto next = last - to_remove.size();
+			return next < entries_.size() ? next : 0;
+		}
+	};
+} // namespace performance
+
+#endif /* end of include guard: THANOS_FLAT_PAGE_TABLE_HPP */
@@ -0,0 +1,484 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <r.laso@usc.es> wrote this file. As long as you retain this notice you
+ * can do whatever you want with this stuff. If we meet some day, and you think
+ * this stuff is worth it, you can buy me a beer in return Ruben Laso
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef THANOS_HOT_PAGES_SKETCH_HPP
+#define THANOS_HOT_PAGES_SKETCH_HPP
+
+#include <algorithm>   // for min, max_element, make_heap
+#include <array>       // for array
+#include <bit>         // for bit_ceil, countr_zero
+#include <cstdint>     // for uint64_t
+#include <limits>      // for numeric_limits
+#include <numeric>     // for accumulate
+#include <sys/types.h> // for size_t, pid_t
+#include <utility>     // for cmp_less, swap
+#include <vector>      // for vector
+
+#include "migration/utils/mem_sample.hpp"    // for memory_sample_t
+#include "samples/perf_event/perf_event.hpp" // for minimum_latency
+#include "system_info/node_array.hpp"        // for node_array, n_nodes
+#include "system_info/system_info.hpp"       // for node_from_cpu
+#include "utils/types.hpp"                   // for addr_t, req_t, lat_t
+
+namespace performance {
+	// Count-min sketch of page accesses.
+	// estimate(page) never underestimates, and overestimates by more than e/width * N (N = total count) with
+	// probability at most e^-DEPTH.
+	class count_min_sketch {
+	private:
+		static constexpr size_t DEPTH = 4;
+
+		static constexpr std::array<uint64_t, DEPTH> SEEDS = { 0x9E3779B97F4A7C15ULL, 0xC2B2AE3D27D4EB4FULL,
+			                                                   0x165667B19E3779F9ULL, 0xD6E8FEB86659FD93ULL };
+
+		std::vector<req_t> counters_{}; // counters_[row * width_ + column]
+		size_t             width_ = 0;
+		size_t             shift_ = 0;
+
+		[[nodiscard]] inline auto column(const addr_t page, const size_t row) const -> size_t {
+			// Multiply-shift hashing of the page number (low bits of the address carry no information)
+			return static_cast<size_t>(((page >> 12) * SEEDS[row]) >> shift_);
+		}
+
+	public:
+		count_min_sketch() = default;
+
+		explicit count_min_sketch(const size_t width) :
+		    counters_(DEPTH * std::bit_ceil(width), 0),
+		    width_(std::bit_ceil(width)),
+		    shift_(64 - std::countr_zero(width_)) {
+		}
+
+		inline void add(const addr_t page, const req_t count) {
+			for (size_t row = 0; row < DEPTH; ++row) {
+				counters_[row * width_ + column(page, row)] += count;
+			}
+		}
+
+		[[nodiscard]] inline auto estimate(const addr_t page) const -> req_t {
+			if (width_ == 0) { return 0; }
+
+			auto min = std::numeric_limits<req_t>::max();
+			for (size_t row = 0; row < DEPTH; ++row) {
+				min = std::min(min, counters_[row * width_ + column(page, row)]);
+			}
+			return min;
+		}
+
+		// Halve every counter, so old accesses weigh less than recent ones
+		inline void age() {
+			for (auto & counter : counters_) {
+				counter /= 2;
+			}
+		}
+	};
+
+	// Space-Saving summary: keeps the (approximate) top-K most accessed pages in K counters.
+	// Every page accessed more than N/K times is guaranteed to be in the summary, and the count of a page
+	// overestimates its real number of accesses by at most error() <= N/K.
+	// Counters are kept in a min-heap, so updates are O(log K).
+	class space_saving {
+	public:
+		class counter {
+		private:
+			addr_t page_;
+			req_t  count_;
+			req_t  error_; // Max. overestimation of count_ (count of the evicted page when it took the counter)
+
+			lat_t latency_sum_ = 0;
+			req_t latency_ctr_ = 0;
+
+			pid_t  last_pid_;
+			node_t page_node_;
+
+		public:
+			counter(const addr_t page, const req_t count, const req_t error, const pid_t pid, const node_t page_node) :
+			    page_(page), count_(count), error_(error), last_pid_(pid), page_node_(page_node) {
+			}
+
+			inline void add_data(const memory_sample_t & sample) {
+				latency_sum_ += sample.latency() * sample.reqs();
+				latency_ctr_ += sample.reqs();
+
+				last_pid_  = sample.tid();
+				page_node_ = sample.page_node();
+			}
+
+			inline void increase(const req_t count) {
+				count_ += count;
+			}
+
+			// Halve the counts, keeping the average latency
+			inline void age() {
+				const auto latency = av_latency();
+
+				count_ /= 2;
+				error_ /= 2;
+
+				latency_ctr_ /= 2;
+				latency_sum_ = latency * latency_ctr_;
+			}
+
+			[[nodiscard]] inline auto page() const {
+				return page_;
+			}
+
+			[[nodiscard]] inline auto count() const {
+				return count_;
+			}
+
+			[[nodiscard]] inline auto error() const {
+				return error_;
+			}
+
+			// Accesses guaranteed to have been made to the page
+			[[nodiscard]] inline auto guaranteed_count() const {
+				return count_ - error_;
+			}
+
+			[[nodiscard]] inline auto av_latency() const -> lat_t {
+				return latency_ctr_ > 0 ? latency_sum_ / latency_ctr_ : samples::minimum_latency;
+			}
+
+			[[nodiscard]] inline auto last_pid() const {
+				return last_pid_;
+			}
+
+			[[nodiscard]] inline auto page_node() const {
+				return page_node_;
+			}
+		};
+
+	private:
+		size_t capacity_ = 0;
+		req_t  total_    = 0;
+
+		std::vector<counter>      heap_{};      // Min-heap by count
+		fast_umap<addr_t, size_t> positions_{}; // positions_[page] = index of the page in heap_
+
+		inline void swap_counters(const size_t i, const size_t j) {
+			std::swap(heap_[i], heap_[j]);
+			positions_[heap_[i].page()] = i;
+			positions_[heap_[j].page()] = j;
+		}
+
+		inline void sift_up(size_t i) {
+			while (i > 0) {
+				const auto parent = (i - 1) / 2;
+				if (heap_[parent].count() <= heap_[i].count()) { break; }
+				swap_counters(i, parent);
+				i = parent;
+			}
+		}
+
+		inline void sift_down(size_t i) {
+			while (true) {
+				const auto left  = 2 * i + 1;
+				const auto right = left + 1;
+
+				auto smallest = i;
+
+				if (left < heap_.size() && heap_[left].count() < heap_[smallest].count()) { smallest = left; }
+				if (right < heap_.size() && heap_[right].count() < heap_[smallest].count()) { smallest = right; }
+
+				if (smallest == i) { break; }
+
+				swap_counters(i, smallest);
+				i = smallest;
+			}
+		}
+
+	public:
+		space_saving() = default;
+
+		explicit space_saving(const size_t capacity) : capacity_(capacity) {
+			heap_.reserve(capacity_);
+			positions_.reserve(capacity_);
+		}
+
+		[[nodiscard]] inline auto begin() const {
+			return heap_.begin();
+		}
+
+		[[nodiscard]] inline auto end() const {
+			return heap_.end();
+		}
+
+		[[nodiscard]] inline auto size() const {
+			return heap_.size();
+		}
+
+		[[nodiscard]] inline auto capacity() const {
+			return capacity_;
+		}
+
+		// Total count of the stream (N)
+		[[nodiscard]] inline auto total() const {
+			return total_;
+		}
+
+		// Max. overestimation of any counter (N/K)
+		[[nodiscard]] inline auto max_error() const -> req_t {
+			return capacity_ > 0 ? total_ / static_cast<req_t>(capacity_) : 0;
+		}
+
+		[[nodiscard]] inline auto find(const addr_t page) const -> const counter * {
+			const auto it = positions_.find(page);
+			return it == positions_.end() ? nullptr : &heap_[it->second];
+		}
+
+		inline void add_data(const memory_sample_t & sample) {
+			if (capacity_ == 0) { return; }
+
+			const auto page = sample.page();
+			const auto reqs = sample.reqs();
+
+			total_ += reqs;
+
+			const auto it = positions_.find(page);
+
+			if (it != positions_.end()) {
+				const auto i = it->second;
+				heap_[i].increase(reqs);
+				heap_[i].add_data(sample);
+				sift_down(i);
+				return;
+			}
+
+			if (heap_.size() < capacity_) {
+				heap_.emplace_back(page, reqs, 0, sample.tid(), sample.page_node()).add_data(sample);
+				positions_[page] = heap_.size() - 1;
+				sift_up(heap_.size() - 1);
+				return;
+			}
+
+			// Replace the page with the minimum count. The new page inherits its count as error
+			const auto min_count = heap_.front().count();
+
+			positions_.erase(heap_.front().page());
+
+			heap_.front() = counter(page, min_count + reqs, min_count, sample.tid(), sample.page_node());
+			heap_.front().add_data(sample);
+			positions_[page] = 0;
+
+			sift_down(0);
+		}
+
+		inline void erase(const addr_t page) {
+			const auto it = positions_.find(page);
+			if (it == positions_.end()) { return; }
+
+			const auto i    = it->second;
+			const auto last = heap_.size() - 1;
+
+			if (i != last) { swap_counters(i, last); }
+
+			positions_.erase(page);
+			heap_.pop_back();
+
+			if (i < heap_.size()) {
+				sift_down(i);
+				sift_up(i);
+			}
+		}
+
+		// Halve every counter (and N), dropping the pages whose count reaches 0. Halving keeps the order of the
+		// counts, so only the positions of the pages after the dropped ones change
+		inline void age() {
+			total_ /= 2;
+
+			for (auto & c : heap_) {
+				c.age();
+			}
+
+			std::erase_if(heap_, [](const counter & c) { return c.count() == 0; });
+			std::make_heap(heap_.begin(), heap_.end(),
+			               [](const counter & a, const counter & b) { return a.count() > b.count(); });
+
+			positions_.clear();
+			for (size_t i = 0; i < heap_.size(); ++i) {
+				positions_[heap_[i].page()] = i;
+			}
+		}
+	};
+
+	// Hotness tracker of memory pages in fixed memory (independent of the size of the application), to be used
+	// instead of the exhaustive mempages_table.
+	// For each node, a Space-Saving summary keeps the top-K pages accessed from the node, and a count-min sketch
+	// estimates the accesses from the node to any page (so the access ratios of the hot pages can be computed).
+	class hot_pages_sketch {
+	public:
+		// Hot page candidate to be migrated
+		struct hot_page {
+			addr_t              page;
+			pid_t               pid;
+			node_t              page_node; // Node in which the page is located
+			node_t              pref_node; // Node with more accesses to the page
+			req_t               accesses;
+			lat_t               av_latency;
+			std::vector<real_t> ratios; // Ratio of accesses from each node
+		};
+
+	private:
+		static constexpr req_t SAMPLES_ENOUGH_INFO = 10;
+
+		// Width of the count-min sketches per Space-Saving counter, so both have similar error bounds
+		static constexpr size_t CMS_WIDTH_PER_COUNTER = 4;
+
+		size_t top_k_ = 0;
+
+		std::vector<space_saving>     top_{}; // top_[node] = top-K pages accessed from node
+		std::vector<count_min_sketch> cms_{}; // cms_[node] = accesses from node to each page
+
+		req_t accesses_   = 0;
+		lat_t av_latency_ = samples::minimum_latency;
+
+		system_info::node_array<lat_t> node_latencies_{ samples::minimum_latency };
+		system_info::node_array<req_t> node_accesses_{};
+
+	public:
+		hot_pages_sketch() = default;
+
+		explicit hot_pages_sketch(const size_t top_k) {
+			resize(top_k);
+		}
+
+		// Number of pages tracked per node. 0 disables the tracker
+		inline void resize(const size_t top_k) {
+			top_k_ = top_k;
+
+			top_.clear();
+			cms_.clear();
+
+			if (top_k_ == 0) { return; }
+
+			for (size_t node = 0; node < system_info::n_nodes(); ++node) {
+				top_.emplace_back(top_k_);
+				cms_.emplace_back(top_k_ * CMS_WIDTH_PER_COUNTER);
+			}
+		}
+
+		[[nodiscard]] inline auto enabled() const {
+			return top_k_ > 0;
+		}
+
+		[[nodiscard]] inline auto top_k() const {
+			return top_k_;
+		}
+
+		// Number of tracked pages (a page may be tracked from several nodes)
+		[[nodiscard]] inline auto size() const {
+			return std::accumulate(top_.begin(), top_.end(), size_t(),
+			                       [](const size_t accum, const space_saving & s) { return accum + s.size(); });
+		}
+
+		[[nodiscard]] inline auto accesses() const {
+			return accesses_;
+		}
+
+		[[nodiscard]] inline auto av_latency() const {
+			return av_latency_;
+		}
+
+		[[nodiscard]] inline auto av_latency(const node_t node) const {
+			return node_latencies_[node];
+		}
+
+		[[nodiscard]] inline auto node_min_av_latency() const -> node_t {
+			const auto latencies = node_latencies_.span();
+			return static_cast<node_t>(std::min_element(latencies.begin(), latencies.end()) - latencies.begin());
+		}
+
+		inline void add_data(const memory_sample_t & sample) {
+			if (!enabled()) { return; }
+
+			const auto src     = system_info::node_from_cpu(sample.cpu());
+			const auto dst     = sample.page_node();
+			const auto latency = sample.latency();
+			const auto reqs    = sample.reqs();
+
+			top_[src].add_data(sample);
+			cms_[src].add(sample.page(), reqs);
+
+			node_latencies_[dst] =
+			    (node_accesses_[dst] * node_latencies_[dst] + latency * reqs) / (node_accesses_[dst] + reqs);
+			node_accesses_[dst] += reqs;
+
+			av_latency_ = (av_latency_ * accesses_ + latency * reqs) / (accesses_ + reqs);
+			accesses_ += reqs;
+		}
+
+		// Hot pages with enough accesses to take decisions. Pages tracked from several nodes appear once, with the
+		// information (PID, location, latency) of the node that accesses them the most
+		[[nodiscard]] inline auto hot_pages() const -> std::vector<hot_page> {
+			std::vector<hot_page> pages;
+
+			fast_uset<addr_t> seen;
+
+			for (size_t node = 0; node < top_.size(); ++node) {
+				for (const auto & c : top_[node]) {
+					if (seen.contains(c.page())) { continue; }
+
+					std::vector<real_t> accesses(top_.size(), 0);
+					for (size_t n = 0; n < top_.size(); ++n) {
+						// Both are overestimations, so take the tightest
+						const auto * tracked = top_[n].find(c.page());
+						const auto   est     = cms_[n].estimate(c.page());
+						accesses[n] = static_cast<real_t>(tracked != nullptr ? std::min(tracked->count(), est) : est);
+					}
+
+					const auto total = std::accumulate(accesses.begin(), accesses.end(), real_t());
+
+					if (total <= SAMPLES_ENOUGH_INFO) { continue; }
+
+					const auto pref_node = std::max_element(accesses.begin(), accesses.end()) - accesses.begin();
+
+					for (auto & ratio : accesses) {
+						ratio /= total;
+					}
+
+					// Information of the node that accesses the page the most, if it tracks the page
+					const auto * pref = top_[pref_node].find(c.page());
+					const auto & info = pref != nullptr ? *pref : c;
+
+					seen.insert(c.page());
+					pages.push_back({ c.page(), info.last_pid(), info.page_node(), static_cast<node_t>(pref_node),
+					                  static_cast<req_t>(total), info.av_latency(), std::move(accesses) });
+				}
+			}
+
+			return pages;
+		}
+
+		// Stop tracking the page (e.g., after migrating it). The count-min sketches cannot forget it
+		inline void erase(const addr_t page) {
+			for (auto & top : top_) {
+				top.erase(page);
+			}
+		}
+
+		// Start a new interval: the counts of pages and accesses are halved, so pages that are no longer hot age
+		// out and new hot pages can displace them. Latency averages are per interval, as in mempages_table
+		inline void clear_it() {
+			for (auto & top : top_) {
+				top.age();
+			}
+			for (auto & cms : cms_) {
+				cms.age();
+			}
+
+			accesses_   = 0;
+			av_latency_ = samples::minimum_latency;
+			node_latencies_.fill(samples::minimum_latency);
+			node_accesses_.fill(0);
+		}
+	};
+} // namespace performance
+
+#endif /* end of include guard: THANOS_HOT_PAGES_SKETCH_HPP */
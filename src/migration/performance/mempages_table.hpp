@@ -10,25 +10,47 @@
 #ifndef THANOS_MEMPAGES_TABLE_HPP
 #define THANOS_MEMPAGES_TABLE_HPP
 
-#include <algorithm>   // for fill, max_element, min_...
-#include <numeric>     // for accumulate
-#include <ostream>     // for operator<<, ostream
-#include <string>      // for string, operator+, to_s...
-#include <sys/types.h> // for size_t, pid_t
-#include <tuple>       // for tie, _Swallow_assign
-#include <type_traits> // for add_const<>::type
-#include <utility>     // for pair, make_pair
-#include <variant>     // for variant
-#include <vector>      // for vector, vector<>::const...
-
-#include "migration/utils/mem_sample.hpp"    // for memory_sample_t
-#include "samples/perf_event/perf_event.hpp" // for minimum_latency
-#include "system_info/system_info.hpp"       // for num_of_nodes, node_from...
-#include "tabulate/tabulate.hpp"             // for Table, Format, FontAlign
-#include "utils/string.hpp"                  // for to_string, percentage
-#include "utils/types.hpp"                   // for real_t, addr_t, node_t
+#include <algorithm>          // for fill, max_element, min_...
+#include <condition_variable> // for condition_variable, condition_variable_any
+#include <cstddef>            // for ptrdiff_t
+#include <functional>         // for function
+#include <iterator>           // for forward_iterator_tag
+#include <memory>             // for shared_ptr, make_shared
+#include <mutex>              // for mutex, unique_lock
+#include <numa.h>             // for numa_run_on_node
+#include <numeric>            // for accumulate
+#include <optional>           // for optional, nullopt
+#include <ostream>            // for operator<<, ostream
+#include <string>             // for string, operator+, to_s...
+#include <span>               // for span
+#include <stop_token>         // for stop_token
+#include <sys/types.h>        // for size_t, pid_t
+#include <thread>             // for jthread
+#include <tuple>              // for tie, _Swallow_assign
+#include <type_traits>        // for conditional_t
+#include <utility>            // for pair, make_pair
+#include <variant>            // for variant
+#include <vector>             // for vector, vector<>::const...
+
+#include "migration/performance/candidate_queue.hpp" // for candidate_queue
+#include "migration/performance/decay.hpp"           // for factor, now
+#include "migration/performance/flat_page_table.hpp" // for flat_page_table
+#include "migration/utils/mem_sample.hpp"            // for memory_sample_t
+#include "samples/perf_event/perf_event.hpp"         // for minimum_latency
+#include "system_info/memory_info.hpp"               // for contains, pagesize
+#include "system_info/node_array.hpp"                // for node_array, for_each_node
+#include "system_info/system_info.hpp"               // for num_of_nodes, node_from...
+#include "tabulate/tabulate.hpp"                     // for Table, Format, FontAlign
+#include "utils/arithmetic.hpp"                      // for rnd
+#include "utils/string.hpp"                          // for to_string, percentage
+#include "utils/types.hpp"                           // for real_t, addr_t, node_t
 
 namespace performance {
+	// Criteria to rank the migration candidates, kept up to date as samples are inserted:
+	// - BY_RATIO: pages accessed mostly from a node other than the last one accessing them, by max. ratio (TMMA).
+	// - BY_LATENCY: pages by their average latency (LMMA).
+	enum class candidate_t { BY_RATIO, BY_LATENCY };
+
 	namespace memtable_details {
 		class row {
 		private:
@@ -36,47 +58,55 @@ namespace performance {
 
 			mutable bool ratios_computed_ = false;
 
-			size_t samples_count_{};
-
 			size_t age_{};
 
-			mutable std::vector<real_t> ratios_{};
+			// Per-node counters are stored inline (no heap allocations per row in common topologies)
+			mutable system_info::node_array<real_t> ratios_{};
 
-			std::vector<size_t> raw_accesses_{};  // Accesses from each node (raw count)
-			std::vector<real_t> node_accesses_{}; // Accesses from each node (with aging)
+			// Accesses from each node (decayed to last_update_). They are also the weights of the latency averages,
+			// so old samples lose weight at the same pace in every statistic of the row
+			system_info::node_array<real_t> node_accesses_{};
 
-			std::vector<lat_t> av_latencies_{};
-			std::vector<req_t> av_latencies_ctr_{};
+			tim_t last_update_ = 0; // Time of the last update of node_accesses_
+			tim_t first_seen_  = 0; // Time of the first sample of the page
 
-			lat_t av_latency_     = 0;
-			req_t av_latency_ctr_ = 0;
+			system_info::node_array<lat_t> av_latencies_{};
+
+			lat_t av_latency_ = 0;
 
 			pid_t  last_pid_  = -1;
 			node_t last_node_ = -1;
 
+			size_t page_size_ = 0; // Size of the page in the last sample (base or huge page)
+
+			// Average of two latencies weighted by their (decayed) number of accesses
+			[[nodiscard]] static inline auto weighted_latency(const lat_t a, const real_t weight_a, const lat_t b,
+			                                                  const real_t weight_b) -> lat_t {
+				const auto weight = weight_a + weight_b;
+				if (weight <= 0) { return a; }
+				return static_cast<lat_t>((static_cast<real_t>(a) * weight_a + static_cast<real_t>(b) * weight_b) /
+				                          weight);
+			}
+
+			[[nodiscard]] inline auto total_accesses() const -> real_t {
+				return std::accumulate(node_accesses_.begin(), node_accesses_.end(), real_t());
+			}
+
 			inline void compute_ratios() const {
-				const auto total_accesses = std::accumulate(raw_accesses_.begin(), raw_accesses_.end(), size_t());
+				// All the nodes decay at the same pace, so the ratios do not depend on the time they are read
+				const auto total = total_accesses();
 
-				if (total_accesses == 0) { return; }
+				if (total <= 0) { return; }
 
-				for (const auto & node : system_info::nodes()) {
-					ratios_[node] = static_cast<real_t>(raw_accesses_[node]) / static_cast<real_t>(total_accesses);
-				}
+				system_info::for_each_node([&](const size_t node) { ratios_[node] = node_accesses_[node] / total; });
 
 				ratios_computed_ = true;
 			}
 
 		public:
-			row() = delete;
+			row() = default;
 
-			row(const pid_t last_pid, const node_t last_node) :
-			    ratios_(system_info::max_node() + 1, 0),
-			    raw_accesses_(system_info::max_node() + 1, 0),
-			    node_accesses_(system_info::max_node() + 1, 0),
-			    av_latencies_(system_info::max_node() + 1, 0),
-			    av_latencies_ctr_(system_info::max_node() + 1, 0),
-			    last_pid_(last_pid),
-			    last_node_(last_node) {
+			row(const pid_t last_pid, const node_t last_node) : last_pid_(last_pid), last_node_(last_node) {
 			}
 
 			[[nodiscard]] static inline auto samples_enough_info() {
@@ -84,99 +114,128 @@ namespace performance {
 			}
 
 			inline void clear() {
-				std::fill(node_accesses_.begin(), node_accesses_.end(), 0);
-				std::fill(raw_accesses_.begin(), raw_accesses_.end(), 0);
-				std::fill(ratios_.begin(), ratios_.end(), 0);
-				std::fill(av_latencies_.begin(), av_latencies_.end(), samples::minimum_latency);
-				std::fill(av_latencies_ctr_.begin(), av_latencies_ctr_.end(), 0.0);
+				node_accesses_.fill(0);
+				ratios_.fill(0);
+				av_latencies_.fill(samples::minimum_latency);
 
-				av_latency_     = {};
-				av_latency_ctr_ = {};
+				av_latency_ = {};
 
 				ratios_computed_ = false;
 
-				samples_count_ = {};
-
 				age_ = {};
+
+				last_update_ = {};
+				first_seen_  = {};
 			}
 
-			inline void add_data(const memory_sample_t & sample, const real_t aging_factor) {
+			inline void add_data(const memory_sample_t & sample, const tim_t now) {
 				const auto node = sample.page_node();
 
-				++samples_count_;
-
-				++raw_accesses_[node];
-
-				node_accesses_[node] += static_cast<real_t>(sample.reqs()) * aging_factor;
+				// Bring the counters to the current time before adding new accesses
+				const auto factor = decay::factor(last_update_, now);
+				if (factor < 1) {
+					system_info::for_each_node([&](const size_t n) { node_accesses_[n] *= factor; });
+				}
+				last_update_ = now;
+				if (first_seen_ == 0) { first_seen_ = now; }
 
+				// A sample may stand for several (pre-aggregated) samples: one request per sample
+				const auto reqs    = static_cast<real_t>(sample.reqs());
 				const auto latency = sample.latency();
 
-				av_latencies_[node] =
-				    (av_latencies_[node] * av_latencies_ctr_[node] + latency) / (av_latencies_ctr_[node] + 1);
-				++av_latencies_ctr_[node];
+				av_latencies_[node] = weighted_latency(av_latencies_[node], node_accesses_[node], latency, reqs);
+				av_latency_         = weighted_latency(av_latency_, total_accesses(), latency, reqs);
 
-				av_latency_ = (av_latency_ * av_latency_ctr_ + latency) / (av_latency_ctr_ + 1);
-				++av_latency_ctr_;
+				node_accesses_[node] += reqs;
 
 				last_pid_  = sample.tid();
 				last_node_ = system_info::node_from_cpu(sample.cpu());
 
+				page_size_ = sample.pagesize();
+
+				ratios_computed_ = false;
+			}
+
+			// Fold the statistics of another row (of the same memory) into this one
+			inline void merge(const row & other) {
+				const auto now = std::max(last_update_, other.last_update_);
+
+				const auto factor       = decay::factor(last_update_, now);
+				const auto other_factor = decay::factor(other.last_update_, now);
+
+				av_latency_ = weighted_latency(av_latency_, total_accesses() * factor, other.av_latency_,
+				                               other.total_accesses() * other_factor);
+
+				system_info::for_each_node([&](const size_t n) {
+					const auto weight       = node_accesses_[n] * factor;
+					const auto other_weight = other.node_accesses_[n] * other_factor;
+
+					av_latencies_[n] = weighted_latency(av_latencies_[n], weight, other.av_latencies_[n], other_weight);
+
+					node_accesses_[n] = weight + other_weight;
+				});
+
+				last_update_ = now;
+				if (first_seen_ == 0 || (other.first_seen_ != 0 && other.first_seen_ < first_seen_)) {
+					first_seen_ = other.first_seen_;
+				}
+
+				if (last_update_ == other.last_update_) {
+					last_pid_  = other.last_pid_;
+					last_node_ = other.last_node_;
+				}
+
 				ratios_computed_ = false;
 			}
 
+			// Based on the decayed samples, so a page that is no longer accessed stops having enough info
 			[[nodiscard]] inline auto enough_info() const {
-				return std::cmp_greater(samples_count_, SAMPLES_ENOUGH_INFO);
+				return hotness() > static_cast<real_t>(SAMPLES_ENOUGH_INFO);
 			}
 
-			[[nodiscard]] inline auto samples_count() const {
-				return samples_count_;
+			// Samples of the page (decayed to the current time)
+			[[nodiscard]] inline auto samples_count() const -> real_t {
+				return hotness();
+			}
+
+			// Accesses to the page (decayed to the current time)
+			[[nodiscard]] inline auto hotness() const -> real_t {
+				return total_accesses() * decay::factor(last_update_);
 			}
 
 			[[nodiscard]] inline auto age() const {
 				return age_;
 			}
 
+			[[nodiscard]] inline auto first_seen() const {
+				return first_seen_;
+			}
+
 			inline void increase_age() {
 				ratios_computed_ = false;
 				++age_;
 			}
 
-			[[nodiscard]] inline auto raw_accesses() const -> const auto & {
-				return raw_accesses_;
-			}
-
-			[[nodiscard]] inline auto raw_accesses(const node_t node) const {
-				return raw_accesses_[node];
-			}
-
-			[[nodiscard]] inline auto node_accesses() const -> const auto & {
-				return node_accesses_;
+			[[nodiscard]] inline auto node_accesses() const {
+				return node_accesses_.span();
 			}
 
 			[[nodiscard]] inline auto node_accesses(const node_t node) const {
 				return node_accesses_[node];
 			}
 
-			[[nodiscard]] inline auto node_accesses() {
-				return node_accesses_;
-			}
-
 			[[nodiscard]] inline auto preferred_node() const -> node_t {
-				return static_cast<node_t>(std::max_element(node_accesses_.begin(), node_accesses_.end()) -
-				                           node_accesses_.begin());
+				const auto accesses = node_accesses();
+				return static_cast<node_t>(std::max_element(accesses.begin(), accesses.end()) - accesses.begin());
 			}
 
-			[[nodiscard]] inline auto reqs_per_node() {
-				return node_accesses_;
+			[[nodiscard]] inline auto reqs_per_node() const {
+				return node_accesses();
 			}
 
-			[[nodiscard]] inline auto reqs_per_node() const -> const auto & {
-				return node_accesses_;
-			}
-
-			[[nodiscard]] inline auto ratios() const -> const auto & {
+			[[nodiscard]] inline auto ratios() const {
 				if (!ratios_computed_) { compute_ratios(); }
-				return ratios_;
+				return ratios_.span();
 			}
 
 			[[nodiscard]] inline auto ratio(const node_t node) const {
@@ -192,8 +251,8 @@ namespace performance {
 				return av_latencies_[node];
 			}
 
-			[[nodiscard]] inline auto av_latencies() const -> const auto & {
-				return av_latencies_;
+			[[nodiscard]] inline auto av_latencies() const {
+				return av_latencies_.span();
 			}
 
 			[[nodiscard]] inline auto last_pid() const {
@@ -204,6 +263,14 @@ namespace performance {
 				return last_node_;
 			}
 
+			[[nodiscard]] inline auto page_size() const {
+				return page_size_;
+			}
+
+			inline void page_size(const size_t bytes) {
+				page_size_ = bytes;
+			}
+
 			friend auto operator<<(std::ostream & os, const row & row) -> std::ostream & {
 				for (const auto & node : system_info::nodes()) {
 					os << row.node_accesses_[node] << " ";
@@ -211,11 +278,304 @@ namespace performance {
 				return os;
 			}
 		};
+		class shard {
+		private:
+			// Rows with fewer (decayed) accesses than this are dropped when pruning
+			static constexpr real_t MIN_HOTNESS = 0.05;
+
+			flat_page_table<row> table_ = {};
+
+			size_t prune_cursor_ = 0; // First row to be checked by the next call to prune()
+
+			candidate_queue by_ratio_{};
+			candidate_queue by_latency_{};
+
+			inline void update_candidates(const addr_t page, const row & info) {
+				if (!info.enough_info()) { return; }
+
+				const auto pref_node = info.preferred_node();
+
+				if (std::cmp_not_equal(pref_node, info.last_node())) {
+					by_ratio_.update(page, info.ratio(pref_node));
+				} else {
+					by_ratio_.erase(page);
+				}
+
+				by_latency_.update(page, static_cast<real_t>(info.av_latency()));
+			}
+
+			// The size of a page flips between base and huge when a THP is collapsed or split (or its backing is
+			// re-read), and so does its key. Keep a single row per THP: the rows of its base pages are folded into the
+			// row of the head when it becomes huge, and the row of the head only covers its first base page when the
+			// THP is split. All of them live in the same shard (see shard_idx)
+			inline void normalize_huge_page(const addr_t page, const size_t size) {
+				const auto thp_size = memory_info::thp_size();
+				const auto base     = static_cast<size_t>(memory_info::pagesize);
+
+				if (std::cmp_equal(thp_size, 0) || memory_info::fake_thp_enabled()) { return; }
+
+				if (std::cmp_equal(size, thp_size)) {
+					const auto head = table_.find(page);
+					if (head != table_.end() && std::cmp_equal(head->second.page_size(), thp_size)) { return; }
+
+					row  folded{};
+					bool any = false;
+
+					for (auto addr = page + base; addr < page + thp_size; addr += base) {
+						const auto it = table_.find(addr);
+						if (it == table_.end()) { continue; }
+
+						folded.merge(it->second);
+						any = true;
+						erase(addr);
+					}
+
+					if (any) {
+						auto & info = table_.try_emplace(page, folded.last_pid(), folded.last_node());
+						info.merge(folded);
+					}
+				} else if (std::cmp_equal(size, base)) {
+					const auto head_addr = page & ~static_cast<addr_t>(thp_size - 1);
+					if (head_addr == page) { return; }
+
+					const auto head = table_.find(head_addr);
+					if (head != table_.end() && std::cmp_equal(head->second.page_size(), thp_size)) {
+						head->second.page_size(base);
+					}
+				}
+			}
+
+			req_t accesses_   = 0;
+			lat_t av_latency_ = samples::minimum_latency;
+
+			std::vector<lat_t> node_latencies_{};
+			std::vector<req_t> node_accesses_{};
+
+		public:
+			shard() noexcept :
+			    node_latencies_(system_info::max_node() + 1, samples::minimum_latency),
+			    node_accesses_(system_info::max_node() + 1, 0) {
+			}
+
+			[[nodiscard]] inline auto table() -> auto & {
+				return table_;
+			}
+
+			[[nodiscard]] inline auto table() const -> const auto & {
+				return table_;
+			}
+
+			[[nodiscard]] inline auto accesses() const {
+				return accesses_;
+			}
+
+			[[nodiscard]] inline auto av_latency() const {
+				return av_latency_;
+			}
+
+			[[nodiscard]] inline auto candidates(const candidate_t kind) -> candidate_queue & {
+				return kind == candidate_t::BY_RATIO ? by_ratio_ : by_latency_;
+			}
+
+			[[nodiscard]] inline auto candidates(const candidate_t kind) const -> const candidate_queue & {
+				return kind == candidate_t::BY_RATIO ? by_ratio_ : by_latency_;
+			}
+
+			inline void erase(const addr_t page) {
+				table_.erase(page);
+				by_ratio_.erase(page);
+				by_latency_.erase(page);
+			}
+
+			[[nodiscard]] inline auto node_latencies() const -> const auto & {
+				return node_latencies_;
+			}
+
+			[[nodiscard]] inline auto node_accesses() const -> const auto & {
+				return node_accesses_;
+			}
+
+			inline void clear_aggregates() {
+				accesses_   = 0;
+				av_latency_ = samples::minimum_latency;
+
+				std::fill(node_latencies_.begin(), node_latencies_.end(), samples::minimum_latency);
+				std::fill(node_accesses_.begin(), node_accesses_.end(), req_t());
+			}
+
+			// Remove (a slice of) the rows that are no longer mapped or whose accesses have decayed away
+			inline void prune(const size_t max_rows) {
+				prune_cursor_ = table_.erase_if(prune_cursor_, max_rows, [this](const auto & el) {
+					const auto & [page, info] = el;
+
+					const bool remove = info.hotness() < MIN_HOTNESS || !memory_info::contains(page);
+					if (remove) {
+						by_ratio_.erase(page);
+						by_latency_.erase(page);
+					}
+					return remove;
+				});
+			}
+
+			inline void add_data(const memory_sample_t & sample, const tim_t now) {
+				const auto page = sample.page();
+
+				normalize_huge_page(page, sample.pagesize());
+
+				// We init the entry if it doesn't exist
+				auto & info = table_.try_emplace(page, sample.tid(), sample.page_node());
+				info.add_data(sample, now);
+
+				update_candidates(page, info);
+
+				const auto node    = sample.page_node();
+				const auto latency = sample.latency();
+				const auto reqs    = sample.reqs();
+
+				node_latencies_[node] =
+				    (node_accesses_[node] * node_latencies_[node] + latency * reqs) / (node_accesses_[node] + reqs);
+				node_accesses_[node] += reqs;
+
+				av_latency_ = (av_latency_ * accesses_ + latency * reqs) / (accesses_ + reqs);
+				accesses_ += reqs;
+			}
+		};
+
+		// Iterates over the entries of all the shards as if it was a single table
+		template<bool Const>
+		class joined_iterator {
+		private:
+			using shards_t = std::conditional_t<Const, const std::vector<shard>, std::vector<shard>>;
+			using inner_t  = std::conditional_t<Const, flat_page_table<row>::const_iterator,
+			                                    flat_page_table<row>::iterator>;
+
+			shards_t * shards_ = nullptr;
+			size_t     idx_    = 0;
+			inner_t    it_     = {};
+
+			// Move to the next shard with elements (or to the end)
+			inline void skip_empty_shards() {
+				while (std::cmp_less(idx_, shards_->size()) && it_ == (*shards_)[idx_].table().end()) {
+					++idx_;
+					if (std::cmp_less(idx_, shards_->size())) { it_ = (*shards_)[idx_].table().begin(); }
+				}
+			}
+
+		public:
+			using iterator_category = std::forward_iterator_tag;
+			using value_type        = flat_page_table<row>::value_type;
+			using difference_type   = std::ptrdiff_t;
+			using reference         = std::conditional_t<Const, const value_type &, value_type &>;
+			using pointer           = std::conditional_t<Const, const value_type *, value_type *>;
+
+			joined_iterator() = default;
+
+			joined_iterator(shards_t * shards, const size_t idx, inner_t it) : shards_(shards), idx_(idx), it_(it) {
+				skip_empty_shards();
+			}
+
+			[[nodiscard]] inline auto operator*() const -> reference {
+				return *it_;
+			}
+
+			[[nodiscard]] inline auto operator->() const -> pointer {
+				return &(*it_);
+			}
+
+			inline auto operator++() -> joined_iterator & {
+				++it_;
+				skip_empty_shards();
+				return *this;
+			}
+
+			inline auto operator++(int) -> joined_iterator {
+				auto old = *this;
+				++(*this);
+				return old;
+			}
+
+			[[nodiscard]] friend inline auto operator==(const joined_iterator & a, const joined_iterator & b) -> bool {
+				if (a.shards_ == nullptr || b.shards_ == nullptr) { return a.shards_ == b.shards_; }
+				return a.idx_ == b.idx_ && (std::cmp_equal(a.idx_, a.shards_->size()) || a.it_ == b.it_);
+			}
+		};
+
+		// Persistent worker threads, one per shard, pinned to the node of the shard. run() hands the same task to all
+		// of them and waits until every one has finished its shard
+		class shard_workers {
+		private:
+			std::mutex                  mtx_;
+			std::condition_variable_any work_cv_;
+			std::condition_variable     done_cv_;
+
+			const std::function<void(size_t)> * task_       = nullptr;
+			size_t                              generation_ = 0;
+			size_t                              pending_    = 0;
+
+			// Declared last: destroyed (stopped and joined) before the synchronization primitives
+			std::vector<std::jthread> threads_{};
+
+			inline void work(const std::stop_token & stop, const size_t idx) {
+				// Nodes may be sparse (or restricted by the cpuset), so shard ids are mapped to the available nodes
+				const auto & nodes = system_info::nodes();
+				numa_run_on_node(static_cast<int>(nodes[idx % nodes.size()]));
+
+				size_t seen = 0;
+
+				while (true) {
+					std::unique_lock lock(mtx_);
+					if (!work_cv_.wait(lock, stop, [&] { return generation_ != seen; })) { return; }
+					seen = generation_;
+					lock.unlock();
+
+					(*task_)(idx);
+
+					lock.lock();
+					if (--pending_ == 0) { done_cv_.notify_one(); }
+				}
+			}
+
+		public:
+			explicit shard_workers(const size_t n) {
+				threads_.reserve(n);
+				for (size_t idx = 0; idx < n; ++idx) {
+					threads_.emplace_back([this, idx](const std::stop_token & stop) { work(stop, idx); });
+				}
+			}
+
+			shard_workers(const shard_workers &)                     = delete;
+			auto operator=(const shard_workers &) -> shard_workers & = delete;
+
+			~shard_workers() = default;
+
+			inline void run(const std::function<void(size_t)> & task) {
+				std::unique_lock lock(mtx_);
+				task_    = &task;
+				pending_ = threads_.size();
+				++generation_;
+				work_cv_.notify_all();
+
+				done_cv_.wait(lock, [&] { return pending_ == 0; });
+				task_ = nullptr;
+			}
+		};
 	} // namespace memtable_details
 
+	// Table of memory pages split into shards by page hash. Ingestion and scans of big tables are distributed among
+	// worker threads, one per shard, pinned to the node the shard is associated to.
 	class mempages_table {
 	private:
-		fast_umap<addr_t, memtable_details::row> table_ = {};
+		using shard_t = memtable_details::shard;
+
+		// Minimum number of elements for an operation to be worth it to run in parallel
+		static constexpr size_t PARALLEL_THRESHOLD = 4096;
+
+		// Rows of each shard checked per interval when pruning: the whole table is checked every PRUNE_FRACTION
+		// intervals (or faster, for small tables)
+		static constexpr size_t MIN_PRUNE_ROWS = 4096;
+		static constexpr size_t PRUNE_FRACTION = 8;
+
+		std::vector<shard_t> shards_ = {};
 
 		req_t accesses_   = 0;
 		lat_t av_latency_ = samples::minimum_latency;
@@ -223,30 +583,114 @@ namespace performance {
 		std::vector<lat_t> node_latencies_{};
 		std::vector<req_t> node_accesses_{};
 
+		// Samples to insert in each shard (kept between calls to save allocations)
+		std::vector<std::vector<memory_sample_t>> routed_{};
+
+		// Started the first time an operation runs in parallel (when the nodes of the system are already known).
+		// Copies of the table share them: run() blocks, so only one table uses them at a time
+		std::shared_ptr<memtable_details::shard_workers> workers_{};
+
+		[[nodiscard]] inline auto shard_idx(const addr_t page) const -> size_t {
+			// Fibonacci hashing of the THP number (low bits of the address carry no information). All the base pages
+			// of a THP go to the same shard, so the shard can keep a single row for it
+			const auto unit = std::max(static_cast<size_t>(memory_info::pagesize), memory_info::thp_size());
+			return ((page / unit) * 0x9E3779B97F4A7C15ULL >> 32) % shards_.size();
+		}
+
+		[[nodiscard]] inline auto shard_for(const addr_t page) -> auto & {
+			return shards_[shard_idx(page)];
+		}
+
+		[[nodiscard]] inline auto shard_for(const addr_t page) const -> const auto & {
+			return shards_[shard_idx(page)];
+		}
+
+		[[nodiscard]] inline auto at(const addr_t page) const -> const auto & {
+			return shard_for(page).table().at(page);
+		}
+
+		[[nodiscard]] inline auto at(const addr_t page) -> auto & {
+			return shard_for(page).table().at(page);
+		}
+
+		// Run f(shard) for every shard, using the worker thread of each shard if requested.
+		template<typename F>
+		inline void for_each_shard(F && f, const bool parallel) {
+			if (!parallel || std::cmp_equal(shards_.size(), 1)) {
+				for (auto & shard : shards_) {
+					f(shard);
+				}
+				return;
+			}
+
+			if (!workers_) { workers_ = std::make_shared<memtable_details::shard_workers>(shards_.size()); }
+
+			workers_->run([&](const size_t idx) { f(shards_[idx]); });
+		}
+
+		// Merge the aggregated per-node values of all the shards
+		inline void merge_shards() {
+			accesses_ = 0;
+			std::fill(node_accesses_.begin(), node_accesses_.end(), req_t());
+			std::fill(node_latencies_.begin(), node_latencies_.end(), lat_t());
+
+			lat_t latency_sum = 0;
+
+			for (const auto & shard : shards_) {
+				accesses_ += shard.accesses();
+				latency_sum += shard.av_latency() * shard.accesses();
+
+				for (const auto & node : system_info::nodes()) {
+					node_accesses_[node] += shard.node_accesses()[node];
+					node_latencies_[node] += shard.node_latencies()[node] * shard.node_accesses()[node];
+				}
+			}
+
+			av_latency_ = accesses_ > 0 ? latency_sum / accesses_ : samples::minimum_latency;
+
+			for (const auto & node : system_info::nodes()) {
+				node_latencies_[node] = node_accesses_[node] > 0 ? node_latencies_[node] / node_accesses_[node] :
+				                                                   samples::minimum_latency;
+			}
+		}
+
 	public:
-		mempages_table() noexcept :
+		using iterator       = memtable_details::joined_iterator<false>;
+		using const_iterator = memtable_details::joined_iterator<true>;
+
+		mempages_table() : mempages_table(system_info::max_node() + 1) {
+		}
+
+		explicit mempages_table(const size_t n_shards) :
+		    shards_(std::max<size_t>(n_shards, 1)),
 		    node_latencies_(system_info::max_node() + 1, samples::minimum_latency),
-		    node_accesses_(system_info::max_node() + 1, 0) {
+		    node_accesses_(system_info::max_node() + 1, 0),
+		    routed_(shards_.size()) {
 		}
 
-		[[nodiscard]] inline auto begin() const {
-			return table_.begin();
+		[[nodiscard]] inline auto begin() const -> const_iterator {
+			return { &shards_, 0, shards_.front().table().begin() };
 		}
 
-		[[nodiscard]] inline auto end() const {
-			return table_.end();
+		[[nodiscard]] inline auto end() const -> const_iterator {
+			return { &shards_, shards_.size(), {} };
 		}
 
-		[[nodiscard]] inline auto begin() {
-			return table_.begin();
+		[[nodiscard]] inline auto begin() -> iterator {
+			return { &shards_, 0, shards_.front().table().begin() };
 		}
 
-		[[nodiscard]] inline auto end() {
-			return table_.end();
+		[[nodiscard]] inline auto end() -> iterator {
+			return { &shards_, shards_.size(), {} };
 		}
 
 		[[nodiscard]] inline auto size() const {
-			return table_.size();
+			return std::accumulate(shards_.begin(), shards_.end(), size_t(),
+			                       [](const auto & acc, const auto & shard) { return acc + shard.table().size(); });
+		}
+
+		[[nodiscard]] inline auto n_shards() const {
+			return shards_.size();
 		}
 
 		[[nodiscard]] static inline auto threshold_enough_info() {
@@ -254,68 +698,124 @@ namespace performance {
 		}
 
 		[[nodiscard]] inline auto pages_with_enough_info() const {
-			return std::accumulate(table_.begin(), table_.end(), size_t(), [&](const auto & acc, const auto & el) {
+			return std::accumulate(begin(), end(), size_t(), [&](const auto & acc, const auto & el) {
 				const auto & [addr, info] = el;
 				return acc + (info.enough_info() ? 1 : 0);
 			});
 		}
 
+		// Start a new interval. Counters of the rows decay lazily, so there is no need to reset them: only a slice of
+		// each shard is checked to drop the pages that are no longer mapped or whose accesses have decayed away.
 		inline void clear_it() {
-			if (memory_info::fake_thp_enabled()) {
-				const auto LAST_SIZE = table_.size();
-				// Clear the table completely
-				table_.clear();
-				// Preallocate to save some time
-				table_.reserve(LAST_SIZE);
-			} else {
-				// Clear non-valid contents
-				std::set<addr_t> to_remove;
-
-				for (auto & [addr, info] : table_) {
-					if (!memory_info::contains(addr)) { to_remove.insert(addr); }
-				}
+			for_each_shard(
+			    [](shard_t & shard) {
+				    shard.prune(std::max(MIN_PRUNE_ROWS, shard.table().size() / PRUNE_FRACTION));
+			    },
+			    std::cmp_greater_equal(size(), PARALLEL_THRESHOLD));
+
+			for (auto & shard : shards_) {
+				shard.clear_aggregates();
+			}
 
-				for (const auto & addr : to_remove) {
-					table_.erase(addr);
-				}
+			accesses_   = 0;
+			av_latency_ = samples::minimum_latency;
 
-				accesses_   = 0;
-				av_latency_ = samples::minimum_latency;
+			std::fill(node_latencies_.begin(), node_latencies_.end(), samples::minimum_latency);
+			std::fill(node_accesses_.begin(), node_accesses_.end(), req_t());
+		}
 
-				std::fill(node_latencies_.begin(), node_latencies_.end(), samples::minimum_latency);
-				std::fill(node_accesses_.begin(), node_accesses_.end(), size_t());
-			}
+		[[nodiscard]] inline auto find(const addr_t page) -> iterator {
+			const auto idx = shard_idx(page);
+			const auto it  = shards_[idx].table().find(page);
+
+			if (it == shards_[idx].table().end()) { return end(); }
+
+			return { &shards_, idx, it };
 		}
 
-		[[nodiscard]] inline auto find(const addr_t page) {
-			return table_.find(page);
+		// Random page of the table, picked in O(1) thanks to the densely stored rows of the shards
+		[[nodiscard]] inline auto random_page() -> iterator {
+			if (std::cmp_equal(size(), 0)) { return end(); }
+
+			auto r = utils::arithmetic::rnd(size_t(), size());
+
+			for (size_t idx = 0; std::cmp_less(idx, shards_.size()); ++idx) {
+				auto & table = shards_[idx].table();
+
+				if (std::cmp_greater_equal(r, table.size())) {
+					r -= table.size();
+					continue;
+				}
+
+				return { &shards_, idx, { &table, r } };
+			}
+
+			return end();
 		}
 
 		inline void remove_entry(const addr_t page) {
-			table_.erase(page);
+			shard_for(page).erase(page);
 		}
 
-		inline void add_data(const memory_sample_t & sample, real_t aging_factor = 1.0) {
-			const auto page = sample.page();
+		// Number of candidates of the given kind
+		[[nodiscard]] inline auto n_candidates(const candidate_t kind) const {
+			return std::accumulate(shards_.begin(), shards_.end(), size_t(), [&](const size_t acc, const shard_t & s) {
+				return acc + s.candidates(kind).size();
+			});
+		}
+
+		// Take the best candidate (page, score) of the given kind if its score is over min_score.
+		// O(#shards + log M). Popped candidates leave the queue until they are requeued (if they are not migrated) or
+		// new samples make them candidates again.
+		[[nodiscard]] inline auto pop_candidate(const candidate_t kind, const real_t min_score)
+		    -> std::optional<candidate_queue::value_type> {
+			shard_t * best = nullptr;
+
+			for (auto & shard : shards_) {
+				const auto top = shard.candidates(kind).top();
+				if (!top.has_value()) { continue; }
 
-			auto table_it = table_.find(page);
-			if (table_it == table_.end()) { // = !contains(). We init the entry if it doesn't exist
-				std::tie(table_it, std::ignore) = table_.insert({ page, { sample.tid(), sample.page_node() } });
+				if (best == nullptr || top->second > best->candidates(kind).top()->second) { best = &shard; }
 			}
 
-			auto & info = table_it->second;
-			info.add_data(sample, aging_factor);
+			if (best == nullptr || best->candidates(kind).top()->second <= min_score) { return std::nullopt; }
+
+			return best->candidates(kind).pop();
+		}
+
+		// Put back a popped candidate that was not migrated (if the page is still in the table)
+		inline void requeue_candidate(const candidate_t kind, const candidate_queue::value_type & candidate) {
+			auto & shard = shard_for(candidate.first);
+			if (!shard.table().contains(candidate.first)) { return; }
 
-			const auto node    = sample.page_node();
-			const auto latency = sample.latency();
-			const auto reqs    = sample.reqs();
+			shard.candidates(kind).update(candidate.first, candidate.second);
+		}
+
+		inline void add_data(const memory_sample_t & sample) {
+			shard_for(sample.page()).add_data(sample, decay::now());
+			merge_shards();
+		}
 
-			node_latencies_[node] =
-			    (node_accesses_[node] * node_latencies_[node] + latency * reqs) / (node_accesses_[node] + reqs);
-			node_accesses_[node] += reqs;
+		// Insert a batch of samples. Samples are routed to their shards and every shard is updated by its own worker.
+		inline void add_data(const std::vector<memory_sample_t> & samples) {
+			// The whole batch is considered to arrive at the same time
+			const auto now = decay::now();
 
-			av_latency_ = (av_latency_ * accesses_ + latency * reqs) / (accesses_ + reqs);
-			accesses_ += reqs;
+			for (const auto & sample : samples) {
+				routed_[shard_idx(sample.page())].emplace_back(sample);
+			}
+
+			for_each_shard(
+			    [&](shard_t & shard) {
+				    auto & routed = routed_[static_cast<size_t>(&shard - shards_.data())];
+				    for (const auto & data : routed) {
+					    shard.add_data(data, now);
+				    }
+				    routed.clear();
+			    },
+			    std::cmp_greater_equal(samples.size(), PARALLEL_THRESHOLD));
+
+			merge_shards();
 		}
 
 		[[nodiscard]] inline auto node_min_av_latency() const {
@@ -345,32 +845,27 @@ namespace performance {
 		}
 
 		[[nodiscard]] inline auto ratios(const addr_t page) const {
-			return table_.at(page).ratios();
+			return at(page).ratios();
 		}
 
 		[[nodiscard]] inline auto node(const addr_t page) const {
-			return table_.at(page).last_node();
+			return at(page).last_node();
 		}
 
 		[[nodiscard]] inline auto preferred_node(const addr_t page) const {
-			return table_.at(page).preferred_node();
-		}
-
-		[[nodiscard]] inline auto reqs_per_node(const addr_t page) {
-			return table_.at(page).reqs_per_node();
+			return at(page).preferred_node();
 		}
 
-		[[nodiscard]] inline auto reqs_per_node(const addr_t page) const -> const auto & {
-			const auto & row = table_.at(page);
-			return row.reqs_per_node();
+		[[nodiscard]] inline auto reqs_per_node(const addr_t page) const {
+			return at(page).reqs_per_node();
 		}
 
 		[[nodiscard]] inline auto av_latency(const addr_t page) const {
-			return table_.at(page).av_latency();
+			return at(page).av_latency();
 		}
 
 		[[nodiscard]] inline auto av_latency(const addr_t page, const node_t node) const {
-			return table_.at(page).av_latency(node);
+			return at(page).av_latency(node);
 		}
 
 		[[nodiscard]] inline auto rel_latency(const addr_t page) const {
@@ -378,12 +873,12 @@ namespace performance {
 		}
 
 		[[nodiscard]] inline auto last_pid_to_access(const addr_t page) const {
-			return table_.at(page).last_pid();
+			return at(page).last_pid();
 		}
 
 		friend auto operator<<(std::ostream & os, const mempages_table & t) -> std::ostream & {
-			os << "Entries: " << t.table_.size() << ". Global av. lat: " << utils::string::to_string(t.av_latency_, 2)
-			   << '\n';
+			os << "Entries: " << t.size() << " (" << t.n_shards() << " shards)"
+			   << ". Global av. lat: " << utils::string::to_string(t.av_latency_, 2) << '\n';
 
 			tabulate::Table node_latencies_table;
 			node_latencies_table.add_row({ "NODE", "AV. LATENCY", "AV. LATENCY\nNORMALISED (%)" });
@@ -401,7 +896,7 @@ namespace performance {
 			                    "REL. LATENCY\nSYSTEM (%)", "AV. LATENCY\nPER NODE", "ACCESSES\nPER NODE",
 			                    "RELATIVE\nACCESSES (%)" });
 
-			for (const auto & [page, row] : t.table_) {
+			for (const auto & [page, row] : t) {
 				auto start = page;
 				auto end   = page + memory_info::pagesize;
 
@@ -409,7 +904,7 @@ namespace performance {
 					const auto thp_opt = memory_info::fake_thp_from_address(start);
 
 					if (thp_opt.has_value()) {
-						const auto & thp = thp_opt.value().get();
+						const auto & thp = thp_opt.value();
 
 						start = thp.start();
 						end   = thp.end();
@@ -12,20 +12,21 @@
 
 #include <algorithm>          // for fill, max_element
 #include <chrono>             // for system_clock::time_...
-#include <cmath>              // for isnormal, pow, exp
-#include <ext/alloc_traits.h> // for __alloc_traits<>::v...
+#include <cmath>              // for isnormal, pow, exp, llround
+#include <cstdint>            // for uint8_t
 #include <iostream>           // for ostream
 #include <numeric>            // for accumulate
 #include <string>             // for string, to_string
 #include <unistd.h>           // for sysconf, _SC_LEVEL1...
 #include <variant>            // for variant
-#include <vector>             // for vector, vector<>::c...
 
+#include "migration/performance/decay.hpp"       // for factor, now
 #include "migration/performance/performance.hpp" // for PERFORMANCE_INVALID...
 #include "migration/utils/inst_sample.hpp"       // for inst_sample_t
 #include "migration/utils/mem_sample.hpp"        // for memory_sample_t
 #include "migration/utils/reqs_sample.hpp"       // for reqs_sample_t
 #include "samples/perf_event/perf_event.hpp"     // for minimum_latency
+#include "system_info/node_array.hpp"            // for node_array, for_each_node
 #include "system_info/system_info.hpp"           // for num_of_nodes, node_...
 #include "tabulate/tabulate.hpp"                 // for Table, Format, Font...
 #include "utils/string.hpp"                      // for to_string
@@ -42,61 +43,88 @@ namespace performance {
 		static constexpr real_t BETA  = 1.0;
 		static constexpr real_t GAMMA = 1.0;
 
-		std::vector<ins_t> flops_{};      // Number of Floating Point operations executed in each node.
-		std::vector<ins_t> inst_{};       // Number of instructions executed in each node.
-		std::vector<req_t> total_reqs_{}; // Total number of memory requests in each node (from "REQ" samples).
-		std::vector<tim_t> times_{};      // Time (in nanoseconds) consumed by the instructions and requests.
+		// Per-node data is stored inline (there is one rm3d per TID, so this saves 9 heap allocations per thread).
+		// Counters decay continuously, so they are kept as real numbers: rounding them would stop small counts from
+		// decaying at all (while big ones do), skewing the ratios among them
+		system_info::node_array<real_t> flops_{};      // Number of Floating Point operations executed in each node.
+		system_info::node_array<real_t> inst_{};       // Number of instructions executed in each node.
+		system_info::node_array<real_t> total_reqs_{}; // Total number of memory requests in each node ("REQ" samples).
+		system_info::node_array<real_t> times_{};      // Time (in ns) consumed by the instructions and requests.
 
-		std::vector<req_t> node_reqs_{}; // Number of memory requests to each memory node (from memory samples).
-		std::vector<lat_t> mean_lat_{};  // Mean latency of memory accesses to each node. Integer is precise enough.
+		system_info::node_array<real_t> node_reqs_{}; // Number of memory requests to each memory node (memory samples).
+		system_info::node_array<lat_t>  mean_lat_{};  // Mean latency of memory accesses to each node.
 
-		std::vector<real_t>     perfs_{};        // 3DyRM performance per memory node.
-		std::vector<time_point> perfs_time_{};   // Time at which 3DyRM performance was updated by last time.
-		std::vector<bool>       perfs_update_{}; // 3DyRM performance needs to be recalculated.
+		system_info::node_array<real_t>     perfs_{};        // 3DyRM performance per memory node.
+		system_info::node_array<time_point> perfs_time_{};   // Last time the 3DyRM performance was updated.
+		system_info::node_array<uint8_t>    perfs_update_{}; // 3DyRM performance needs to be recalculated.
+
+		tim_t last_update_ = 0; // Time of the last update of the counters (they decay lazily)
+
+		// Decay the counters to the current time. All of them decay at the same pace, so the ratios among them
+		// (Ops/s, Ops/B) are kept
+		inline void decay_counters() {
+			const auto now    = decay::now();
+			const auto factor = decay::factor(last_update_, now);
+
+			last_update_ = now;
+
+			if (factor >= 1) { return; }
+
+			system_info::for_each_node([&](const size_t node) {
+				flops_[node] *= factor;
+				inst_[node] *= factor;
+				total_reqs_[node] *= factor;
+				times_[node] *= factor;
+				node_reqs_[node] *= factor;
+			});
+		}
 
 	public:
 		rm3d() :
-		    flops_(system_info::max_node() + 1, 0),
-		    inst_(system_info::max_node() + 1, 0),
-		    total_reqs_(system_info::max_node() + 1, 0),
-		    times_(system_info::max_node() + 1, 0),
-		    node_reqs_(system_info::max_node() + 1, 0),
-		    mean_lat_(system_info::max_node() + 1, samples::minimum_latency),
-		    perfs_(system_info::max_node() + 1, PERFORMANCE_INVALID_VALUE),
-		    perfs_time_(system_info::max_node() + 1, hres_clock::now()),
-		    perfs_update_(system_info::max_node() + 1, false) {
+		    mean_lat_(samples::minimum_latency),
+		    perfs_(PERFORMANCE_INVALID_VALUE),
+		    perfs_time_(hres_clock::now()),
+		    perfs_update_(false) {
 		}
 
 		inline void add_data(const inst_sample_t & data) {
+			decay_counters();
+
 			const auto node = system_info::node_from_cpu(data.cpu());
 
 			if (data.flop()) {
-				flops_[node] += data.inst() * data.multiplier();
+				flops_[node] += static_cast<real_t>(data.inst() * data.multiplier());
 			} else {
-				inst_[node] += data.inst() * data.multiplier();
+				inst_[node] += static_cast<real_t>(data.inst() * data.multiplier());
 			}
-			times_[node] += data.time();
+			times_[node] += static_cast<real_t>(data.time());
 
 			perfs_update_[node] = true;
 		}
 
 		inline void add_data(const reqs_sample_t & data) {
+			decay_counters();
+
 			const auto node = system_info::node_from_cpu(data.cpu());
 
-			total_reqs_[node] += data.reqs();
+			total_reqs_[node] += static_cast<real_t>(data.reqs());
 
 			perfs_update_[node] = true;
 		}
 
 		inline void add_data(const memory_sample_t & data) {
+			decay_counters();
+
 			const auto src_node = system_info::node_from_cpu(data.cpu());
 			const auto dst_node = data.page_node();
 
-			const auto latency = data.latency();
-			const auto reqs    = data.reqs();
+			const auto latency = static_cast<real_t>(data.latency());
+			const auto reqs    = static_cast<real_t>(data.reqs());
+
+			const auto mean_lat = static_cast<real_t>(mean_lat_[dst_node]);
 
-			mean_lat_[dst_node] =
-			    (mean_lat_[dst_node] * node_reqs_[dst_node] + latency * reqs) / (node_reqs_[dst_node] + reqs);
+			mean_lat_[dst_node] = static_cast<lat_t>(
+			    std::lround((mean_lat * node_reqs_[dst_node] + latency * reqs) / (node_reqs_[dst_node] + reqs)));
 			node_reqs_[dst_node] += reqs;
 
 			perfs_update_[src_node] = true;
@@ -108,13 +136,13 @@ namespace performance {
 			const real_t seconds =
 			    static_cast<real_t>(times_[node]) / 1e9F; // 10^9 as times are measured in nanoseconds
 
-			return static_cast<real_t>(inst_[node] + flops_[node]) / seconds;
+			return (inst_[node] + flops_[node]) / seconds;
 		}
 
 		[[nodiscard]] inline auto ops_per_byte(const node_t node) const {
 			if (!std::isnormal(total_reqs_[node])) { return real_t(); }
 
-			return ops_per_second(node) / static_cast<real_t>(total_reqs_[node] * CACHE_LINE_SIZE);
+			return ops_per_second(node) / (total_reqs_[node] * static_cast<real_t>(CACHE_LINE_SIZE));
 		}
 
 		[[nodiscard]] inline auto av_latency(const node_t node) const {
@@ -152,9 +180,9 @@ namespace performance {
 		}
 
 		inline void calc_perf() {
-			for (const auto & node : system_info::nodes()) {
-				if (perfs_update_[node]) { calc_perf(node); }
-			}
+			system_info::for_each_node([&](const size_t node) {
+				if (perfs_update_[node]) { calc_perf(static_cast<node_t>(node)); }
+			});
 		}
 
 		// Function to compute the decay. According to temporal locality principle, recently accessed data is likely to
@@ -186,39 +214,38 @@ namespace performance {
 		}
 
 		[[nodiscard]] inline auto node_reqs(const node_t node) const -> req_t {
-			return node_reqs_[node];
+			return static_cast<req_t>(std::llround(node_reqs_[node]));
 		}
 
 		[[nodiscard]] inline auto scaled_node_reqs() const {
-			const auto scale = std::accumulate(total_reqs_.begin(), total_reqs_.end(), 0.0) /
-			                   std::accumulate(node_reqs_.begin(), node_reqs_.end(), 0.0);
+			auto scale = std::accumulate(total_reqs_.begin(), total_reqs_.end(), 0.0) /
+			             std::accumulate(node_reqs_.begin(), node_reqs_.end(), 0.0);
 
-			if (!std::isnormal(scale) || scale <= 0) { return node_reqs_; }
+			if (!std::isnormal(scale) || scale <= 0) { scale = 1; }
 
-			auto scaled_reqs = node_reqs_;
+			system_info::node_array<req_t> scaled_reqs{};
 
-			for (auto & reqs : scaled_reqs) {
-				reqs = static_cast<req_t>(static_cast<real_t>(reqs) * scale);
-			}
+			system_info::for_each_node([&](const size_t node) {
+				scaled_reqs[node] = static_cast<req_t>(std::llround(node_reqs_[node] * scale));
+			});
 
 			return scaled_reqs;
 		}
 
 		[[nodiscard]] inline auto scaled_node_reqs(const node_t node) const {
-			const auto scale =
-			    static_cast<real_t>(total_reqs_[node]) / (std::accumulate(node_reqs_.begin(), node_reqs_.end(), 0.0));
+			const auto scale = total_reqs_[node] / (std::accumulate(node_reqs_.begin(), node_reqs_.end(), 0.0));
 
-			auto scaled_reqs = node_reqs_;
+			system_info::node_array<req_t> scaled_reqs{};
 
-			for (auto & reqs : scaled_reqs) {
-				reqs *= static_cast<req_t>(static_cast<real_t>(reqs) * scale);
-			}
+			system_info::for_each_node([&](const size_t n) {
+				scaled_reqs[n] = static_cast<req_t>(std::llround(node_reqs_[n] * node_reqs_[n] * scale));
+			});
 
 			return scaled_reqs;
 		}
 
 		inline void reset() {
-			for (const auto & node : system_info::nodes()) {
+			system_info::for_each_node([&](const size_t node) {
 				flops_[node]      = {};
 				inst_[node]       = {};
 				total_reqs_[node] = {};
@@ -226,14 +253,14 @@ namespace performance {
 
 				node_reqs_[node] = {};
 				mean_lat_[node]  = {};
-			}
+			});
 		}
 
 		inline void hard_reset() {
 			reset();
-			fill(perfs_.begin(), perfs_.end(), PERFORMANCE_INVALID_VALUE);
-			fill(perfs_update_.begin(), perfs_update_.end(), false);
-			fill(perfs_time_.begin(), perfs_time_.end(), hres_clock::now());
+			perfs_.fill(PERFORMANCE_INVALID_VALUE);
+			perfs_update_.fill(false);
+			perfs_time_.fill(hres_clock::now());
 		}
 
 		[[nodiscard]] inline auto operator[](const node_t node) const {
@@ -12,12 +12,17 @@
 
 #include <algorithm>          // for fill
 #include <cmath>              // for isnormal
+#include <cstddef>            // for ptrdiff_t
+#include <iterator>           // for forward_iterator_tag
+#include <limits>             // for numeric_limits
 #include <ext/alloc_traits.h> // for __alloc_traits<>::v...
 #include <iostream>           // for operator<<, ostream
 #include <memory>             // for allocator_traits<>:...
+#include <optional>           // for optional, nullopt
 #include <string>             // for string, to_string
 #include <sys/types.h>        // for pid_t, size_t
 #include <type_traits>        // for add_const<>::type
+#include <utility>            // for pair, cmp_less
 #include <variant>            // for variant
 #include <vector>             // for vector
 
@@ -56,6 +61,11 @@ namespace performance {
 				running_ = false;
 			}
 
+			// The counters of the performance data decay lazily, so only the running state is reset
+			inline void new_interval() {
+				running_ = false;
+			}
+
 			template<class T>
 			inline void add_data(const T & data) {
 				performance_.add_data(data);
@@ -105,9 +115,27 @@ namespace performance {
 		};
 	} // namespace details
 
+	// Threads are given a dense slot when they are added to the table, so per-thread data is kept in flat arrays
+	// (indexed by slot) and the TID -> slot lookup is only needed once per sample (or batch of samples of a thread).
+	// Slots of removed threads are reused by new ones.
 	class tid_perf_table {
+	public:
+		using value_type = std::pair<pid_t, details::row>;
+
 	private:
-		mutable fast_umap<pid_t, details::row> table_ = {};
+		static constexpr size_t NO_SLOT = std::numeric_limits<size_t>::max();
+		static constexpr pid_t  NO_TID  = -1;
+
+		std::vector<value_type>            entries_{};    // entries_[slot] = { TID, row } (NO_TID if the slot is free)
+		std::vector<pid_t>                 pids_{};       // pids_[slot] = PID of the thread (updated in calc_perf)
+		std::vector<std::optional<real_t>> rel_perfs_{};  // rel_perfs_[slot] = relative performance (from calc_perf,
+		                                                  // reset when new data of the thread is added)
+		std::vector<size_t>                free_slots_{}; // Slots of removed threads, to be reused
+		fast_umap<pid_t, size_t>           slots_{};      // slots_[tid] = slot of the thread
+
+		// Samples come in bursts from the same thread, so remember the last lookup
+		mutable pid_t  last_tid_  = NO_TID;
+		mutable size_t last_slot_ = NO_SLOT;
 
 		mutable fast_umap<pid_t, real_t> mean_perf_pid_    = {};
 		mutable fast_umap<pid_t, real_t> mean_cpu_use_pid_ = {};
@@ -120,27 +148,165 @@ namespace performance {
 		req_t accesses_   = 0;
 		lat_t av_latency_ = samples::minimum_latency;
 
-		// av_latencies_[src][dst] = latency of memory operations from node src to node dst
-		std::vector<std::vector<lat_t>> av_latencies_{}; // integer gives enough precision, no need for floats
-		std::vector<std::vector<req_t>> mem_accesses_{};
+		// Number of rows/columns of the latency matrix
+		size_t n_nodes_ = 0;
+
+		// av_latencies_[src * n_nodes_ + dst] = latency of memory operations from node src to node dst
+		std::vector<lat_t> av_latencies_{}; // integer gives enough precision, no need for floats
+		std::vector<req_t> mem_accesses_{};
+
+		[[nodiscard]] inline auto find_slot(const pid_t tid) const -> size_t {
+			if (tid == last_tid_) { return last_slot_; }
+
+			const auto it = slots_.find(tid);
+			if (it == slots_.end()) { return NO_SLOT; }
+
+			last_tid_  = tid;
+			last_slot_ = it->second;
+
+			return last_slot_;
+		}
+
+		// Row of the thread, or an empty row if the thread is not in the table
+		[[nodiscard]] inline auto row_of(const pid_t tid) const -> const details::row & {
+			static const details::row empty_row{};
+
+			const auto slot = find_slot(tid);
+			return slot == NO_SLOT ? empty_row : entries_[slot].second;
+		}
+
+		// Compared to threads with same PID
+		[[nodiscard]] inline auto relative_performance(const pid_t pid, const real_t perf, const real_t cpu_use) const
+		    -> real_t {
+			const auto rel_perf = (perf == performance::PERFORMANCE_INVALID_VALUE) ?
+			                          (cpu_use / mean_cpu_use_pid_[pid]) :
+			                          (perf / mean_perf_pid_[pid]);
+
+			// Compared to all other threads
+			// const auto rel_perf = (perf == performance::PERFORMANCE_INVALID_VALUE) ?
+			//                           (cpu_use / mean_cpu_use_) :
+			//                           (perf / mean_perf_);
+
+			return std::isnormal(rel_perf) ? rel_perf : performance::PERFORMANCE_INVALID_VALUE;
+		}
+
+		inline void clear_latencies() {
+			accesses_   = 0;
+			av_latency_ = samples::minimum_latency;
+			std::fill(av_latencies_.begin(), av_latencies_.end(), samples::minimum_latency);
+
+			// With a calibration, remote accesses start from their measured penalty instead of the local latency
+			if (system_info::calibrated()) {
+				for (const auto src : system_info::nodes()) {
+					for (const auto dst : system_info::nodes()) {
+						av_latencies_[static_cast<size_t>(src) * n_nodes_ + static_cast<size_t>(dst)] =
+						    static_cast<lat_t>(static_cast<real_t>(samples::minimum_latency) *
+						                       system_info::distance_factor(src, dst));
+					}
+				}
+			}
+			std::fill(mem_accesses_.begin(), mem_accesses_.end(), 0);
+		}
 
 	public:
+		class const_iterator {
+		private:
+			const std::vector<tid_perf_table::value_type> * entries_ = nullptr;
+			size_t                                          slot_    = 0;
+
+			inline void skip_free() {
+				while (std::cmp_less(slot_, entries_->size()) && (*entries_)[slot_].first == NO_TID) {
+					++slot_;
+				}
+			}
+
+		public:
+			using iterator_category = std::forward_iterator_tag;
+			using value_type        = tid_perf_table::value_type;
+			using difference_type   = std::ptrdiff_t;
+			using reference         = const value_type &;
+			using pointer           = const value_type *;
+
+			const_iterator() = default;
+
+			const_iterator(const std::vector<tid_perf_table::value_type> * entries, const size_t slot) :
+			    entries_(entries), slot_(slot) {
+				skip_free();
+			}
+
+			[[nodiscard]] inline auto slot() const {
+				return slot_;
+			}
+
+			[[nodiscard]] inline auto operator*() const -> reference {
+				return (*entries_)[slot_];
+			}
+
+			[[nodiscard]] inline auto operator->() const -> pointer {
+				return &(*entries_)[slot_];
+			}
+
+			inline auto operator++() -> const_iterator & {
+				++slot_;
+				skip_free();
+				return *this;
+			}
+
+			inline auto operator++(int) -> const_iterator {
+				auto old = *this;
+				++(*this);
+				return old;
+			}
+
+			[[nodiscard]] friend inline auto operator==(const const_iterator & a, const const_iterator & b) -> bool {
+				return a.slot_ == b.slot_;
+			}
+		};
+
 		tid_perf_table() noexcept :
-		    av_latencies_(system_info::max_node() + 1,
-		                  std::vector<lat_t>(system_info::max_node() + 1, samples::minimum_latency)),
-		    mem_accesses_(system_info::max_node() + 1, std::vector<req_t>(system_info::max_node() + 1, 0)) {
+		    n_nodes_(system_info::max_node() + 1),
+		    av_latencies_(n_nodes_ * n_nodes_, samples::minimum_latency),
+		    mem_accesses_(n_nodes_ * n_nodes_, 0) {
 		}
 
 		[[nodiscard]] inline auto begin() const {
-			return table_.begin();
+			return const_iterator(&entries_, 0);
 		}
 
 		[[nodiscard]] inline auto end() const {
-			return table_.end();
+			return const_iterator(&entries_, entries_.size());
 		}
 
 		[[nodiscard]] inline auto size() const {
-			return table_.size();
+			return slots_.size();
+		}
+
+		// Slot of the thread. If the thread is not in the table, it is added.
+		[[nodiscard]] inline auto slot(const pid_t tid) -> size_t {
+			const auto found = find_slot(tid);
+			if (found != NO_SLOT) { return found; }
+
+			size_t new_slot = entries_.size();
+
+			if (free_slots_.empty()) {
+				entries_.emplace_back(tid, details::row{});
+				pids_.emplace_back(system_info::pid_from_tid(tid));
+				rel_perfs_.emplace_back();
+			} else {
+				new_slot = free_slots_.back();
+				free_slots_.pop_back();
+
+				entries_[new_slot]   = { tid, details::row{} };
+				pids_[new_slot]      = system_info::pid_from_tid(tid);
+				rel_perfs_[new_slot] = std::nullopt;
+			}
+
+			slots_[tid] = new_slot;
+
+			last_tid_  = tid;
+			last_slot_ = new_slot;
+
+			return new_slot;
 		}
 
 		inline void update() {
@@ -148,50 +314,51 @@ namespace performance {
 			calc_perf();
 		}
 
-		inline void add_data(const memory_sample_t & sample) {
-			auto & row = table_[sample.tid()];
-			row.add_data(sample);
+		inline void add_data(const size_t slot, const memory_sample_t & sample) {
+			entries_[slot].second.add_data(sample);
+			rel_perfs_[slot].reset();
 
-			const auto & src = system_info::node_from_cpu(sample.cpu());
-			const auto & dst = sample.page_node();
+			const auto & src = static_cast<size_t>(system_info::node_from_cpu(sample.cpu()));
+			const auto & dst = static_cast<size_t>(sample.page_node());
 
 			const auto latency = sample.latency();
 			const auto reqs    = sample.reqs();
 
-			av_latencies_[src][dst] =
-			    (mem_accesses_[src][dst] * av_latencies_[src][dst] + latency * reqs) / (mem_accesses_[src][dst] + reqs);
-			mem_accesses_[src][dst] += reqs;
+			auto & av_latency   = av_latencies_[src * n_nodes_ + dst];
+			auto & mem_accesses = mem_accesses_[src * n_nodes_ + dst];
+
+			av_latency = (mem_accesses * av_latency + latency * reqs) / (mem_accesses + reqs);
+			mem_accesses += reqs;
 
 			av_latency_ = (av_latency_ * accesses_ + latency * reqs) / (accesses_ + reqs);
 			accesses_ += reqs;
 		}
 
-		inline void add_data(const reqs_sample_t & sample) {
-			auto & row = table_[sample.tid()];
-			row.add_data(sample);
+		template<class T>
+		inline void add_data(const size_t slot, const T & sample) {
+			entries_[slot].second.add_data(sample);
+			rel_perfs_[slot].reset();
 		}
 
-		inline void add_data(const inst_sample_t & sample) {
-			auto & row = table_[sample.tid()];
-			row.add_data(sample);
+		template<class T>
+		inline void add_data(const T & sample) {
+			add_data(slot(sample.tid()), sample);
 		}
 
 		inline void add_tids(const set<pid_t> & tids) {
 			for (const auto & tid : tids) {
-				if (!table_.contains(tid)) {
-					table_[tid] = {};
+				if (slots_.contains(tid)) { continue; }
 
-					const auto pid = system_info::pid_from_tid(tid);
-					mean_perf_pid_[pid] += 0;
-					mean_cpu_use_pid_[pid] += 0;
-				}
+				const auto pid = pids_[slot(tid)];
+				mean_perf_pid_[pid] += 0;
+				mean_cpu_use_pid_[pid] += 0;
 			}
 		}
 
 		inline void clear_it() {
 			check_alive_tids();
-			for (auto & [tid, row] : table_) {
-				row.clear();
+			for (auto & [tid, row] : entries_) {
+				row.new_interval();
 			}
 			for (auto & [pid, mean] : mean_perf_pid_) {
 				mean = 0;
@@ -202,50 +369,50 @@ namespace performance {
 
 			total_performance_ = 0;
 
-			accesses_   = 0;
-			av_latency_ = samples::minimum_latency;
-			for (const auto & node : system_info::nodes()) {
-				std::fill(av_latencies_[node].begin(), av_latencies_[node].end(), samples::minimum_latency);
-				std::fill(mem_accesses_[node].begin(), mem_accesses_[node].end(), 0);
-			}
+			clear_latencies();
 		}
 
 		inline void hard_clear() {
-			table_.clear();
+			entries_.clear();
+			pids_.clear();
+			rel_perfs_.clear();
+			free_slots_.clear();
+			slots_.clear();
+			last_tid_  = NO_TID;
+			last_slot_ = NO_SLOT;
+
 			mean_perf_pid_.clear();
 			mean_cpu_use_pid_.clear();
-			accesses_   = 0;
-			av_latency_ = samples::minimum_latency;
-			for (const auto & node : system_info::nodes()) {
-				std::fill(av_latencies_[node].begin(), av_latencies_[node].end(), samples::minimum_latency);
-				std::fill(mem_accesses_[node].begin(), mem_accesses_[node].end(), 0);
-			}
+
+			clear_latencies();
 		}
 
 		inline void remove_entry(const pid_t tid) {
-			table_.erase(tid);
-		}
+			const auto slot = find_slot(tid);
+			if (slot == NO_SLOT) { return; }
 
-		inline void check_alive_tids() {
-			std::vector<pid_t> tids_to_remove;
+			entries_[slot] = { NO_TID, details::row{} };
+			free_slots_.emplace_back(slot);
+			slots_.erase(tid);
 
-			for (const auto & [tid, row] : table_) {
-				if (!system_info::is_pid_alive(tid)) { tids_to_remove.emplace_back(tid); }
-			}
+			last_tid_  = NO_TID;
+			last_slot_ = NO_SLOT;
+		}
 
-			for (const auto & tid : tids_to_remove) {
-				remove_entry(tid);
+		inline void check_alive_tids() {
+			for (const auto & [tid, row] : entries_) {
+				if (tid != NO_TID && !system_info::is_pid_alive(tid)) { remove_entry(tid); }
 			}
 		}
 
 		inline void check_running() {
-			for (auto & [tid, row] : table_) {
-				if (!row.running() && system_info::is_running(tid)) { row.running(true); }
+			for (auto & [tid, row] : entries_) {
+				if (tid != NO_TID && !row.running() && system_info::is_running(tid)) { row.running(true); }
 			}
 		}
 
 		[[nodiscard]] inline auto is_running(const pid_t tid) const -> bool {
-			return table_[tid].running();
+			return row_of(tid).running();
 		}
 
 		inline void calc_perf() {
@@ -257,27 +424,43 @@ namespace performance {
 
 			umap<pid_t, size_t> valid_perf_pid;
 
-			for (auto & [tid, row] : table_) {
-				if (!row.running()) { continue; }
+			// Performance of the threads in the node they are running, and CPU use (by slot)
+			std::vector<real_t> perfs(entries_.size(), performance::PERFORMANCE_INVALID_VALUE);
+			std::vector<real_t> cpu_uses(entries_.size(), 0);
+
+			for (size_t slot = 0; std::cmp_less(slot, entries_.size()); ++slot) {
+				auto & [tid, row] = entries_[slot];
+
+				if (tid == NO_TID) { continue; }
+
+				// The PID of a TID changes if a non-leader thread calls exec
+				pids_[slot] = system_info::pid_from_tid(tid);
+
+				cpu_uses[slot] = system_info::cpu_use(tid);
+
+				if (!row.running()) {
+					perfs[slot] = row.perf_in_node(system_info::pinned_node_from_tid(tid));
+					continue;
+				}
 
 				row.calc_perf();
 
 				const auto node = system_info::pinned_node_from_tid(tid);
 				const auto perf = row.perf_in_node(node);
 
-				if (perf < 0) { continue; }
+				perfs[slot] = perf;
 
-				const auto cpu_use = system_info::cpu_use(tid);
+				if (perf < 0) { continue; }
 
 				total_performance_ += perf;
 
 				temp_mean += perf;
-				temp_cpu += cpu_use;
+				temp_cpu += cpu_uses[slot];
 
-				const auto pid = system_info::pid_from_tid(tid);
+				const auto pid = pids_[slot];
 
 				mean_perf_pid_[pid] += perf;
-				mean_cpu_use_pid_[pid] += cpu_use;
+				mean_cpu_use_pid_[pid] += cpu_uses[slot];
 
 				++valid_perf;
 				++valid_perf_pid[pid];
@@ -296,10 +479,17 @@ namespace performance {
 				const auto aux_cpu_use = mean_cpu_use_pid_[pid] / static_cast<real_t>(valid);
 				mean_cpu_use_pid_[pid] = std::isnormal(aux_cpu_use) ? aux_cpu_use : real_t(1.0);
 			}
+
+			// Relative performance of every thread, compared to threads with same PID
+			for (size_t slot = 0; std::cmp_less(slot, entries_.size()); ++slot) {
+				if (entries_[slot].first == NO_TID) { continue; }
+
+				rel_perfs_[slot] = relative_performance(pids_[slot], perfs[slot], cpu_uses[slot]);
+			}
 		}
 
 		[[nodiscard]] inline auto av_latency(const node_t src, const node_t dst) const {
-			return av_latencies_[src][dst];
+			return av_latencies_[static_cast<size_t>(src) * n_nodes_ + static_cast<size_t>(dst)];
 		}
 
 		[[nodiscard]] inline auto av_latency() const {
@@ -307,11 +497,11 @@ namespace performance {
 		}
 
 		[[nodiscard]] inline auto get_rm3d(const pid_t tid) const -> const auto & {
-			return table_[tid].performance();
+			return row_of(tid).performance();
 		}
 
 		[[nodiscard]] inline auto performance(const pid_t tid, const node_t node) const -> real_t {
-			return table_[tid].perf_in_node(node);
+			return row_of(tid).perf_in_node(node);
 		}
 
 		[[nodiscard]] inline auto performance(const pid_t tid) const -> real_t {
@@ -320,7 +510,7 @@ namespace performance {
 		}
 
 		[[nodiscard]] inline auto raw_performance(const pid_t tid, const node_t node) const {
-			return table_[tid].raw_perf_in_node(node);
+			return row_of(tid).raw_perf_in_node(node);
 		}
 
 		[[nodiscard]] inline auto raw_performance(const pid_t tid) const {
@@ -328,21 +518,13 @@ namespace performance {
 			return raw_performance(tid, node);
 		}
 
-		[[nodiscard]] inline auto rel_performance(const pid_t tid) const {
-			const auto   pid  = system_info::pid_from_tid(tid);
-			const auto & perf = performance(tid);
-
-			// Compared to threads with same PID
-			const auto rel_perf = (perf == performance::PERFORMANCE_INVALID_VALUE) ?
-			                          (system_info::cpu_use(tid) / mean_cpu_use_pid_[pid]) :
-			                          (perf / mean_perf_pid_[pid]);
+		[[nodiscard]] inline auto rel_performance(const pid_t tid) const -> real_t {
+			const auto slot = find_slot(tid);
 
-			// Compared to all other threads
-			// const auto rel_perf = (perf == performance::PERFORMANCE_INVALID_VALUE) ?
-			//                           (system_info::cpu_use(tid) / mean_cpu_use_) :
-			//                           (perf / mean_perf_);
+			if (slot != NO_SLOT && rel_perfs_[slot].has_value()) { return rel_perfs_[slot].value(); }
 
-			return std::isnormal(rel_perf) ? rel_perf : performance::PERFORMANCE_INVALID_VALUE;
+			// Not in the table (yet), or with new data since the last calc_perf
+			return relative_performance(system_info::pid_from_tid(tid), performance(tid), system_info::cpu_use(tid));
 		}
 
 		[[nodiscard]] inline auto total_performance() const -> real_t {
@@ -350,15 +532,15 @@ namespace performance {
 		}
 
 		[[nodiscard]] inline auto preferred_node(const pid_t tid) const -> node_t {
-			return table_[tid].preferred_node();
+			return row_of(tid).preferred_node();
 		}
 
 		[[nodiscard]] inline auto reqs_per_node(const pid_t tid) const {
-			return table_[tid].reqs_per_node();
+			return row_of(tid).reqs_per_node();
 		}
 
 		friend auto operator<<(std::ostream & os, const tid_perf_table & t) -> std::ostream & {
-			os << "Entries: " << t.table_.size() << '\n';
+			os << "Entries: " << t.size() << '\n';
 
 			tabulate::Table perf_table;
 
@@ -366,7 +548,7 @@ namespace performance {
 			                     "PERFORMANCE", "RELATIVE\nPERF. (%)", "CPU%", "OPS/S", "OPS/B", "AV. LAT",
 			                     "NUMA\nSCORE" });
 
-			for (const auto & [tid, per] : t.table_) {
+			for (const auto & [tid, per] : t) {
 				const auto & cpu  = system_info::pinned_cpu_from_tid(tid);
 				const auto & node = system_info::node_from_cpu(cpu);
 
@@ -394,7 +576,7 @@ namespace performance {
 			os << '\n';
 
 			if (verbose::print_with_lvl(verbose::LVL4)) {
-				for (const auto & [tid, per] : t.table_) {
+				for (const auto & [tid, per] : t) {
 					os << "TID " << tid << " perf:" << '\n';
 					os << per;
 				}
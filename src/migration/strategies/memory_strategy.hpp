@@ -11,6 +11,7 @@
 #define THANOS_MEMORY_STRATEGY_HPP
 
 #include <algorithm>     // for sort
+#include <iostream>      // for cout
 #include <map>           // for map, operator==
 #include <ranges>        // for ranges::iota_view...
 #include <sys/types.h>   // for pid_t, size_t
@@ -22,10 +23,15 @@
 #include <vector>        // for vector
 
 #include "migration/mem_migration_cell.hpp"         // for mem_migration_cell
+#include "migration/migration_planner.hpp"          // for migration_planner, migration_plan
+#include "migration/performance/decay.hpp"          // for now
 #include "migration/migration_var.hpp"              // for memory_prefetch_...
 #include "migration/performance/mempages_table.hpp" // for mempages_table, row
-#include "system_info/memory_info.hpp"              // for move_pages, page...
+#include "migration/utils/times.hpp"                 // for min_time_between_migrations
+#include "system_info/memory_info.hpp"              // for page_size, fake_thp...
+#include "utils/string.hpp"                         // for to_string
 #include "utils/types.hpp"                          // for addr_t, node_t
+#include "utils/verbose.hpp"                        // for LVL2, print_with_lvl
 
 namespace migration::memory {
 	class Istrategy {
@@ -52,7 +58,7 @@ namespace migration::memory {
 			if (memory_info::fake_thp_enabled()) {
 				const auto thp_opt = memory_info::fake_thp_from_address(initial);
 				if (thp_opt.has_value()) {
-					const auto & thp = thp_opt.value().get();
+					const auto & thp = thp_opt.value();
 
 					region_end = thp.end();
 
@@ -126,59 +132,114 @@ namespace migration::memory {
 			return pages;
 		}
 
-		[[nodiscard]] static auto select_best_migrations(std::vector<addr_ratio_mig_t> & candidates,
-		                                                 const size_t n_migrations) -> std::vector<mem_migration_cell> {
-			// If we have more candidates than the max. pages to migrate, we have to take the most promising ones...
-			if (std::cmp_greater(candidates.size(), n_migrations)) {
-				// Sort candidates by ratio. First has a higher max. ratio.
-				std::sort(candidates.begin(), candidates.end(),
-				          [&](const addr_ratio_mig_t & a, const addr_ratio_mig_t & b) {
-					          const auto & [addr_a, ratio_a, mig_cell_a] = a;
-					          const auto & [addr_b, ratio_b, mig_cell_b] = b;
-
-					          return ratio_a > ratio_b;
-				          });
-			}
+		// Whether the expected gain of a migration outweighs the cost of moving its pages. "info" holds the statistics
+		// of its first page. Prefetched pages without statistics are moved on speculation, so they are left out of
+		// both the benefit and the cost
+		[[nodiscard]] static auto worth_migrating(const mem_migration_cell & migration,
+		                                          const performance::memtable_details::row & info) -> bool {
+			if (!cost_model.enabled()) { return true; }
+
+			const auto now = performance::decay::now();
 
-			std::vector<mem_migration_cell> migrations;
-			migrations.reserve(n_migrations);
+			const auto page_benefit = [&](const performance::memtable_details::row & row) {
+				return cost_model.benefit(row, migration.src(), migration.dst(), min_time_between_migrations, now);
+			};
+
+			const auto & addresses = migration.addr();
+
+			real_t benefit = 0;
+			size_t bytes   = 0;
+
+			for (size_t i = 0; i < addresses.size(); ++i) {
+				if (i == 0) {
+					benefit += page_benefit(info);
+				} else {
+					const auto page_it = perf_table.find(addresses[i]);
+					if (page_it == perf_table.end()) { continue; }
 
-			for (const auto & candidate : candidates) {
-				const auto & [addr, ratio, mig_cell] = candidate;
-				migrations.emplace_back(mig_cell);
+					benefit += page_benefit(page_it->second);
+				}
+
+				bytes += memory_info::page_size(addresses[i]);
 			}
 
-			return migrations;
+			return cost_model.approve(benefit - cost_model.cost(bytes, migration.src(), migration.dst()));
 		}
 
-		[[nodiscard]] static auto gather_and_perform_migrations(const std::vector<mem_migration_cell> & migrations)
-		    -> size_t {
-			using tuple_t = std::pair<std::vector<addr_t>, std::vector<node_t>>;
-			umap<pid_t, tuple_t> migrations_tuples;
+		// Same for the migration of a whole region of the adaptive tracker
+		[[nodiscard]] static auto worth_migrating(const mem_migration_cell & migration,
+		                                          const performance::adaptive_regions::region & region) -> bool {
+			if (!cost_model.enabled()) { return true; }
 
-			for (const auto & migration : migrations) {
-				const auto pid = migration.pid();
+			const auto benefit = cost_model.benefit(region, migration.src(), migration.dst(),
+			                                        min_time_between_migrations, performance::decay::now());
 
-				auto & [addresses, nodes] = migrations_tuples[pid];
+			return cost_model.approve(benefit - cost_model.cost(region.bytes(), migration.src(), migration.dst()));
+		}
 
-				for (const auto addr : migration.addr()) {
-					addresses.emplace_back(addr);
-					nodes.emplace_back(migration.dst());
+		// Take the most promising candidates (by ratio), up to n_migrations and within the bandwidth budgets
+		[[nodiscard]] static auto plan_migrations(std::vector<addr_ratio_mig_t> & candidates,
+		                                          const size_t n_migrations) -> migration_plan {
+			const auto planner =
+			    migration_planner::from_bandwidth(link_bandwidth, inbound_links, min_time_between_migrations);
+
+			auto plan = planner.plan(candidates, n_migrations);
+
+			if (verbose::print_with_lvl(verbose::LVL2)) {
+				std::cout << "Migration plan: " << plan.size() << " migrations ("
+				          << utils::string::to_string(static_cast<real_t>(plan.bytes()) / real_t(1 << 20), 2)
+				          << " MiB). " << plan.rejected() << " candidates over the bandwidth budget." << '\n';
+				if (cost_model.enabled()) {
+					std::cout << "Cost model (move_pages at " << utils::string::to_string(cost_model.throughput(), 2)
+					          << " GB/s, " << utils::string::to_string(cost_model.sample_period(), 0)
+					          << " accesses per sample): " << cost_model.approved() << " migrations approved, "
+					          << cost_model.rejected() << " rejected so far." << '\n';
 				}
 			}
 
-			size_t migrated_pages = 0;
+			return plan;
+		}
 
-			for (const auto & [pid, addr_node_map] : migrations_tuples) {
-				const auto & [addresses, nodes] = addr_node_map;
+		[[nodiscard]] static auto select_best_migrations(std::vector<addr_ratio_mig_t> & candidates,
+		                                                 const size_t n_migrations) -> std::vector<mem_migration_cell> {
+			return plan_migrations(candidates, n_migrations).migrations();
+		}
+
+		// Once the migrations are selected, the statistics of the migrated pages start from scratch, while the
+		// candidates popped from perf_table but rejected (by the strategy, the cost model or the planner) go back to
+		// their queue, so they are considered again without waiting for new samples
+		static void settle_candidates(const performance::candidate_t kind,
+		                              const std::vector<performance::candidate_queue::value_type> & popped,
+		                              const std::vector<mem_migration_cell> & migrations) {
+			fast_uset<addr_t> migrated;
+
+			for (const auto & migration : migrations) {
+				migrated.insert(migration.addr().begin(), migration.addr().end());
+
+				if (migration.addr().empty()) { continue; }
 
-				if (memory_info::move_pages(addresses, pid, nodes)) {
-					migrated_pages += addresses.size();
-					migration::memory::total_migrations += addresses.size();
+				const auto page_it = perf_table.find(migration.addr().front());
+				if (page_it != perf_table.end()) { page_it->second.clear(); }
+			}
+
+			for (const auto & candidate : popped) {
+				if (!migrated.contains(candidate.first)) { perf_table.requeue_candidate(kind, candidate); }
+			}
+		}
+
+		// Hand the migrations over to the executor. Returns the number of pages queued (results arrive later)
+		[[nodiscard]] static auto gather_and_perform_migrations(const std::vector<mem_migration_cell> & migrations)
+		    -> size_t {
+			// Only the pages actually handed over stop being tracked: the rest stay candidates for later intervals
+			if (hot_pages.enabled()) {
+				for (const auto & migration : migrations) {
+					for (const auto addr : migration.addr()) {
+						hot_pages.erase(addr);
+					}
 				}
 			}
 
-			return migrated_pages;
+			return executor.submit(migrations);
 		}
 
 		virtual void migrate() = 0;
@@ -13,6 +13,7 @@
 #include <algorithm>     // for min
 #include <cstddef>       // for size_t
 #include <iostream>      // for operator<<, basi...
+#include <limits>        // for numeric_limits
 #include <numeric>       // for accumulate
 #include <string>        // for operator<<, char...
 #include <type_traits>   // for add_const<>::type
@@ -25,6 +26,7 @@
 #include "migration/performance/mempages_table.hpp" // for mempages_table
 #include "migration/performance/tid_perf_table.hpp" // for tid_perf_table
 #include "migration/strategies/memory_strategy.hpp" // for Istrategy...
+#include "system_info/system_info.hpp"              // for calibrated, distance_factor
 #include "utils/string.hpp"                         // for percentage, to_s...
 #include "utils/types.hpp"                          // for addr_t, real_t
 #include "utils/verbose.hpp"                        // for lvl, DEFAULT_LVL
@@ -36,74 +38,133 @@ namespace migration::memory {
 		static constexpr lat_t REL_LATENCY_THRESHOLD    = 130; // 130 %, 大于这个值叫做busy node
 		static constexpr lat_t SATURATED_NODE_THRESHOLD = 130; // 130 %
 
+		// With a calibration, a page is "slow" when its latency is halfway to the one of the closest remote node
+		[[nodiscard]] static inline auto rel_latency_threshold() -> lat_t {
+			if (!system_info::calibrated() || system_info::num_of_nodes() < 2) { return REL_LATENCY_THRESHOLD; }
+
+			real_t closest_remote = std::numeric_limits<real_t>::max();
+			for (const auto src : system_info::nodes()) {
+				for (const auto dst : system_info::nodes()) {
+					if (src == dst) { continue; }
+					closest_remote = std::min(closest_remote, system_info::distance_factor(src, dst));
+				}
+			}
+
+			if (closest_remote <= 1) { return REL_LATENCY_THRESHOLD; }
+
+			return static_cast<lat_t>(100 * (1 + closest_remote) / 2);
+		}
+
 		[[nodiscard]] static inline auto is_node_saturated(const node_t node) -> bool {
 			const auto & node_latency = perf_table.av_latency(node);
 			const auto & sys_latency  = perf_table.av_latency();
 
 			return (node_latency * 100 / sys_latency) > SATURATED_NODE_THRESHOLD;
 		}
-		// nodiscard如果返回值没被使用 报警
-		[[nodiscard]] static auto perform_migration_algorithm_all_pages() -> std::vector<mem_migration_cell> {
+		// Candidates are ranked by latency as samples are inserted in the table, so only the pages over the threshold
+		// are visited. When all the pages can be migrated, pages already in their preferred node are considered too
+		// (they may be moved to the least saturated node).
+		[[nodiscard]] static auto perform_migration_algorithm_n_pages(const size_t n_pages, const bool all_pages)
+		    -> std::vector<mem_migration_cell> {
+			if (verbose::print_with_lvl(verbose::DEFAULT_LVL)) {
+				std::cout << "Max. pages to migrate: " << n_pages << " / " << perf_table.size() << " ("
+				          << utils::string::percentage(portion_memory_migrations) << "%)" << '\n';
+			}
+
 			size_t migrations_to_preferred       = 0;
 			size_t migrations_to_least_saturated = 0;
 
 			const auto least_saturated_node = perf_table.node_min_av_latency();
 
+			const auto threshold = rel_latency_threshold();
+
+			// rel_latency > threshold <=> latency > min_latency
+			const auto min_latency = static_cast<real_t>(perf_table.av_latency() * threshold) / real_t(100);
+
+			const auto n_candidates = perf_table.n_candidates(performance::candidate_t::BY_LATENCY);
+
 			fast_uset<addr_t> pages_to_migrate;
 
-			std::vector<mem_migration_cell> migrations;
+			std::vector<addr_ratio_mig_t> candidates;
+
+			// Candidates taken from the queue, to put back the ones that are not migrated
+			std::vector<performance::candidate_queue::value_type> popped;
 
 			// Preallocate some memory to save time later
-			// Performance table
-			migrations.reserve(perf_table.size());
+			candidates.reserve(std::min(n_pages, n_candidates));
+
+			while (std::cmp_less(candidates.size(), n_pages)) {
+				// The remaining candidates (if any) have a latency under the threshold
+				const auto candidate = perf_table.pop_candidate(performance::candidate_t::BY_LATENCY, min_latency);
+				if (!candidate.has_value()) { break; }
+
+				popped.emplace_back(candidate.value());
+
+				const auto mem_page = candidate->first;
 
-			for (auto & [mem_page, info] : perf_table) {
 				// If the page was already considered for migration...
 				if (pages_to_migrate.contains(mem_page)) {
 					// Keep going with the next page
 					continue;
 				}
 
+				const auto page_it = perf_table.find(mem_page);
+				if (page_it == perf_table.end()) { continue; }
+
+				auto & info = page_it->second;
+
 				if (!info.enough_info()) { continue; }
 
-				const auto rel_latency =
-				    info.av_latency() * 100 / perf_table.av_latency(); // = perf_table.rel_latency(mem_page);
-				//这个memory page得lat与全局lat比较
-				//如果大的话这个page就要migrate
-				if (std::cmp_greater(rel_latency, REL_LATENCY_THRESHOLD)) {
-					const auto & ratios = info.ratios();
+				const auto rel_latency = perf_table.rel_latency(mem_page);
+
+				if (rel_latency <= threshold) { continue; }
 
-					const auto max_node = info.preferred_node();
+				const auto ratios = info.ratios();
 
-					const auto pid       = info.last_pid();
-					const auto curr_node = info.last_node();
+				const auto max_node  = info.preferred_node();
+				const auto max_ratio = ratios[max_node];
 
-					// If the "preferred node" is not saturated, move to it. Else, move to the "least saturated" node.
-					const auto dst_node = is_node_saturated(max_node) ? least_saturated_node : max_node;
+				const auto pid       = info.last_pid();
+				const auto curr_node = info.last_node();
 
-					if (is_node_saturated(max_node)) {
-						++migrations_to_least_saturated;
-					} else {
-						++migrations_to_preferred;
-					}
+				if (!all_pages && std::cmp_equal(curr_node, max_node)) { continue; }
 
-					std::vector<addr_t> pages{ mem_page };
+				// If the "preferred node" is not saturated, move to it. Else, move to the "least saturated" node.
+				const auto dst_node = is_node_saturated(max_node) ? least_saturated_node : max_node;
 
-					const auto pages_to_prefetch = prefetch_candidates(mem_page, dst_node);
+				if (is_node_saturated(max_node)) {
+					++migrations_to_least_saturated;
+				} else {
+					++migrations_to_preferred;
+				}
 
-					pages.insert(pages.end(), pages_to_prefetch.begin(), pages_to_prefetch.end());
+				std::vector<addr_t> pages{ mem_page };
 
-					pages_to_migrate.insert(pages.begin(), pages.end());
+				const auto pages_to_prefetch = prefetch_candidates(mem_page, dst_node);
 
-					migrations.emplace_back(pages, pid, curr_node, dst_node, ratios);
+				pages.insert(pages.end(), pages_to_prefetch.begin(), pages_to_prefetch.end());
 
-					info.clear();
-				}
+				mem_migration_cell migration(pages, pid, curr_node, dst_node, ratios);
+
+				// Not worth it (yet): keep gathering statistics of the page
+				if (!worth_migrating(migration, info)) { continue; }
+
+				pages_to_migrate.insert(pages.begin(), pages.end());
+
+				candidates.emplace_back(mem_page, max_ratio, migration);
 			}
 
 			if (verbose::print_with_lvl(verbose::LVL4)) {
-				std::cout << "Pages with rel_latency > threshold: " << migrations.size() << " ("
-				          << utils::string::percentage(migrations.size(), perf_table.size()) << "%)" << '\n';
+				std::cout << "Pages with rel_latency > threshold (visited): " << candidates.size() << " of "
+				          << n_candidates << " candidates ("
+				          << utils::string::percentage(n_candidates, perf_table.size()) << "% of the pages)" << '\n';
+			}
+
+			auto migrations = select_best_migrations(candidates, candidates.size());
+
+			settle_candidates(performance::candidate_t::BY_LATENCY, popped, migrations);
+
+			if (verbose::print_with_lvl(verbose::LVL4)) {
 				std::cout << "Pages to migrate (w/o prefetching): " << migrations.size() << " ("
 				          << utils::string::percentage(migrations.size(), perf_table.size()) << "%)" << '\n';
 				std::cout << "Migrations to preferred node: " << migrations_to_preferred << " ("
@@ -116,107 +177,122 @@ namespace migration::memory {
 			return migrations;
 		}
 
-		[[nodiscard]] static auto perform_migration_algorithm_n_pages(const size_t n_pages)
-		    -> std::vector<mem_migration_cell> {
-			if (verbose::print_with_lvl(verbose::DEFAULT_LVL)) {
-				std::cout << "Max. pages to migrate: " << n_pages << " / " << perf_table.size() << " ("
-				          << utils::string::percentage(portion_memory_migrations) << "%)" << '\n';
-			}
+		// Same criterion as above, but the candidates come from the fixed-memory hot pages tracker
+		[[nodiscard]] static auto perform_migration_algorithm_hot_pages() -> std::vector<mem_migration_cell> {
+			const auto hot = hot_pages.hot_pages();
 
-			size_t migrations_to_preferred       = 0;
-			size_t migrations_to_least_saturated = 0;
+			const auto least_saturated_node = hot_pages.node_min_av_latency();
+			const auto threshold            = rel_latency_threshold();
 
-			const auto least_saturated_node = perf_table.node_min_av_latency();
+			const auto is_saturated = [](const node_t node) {
+				return (hot_pages.av_latency(node) * 100 / hot_pages.av_latency()) > SATURATED_NODE_THRESHOLD;
+			};
 
 			uset<addr_t> pages_to_migrate;
 
 			std::vector<addr_ratio_mig_t> candidates;
+			candidates.reserve(hot.size());
 
-			// Preallocate some memory to save time later
-			candidates.reserve(perf_table.size());
+			for (const auto & hot_page : hot) {
+				if (pages_to_migrate.contains(hot_page.page)) { continue; }
 
-			for (auto & [mem_page, info] : perf_table) {
-				// If the page was already considered for migration...
-				if (pages_to_migrate.contains(mem_page)) {
-					// Keep going with the next page
+				const auto rel_latency = hot_page.av_latency * 100 / hot_pages.av_latency();
+
+				if (rel_latency <= threshold || std::cmp_equal(hot_page.page_node, hot_page.pref_node)) {
 					continue;
 				}
 
-				if (!info.enough_info()) { continue; }
-
-				const auto rel_latency = perf_table.rel_latency(mem_page);
+				// If the "preferred node" is not saturated, move to it. Else, move to the "least saturated" node.
+				const auto dst_node = is_saturated(hot_page.pref_node) ? least_saturated_node : hot_page.pref_node;
 
-				if (rel_latency > REL_LATENCY_THRESHOLD) {
-					const auto ratios = info.ratios();
+				std::vector<addr_t> pages{ hot_page.page };
 
-					const auto max_node  = info.preferred_node();
-					const auto max_ratio = ratios[max_node];
+				const auto pages_to_prefetch = prefetch_candidates(hot_page.page, dst_node);
 
-					const auto pid       = info.last_pid();
-					const auto curr_node = info.last_node();
+				pages.insert(pages.end(), pages_to_prefetch.begin(), pages_to_prefetch.end());
 
-					if (std::cmp_equal(curr_node, max_node)) { continue; }
+				pages_to_migrate.insert(pages.begin(), pages.end());
 
-					// If the "preferred node" is not saturated, move to it. Else, move to the "least saturated" node.
-					const auto dst_node = is_node_saturated(max_node) ? least_saturated_node : max_node;
+				mem_migration_cell migration(pages, hot_page.pid, hot_page.page_node, dst_node, hot_page.ratios);
 
-					if (is_node_saturated(max_node)) {
-						++migrations_to_least_saturated;
-					} else {
-						++migrations_to_preferred;
-					}
+				candidates.emplace_back(hot_page.page, hot_page.ratios[hot_page.pref_node], migration);
+			}
 
-					std::vector<addr_t> pages{ mem_page };
+			const auto n_pages = static_cast<size_t>(portion_memory_migrations * static_cast<real_t>(hot.size()));
 
-					const auto pages_to_prefetch = prefetch_candidates(mem_page, dst_node);
+			if (verbose::print_with_lvl(verbose::LVL4)) {
+				std::cout << "Hot pages with rel_latency > threshold: " << candidates.size() << " ("
+				          << utils::string::percentage(candidates.size(), hot.size()) << "%)" << '\n';
+			}
 
-					pages.insert(pages.end(), pages_to_prefetch.begin(), pages_to_prefetch.end());
+			return select_best_migrations(candidates, std::min(n_pages, candidates.size()));
+		}
 
-					pages_to_migrate.insert(pages.begin(), pages.end());
+		// Same criterion as above, applied to whole regions of the adaptive region tracker
+		[[nodiscard]] static auto perform_migration_algorithm_regions() -> std::vector<mem_migration_cell> {
+			const auto least_saturated_node = access_regions.node_min_av_latency();
+			const auto threshold            = rel_latency_threshold();
 
-					mem_migration_cell migration(pages, pid, curr_node, dst_node, ratios);
+			const auto is_saturated = [](const node_t node) {
+				const auto rel_latency = access_regions.av_latency(node) * 100 / access_regions.av_latency();
+				return rel_latency > SATURATED_NODE_THRESHOLD;
+			};
 
-					candidates.emplace_back(mem_page, max_ratio, migration);
+			std::vector<addr_ratio_mig_t> candidates;
 
-					info.clear();
+			for (const auto & region : access_regions) {
+				if (!region.enough_info() || std::cmp_less(region.node(), 0) ||
+				    region.bytes() > performance::adaptive_regions::MAX_MIGRATION_BYTES) {
+					continue;
 				}
-			}
 
-			if (verbose::print_with_lvl(verbose::LVL4)) {
-				std::cout << "Pages with rel_latency > threshold: " << candidates.size() << " ("
-				          << utils::string::percentage(candidates.size(), perf_table.size()) << "%)" << '\n';
-			}
+				const auto pref_node   = region.preferred_node();
+				const auto rel_latency = region.av_latency() * 100 / access_regions.av_latency();
+
+				if (rel_latency <= threshold || std::cmp_equal(region.node(), pref_node)) { continue; }
+
+				// If the "preferred node" is not saturated, move to it. Else, move to the "least saturated" node.
+				const auto dst_node = is_saturated(pref_node) ? least_saturated_node : pref_node;
+
+				if (std::cmp_equal(region.node(), dst_node)) { continue; }
+
+				const auto ratios = region.ratios();
 
-			const auto n_migrations = std::min(candidates.size(), n_pages);
+				mem_migration_cell migration(region.pages(), region.pid(), region.node(), dst_node, ratios);
 
-			auto migrations = select_best_migrations(candidates, n_migrations);
+				// Not worth it (yet): keep gathering statistics of the region
+				if (!worth_migrating(migration, region)) { continue; }
+
+				candidates.emplace_back(region.begin(), ratios[pref_node], migration);
+			}
+
+			const auto n_regions =
+			    static_cast<size_t>(portion_memory_migrations * static_cast<real_t>(access_regions.size()));
 
 			if (verbose::print_with_lvl(verbose::LVL4)) {
-				std::cout << "Pages to migrate (w/o prefetching): " << migrations.size() << " ("
-				          << utils::string::percentage(migrations.size(), perf_table.size()) << "%)" << '\n';
-				std::cout << "Migrations to preferred node: " << migrations_to_preferred << " ("
-				          << utils::string::percentage(migrations_to_preferred, migrations.size()) << "%)" << '\n';
-				std::cout << "Migrations to least saturated node: " << migrations_to_least_saturated << " ("
-				          << utils::string::percentage(migrations_to_least_saturated, migrations.size()) << "%)"
-				          << '\n';
+				std::cout << "Regions with rel_latency > threshold: " << candidates.size() << " ("
+				          << utils::string::percentage(candidates.size(), access_regions.size()) << "%)" << '\n';
 			}
 
-			return migrations;
+			// The statistics of the regions start over once the executor reports their pages as moved
+			return select_best_migrations(candidates, std::min(n_regions, candidates.size()));
 		}
 
 		[[nodiscard]] static auto perform_migration_algorithm() -> std::vector<mem_migration_cell> {
 			if (std::cmp_equal(system_info::num_of_nodes(), 1)) { return {}; }
 
+			if (hot_pages.enabled()) { return perform_migration_algorithm_hot_pages(); }
+
+			if (access_regions.enabled()) { return perform_migration_algorithm_regions(); }
+
 			const auto max_pages_to_migrate =
 			    static_cast<size_t>(portion_memory_migrations * static_cast<real_t>(perf_table.size()));
 
 			if (std::cmp_equal(max_pages_to_migrate, 0)) { return {}; }
 
-			if (std::cmp_equal(max_pages_to_migrate, perf_table.size())) {
-				return perform_migration_algorithm_all_pages();
-			}
+			const auto all_pages = std::cmp_equal(max_pages_to_migrate, perf_table.size());
 
-			return perform_migration_algorithm_n_pages(max_pages_to_migrate);
+			return perform_migration_algorithm_n_pages(max_pages_to_migrate, all_pages);
 		}
 
 	public:
@@ -248,7 +324,7 @@ namespace migration::memory {
 				                                              [](size_t accum, const mem_migration_cell & m) -> size_t {
 					                                              return accum + m.addr().size();
 				                                              });
-				std::cout << "Successfully migrated " << performed_migrations << " memory pages of " << total_candidates
+				std::cout << "Queued " << performed_migrations << " memory pages of " << total_candidates
 				          << " candidates (" << utils::string::percentage(performed_migrations, total_candidates, 0)
 				          << "% of pages). Including prefetching." << '\n';
 			}
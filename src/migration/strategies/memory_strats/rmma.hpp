@@ -73,11 +73,7 @@ namespace migration::memory {
 
 			while (i-- > 0) {
 				// Go to a random page
-				auto it = perf_table.begin();
-
-				const auto r = utils::arithmetic::rnd(size_t(), perf_table.size());
-
-				std::ranges::advance(it, r, perf_table.end());
+				const auto it = perf_table.random_page();
 
 				const auto & [mem_page, info] = *it;
 
@@ -145,7 +141,7 @@ namespace migration::memory {
 				                                              [](size_t accum, const mem_migration_cell & m) -> size_t {
 					                                              return accum + m.addr().size();
 				                                              });
-				std::cout << "Successfully migrated " << performed_migrations << " memory pages of " << total_candidates
+				std::cout << "Queued " << performed_migrations << " memory pages of " << total_candidates
 				          << " candidates (" << utils::string::percentage(performed_migrations, total_candidates, 0)
 				          << "% of pages). Including prefetching." << '\n';
 			}
@@ -40,21 +40,46 @@ namespace migration::memory {
 	// Threshold Memory pages Migration Algorithm
 	class tmma : public migration::memory::Istrategy {
 	private:
-		[[nodiscard]] static auto perform_migration_algorithm_all_pages() -> std::vector<mem_migration_cell> {
+		// Candidates are ranked by max. ratio as samples are inserted in the table, so only the best ones are visited
+		[[nodiscard]] static auto perform_migration_algorithm_n_pages(const size_t n_pages)
+		    -> std::vector<mem_migration_cell> {
+			if (verbose::print_with_lvl(verbose::DEFAULT_LVL)) {
+				std::cout << "Max. pages to migrate: " << n_pages << " / " << perf_table.size() << " ("
+				          << utils::string::percentage(portion_memory_migrations) << "%)" << '\n';
+			}
+
+			const auto n_candidates = perf_table.n_candidates(performance::candidate_t::BY_RATIO);
+
 			uset<addr_t> pages_to_migrate;
 
-			std::vector<mem_migration_cell> migrations;
+			std::vector<addr_ratio_mig_t> candidates;
+
+			// Candidates taken from the queue, to put back the ones that are not migrated
+			std::vector<performance::candidate_queue::value_type> popped;
 
 			// Preallocate some memory to save time later
-			migrations.reserve(perf_table.size());
+			candidates.reserve(std::min(n_pages, n_candidates));
+
+			while (std::cmp_less(candidates.size(), n_pages)) {
+				// The remaining candidates (if any) have a ratio under the threshold
+				const auto candidate = perf_table.pop_candidate(performance::candidate_t::BY_RATIO, min_ratio_mig);
+				if (!candidate.has_value()) { break; }
+
+				popped.emplace_back(candidate.value());
+
+				const auto mem_page = candidate->first;
 
-			for (auto & [mem_page, info] : perf_table) {
 				// If the page was already considered for migration...
 				if (pages_to_migrate.contains(mem_page)) {
 					// Keep going with the next page
 					continue;
 				}
 
+				const auto page_it = perf_table.find(mem_page);
+				if (page_it == perf_table.end()) { continue; }
+
+				auto & info = page_it->second;
+
 				if (!info.enough_info()) { continue; }
 
 				const auto curr_node = info.last_node();
@@ -64,8 +89,6 @@ namespace migration::memory {
 				const auto max_ratio = ratios[pref_node];
 
 				if (std::cmp_not_equal(pref_node, curr_node) && max_ratio > min_ratio_mig) {
-					pages_to_migrate.insert(mem_page);
-
 					const auto pid = info.last_pid();
 
 					std::vector<addr_t> pages{ mem_page };
@@ -74,16 +97,27 @@ namespace migration::memory {
 
 					pages.insert(pages.end(), pages_to_prefetch.begin(), pages_to_prefetch.end());
 
-					pages_to_migrate.insert(pages.begin(), pages.end());
-
 					mem_migration_cell migration(pages, pid, curr_node, pref_node, ratios);
 
-					migrations.emplace_back(pages, pid, curr_node, pref_node, ratios);
+					// Not worth it (yet): keep gathering statistics of the page
+					if (!worth_migrating(migration, info)) { continue; }
+
+					pages_to_migrate.insert(pages.begin(), pages.end());
 
-					info.clear();
+					candidates.emplace_back(mem_page, max_ratio, migration);
 				}
 			}
 
+			if (verbose::print_with_lvl(verbose::LVL4)) {
+				std::cout << "Pages with ratio > threshold (visited): " << candidates.size() << " of "
+				          << n_candidates << " candidates ("
+				          << utils::string::percentage(n_candidates, perf_table.size()) << "% of the pages)" << '\n';
+			}
+
+			auto migrations = select_best_migrations(candidates, candidates.size());
+
+			settle_candidates(performance::candidate_t::BY_RATIO, popped, migrations);
+
 			if (verbose::print_with_lvl(verbose::LVL4)) {
 				std::cout << "Pages to migrate (w/o prefetching): " << migrations.size() << " ("
 				          << utils::string::percentage(migrations.size(), perf_table.size()) << "%)" << '\n';
@@ -92,85 +126,94 @@ namespace migration::memory {
 			return migrations;
 		}
 
-		[[nodiscard]] static auto perform_migration_algorithm_n_pages(const size_t n_pages)
-		    -> std::vector<mem_migration_cell> {
-			if (verbose::print_with_lvl(verbose::DEFAULT_LVL)) {
-				std::cout << "Max. pages to migrate: " << n_pages << " / " << perf_table.size() << " ("
-				          << utils::string::percentage(portion_memory_migrations) << "%)" << '\n';
-			}
+		// Same criterion as above, but the candidates come from the fixed-memory hot pages tracker
+		[[nodiscard]] static auto perform_migration_algorithm_hot_pages() -> std::vector<mem_migration_cell> {
+			const auto hot = hot_pages.hot_pages();
 
 			uset<addr_t> pages_to_migrate;
 
 			std::vector<addr_ratio_mig_t> candidates;
+			candidates.reserve(hot.size());
 
-			// Preallocate some memory to save time later
-			candidates.reserve(perf_table.size());
-
-			for (auto & [mem_page, info] : perf_table) {
-				// If the page was already considered for migration...
-				if (pages_to_migrate.contains(mem_page)) {
-					// Keep going with the next page
-					continue;
-				}
-
-				if (!info.enough_info()) { continue; }
-
-				const auto curr_node = info.last_node();
-				const auto pref_node = info.preferred_node();
+			for (const auto & hot_page : hot) {
+				if (pages_to_migrate.contains(hot_page.page)) { continue; }
 
-				const auto ratios    = info.ratios();
-				const auto max_ratio = ratios[pref_node];
+				const auto max_ratio = hot_page.ratios[hot_page.pref_node];
 
-				if (std::cmp_not_equal(pref_node, curr_node) && max_ratio > min_ratio_mig) {
-					pages_to_migrate.insert(mem_page);
+				if (std::cmp_not_equal(hot_page.pref_node, hot_page.page_node) && max_ratio > min_ratio_mig) {
+					std::vector<addr_t> pages{ hot_page.page };
 
-					const auto pid = info.last_pid();
-
-					std::vector<addr_t> pages{ mem_page };
-
-					const auto pages_to_prefetch = prefetch_candidates(mem_page, pref_node);
+					const auto pages_to_prefetch = prefetch_candidates(hot_page.page, hot_page.pref_node);
 
 					pages.insert(pages.end(), pages_to_prefetch.begin(), pages_to_prefetch.end());
 
 					pages_to_migrate.insert(pages.begin(), pages.end());
 
-					mem_migration_cell migration(pages, pid, curr_node, pref_node, ratios);
+					mem_migration_cell migration(pages, hot_page.pid, hot_page.page_node, hot_page.pref_node,
+					                             hot_page.ratios);
 
-					candidates.emplace_back(mem_page, max_ratio, migration);
-
-					info.clear();
+					candidates.emplace_back(hot_page.page, max_ratio, migration);
 				}
 			}
 
+			const auto n_pages = static_cast<size_t>(portion_memory_migrations * static_cast<real_t>(hot.size()));
+
 			if (verbose::print_with_lvl(verbose::LVL4)) {
-				std::cout << "Pages with ratio > threshold: " << candidates.size() << " ("
-				          << utils::string::percentage(candidates.size(), perf_table.size()) << "%)" << '\n';
+				std::cout << "Hot pages with ratio > threshold: " << candidates.size() << " ("
+				          << utils::string::percentage(candidates.size(), hot.size()) << "%)" << '\n';
 			}
 
-			const auto n_migrations = std::min(n_pages, candidates.size());
+			return select_best_migrations(candidates, std::min(n_pages, candidates.size()));
+		}
+
+		// Same criterion as above, applied to whole regions of the adaptive region tracker
+		[[nodiscard]] static auto perform_migration_algorithm_regions() -> std::vector<mem_migration_cell> {
+			std::vector<addr_ratio_mig_t> candidates;
+
+			for (const auto & region : access_regions) {
+				if (!region.enough_info() || std::cmp_less(region.node(), 0) ||
+				    region.bytes() > performance::adaptive_regions::MAX_MIGRATION_BYTES) {
+					continue;
+				}
+
+				const auto pref_node = region.preferred_node();
+				const auto ratios    = region.ratios();
+				const auto max_ratio = ratios[pref_node];
+
+				if (std::cmp_not_equal(pref_node, region.node()) && max_ratio > min_ratio_mig) {
+					mem_migration_cell migration(region.pages(), region.pid(), region.node(), pref_node, ratios);
 
-			auto migrations = select_best_migrations(candidates, n_migrations);
+					// Not worth it (yet): keep gathering statistics of the region
+					if (!worth_migrating(migration, region)) { continue; }
+
+					candidates.emplace_back(region.begin(), max_ratio, migration);
+				}
+			}
+
+			const auto n_regions =
+			    static_cast<size_t>(portion_memory_migrations * static_cast<real_t>(access_regions.size()));
 
 			if (verbose::print_with_lvl(verbose::LVL4)) {
-				std::cout << "Pages to migrate (w/o prefetching): " << migrations.size() << " ("
-				          << utils::string::percentage(migrations.size(), perf_table.size()) << "%)" << '\n';
+				std::cout << "Regions with ratio > threshold: " << candidates.size() << " ("
+				          << utils::string::percentage(candidates.size(), access_regions.size()) << "%)" << '\n';
 			}
 
-			return migrations;
+			// The statistics of the regions start over once the executor reports their pages as moved
+			return select_best_migrations(candidates, std::min(n_regions, candidates.size()));
 		}
 
 		[[nodiscard]] static auto perform_migration_algorithm() -> std::vector<mem_migration_cell> {
 			if (std::cmp_equal(system_info::num_of_nodes(), 1)) { return {}; }
 
+			if (hot_pages.enabled()) { return perform_migration_algorithm_hot_pages(); }
+
+			if (access_regions.enabled()) { return perform_migration_algorithm_regions(); }
+
 			const auto max_pages_to_migrate =
 			    static_cast<size_t>(portion_memory_migrations * static_cast<real_t>(perf_table.size()));
 
 			if (std::cmp_equal(max_pages_to_migrate, 0)) { return {}; }
 
-			if (std::cmp_equal(max_pages_to_migrate, perf_table.size())) {
-				return perform_migration_algorithm_all_pages();
-			}
-
 			return perform_migration_algorithm_n_pages(max_pages_to_migrate);
 		}
 
@@ -203,7 +246,7 @@ namespace migration::memory {
 				                                              [](size_t accum, const mem_migration_cell & m) -> size_t {
 					                                              return accum + m.addr().size();
 				                                              });
-				std::cout << "Successfully migrated " << performed_migrations << " memory pages of " << total_candidates
+				std::cout << "Queued " << performed_migrations << " memory pages of " << total_candidates
 				          << " candidates (" << utils::string::percentage(performed_migrations, total_candidates, 0)
 				          << "% of pages). Including prefetching." << '\n';
 			}
@@ -15,7 +15,6 @@
 #include <iostream>    // for operator<<, basi...
 #include <iterator>    // for advance
 #include <map>         // for _Rb_tree_const_i...
-#include <numa.h>      // for numa_distance
 #include <numeric>     // for accumulate
 #include <ranges>      // for ranges::iota_view...
 #include <set>         // for set, set<>::iter...
@@ -71,8 +70,7 @@ namespace migration::thread {
 	[[nodiscard]] inline auto tickets_pref_node(const pid_t pid, const node_t dst_node) -> tickets_t {
 		const auto pref_node = perf_table.preferred_node(pid);
 
-		tickets_t tickets(TICKETS_PREF_NODE.value() * static_cast<real_t>(system_info::local_distance()) /
-		                      static_cast<real_t>(numa_distance(dst_node, pref_node)),
+		tickets_t tickets(TICKETS_PREF_NODE.value() / system_info::distance_factor(dst_node, pref_node),
 		                  dst_node == pref_node ? TICKETS_PREF_NODE.mask() : tickets_mask_t(0));
 
 		return tickets;
@@ -83,7 +81,14 @@ namespace migration::thread {
 	}
 
 	[[nodiscard]] inline auto tickets_free_core(const cpu_t dst_cpu) -> tickets_t {
-		return system_info::is_cpu_free(dst_cpu) ? TICKETS_FREE_CORE : tickets_t();
+		if (!system_info::is_cpu_free(dst_cpu)) { return {}; }
+
+		// A free CPU whose SMT siblings are busy still shares the core (and its caches) with them
+		if (!system_info::is_core_free(dst_cpu)) {
+			return tickets_t(TICKETS_FREE_CORE.value() / 2, TICKETS_FREE_CORE.mask());
+		}
+
+		return TICKETS_FREE_CORE;
 	}
 
 	[[nodiscard]] inline auto tickets_free_core_in_node(const node_t dst_node) -> tickets_t {
@@ -110,7 +115,7 @@ namespace migration::thread {
 
 	[[nodiscard]] inline auto tickets_cpu(const pid_t pid, const cpu_t dst_cpu) -> tickets_t {
 		const auto src_cpu = system_info::pinned_cpu_from_tid(pid);
-		return tickets_node(pid, src_cpu, dst_cpu);
+		return tickets_cpu(pid, src_cpu, dst_cpu);
 	}
 
 	[[nodiscard]] inline auto mutate_ticket(const tickets_t tickets, const tickets_val_t range, const real_t diff)
@@ -605,29 +610,54 @@ namespace migration::thread {
 		virtual void migrate() = 0;
 
 	private:
-		// Search first in CPUs of the "closest" nodes
+		// Search first in CPUs sharing the last level cache, then in CPUs of the "closest" nodes. Among CPUs equally
+		// busy, the ones whose SMT siblings are less busy are preferred
 		[[nodiscard]] static auto closest_less_busy_cpu(const cpu_t src_cpu, const size_t min_tids_per_cpu,
 		                                                const bool ignore_idle) -> std::optional<cpu_t> {
-			const auto nodes_by_distance = system_info::nodes_by_distance(system_info::node_from_cpu(src_cpu));
+			const auto & topology          = system_info::cpu_topology();
+			const auto   nodes_by_distance = system_info::nodes_by_distance(system_info::node_from_cpu(src_cpu));
 
-			auto min_tids = std::numeric_limits<size_t>::max();
-			auto min_cpu  = src_cpu;
+			const auto core_tids = [&](const cpu_t cpu) {
+				size_t tids = 0;
+				for (const auto sibling : topology.smt_siblings(cpu)) {
+					tids += system_info::tids_from_cpu(sibling, ignore_idle).size();
+				}
+				return tids;
+			};
 
-			// Search first in "closest" nodes
-			for (const auto & dst_node : nodes_by_distance) {
-				for (const auto & dst_cpu : system_info::cpus_from_node(dst_node)) {
-					if (std::cmp_equal(src_cpu, dst_cpu)) { continue; }
+			auto min_tids      = std::numeric_limits<size_t>::max();
+			auto min_core_tids = std::numeric_limits<size_t>::max();
+			auto min_cpu       = src_cpu;
 
-					const auto dst_tids = system_info::tids_from_cpu(dst_cpu, ignore_idle).size();
+			// Returns true when the CPU is good enough to stop searching
+			const auto visit = [&](const cpu_t dst_cpu) {
+				if (std::cmp_equal(src_cpu, dst_cpu)) { return false; }
 
-					if (std::cmp_less(dst_tids, min_tids)) {
-						min_cpu  = dst_cpu;
-						min_tids = dst_tids;
-						if (std::cmp_less(dst_tids, min_tids_per_cpu)) { return min_cpu; }
-					}
+				const auto dst_tids = system_info::tids_from_cpu(dst_cpu, ignore_idle).size();
+				if (std::cmp_greater(dst_tids, min_tids)) { return false; }
+
+				const auto dst_core_tids = core_tids(dst_cpu);
+				if (dst_tids == min_tids && dst_core_tids >= min_core_tids) { return false; }
+
+				min_cpu       = dst_cpu;
+				min_tids      = dst_tids;
+				min_core_tids = dst_core_tids;
+
+				return std::cmp_less(dst_tids, min_tids_per_cpu) && dst_core_tids == dst_tids;
+			};
+
+			for (const auto & dst_cpu : topology.llc_cpus(src_cpu)) {
+				if (visit(dst_cpu)) { return min_cpu; }
+			}
+
+			for (const auto & dst_node : nodes_by_distance) {
+				for (const auto & dst_cpu : system_info::cpus_from_node(dst_node)) {
+					if (topology.same_llc(src_cpu, dst_cpu)) { continue; }
+					if (visit(dst_cpu)) { return min_cpu; }
 				}
 			}
 
+			// Nothing free enough: the least busy CPU found, if it is less busy than the source
 			const auto src_tids = system_info::tids_from_cpu(src_cpu, ignore_idle).size();
 
 			if (std::cmp_less(min_tids, src_tids)) { return min_cpu; }
@@ -742,7 +772,7 @@ namespace migration::thread {
 		}
 
 		[[nodiscard]] static auto balance_CPUs(const bool ignore_idle) -> std::vector<migration_cell> {
-			const auto total_tids = system_info::tids(ignore_idle).size();
+			const auto total_tids = system_info::num_of_tids(ignore_idle);
 
 			// No threads -> no imbalance
 			if (std::cmp_equal(total_tids, 0)) { return {}; }
@@ -765,7 +795,7 @@ namespace migration::thread {
 		}
 
 		[[nodiscard]] auto balance_nodes(const bool ignore_idle) const -> std::vector<migration_cell> {
-			const auto total_tids = system_info::tids(ignore_idle).size();
+			const auto total_tids = system_info::num_of_tids(ignore_idle);
 
 			// No threads -> no imbalance
 			if (std::cmp_equal(total_tids, 0)) { return {}; }
@@ -75,6 +75,10 @@ public:
 		return pagesize_;
 	}
 
+	[[nodiscard]] inline auto dsrc() const -> dsrc_t {
+		return dsrc_;
+	}
+
 	[[nodiscard]] inline auto reqs() const -> req_t {
 		return reqs_;
 	}
@@ -0,0 +1,222 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <r.laso@usc.es> wrote this file. As long as you retain this notice you
+ * can do whatever you want with this stuff. If we meet some day, and you think
+ * this stuff is worth it, you can buy me a beer in return Ruben Laso
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef THANOS_MEM_SAMPLE_AGGREGATOR_HPP
+#define THANOS_MEM_SAMPLE_AGGREGATOR_HPP
+
+#include <algorithm>   // for fill, min, max
+#include <bit>         // for bit_ceil
+#include <cstdint>     // for uint32_t, uint64_t
+#include <limits>      // for numeric_limits
+#include <sys/types.h> // for pid_t, size_t
+#include <utility>     // for cmp_less
+#include <vector>      // for vector
+
+#include "migration/utils/mem_sample.hpp" // for memory_sample_t
+#include "system_info/system_info.hpp"    // for node_from_cpu
+#include "utils/types.hpp"                // for addr_t, lat_t, node_t, req_t
+
+// Collapses the memory samples of a batch into a single entry per (page, TID, CPU node, page node).
+// Hot pages get hundreds of samples per interval, so updating the performance tables once per entry
+// (instead of once per sample) saves a lot of hash lookups in those (big) tables.
+// The scratch table uses open addressing with linear probing and keeps its memory between batches.
+class memory_sample_aggregator {
+public:
+	class entry {
+	private:
+		addr_t page_;      // Address of the beginning of the page (or fake THP)
+		addr_t addr_;      // Last sampled address
+		pid_t  pid_;       // PID of the sampled thread
+		pid_t  tid_;       // TID of the sampled thread
+		cpu_t  cpu_;       // Last CPU in which the thread was sampled
+		node_t cpu_node_;  // Node of the CPU (part of the key)
+		node_t page_node_; // Node in which the page is located (part of the key)
+		tim_t  time_;      // Time of the last sample
+		size_t pagesize_;  // Size of the page
+		dsrc_t dsrc_;      // Data source of the last sample
+
+		req_t count_       = 0;
+		lat_t latency_sum_ = 0;
+		lat_t min_latency_ = std::numeric_limits<lat_t>::max();
+		lat_t max_latency_ = 0;
+
+	public:
+		entry(const memory_sample_t & sample, const node_t cpu_node) :
+		    page_(sample.page()),
+		    addr_(sample.addr()),
+		    pid_(sample.pid()),
+		    tid_(sample.tid()),
+		    cpu_(sample.cpu()),
+		    cpu_node_(cpu_node),
+		    page_node_(sample.page_node()),
+		    time_(sample.time()),
+		    pagesize_(sample.pagesize()),
+		    dsrc_(sample.dsrc()) {
+		}
+
+		[[nodiscard]] inline auto matches(const memory_sample_t & sample, const node_t cpu_node) const -> bool {
+			return page_ == sample.page() && tid_ == sample.tid() && cpu_node_ == cpu_node &&
+			       page_node_ == sample.page_node();
+		}
+
+		inline void add(const memory_sample_t & sample) {
+			const auto latency = sample.latency();
+
+			count_ += sample.reqs();
+			latency_sum_ += latency * sample.reqs();
+			min_latency_ = std::min(min_latency_, latency);
+			max_latency_ = std::max(max_latency_, latency);
+
+			addr_ = sample.addr();
+			cpu_  = sample.cpu();
+			time_ = sample.time();
+			dsrc_ = sample.dsrc();
+		}
+
+		[[nodiscard]] inline auto page() const {
+			return page_;
+		}
+
+		[[nodiscard]] inline auto tid() const {
+			return tid_;
+		}
+
+		[[nodiscard]] inline auto cpu_node() const {
+			return cpu_node_;
+		}
+
+		[[nodiscard]] inline auto page_node() const {
+			return page_node_;
+		}
+
+		[[nodiscard]] inline auto count() const {
+			return count_;
+		}
+
+		[[nodiscard]] inline auto latency_sum() const {
+			return latency_sum_;
+		}
+
+		[[nodiscard]] inline auto av_latency() const -> lat_t {
+			return count_ > 0 ? (latency_sum_ + count_ / 2) / count_ : 0;
+		}
+
+		[[nodiscard]] inline auto min_latency() const {
+			return min_latency_;
+		}
+
+		[[nodiscard]] inline auto max_latency() const {
+			return max_latency_;
+		}
+
+		// Sample equivalent to all the samples collapsed in this entry: reqs = #samples, latency = mean latency
+		[[nodiscard]] inline auto to_sample() const -> memory_sample_t {
+			return { cpu_, pid_, tid_, time_, count_, addr_, page_, av_latency(), pagesize_, dsrc_, page_node_ };
+		}
+	};
+
+private:
+	static constexpr uint32_t EMPTY_SLOT   = std::numeric_limits<uint32_t>::max();
+	static constexpr size_t   MIN_CAPACITY = 1024;
+
+	std::vector<entry>    entries_{}; // Entries in insertion order (dense, to be iterated when flushing)
+	std::vector<uint32_t> slots_{};   // Open addressing table with indices to entries_
+	size_t                mask_ = 0;
+
+	size_t samples_ = 0;
+
+	[[nodiscard]] static inline auto hash(const addr_t page, const pid_t tid, const node_t cpu_node,
+	                                      const node_t page_node) -> uint64_t {
+		// Fibonacci hashing. Pages are aligned, so low bits of the address carry no information
+		auto h = (page >> 12) * 0x9E3779B97F4A7C15ULL;
+		h ^= (static_cast<uint64_t>(tid) << 16 | static_cast<uint64_t>(cpu_node) << 8 |
+		      static_cast<uint64_t>(page_node)) *
+		     0xC2B2AE3D27D4EB4FULL;
+		return h ^ (h >> 29);
+	}
+
+	inline void rehash(const size_t capacity) {
+		slots_.assign(capacity, EMPTY_SLOT);
+		mask_ = capacity - 1;
+
+		for (uint32_t i = 0; std::cmp_less(i, entries_.size()); ++i) {
+			const auto & e = entries_[i];
+
+			auto slot = hash(e.page(), e.tid(), e.cpu_node(), e.page_node()) & mask_;
+			while (slots_[slot] != EMPTY_SLOT) {
+				slot = (slot + 1) & mask_;
+			}
+			slots_[slot] = i;
+		}
+	}
+
+public:
+	memory_sample_aggregator() {
+		rehash(MIN_CAPACITY);
+	}
+
+	explicit memory_sample_aggregator(const size_t expected_entries) {
+		rehash(std::max(MIN_CAPACITY, std::bit_ceil(expected_entries * 2)));
+	}
+
+	[[nodiscard]] inline auto begin() const {
+		return entries_.begin();
+	}
+
+	[[nodiscard]] inline auto end() const {
+		return entries_.end();
+	}
+
+	[[nodiscard]] inline auto size() const {
+		return entries_.size();
+	}
+
+	[[nodiscard]] inline auto empty() const {
+		return entries_.empty();
+	}
+
+	// Number of samples aggregated since the last clear()
+	[[nodiscard]] inline auto samples() const {
+		return samples_;
+	}
+
+	inline void add(const memory_sample_t & sample) {
+		const auto cpu_node = system_info::node_from_cpu(sample.cpu());
+
+		auto slot = hash(sample.page(), sample.tid(), cpu_node, sample.page_node()) & mask_;
+
+		while (slots_[slot] != EMPTY_SLOT) {
+			auto & e = entries_[slots_[slot]];
+			if (e.matches(sample, cpu_node)) {
+				e.add(sample);
+				++samples_;
+				return;
+			}
+			slot = (slot + 1) & mask_;
+		}
+
+		slots_[slot] = static_cast<uint32_t>(entries_.size());
+		entries_.emplace_back(sample, cpu_node).add(sample);
+		++samples_;
+
+		// Keep load factor under 0.5 so probe sequences stay short
+		if (entries_.size() * 2 > slots_.size()) { rehash(slots_.size() * 2); }
+	}
+
+	// Empties the table but keeps the allocated memory for the next batch
+	inline void clear() {
+		if (entries_.empty()) { return; }
+
+		entries_.clear();
+		std::fill(slots_.begin(), slots_.end(), EMPTY_SLOT);
+		samples_ = 0;
+	}
+};
+
+#endif /* end of include guard: THANOS_MEM_SAMPLE_AGGREGATOR_HPP */
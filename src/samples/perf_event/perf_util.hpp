@@ -386,8 +386,8 @@ static auto transfer_data_from_buffer_to_structure(perf_event_desc_t * fds, int
 	sample->cpu = cpu.cpu;
 	sz -= sizeof(cpu);
 
-	perf_read_buffer_64(hw, &val64); // PERIOD
-	sz -= sizeof(val64);
+	perf_read_buffer_64(hw, &sample->period); // PERIOD
+	sz -= sizeof(sample->period);
 
 
 	if (fmt & PERF_FORMAT_GROUP) { // Inst samples
@@ -571,6 +571,7 @@ static int transfer_data_from_buffer_to_structure_allifs(perf_event_desc_t * fds
 			return -1;
 		}
 
+		sample->period = val64;
 		sz -= sizeof(val64);
 	}
 
@@ -104,6 +104,10 @@ namespace samples {
 		PIDs_to_filter.insert(pid);
 	}
 
+	inline void erase_PID_to_filter(const pid_t & pid) {
+		PIDs_to_filter.erase(pid);
+	}
+
 	[[nodiscard]] inline auto accept_PID_filter(const pid_t tid) -> bool {
 		return PIDs_to_filter.contains(tid);
 	}
@@ -175,6 +179,7 @@ namespace samples {
 		uint64_t time{};         // Timestamp (nanoseconds).
 		uint64_t sample_addr{};  // Address, if applicable.
 		uint32_t cpu{};          // CPU where the samples was generated.
+		uint64_t period{};       // Events represented by the sample (adjusted by the kernel in frequency mode).
 		uint64_t weight{};       // Hardware provided weight value that expresses how costly the sampled event was.
 		                         // This allows the hardware to highlight expensive events in a profile.
 		uint64_t time_enabled{}; // Time event active (nanoseconds).
@@ -218,6 +223,7 @@ namespace samples {
 			os << "\tDSRC: "         << p.dsrc                << '\n';
 			os << "\tTime: "         << p.time                << '\n';
 			os << "\tAddr: "         << p.sample_addr         << '\n';
+			os << "\tPeriod: "       << p.period              << '\n';
 			os << "\tWeight: "       << p.weight              << '\n';
 			os << "\tTime enabled: " << p.time_enabled        << '\n';
 			os << "\tTime running: " << p.time_running        << '\n';
@@ -0,0 +1,256 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <r.laso@usc.es> wrote this file. As long as you retain this notice you
+ * can do whatever you want with this stuff. If we meet some day, and you think
+ * this stuff is worth it, you can buy me a beer in return Ruben Laso
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef THANOS_CALIBRATION_HPP
+#define THANOS_CALIBRATION_HPP
+
+#include <algorithm>   // for max, min
+#include <chrono>      // for duration
+#include <cerrno>      // for errno
+#include <cstddef>     // for size_t
+#include <cstdint>     // for uint64_t
+#include <cstring>     // for strerror
+#include <fstream>     // for ifstream, ofstream
+#include <iostream>    // for operator<<, basic_ostream, cerr
+#include <limits>      // for numeric_limits
+#include <numa.h>      // for numa_alloc_onnode, numa_free, numa_run_on_node
+#include <optional>    // for optional
+#include <random>      // for mt19937_64, uniform_int_distribution
+#include <string>      // for string, getline, to_string
+#include <string_view> // for string_view
+#include <thread>      // for thread
+#include <utility>     // for swap
+#include <vector>      // for vector
+
+#include "utils/proc.hpp"    // for read_file
+#include "utils/types.hpp"   // for node_t, real_t, hres_clock
+#include "utils/verbose.hpp" // for print_with_lvl, LVL1
+
+// Measured cost of memory accesses between every pair of nodes, as an alternative to the distances of the SLIT
+// (numa_distance), which often do not match the real ratios. From a thread pinned to each node:
+// - latency: pointer chasing over a random cyclic permutation of cache lines, in a buffer bound to each node and
+//   larger than the LLC, so every load misses the caches and depends on the previous one (idle latency).
+// - bandwidth: sequential reads of the same buffer (streaming).
+// Measuring takes ~0.1 s per pair of nodes, so the results are cached in a file, keyed by the machine (DMI), its
+// CPUs and SLIT (which changes with the BIOS settings, e.g., sub-NUMA clustering)
+namespace system_info::calibration {
+	static constexpr size_t BUFFER_BYTES     = size_t(256) << 20; // Per node
+	static constexpr size_t CACHE_LINE       = 64;
+	static constexpr size_t CHASE_LOADS      = size_t(1) << 21;
+	static constexpr size_t BANDWIDTH_ROUNDS = 3; // The best one is kept
+
+	static constexpr const char * DEFAULT_FILE = "calibration.txt";
+
+	struct matrix_t {
+		size_t n_nodes = 0;
+
+		std::vector<real_t> latency{};   // latency[cpu_node * n_nodes + mem_node] = ns per dependent load
+		std::vector<real_t> bandwidth{}; // bandwidth[cpu_node * n_nodes + mem_node] = GB/s of a streaming read
+
+		matrix_t() = default;
+
+		explicit matrix_t(const size_t n) : n_nodes(n), latency(n * n), bandwidth(n * n) {
+		}
+
+		[[nodiscard]] inline auto empty() const -> bool {
+			return n_nodes == 0;
+		}
+
+		[[nodiscard]] inline auto latency_at(const node_t src, const node_t dst) const -> real_t {
+			return latency[static_cast<size_t>(src) * n_nodes + static_cast<size_t>(dst)];
+		}
+
+		[[nodiscard]] inline auto bandwidth_at(const node_t src, const node_t dst) const -> real_t {
+			return bandwidth[static_cast<size_t>(src) * n_nodes + static_cast<size_t>(dst)];
+		}
+	};
+
+	// Identifies the machine and its BIOS topology: DMI strings, number of CPUs and the SLIT of every node
+	[[nodiscard]] inline auto machine_key(const std::vector<node_t> & nodes, const size_t n_cpus) -> std::string {
+		std::string buffer;
+		std::string key;
+
+		const auto append = [&](const std::string & path) {
+			auto content = utils::proc::read_file(path, buffer).value_or(std::string_view());
+			while (!content.empty() && (content.back() == '\n' || content.back() == ' ')) {
+				content.remove_suffix(1);
+			}
+			key += std::string(content) + ";";
+		};
+
+		for (const auto * field : { "sys_vendor", "product_name", "board_name", "bios_version", "bios_date" }) {
+			append(std::string("/sys/class/dmi/id/") + field);
+		}
+
+		key += "cpus=" + std::to_string(n_cpus) + ";";
+
+		for (const auto node : nodes) {
+			key += "node" + std::to_string(node) + "=";
+			append("/sys/devices/system/node/node" + std::to_string(node) + "/distance");
+		}
+
+		return key;
+	}
+
+	// Average ns per load chasing pointers in the buffer (a random cyclic permutation of its cache lines)
+	[[nodiscard]] inline auto chase(const size_t * const buffer) -> real_t {
+		constexpr size_t stride = CACHE_LINE / sizeof(size_t);
+
+		size_t next = 0;
+
+		const auto begin = hres_clock::now();
+		for (size_t i = 0; i < CHASE_LOADS; ++i) {
+			next = buffer[next * stride];
+		}
+		const auto end = hres_clock::now();
+
+		// Make the result observable, so the loop is not removed
+		[[maybe_unused]] static volatile size_t sink;
+		sink = next;
+
+		return std::chrono::duration<real_t, std::nano>(end - begin).count() / static_cast<real_t>(CHASE_LOADS);
+	}
+
+	// GB/s reading the whole buffer (the best of BANDWIDTH_ROUNDS)
+	[[nodiscard]] inline auto stream(const uint64_t * const buffer) -> real_t {
+		constexpr size_t n = BUFFER_BYTES / sizeof(uint64_t);
+
+		real_t best = 0;
+
+		for (size_t round = 0; round < BANDWIDTH_ROUNDS; ++round) {
+			uint64_t sum = 0;
+
+			const auto begin = hres_clock::now();
+			for (size_t i = 0; i < n; i += 4) {
+				sum += buffer[i] + buffer[i + 1] + buffer[i + 2] + buffer[i + 3];
+			}
+			const auto end = hres_clock::now();
+
+			[[maybe_unused]] static volatile uint64_t sink;
+			sink = sum;
+
+			const auto ns = std::chrono::duration<real_t, std::nano>(end - begin).count();
+			best          = std::max(best, static_cast<real_t>(BUFFER_BYTES) / ns);
+		}
+
+		return best;
+	}
+
+	// Measures the matrix, with a thread pinned to each node of "nodes" in turn (the calling thread is not moved)
+	[[nodiscard]] inline auto measure(const std::vector<node_t> & nodes) -> matrix_t {
+		const auto max_node = nodes.empty() ? 0 : *std::ranges::max_element(nodes);
+
+		matrix_t matrix(static_cast<size_t>(max_node) + 1);
+
+		constexpr size_t stride  = CACHE_LINE / sizeof(size_t);
+		constexpr size_t n_lines = BUFFER_BYTES / CACHE_LINE;
+
+		for (const auto mem_node : nodes) {
+			auto * buffer = static_cast<size_t *>(numa_alloc_onnode(BUFFER_BYTES, mem_node));
+
+			if (buffer == nullptr) {
+				if (verbose::print_with_lvl(verbose::LVL1)) {
+					std::cerr << "Could not allocate the calibration buffer in node " << mem_node << '\n';
+				}
+				return {};
+			}
+
+			// Random cyclic permutation of the lines (Sattolo's algorithm): line i points to line order[i]
+			std::vector<size_t> order(n_lines);
+			for (size_t i = 0; i < n_lines; ++i) {
+				order[i] = i;
+			}
+
+			std::mt19937_64 rng(mem_node);
+			for (size_t i = n_lines - 1; i > 0; --i) {
+				std::uniform_int_distribution<size_t> dist(0, i - 1);
+				std::swap(order[i], order[dist(rng)]);
+			}
+
+			for (size_t i = 0; i < n_lines; ++i) {
+				buffer[i * stride] = order[i];
+			}
+
+			for (const auto cpu_node : nodes) {
+				int error = 0; // errno of numa_run_on_node, if the worker could not run in cpu_node
+
+				std::thread worker([&] {
+					if (numa_run_on_node(cpu_node) < 0) {
+						error = errno;
+						return;
+					}
+
+					const auto index = static_cast<size_t>(cpu_node) * matrix.n_nodes + static_cast<size_t>(mem_node);
+
+					matrix.latency[index]   = chase(buffer);
+					matrix.bandwidth[index] = stream(reinterpret_cast<const uint64_t *>(buffer));
+				});
+				worker.join();
+
+				// A cell left unmeasured would look like an infinitely fast link
+				if (error != 0) {
+					if (verbose::print_with_lvl(verbose::LVL1)) {
+						std::cerr << "Could not run the calibration in node " << cpu_node << ": " << strerror(error)
+						          << '\n';
+					}
+					numa_free(buffer, BUFFER_BYTES);
+					return {};
+				}
+			}
+
+			numa_free(buffer, BUFFER_BYTES);
+		}
+
+		return matrix;
+	}
+
+	// Matrix cached in the file, if it was measured in this same machine (key)
+	[[nodiscard]] inline auto read(const std::string & filename, const std::string & key) -> std::optional<matrix_t> {
+		std::ifstream file(filename);
+		if (!file.is_open()) { return std::nullopt; }
+
+		std::string file_key;
+		std::getline(file, file_key);
+		if (file_key != key) { return std::nullopt; }
+
+		size_t n = 0;
+		if (!(file >> n) || n == 0) { return std::nullopt; }
+
+		matrix_t matrix(n);
+
+		for (auto & latency : matrix.latency) {
+			file >> latency;
+		}
+		for (auto & bandwidth : matrix.bandwidth) {
+			file >> bandwidth;
+		}
+
+		if (file.fail()) { return std::nullopt; }
+
+		return matrix;
+	}
+
+	inline auto write(const std::string & filename, const std::string & key, const matrix_t & matrix) -> bool {
+		std::ofstream file(filename);
+		if (!file.is_open()) { return false; }
+
+		file << key << '\n' << matrix.n_nodes << '\n';
+
+		for (size_t i = 0; i < matrix.latency.size(); ++i) {
+			file << matrix.latency[i] << ((i + 1) % matrix.n_nodes == 0 ? '\n' : ' ');
+		}
+		for (size_t i = 0; i < matrix.bandwidth.size(); ++i) {
+			file << matrix.bandwidth[i] << ((i + 1) % matrix.n_nodes == 0 ? '\n' : ' ');
+		}
+
+		return file.good();
+	}
+} // namespace system_info::calibration
+
+#endif /* end of include guard: THANOS_CALIBRATION_HPP */
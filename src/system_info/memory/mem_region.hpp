@@ -13,6 +13,7 @@
 #include <fstream>     // for operator<<, basic_ostream, ostream
 #include <ranges>      // for ranges::iota_view...
 #include <string>      // for operator<<, string
+#include <string_view> // for string_view
 #include <sys/types.h> // for size_t, pid_t
 #include <vector>      // for vector
 
@@ -21,17 +22,20 @@
 #include "utils/string.hpp"         // for to_string_hex
 
 class mem_region : public mem_region_maps, public mem_region_numa_maps {
+private:
+	size_t thp_bytes_ = 0; // Bytes backed by transparent huge pages (AnonHugePages in /proc/<pid>/smaps)
+
 public:
 	mem_region(const pid_t pid, const size_t maps_index, const size_t numa_maps_index) :
 	    mem_region_maps(pid, maps_index), mem_region_numa_maps(pid, numa_maps_index) {
 	}
 
-	mem_region(const pid_t pid, const std::string & line_maps, const size_t index_maps,
-	           const std::string & line_numa_maps, const size_t index_numa_maps) :
+	mem_region(const pid_t pid, std::string_view line_maps, const size_t index_maps, std::string_view line_numa_maps,
+	           const size_t index_numa_maps) :
 	    mem_region_maps(line_maps, index_maps, pid), mem_region_numa_maps(line_numa_maps, index_numa_maps, pid) {
 	}
 
-	mem_region(mem_region_maps & maps, mem_region_numa_maps & numa_maps) :
+	mem_region(const mem_region_maps & maps, const mem_region_numa_maps & numa_maps) :
 	    mem_region_maps(maps), mem_region_numa_maps(numa_maps) {
 	}
 
@@ -43,6 +47,24 @@ public:
 		return mem_region_numa_maps::index();
 	}
 
+	// Size of the pages of the region (> base page size for hugetlbfs mappings)
+	[[nodiscard]] inline auto page_size() const -> size_t {
+		return kernelpagesize_kB() * 1024;
+	}
+
+	// Update the NUMA information (numa_maps) of the region, keeping the one from maps
+	inline void numa_maps(const mem_region_numa_maps & numa_maps) {
+		static_cast<mem_region_numa_maps &>(*this) = numa_maps;
+	}
+
+	[[nodiscard]] inline auto thp_bytes() const {
+		return thp_bytes_;
+	}
+
+	inline void thp_bytes(const size_t bytes) {
+		thp_bytes_ = bytes;
+	}
+
 	inline friend auto operator<<(std::ostream & os, const mem_region & m) -> std::ostream & {
 		os << utils::string::to_string_hex(m.begin()) << '-' << utils::string::to_string_hex(m.end()) << std::dec << ' '
 		   << m.bytes() << "B " << m.flags() << ' ' << "policy=" << m.policy() << ' ';
@@ -65,7 +87,8 @@ public:
 		os << "swapcache="         << m.swapcache() << ' ';
 		os << "active="            << m.active()    << ' ';
 		os << "writeback="         << m.writeback() << ' ';
-		os << "kernelpagesize_kB=" << m.kernelpagesize_kB();
+		os << "kernelpagesize_kB=" << m.kernelpagesize_kB() << ' ';
+		os << "AnonHugePages="     << m.thp_bytes() / 1024 << "kB";
 		/* clang-format on */
 
 		return os;
@@ -10,16 +10,19 @@
 #ifndef THANOS_MEM_REGION_MAPS_HPP
 #define THANOS_MEM_REGION_MAPS_HPP
 
+#include <algorithm>   // for copy_n, min
 #include <cerrno>      // for errno
 #include <climits>     // for PATH_MAX
 #include <cstdint>     // for uint32_t
-#include <cstdio>      // for sscanf, size_t, sprintf
+#include <cstdio>      // for size_t, sprintf
 #include <cstring>     // for strcmp, strerror, size_t
 #include <fstream>     // for operator<<, basic_ostream, ostringstream
 #include <stdexcept>   // for runtime_error
 #include <string>      // for string, getline, operator<<
+#include <string_view> // for string_view
 #include <sys/types.h> // for pid_t
 
+#include "utils/proc.hpp"  // for next_token, parse
 #include "utils/types.hpp" // for addr_t
 
 class mem_region_maps {
@@ -57,12 +60,32 @@ private:
 
 	std::array<char, PATH_MAX> path_{ '\0' };
 
-	inline void parse_line(const std::string & line) {
-		std::sscanf(line.c_str(), "%lx-%lx %4c %x %x:%x %x %s", &begin_, &end_, flags_.data(), &offset_, &device_maj_,
-		            &device_min_, &inode_, path_.data());
-		flags_.back() = '\0';
+	inline void parse_line(std::string_view line) {
+		using utils::proc::next_token;
+		using utils::proc::parse;
 
+		// <begin>-<end> <flags> <offset> <device_maj>:<device_min> <inode> [path]
+		begin_ = parse<addr_t>(line, 16).value_or(0);
+		end_   = parse<addr_t>(line, 16).value_or(0);
 		bytes_ = end_ - begin_;
+
+		const auto flags = next_token(line);
+		std::copy_n(flags.begin(), std::min(flags.size(), flags_.size() - 1), flags_.begin());
+		flags_.back() = '\0';
+
+		auto offset = next_token(line);
+		offset_     = parse<uint32_t>(offset, 16).value_or(0);
+
+		auto device = next_token(line);
+		device_maj_ = parse<uint32_t>(device, 16).value_or(0);
+		device_min_ = parse<uint32_t>(device, 16).value_or(0);
+
+		auto inode = next_token(line);
+		inode_     = parse<uint32_t>(inode).value_or(0);
+
+		const auto path = next_token(line);
+		std::copy_n(path.begin(), std::min(path.size(), path_.size() - 1), path_.begin());
+		path_[std::min(path.size(), path_.size() - 1)] = '\0';
 	}
 
 public:
@@ -100,7 +123,7 @@ public:
 		}
 	}
 
-	mem_region_maps(const std::string & line_info, const size_t & index, const pid_t & tid) : index_(index), tid_(tid) {
+	mem_region_maps(std::string_view line_info, const size_t & index, const pid_t & tid) : index_(index), tid_(tid) {
 		parse_line(line_info);
 	}
 
@@ -12,16 +12,18 @@
 
 #include <cerrno>      // for errno
 #include <climits>     // for PATH_MAX
-#include <cstdio>      // for sscanf
 #include <cstring>     // for size_t, strerror
 #include <istream>     // for operator<<, basic_ostream
 #include <ranges>      // for ranges::iota_view...
 #include <stdexcept>   // for runtime_error
 #include <string>      // for string, operator<<, getline
+#include <string_view> // for string_view
 #include <sys/types.h> // for pid_t
+#include <utility>     // for cmp_less
 #include <vector>      // for allocator, vector
 
 #include "system_info/system_info.hpp" // for num_of_nodes
+#include "utils/proc.hpp"              // for next_token, parse, parse_key
 #include "utils/types.hpp"             // for addr_t
 
 class mem_region_numa_maps {
@@ -87,22 +89,24 @@ private:
 	size_t kernelpagesize_kB_ = 4; // Size of each memory page
 
 protected:
-	auto parse_parameter(const std::string & parameter) -> bool {
-		const char * string = parameter.c_str();
+	auto parse_parameter(std::string_view parameter) -> bool {
+		using utils::proc::parse_key;
 
 		// Try parsing N<node>=<nr_pages>
-		int node  = 0;
-		int value = 0;
-
-		if (sscanf(string, "N%d=%d", &node, &value) > 0) {
-			pages_per_node_[node] = value;
-			return true;
+		if (parameter.starts_with('N')) {
+			auto       value = parameter.substr(1);
+			const auto node  = utils::proc::parse<size_t>(value);
+			const auto pages = utils::proc::parse<size_t>(value);
+
+			if (node.has_value() && pages.has_value() && std::cmp_less(node.value(), pages_per_node_.size())) {
+				pages_per_node_[node.value()] = pages.value();
+				return true;
+			}
 		}
 
 		// Try parsing file=<filename>
-		std::array<char, PATH_MAX> filename{ '\0' };
-		if (sscanf(string, "file=%s", filename.data()) > 0) {
-			file_ = std::string(filename.data());
+		if (parameter.starts_with("file=")) {
+			file_ = parameter.substr(std::string_view("file=").size());
 			return true;
 		}
 
@@ -123,72 +127,66 @@ protected:
 		}
 
 		// Try parsing anon=<pages>
-		if (std::cmp_greater(sscanf(string, "anon=%d", &value), 0)) {
-			anon_ = value;
+		if (const auto value = parse_key<size_t>(parameter, "anon="); value.has_value()) {
+			anon_ = value.value();
 			return true;
 		}
 
 		// Try parsing dirty=<pages>
-		if (std::cmp_greater(sscanf(string, "dirty=%d", &value), 0)) {
-			dirty_ = value;
+		if (const auto value = parse_key<size_t>(parameter, "dirty="); value.has_value()) {
+			dirty_ = value.value();
 			return true;
 		}
 
 		// Try parsing mapped=<pages>
-		if (std::cmp_greater(sscanf(string, "mapped=%d", &value), 0)) {
-			mapped_ = value;
+		if (const auto value = parse_key<size_t>(parameter, "mapped="); value.has_value()) {
+			mapped_ = value.value();
 			return true;
 		}
 
 		// Try parsing mapmax=<count>
-		if (std::cmp_greater(sscanf(string, "mapmax=%d", &value), 0)) {
-			mapmax_ = value;
+		if (const auto value = parse_key<size_t>(parameter, "mapmax="); value.has_value()) {
+			mapmax_ = value.value();
 			return true;
 		}
 
 		// Try parsing swapcache=<count>
-		if (std::cmp_greater(sscanf(string, "swapcache=%d", &value), 0)) {
-			swapcache_ = value;
+		if (const auto value = parse_key<size_t>(parameter, "swapcache="); value.has_value()) {
+			swapcache_ = value.value();
+			return true;
+		}
+
+		// Try parsing active=<pages>
+		if (const auto value = parse_key<size_t>(parameter, "active="); value.has_value()) {
+			active_ = value.value();
 			return true;
 		}
 
 		// Try parsing writeback=<pages>
-		if (std::cmp_greater(sscanf(string, "writeback=%d", &value), 0)) {
-			writeback_ = value;
+		if (const auto value = parse_key<size_t>(parameter, "writeback="); value.has_value()) {
+			writeback_ = value.value();
 			return true;
 		}
 
-		// Try parsing kernelpagesize_Kb=<pagesize>
-		if (std::cmp_greater(sscanf(string, "kernelpagesize_kB=%d", &value), 0)) {
-			kernelpagesize_kB_ = value;
+		// Try parsing kernelpagesize_kB=<pagesize>
+		if (const auto value = parse_key<size_t>(parameter, "kernelpagesize_kB="); value.has_value()) {
+			kernelpagesize_kB_ = value.value();
 			return true;
 		}
 
 		return false;
 	}
 
-	void parse_line(const std::string & line_) {
-		std::string line(line_);
+	void parse_line(std::string_view line) {
+		using utils::proc::next_token;
 
-		constexpr char SEP = ' ';
+		auto address = next_token(line);
+		address_     = utils::proc::parse<addr_t>(address, 16).value_or(0);
 
-		size_t pos = 0;
-
-		std::string token;
-
-		token = line.substr(0, pos = line.find(SEP));
-		sscanf(token.c_str(), "%lx", &address_);
-		line.erase(0, pos + 1); // +1 because of separator char
-
-		policy_ = line.substr(0, pos = line.find(SEP));
-		line.erase(0, pos + 1); // +1 because of separator char
-
-		while ((pos = line.find(SEP)) != std::string::npos) {
-			token = line.substr(0, pos);
+		policy_ = next_token(line);
 
+		for (auto token = next_token(line); !token.empty(); token = next_token(line)) {
 			parse_parameter(token);
-
-			line.erase(0, pos + 1);
 		}
 	}
 
@@ -228,7 +226,7 @@ public:
 		}
 	}
 
-	mem_region_numa_maps(const std::string & line_info, const size_t & index, const pid_t & tid) :
+	mem_region_numa_maps(std::string_view line_info, const size_t & index, const pid_t & tid) :
 	    index_(index), pid_(tid), pages_per_node_(system_info::num_of_nodes()) {
 		parse_line(line_info);
 	}
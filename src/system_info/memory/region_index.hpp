@@ -0,0 +1,113 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <r.laso@usc.es> wrote this file. As long as you retain this notice you
+ * can do whatever you want with this stuff. If we meet some day, and you think
+ * this stuff is worth it, you can buy me a beer in return Ruben Laso
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef THANOS_REGION_INDEX_HPP
+#define THANOS_REGION_INDEX_HPP
+
+#include <cstddef>     // for size_t
+#include <limits>      // for numeric_limits
+#include <span>        // for span
+#include <sys/types.h> // for size_t
+#include <vector>      // for vector
+
+#include "mem_region.hpp"  // for mem_region
+#include "utils/types.hpp" // for addr_t
+
+// Sorted flat index of the memory regions for address -> region lookups.
+// Bounds are kept in contiguous arrays (searched without branches) and each thread remembers its last hit, as
+// consecutive samples usually fall in the same region. The index points to the regions of the container it was built
+// from, so it must be rebuilt whenever that container changes.
+class region_index {
+private:
+	std::vector<addr_t>             begins_{};
+	std::vector<addr_t>             ends_{};
+	std::vector<const mem_region *> regions_{};
+
+	size_t generation_ = 0; // Invalidates the last hits of the threads after a rebuild
+
+	struct last_hit_t {
+		const region_index * index      = nullptr;
+		size_t               generation = std::numeric_limits<size_t>::max();
+		size_t               pos        = 0;
+	};
+
+	// Position of the last region starting at or before addr (size() if there is none)
+	[[nodiscard]] inline auto search(const addr_t addr) const -> size_t {
+		if (begins_.empty()) { return 0; }
+
+		const auto * base = begins_.data();
+
+		auto n = begins_.size();
+
+		while (n > 1) {
+			const auto half = n / 2;
+
+			base = base[half] <= addr ? base + half : base;
+			n -= half;
+		}
+
+		return *base <= addr ? static_cast<size_t>(base - begins_.data()) : begins_.size();
+	}
+
+public:
+	[[nodiscard]] inline auto size() const {
+		return regions_.size();
+	}
+
+	[[nodiscard]] inline auto empty() const {
+		return regions_.empty();
+	}
+
+	// Map = ordered container of [begin address, mem_region]
+	template<typename Map>
+	inline void rebuild(const Map & regions) {
+		begins_.clear();
+		ends_.clear();
+		regions_.clear();
+
+		begins_.reserve(regions.size());
+		ends_.reserve(regions.size());
+		regions_.reserve(regions.size());
+
+		for (const auto & [begin, region] : regions) {
+			begins_.emplace_back(region.begin());
+			ends_.emplace_back(region.end());
+			regions_.emplace_back(&region);
+		}
+
+		++generation_;
+	}
+
+	// Region containing addr (nullptr if there is none)
+	[[nodiscard]] inline auto find(const addr_t addr) const -> const mem_region * {
+		thread_local last_hit_t last;
+
+		if (last.index == this && last.generation == generation_ && begins_[last.pos] <= addr &&
+		    addr < ends_[last.pos]) {
+			return regions_[last.pos];
+		}
+
+		const auto pos = search(addr);
+
+		if (pos == begins_.size() || addr >= ends_[pos]) { return nullptr; }
+
+		last = { this, generation_, pos };
+
+		return regions_[pos];
+	}
+
+	// Regions containing each of the addresses (regions[i] = nullptr if addresses[i] is not in any region)
+	inline void find(std::span<const addr_t> addresses, std::span<const mem_region *> regions) const {
+		for (size_t i = 0; i < addresses.size() && i < regions.size(); ++i) {
+			regions[i] = find(addresses[i]);
+		}
+	}
+};
+
+#endif /* end of include guard: THANOS_REGION_INDEX_HPP */
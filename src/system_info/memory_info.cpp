@@ -9,7 +9,8 @@
 
 #include "memory_info.hpp"
 
-#include <concepts>
+#include <concepts> // for integral
+#include <fstream>  // for ifstream
 
 #include "types.hpp" // for addr_t
 
@@ -21,7 +22,24 @@ namespace memory_info {
 
 		size_t fake_thp_size = DEFAULT_FAKE_THP_SIZE;
 
-		map<addr_t, thp> fake_thp_regions;
+		region_index regions_index;
+
+		huge_page_policy_t huge_page_policy = DEFAULT_HUGE_PAGE_POLICY;
+
+		const size_t thp_size = [] {
+			std::ifstream file("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size");
+
+			size_t size = 0;
+			if (!(file >> size)) { return size_t(); }
+
+			return size;
+		}();
+
+		bool huge_regions = false;
+
+		umap<pid_t, umap<addr_t, bool>> thp_chunks;
+
+		umap<pid_t, pid_regions_t> pid_regions;
 	} // namespace details
 
 	namespace {
@@ -10,13 +10,18 @@
 #ifndef THANOS_MEMORY_INFO_HPP
 #define THANOS_MEMORY_INFO_HPP
 
+#include <algorithm>   // for ranges::all_of
 #include <array>       // for array
 #include <cerrno>      // for errno, EACCES, EBUSY
+#include <cstdio>      // for sscanf
 #include <cstring>     // for strerror
 #include <exception>   // for exception
+#include <fstream>     // for ifstream
 #include <iostream>    // for operator<<, basic_...
 #include <map>         // for map, operator==
+#include <numeric>     // for accumulate
 #include <ranges>      // for ranges::iota_view...
+#include <span>        // for span
 #include <stdexcept>   // for runtime_error
 #include <string>      // for char_traits, opera...
 #include <type_traits> // for __strip_reference_...
@@ -29,29 +34,81 @@
 
 #include "memory/mem_region.hpp"                  // for mem_region, operat...
 #include "memory/mem_region_numa_maps.hpp"        // for mem_region_numa_maps
+#include "memory/region_index.hpp"                // for region_index
 #include "memory/thp.hpp"                         // for thp...
 #include "memory/vmstat.hpp"                      // for vmstat_t, vmstat_t...
 #include "system_info/memory/mem_region_maps.hpp" // for mem_region_maps
-#include "system_info/system_info.hpp"            // for pid_is_lwp
+#include "system_info/system_info.hpp"            // for pid_is_lwp, reconcile_memory_usage
+#include "utils/proc.hpp"                         // for proc_file, for_each_line, parse
 #include "utils/string.hpp"                       // for to_string_hex
+#include "utils/time.hpp"                         // for time_until_now
 #include "utils/types.hpp"                        // for addr_t, node_t
 #include "utils/verbose.hpp"                      // for lvl, DEFAULT_LVL
 
 namespace memory_info {
 	static const auto pagesize = sysconf(_SC_PAGESIZE);
 
+	// How huge pages (THPs and hugetlbfs pages) are handled:
+	// - WHOLE: a huge page is tracked as a single page and it is migrated as a unit (one address per move_pages).
+	// - SPLIT: huge pages are tracked per base page, and the kernel splits them when they are migrated.
+	enum class huge_page_policy_t { WHOLE, SPLIT };
+
 	namespace details {
 		static constexpr size_t DEFAULT_FAKE_THP_SIZE = 0; // Disabled by default
 
+		static constexpr auto DEFAULT_HUGE_PAGE_POLICY = huge_page_policy_t::WHOLE;
+
 		extern vmstat_t<> vmstat;
 
 		extern map<addr_t, mem_region> memory_regions;
 
 		extern size_t fake_thp_size;
 
-		extern map<addr_t, thp> fake_thp_regions;
+		extern region_index regions_index; // Flat index of memory_regions for address lookups
+
+		extern huge_page_policy_t huge_page_policy;
+
+		extern const size_t thp_size; // Size of a PMD-mapped THP (0 if THPs are not supported)
+
+		extern bool huge_regions; // True if any memory region has huge pages
+
+		// thp_chunks[PID][THP-aligned address] = backed by a THP (from kpageflags), until the PID's regions are re-read
+		extern umap<pid_t, umap<addr_t, bool>> thp_chunks;
+
+		static constexpr real_t NUMA_MAPS_PERIOD = 10; // Seconds between full reads of numa_maps of a process
+
+		// /proc files of a monitored process and the VMAs found in its last refresh
+		struct pid_regions_t {
+			utils::proc::proc_file maps;
+			utils::proc::proc_file numa_maps;
+			utils::proc::proc_file smaps;
+
+			fast_umap<addr_t, size_t> vmas{}; // vmas[begin] = hash of the maps line
+
+			time_point last_numa_maps{}; // Last time numa_maps was read for all the regions
+
+			explicit pid_regions_t(const pid_t pid) :
+			    maps("/proc/" + std::to_string(pid) + "/maps"),
+			    numa_maps("/proc/" + std::to_string(pid) + "/numa_maps"),
+			    smaps("/proc/" + std::to_string(pid) + "/smaps") {
+			}
+		};
+
+		extern umap<pid_t, pid_regions_t> pid_regions;
 	} // namespace details
 
+	inline auto huge_page_policy() {
+		return details::huge_page_policy;
+	}
+
+	inline void huge_page_policy(const huge_page_policy_t policy) {
+		details::huge_page_policy = policy;
+	}
+
+	inline auto thp_size() {
+		return details::thp_size;
+	}
+
 	inline auto fake_thp_enabled() {
 		return std::cmp_not_equal(details::fake_thp_size, 0);
 	}
@@ -107,12 +164,13 @@ namespace memory_info {
 		return true;
 	}
 
-	inline auto move_pages(const std::vector<addr_t> & addresses, const pid_t pid, const std::vector<int> & nodes)
-	    -> bool {
+	// statuses[i] = node where addresses[i] is after the call, or -errno if it could not be moved
+	inline auto move_pages(const std::vector<addr_t> & addresses, const pid_t pid, const std::vector<int> & nodes,
+	                       std::vector<int> & statuses) -> bool {
 		size_t count = addresses.size();
 
 		std::vector<void *> pages(count, nullptr);
-		std::vector<int>    statuses(count, 0);
+		statuses.assign(count, 0);
 
 		for (size_t i = 0; const auto addr : addresses) {
 			pages[i] = reinterpret_cast<void *>(addr);
@@ -122,8 +180,13 @@ namespace memory_info {
 		const auto ret = numa_move_pages(pid, count, pages.data(), nodes.data(), statuses.data(), MPOL_MF_MOVE);
 
 		if (std::cmp_less(ret, 0)) {
+			const auto error = errno;
+
+			// The whole call failed: no page was moved
+			statuses.assign(count, -error);
+
 			if (verbose::print_with_lvl(verbose::DEFAULT_LVL)) {
-				std::cerr << "Error migrating " << count << " pages: " << strerror(errno) << '\n';
+				std::cerr << "Error migrating " << count << " pages: " << strerror(error) << '\n';
 			}
 
 			return false;
@@ -132,22 +195,17 @@ namespace memory_info {
 		return true;
 	}
 
-	inline auto move_pages(const std::vector<addr_t> & addresses, const pid_t pid, const int node) {
-		return move_pages(addresses, pid, std::vector<int>(addresses.size(), node));
-	}
-
-	// Currently, only normal ("small") pages are supported.
-	// Hopefully, THP (Transparent Huge Pages) will be supported in the future
-	[[nodiscard]] inline auto page_size([[maybe_unused]] const addr_t addr) -> size_t {
-		return pagesize;
-	}
+	// True only if every page was moved
+	inline auto move_pages(const std::vector<addr_t> & addresses, const pid_t pid, const std::vector<int> & nodes)
+	    -> bool {
+		std::vector<int> statuses;
+		if (!move_pages(addresses, pid, nodes, statuses)) { return false; }
 
-	[[nodiscard]] inline auto page_from_addr(const addr_t addr) -> addr_t {
-		return addr & ~(static_cast<addr_t>(page_size(addr) - 1));
+		return std::ranges::all_of(statuses, [](const int status) { return status >= 0; });
 	}
 
-	[[nodiscard]] inline auto page_from_addr(const addr_t addr, const size_t size) -> addr_t {
-		return addr & ~(static_cast<addr_t>(size - 1));
+	inline auto move_pages(const std::vector<addr_t> & addresses, const pid_t pid, const int node) {
+		return move_pages(addresses, pid, std::vector<int>(addresses.size(), node));
 	}
 
 	[[nodiscard]] inline auto get_page_current_node(const addr_t addr, const pid_t pid = 0) -> node_t {
@@ -187,26 +245,76 @@ namespace memory_info {
 
 	[[nodiscard]] static auto region_from_address(const addr_t addr)
 	    -> std::optional<std::reference_wrapper<const mem_region>> {
-		// Try to find the memory region whose address is greater or equal
-		auto it = details::memory_regions.lower_bound(addr);
+		const auto * region = details::regions_index.find(addr);
+
+		if (region == nullptr) { return std::nullopt; }
+
+		return { *region };
+	}
+
+	// Memory regions of a batch of addresses (regions[i] = nullptr if addresses[i] is not in any region)
+	static void regions_from_addresses(std::span<const addr_t> addresses, std::span<const mem_region *> regions) {
+		details::regions_index.find(addresses, regions);
+	}
+
+	[[nodiscard]] auto is_huge_page(const addr_t addr) -> bool;
+
+	[[nodiscard]] auto is_huge_page(const addr_t addr, const pid_t pid) -> bool;
+
+	// Size of the page containing addr:
+	// - hugetlbfs mappings: kernelpagesize_kB from numa_maps.
+	// - THPs: regions fully backed by THPs (AnonHugePages in smaps) are huge for every THP-aligned chunk. For regions
+	//   partially backed, each chunk is checked once in kpageflags (until the regions are updated again).
+	// - Otherwise (or with the SPLIT policy), the base page size.
+	// (region = memory region of addr, if already known, or nullptr)
+	[[nodiscard]] inline auto page_size(const addr_t addr, const mem_region * region_ptr) -> size_t {
+		if (!details::huge_regions || details::huge_page_policy == huge_page_policy_t::SPLIT) { return pagesize; }
+
+		if (region_ptr == nullptr) { return pagesize; }
+
+		const auto & region = *region_ptr;
+
+		if (std::cmp_greater(region.page_size(), pagesize)) { return region.page_size(); }
+
+		const auto huge_size = details::thp_size;
+
+		if (std::cmp_equal(region.thp_bytes(), 0) || std::cmp_equal(huge_size, 0)) { return pagesize; }
+
+		const auto chunk = addr & ~(static_cast<addr_t>(huge_size - 1));
+
+		// The THP must lie within the region
+		if (chunk < region.begin() || chunk + huge_size > region.end()) { return pagesize; }
+
+		const auto first_chunk = (region.begin() + huge_size - 1) & ~(static_cast<addr_t>(huge_size - 1));
+		const auto last_chunk  = region.end() & ~(static_cast<addr_t>(huge_size - 1));
+
+		if (std::cmp_greater_equal(region.thp_bytes(), last_chunk - first_chunk)) { return huge_size; }
+
+		const auto [it, inserted] = details::thp_chunks[region.pid()].try_emplace(chunk, false);
 
-		// If there is no match, .lower_bound() will return .end()
-		if (it == details::memory_regions.end()) { return std::nullopt; }
+		if (inserted) {
+			try {
+				it->second = is_huge_page(chunk, region.pid());
+			} catch (const std::exception & e) {
+				if (verbose::print_with_lvl(verbose::LVL_MAX)) { std::cerr << e.what() << '\n'; }
+			}
+		}
 
-		// If address matches we have been lucky
-		if (it->second.address() == addr) { return { it->second }; }
+		return it->second ? huge_size : pagesize;
+	}
 
-		// We found a greater address, so try with the previous region
+	[[nodiscard]] inline auto page_size(const addr_t addr) -> size_t {
+		if (!details::huge_regions || details::huge_page_policy == huge_page_policy_t::SPLIT) { return pagesize; }
 
-		// If it == .begin() but address does not match, we had bad luck
-		if (it == details::memory_regions.begin()) { return std::nullopt; }
+		return page_size(addr, details::regions_index.find(addr));
+	}
 
-		// Go to the previous registered memory region
-		--it;
-		if (it->second.begin() < addr && addr < it->second.end()) { return { it->second }; }
+	[[nodiscard]] inline auto page_from_addr(const addr_t addr, const size_t size) -> addr_t {
+		return addr & ~(static_cast<addr_t>(size - 1));
+	}
 
-		// No luck at all, return an empty optional...
-		return std::nullopt;
+	[[nodiscard]] inline auto page_from_addr(const addr_t addr) -> addr_t {
+		return page_from_addr(addr, page_size(addr));
 	}
 
 	[[nodiscard]] inline auto node_from_address(const addr_t addr) -> node_t {
@@ -235,115 +343,175 @@ namespace memory_info {
 		return nodes;
 	}
 
-	[[nodiscard]] auto is_huge_page(const addr_t addr) -> bool;
+	// Fake THP containing addr: the region is split in chunks of fake_thp_size pages from its base address (the last
+	// one may be smaller), so the boundaries are computed instead of stored
+	[[nodiscard]] static auto fake_thp_from_address(const addr_t addr, const mem_region * region)
+	    -> std::optional<thp> {
+		if (region == nullptr || !fake_thp_enabled()) { return std::nullopt; }
 
-	[[nodiscard]] auto is_huge_page(const addr_t addr, const pid_t pid) -> bool;
+		const auto chunk = static_cast<addr_t>(pagesize) * details::fake_thp_size;
+		const auto start = region->begin() + (addr - region->begin()) / chunk * chunk;
 
-	[[nodiscard]] static auto fake_thp_from_address(const addr_t addr)
-	    -> std::optional<std::reference_wrapper<const thp>> {
-		// Try to find the memory region whose address is greater or equal
-		auto it = details::fake_thp_regions.lower_bound(addr);
+		return thp(start, std::min(region->end(), start + chunk));
+	}
 
-		// If there is no match, .lower_bound() will return .end()
-		if (it == details::fake_thp_regions.end()) { return std::nullopt; }
+	[[nodiscard]] static auto fake_thp_from_address(const addr_t addr) -> std::optional<thp> {
+		return fake_thp_from_address(addr, details::regions_index.find(addr));
+	}
 
-		// If address matches we have been lucky
-		if (it->second.start() == addr) { return it->second; }
+	// anon_huge_pages[region start] = bytes of the region backed by THPs (from the content of /proc/<pid>/smaps)
+	[[nodiscard]] static auto read_anon_huge_pages(const std::string_view smaps) -> umap<addr_t, size_t> {
+		umap<addr_t, size_t> anon_huge_pages;
 
-		// We found a greater address, so try with the previous region
+		addr_t region_begin = 0;
 
-		// If it == .begin() but address does not match, we had bad luck
-		if (it == details::fake_thp_regions.begin()) { return std::nullopt; }
+		utils::proc::for_each_line(smaps, [&](std::string_view line, const size_t) {
+			// Fields are "<Name>: <value> kB", while headers are "<begin>-<end> perms offset dev inode [file]"
+			// (fields such as "AnonHugePages:" also start with an hex digit, so the separator tells them apart)
+			if (const auto kB = utils::proc::parse_key<size_t>(line, "AnonHugePages:"); kB.has_value()) {
+				if (kB.value() > 0) { anon_huge_pages[region_begin] = kB.value() * 1024; }
+				return;
+			}
 
-		// Go to the previous registered memory region
-		--it;
-		if (it->second.start() < addr && addr < it->second.end()) { return it->second; }
+			const auto name_end = line.find_first_of(":-");
+			if (name_end != std::string_view::npos && line[name_end] == '-') {
+				region_begin = utils::proc::parse<addr_t>(line, 16).value_or(region_begin);
+			}
+		});
 
-		// No luck at all, return an empty optional...
-		return std::nullopt;
+		return anon_huge_pages;
 	}
 
-	static void update_fake_thps() {
-		if (!fake_thp_enabled()) { return; }
-
-		details::fake_thp_regions.clear();
-
-		for (const auto & [addr, region] : details::memory_regions) {
-			auto start = region.address();
+	// Removes the memory region starting at "address" if it belongs to the given PID
+	static void erase_memory_region(const addr_t address, const pid_t pid) {
+		const auto it = details::memory_regions.find(address);
 
-			while (std::cmp_less(start, region.end())) {
-				const auto end = std::min(region.end(), start + pagesize * details::fake_thp_size);
-				details::fake_thp_regions.emplace(start, thp(start, end));
-				start = end;
-			}
+		if (it != details::memory_regions.end() && it->second.pid() == pid) {
+			details::memory_regions.erase(it);
 		}
 	}
 
-	static void update_memory_regions(pid_t pid) {
-		umap<addr_t, mem_region_maps>      regions_maps;
-		umap<addr_t, mem_region_numa_maps> regions_numa_maps;
+	// Incremental refresh of the memory regions of a process:
+	// - /proc/<pid>/maps is read (into a reused buffer) and compared with the previous refresh, so only the VMAs that
+	//   appeared or changed are parsed and updated, and the ones that vanished are removed.
+	// - /proc/<pid>/numa_maps (and smaps), which make the kernel walk the page tables, are only read if some VMA
+	//   changed (and only those regions are updated) or every NUMA_MAPS_PERIOD seconds (updating all the regions).
+	static void refresh_memory_regions(pid_t pid) {
+		auto & state = details::pid_regions.try_emplace(pid, pid).first->second;
 
-		const auto maps_filename = "/proc/" + std::to_string(pid) + "/maps";
+		const auto maps = state.maps.read_or_throw();
 
-		std::ifstream maps(maps_filename);
+		fast_umap<addr_t, size_t> vmas; // vmas[begin] = hash of the maps line
+		vmas.reserve(state.vmas.size());
 
-		if (!maps.good()) {
-			const auto error = "Cannot open file " + maps_filename + ": " + strerror(errno);
-			throw std::runtime_error(error);
-		}
+		fast_umap<addr_t, mem_region_maps> changed;
 
-		size_t i = 0;
+		utils::proc::for_each_line(maps, [&](const std::string_view line, const size_t i) {
+			auto       begin_str = line;
+			const auto begin     = utils::proc::parse<addr_t>(begin_str, 16);
 
-		while (maps.good()) {
-			std::string line;
+			if (!begin.has_value()) { return; }
 
-			std::getline(maps, line);
+			const auto hash = std::hash<std::string_view>{}(line);
 
-			mem_region_maps region(line, i, pid);
+			vmas.emplace(begin.value(), hash);
 
-			regions_maps.insert(std::make_pair(region.begin(), region));
+			const auto it = state.vmas.find(begin.value());
+			if (it == state.vmas.end() || it->second != hash) {
+				changed.emplace(begin.value(), mem_region_maps(line, i, pid));
+			}
+		});
 
-			++i;
+		for (const auto & [begin, hash] : state.vmas) {
+			if (!vmas.contains(begin)) { erase_memory_region(begin, pid); }
 		}
 
-		const auto numa_maps_filename = "/proc/" + std::to_string(pid) + "/numa_maps";
+		const bool full_refresh = utils::time::time_until_now(state.last_numa_maps) > details::NUMA_MAPS_PERIOD;
 
-		std::ifstream numa_maps(numa_maps_filename);
-
-		if (!numa_maps.good()) {
-			const auto error = "Cannot open file " + numa_maps_filename + ": " + strerror(errno);
-			throw std::runtime_error(error);
+		if (changed.empty() && !full_refresh) {
+			state.vmas.swap(vmas);
+			return;
 		}
 
-		i = 0;
+		const auto numa_maps = state.numa_maps.read_or_throw();
 
-		while (numa_maps.good()) {
-			std::string line;
+		const bool smaps_read =
+		    details::huge_page_policy == huge_page_policy_t::WHOLE && std::cmp_greater(details::thp_size, 0);
 
-			std::getline(numa_maps, line);
+		umap<addr_t, size_t> anon_huge_pages;
+		if (smaps_read) { anon_huge_pages = read_anon_huge_pages(state.smaps.read_or_throw()); }
 
-			mem_region_numa_maps region(line, i, pid);
+		// Only now the changed VMAs can be considered up to date: if a read failed, they are parsed again next time
+		state.vmas.swap(vmas);
 
-			regions_numa_maps.insert(std::make_pair(region.address(), region));
+		// The per-node usage of the process comes for free with the (expensive) read of numa_maps
+		system_info::reconcile_memory_usage(pid, numa_maps);
 
-			++i;
-		}
+		// The THP backing of the regions of this process is re-read, so the chunks checked in kpageflags are stale
+		if (smaps_read) { details::thp_chunks.erase(pid); }
 
-		for (auto & [address, region_numa_maps] : regions_numa_maps) {
-			const auto & region_maps = regions_maps.find(address);
+		utils::proc::for_each_line(numa_maps, [&](const std::string_view line, const size_t i) {
+			auto       address_str = line;
+			const auto address     = utils::proc::parse<addr_t>(address_str, 16);
 
-			if (region_maps == regions_maps.end()) { continue; }
+			if (!address.has_value()) { return; }
 
-			details::memory_regions.insert(std::make_pair(address, mem_region(region_maps->second, region_numa_maps)));
-		}
+			mem_region * region = nullptr;
+
+			if (const auto maps_it = changed.find(address.value()); maps_it != changed.end()) {
+				// New or modified VMA: (re)build the whole region, unless another process already owns the address
+				const mem_region_numa_maps numa(line, i, pid);
+
+				const auto [it, inserted] = details::memory_regions.try_emplace(address.value(), maps_it->second, numa);
+
+				if (inserted) {
+					region = &it->second;
+				} else if (it->second.pid() == pid) {
+					it->second = mem_region(maps_it->second, numa);
+					region     = &it->second;
+				}
+			} else if (full_refresh) {
+				// Unchanged VMA: only its NUMA information (e.g., pages per node) may have changed
+				const auto it = details::memory_regions.find(address.value());
+
+				if (it != details::memory_regions.end() && it->second.pid() == pid) {
+					it->second.numa_maps(mem_region_numa_maps(line, i, pid));
+					region = &it->second;
+				}
+			}
+
+			if (region == nullptr || !smaps_read) { return; }
+
+			const auto thp_it = anon_huge_pages.find(address.value());
+			region->thp_bytes(thp_it != anon_huge_pages.end() ? thp_it->second : 0);
+		});
+
+		if (full_refresh) { state.last_numa_maps = hres_clock::now(); }
+	}
+
+	static void update_memory_regions(pid_t pid) {
+		refresh_memory_regions(pid);
+		details::regions_index.rebuild(details::memory_regions);
 	}
 
 	template<template<typename...> typename Iterable>
 	static void update_memory_regions(const Iterable<pid_t> & pids) {
-		details::memory_regions.clear();
-
 		update_vmstat();
 
+		// Forget the processes that are not monitored anymore (or became LWPs)
+		std::erase_if(details::pid_regions, [&](const auto & item) {
+			const auto & [pid, state] = item;
+
+			if (std::ranges::find(pids, pid) != pids.end() && !system_info::pid_is_lwp(pid)) { return false; }
+
+			for (const auto & [begin, hash] : state.vmas) {
+				erase_memory_region(begin, pid);
+			}
+			details::thp_chunks.erase(pid);
+
+			return true;
+		});
+
 		for (const auto & pid : pids) {
 			// If the PID corresponds to a LWP (Light Weight Process)...
 			if (system_info::pid_is_lwp(pid)) {
@@ -351,7 +519,7 @@ namespace memory_info {
 				continue;
 			}
 			try {
-				update_memory_regions(pid);
+				refresh_memory_regions(pid);
 			} catch (const std::exception & e) {
 				if (verbose::print_with_lvl(verbose::LVL1)) { std::cerr << e.what() << '\n'; }
 			} catch (...) {
@@ -360,10 +528,25 @@ namespace memory_info {
 				}
 			}
 		}
+
+		details::regions_index.rebuild(details::memory_regions);
+
+		details::huge_regions = std::ranges::any_of(details::memory_regions, [](const auto & item) {
+			const auto & [address, region] = item;
+			return region.thp_bytes() > 0 || std::cmp_greater(region.page_size(), pagesize);
+		});
 	}
 
 	[[nodiscard]] inline auto n_thps_all_regions() {
-		return details::fake_thp_regions.size();
+		if (!fake_thp_enabled()) { return size_t(); }
+
+		const auto chunk = static_cast<size_t>(pagesize) * details::fake_thp_size;
+
+		return std::accumulate(details::memory_regions.begin(), details::memory_regions.end(), size_t(),
+		                       [&](const auto & acc, const auto & el) {
+			                       const auto & [addr, region] = el;
+			                       return acc + (region.bytes() + chunk - 1) / chunk;
+		                       });
 	}
 
 	[[nodiscard]] inline auto n_pages_all_regions() {
@@ -376,26 +559,7 @@ namespace memory_info {
 	}
 
 	[[nodiscard]] static auto contains(const addr_t addr) -> bool {
-		// Try to find the memory region whose address is greater or equal
-		auto it = details::memory_regions.lower_bound(addr);
-
-		// If there is no match, .lower_bound() will return .end()
-		if (it == details::memory_regions.end()) { return false; }
-
-		// If address matches we have been lucky
-		if (it->second.address() == addr) { return true; }
-
-		// We found a greater address, so try with the previous region
-
-		// If it == .begin() but address does not match, we had bad luck
-		if (it == details::memory_regions.begin()) { return false; }
-
-		// Go to the previous registered memory region
-		--it;
-		if (it->second.begin() < addr && addr < it->second.end()) { return true; }
-
-		// No luck at all...
-		return false;
+		return details::regions_index.find(addr) != nullptr;
 	}
 
 	template<template<typename...> typename Iterable>
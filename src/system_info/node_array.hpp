@@ -0,0 +1,199 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <r.laso@usc.es> wrote this file. As long as you retain this notice you
+ * can do whatever you want with this stuff. If we meet some day, and you think
+ * this stuff is worth it, you can buy me a beer in return Ruben Laso
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef THANOS_NODE_ARRAY_HPP
+#define THANOS_NODE_ARRAY_HPP
+
+#include <algorithm>   // for fill
+#include <array>       // for array
+#include <numa.h>      // for numa_max_node
+#include <span>        // for span
+#include <sys/types.h> // for size_t
+#include <utility>     // for index_sequence, make_index_sequence
+#include <vector>      // for vector
+
+#ifndef THANOS_MAX_NODES
+#define THANOS_MAX_NODES 8
+#endif
+
+namespace system_info {
+	// Storage of node_array on the heap, sized at runtime
+	static constexpr size_t DYNAMIC_NODES = 0;
+
+	// Max. number of NUMA nodes whose per-node data is stored inline (without heap allocations). DYNAMIC_NODES if the
+	// per-node data is always stored on the heap
+	static constexpr size_t MAX_INLINE_NODES = THANOS_MAX_NODES;
+
+	// Size of per-node data (node IDs go from 0 to max_node)
+	[[nodiscard]] inline auto n_nodes() -> size_t {
+		static const auto N_NODES = static_cast<size_t>(numa_max_node() + 1);
+		return N_NODES;
+	}
+
+	namespace details {
+		template<size_t N, typename F>
+		inline void unrolled_for(F && f) {
+			[&]<size_t... I>(std::index_sequence<I...>) { (f(I), ...); }(std::make_index_sequence<N>{});
+		}
+	} // namespace details
+
+	// Calls f(node) for every node ID in [0, max_node].
+	// Common topologies (1, 2, 4 and 8 nodes) are dispatched (once the number of nodes is known at startup) to fully
+	// unrolled loops. Any other topology falls back to a plain loop.
+	template<typename F>
+	inline void for_each_node(F && f) {
+		switch (n_nodes()) {
+			case 1:
+				details::unrolled_for<1>(f);
+				break;
+			case 2:
+				details::unrolled_for<2>(f);
+				break;
+			case 4:
+				details::unrolled_for<4>(f);
+				break;
+			case 8:
+				details::unrolled_for<8>(f);
+				break;
+			default:
+				for (size_t node = 0; node < n_nodes(); ++node) {
+					f(node);
+				}
+				break;
+		}
+	}
+
+	// Per-node data, stored inline in a std::array of N elements (N = MAX_INLINE_NODES unless stated otherwise), so
+	// accesses are plain indexing. The system must not have more than N nodes (checked at startup, see fits())
+	template<typename T, size_t N = MAX_INLINE_NODES>
+	class node_array {
+	private:
+		std::array<T, N> data_{};
+
+	public:
+		node_array() = default;
+
+		explicit node_array(const T & value) {
+			data_.fill(value);
+		}
+
+		// Whether this storage can hold the data of every node of the system
+		[[nodiscard]] static inline auto fits() -> bool {
+			return n_nodes() <= N;
+		}
+
+		[[nodiscard]] inline auto data() -> T * {
+			return data_.data();
+		}
+
+		[[nodiscard]] inline auto data() const -> const T * {
+			return data_.data();
+		}
+
+		[[nodiscard]] static inline auto size() -> size_t {
+			return n_nodes();
+		}
+
+		[[nodiscard]] inline auto operator[](const size_t node) -> T & {
+			return data_[node];
+		}
+
+		[[nodiscard]] inline auto operator[](const size_t node) const -> const T & {
+			return data_[node];
+		}
+
+		[[nodiscard]] inline auto begin() {
+			return data();
+		}
+
+		[[nodiscard]] inline auto end() {
+			return data() + size();
+		}
+
+		[[nodiscard]] inline auto begin() const {
+			return data();
+		}
+
+		[[nodiscard]] inline auto end() const {
+			return data() + size();
+		}
+
+		[[nodiscard]] inline auto span() const {
+			return std::span<const T>(data(), size());
+		}
+
+		inline void fill(const T & value) {
+			std::fill(begin(), end(), value);
+		}
+	};
+
+	// Heap storage for any number of nodes (builds with MAX_NODES=0, for big or odd topologies).
+	// No std::vector<bool> specialisation: use uint8_t
+	template<typename T>
+	class node_array<T, DYNAMIC_NODES> {
+	private:
+		std::vector<T> data_ = std::vector<T>(n_nodes());
+
+	public:
+		node_array() = default;
+
+		explicit node_array(const T & value) : data_(n_nodes(), value) {
+		}
+
+		[[nodiscard]] static inline auto fits() -> bool {
+			return true;
+		}
+
+		[[nodiscard]] inline auto data() -> T * {
+			return data_.data();
+		}
+
+		[[nodiscard]] inline auto data() const -> const T * {
+			return data_.data();
+		}
+
+		[[nodiscard]] static inline auto size() -> size_t {
+			return n_nodes();
+		}
+
+		[[nodiscard]] inline auto operator[](const size_t node) -> T & {
+			return data_[node];
+		}
+
+		[[nodiscard]] inline auto operator[](const size_t node) const -> const T & {
+			return data_[node];
+		}
+
+		[[nodiscard]] inline auto begin() {
+			return data();
+		}
+
+		[[nodiscard]] inline auto end() {
+			return data() + size();
+		}
+
+		[[nodiscard]] inline auto begin() const {
+			return data();
+		}
+
+		[[nodiscard]] inline auto end() const {
+			return data() + size();
+		}
+
+		[[nodiscard]] inline auto span() const {
+			return std::span<const T>(data_);
+		}
+
+		inline void fill(const T & value) {
+			std::fill(begin(), end(), value);
+		}
+	};
+} // namespace system_info
+
+#endif /* end of include guard: THANOS_NODE_ARRAY_HPP */
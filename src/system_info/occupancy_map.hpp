@@ -0,0 +1,251 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <r.laso@usc.es> wrote this file. As long as you retain this notice you
+ * can do whatever you want with this stuff. If we meet some day, and you think
+ * this stuff is worth it, you can buy me a beer in return Ruben Laso
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef THANOS_OCCUPANCY_MAP_HPP
+#define THANOS_OCCUPANCY_MAP_HPP
+
+#include <bit>         // for popcount, countr_zero
+#include <cstddef>     // for size_t, ptrdiff_t
+#include <cstdint>     // for uint64_t, uint32_t
+#include <iterator>    // for forward_iterator_tag
+#include <sys/types.h> // for pid_t
+#include <vector>      // for vector
+
+#include "utils/types.hpp" // for umap
+
+// Threads placed in each CPU (or node), as bitsets over dense thread slots, plus a mask of the idle threads.
+// Queries return views over the bitsets: iterating them visits the set bits and counting them is a popcount, so
+// no container of TIDs is built
+class occupancy_map {
+private:
+	using word_t = uint64_t;
+
+	static constexpr size_t WORD_BITS = 64;
+
+	std::vector<pid_t>    tids_{};  // TID of each slot (0 if the slot is free)
+	std::vector<uint32_t> free_{};  // Free slots
+	umap<pid_t, uint32_t> slots_{}; // TID -> slot
+
+	std::vector<std::vector<word_t>> places_{}; // Bitset of threads of each place (CPU or node)
+	std::vector<word_t>              idle_{};   // Bitset of idle threads
+
+	size_t words_ = 0; // Words of every bitset
+
+	[[nodiscard]] inline auto slot(const pid_t tid) -> uint32_t {
+		if (const auto it = slots_.find(tid); it != slots_.end()) { return it->second; }
+
+		uint32_t slot = 0;
+
+		if (free_.empty()) {
+			slot = static_cast<uint32_t>(tids_.size());
+			tids_.emplace_back();
+
+			if (tids_.size() > words_ * WORD_BITS) {
+				++words_;
+				for (auto & place : places_) {
+					place.resize(words_);
+				}
+				idle_.resize(words_);
+			}
+		} else {
+			slot = free_.back();
+			free_.pop_back();
+		}
+
+		tids_[slot]  = tid;
+		slots_[tid] = slot;
+
+		return slot;
+	}
+
+	static inline void set_bit(std::vector<word_t> & bits, const uint32_t slot, const bool value) {
+		const auto mask = word_t(1) << (slot % WORD_BITS);
+
+		if (value) {
+			bits[slot / WORD_BITS] |= mask;
+		} else {
+			bits[slot / WORD_BITS] &= ~mask;
+		}
+	}
+
+public:
+	// TIDs of a bitset, optionally excluding the ones of a mask (e.g., the idle threads).
+	// Only valid while the occupancy_map exists
+	class view {
+	private:
+		const std::vector<word_t> * bits_    = nullptr;
+		const std::vector<word_t> * exclude_ = nullptr;
+		const std::vector<pid_t> *  tids_    = nullptr;
+
+		[[nodiscard]] inline auto word(const size_t i) const -> word_t {
+			return (*bits_)[i] & (exclude_ != nullptr ? ~(*exclude_)[i] : ~word_t(0));
+		}
+
+		[[nodiscard]] inline auto n_words() const -> size_t {
+			return bits_->size();
+		}
+
+	public:
+		class iterator {
+		private:
+			const view * view_ = nullptr;
+
+			size_t word_i_ = 0;
+			word_t word_   = 0; // Bits of the current word not visited yet
+
+			inline void skip_empty_words() {
+				while (word_ == 0 && ++word_i_ < view_->n_words()) {
+					word_ = view_->word(word_i_);
+				}
+			}
+
+		public:
+			using iterator_category = std::forward_iterator_tag;
+			using value_type        = pid_t;
+			using difference_type   = std::ptrdiff_t;
+			using pointer           = const pid_t *;
+			using reference         = pid_t;
+
+			iterator() = default;
+
+			iterator(const view * v, const size_t word_i) : view_(v), word_i_(word_i) {
+				if (word_i_ < view_->n_words()) {
+					word_ = view_->word(word_i_);
+					skip_empty_words();
+				}
+			}
+
+			[[nodiscard]] inline auto operator*() const -> pid_t {
+				return (*view_->tids_)[word_i_ * WORD_BITS + static_cast<size_t>(std::countr_zero(word_))];
+			}
+
+			inline auto operator++() -> iterator & {
+				word_ &= word_ - 1; // Clear the lowest set bit
+				skip_empty_words();
+				return *this;
+			}
+
+			inline auto operator++(int) -> iterator {
+				auto it = *this;
+				++(*this);
+				return it;
+			}
+
+			[[nodiscard]] inline auto operator==(const iterator & other) const -> bool {
+				return word_i_ == other.word_i_ && word_ == other.word_;
+			}
+		};
+
+		view() = default;
+
+		view(const std::vector<word_t> & bits, const std::vector<word_t> * exclude, const std::vector<pid_t> & tids) :
+		    bits_(&bits), exclude_(exclude), tids_(&tids) {
+		}
+
+		[[nodiscard]] inline auto begin() const -> iterator {
+			return { this, 0 };
+		}
+
+		[[nodiscard]] inline auto end() const -> iterator {
+			return { this, n_words() };
+		}
+
+		[[nodiscard]] inline auto size() const -> size_t {
+			size_t count = 0;
+			for (size_t i = 0; i < n_words(); ++i) {
+				count += static_cast<size_t>(std::popcount(word(i)));
+			}
+			return count;
+		}
+
+		[[nodiscard]] inline auto empty() const -> bool {
+			for (size_t i = 0; i < n_words(); ++i) {
+				if (word(i) != 0) { return false; }
+			}
+			return true;
+		}
+	};
+
+	occupancy_map() = default;
+
+	explicit occupancy_map(const size_t n_places) {
+		resize(n_places);
+	}
+
+	inline void resize(const size_t n_places) {
+		places_.resize(n_places, std::vector<word_t>(words_));
+	}
+
+	[[nodiscard]] inline auto n_places() const -> size_t {
+		return places_.size();
+	}
+
+	inline void insert(const size_t place, const pid_t tid, const bool idle) {
+		const auto s = slot(tid);
+		set_bit(places_[place], s, true);
+		set_bit(idle_, s, idle);
+	}
+
+	inline void erase(const size_t place, const pid_t tid) {
+		if (const auto it = slots_.find(tid); it != slots_.end()) { set_bit(places_[place], it->second, false); }
+	}
+
+	// Removes the thread from every place, releasing its slot
+	inline void erase(const pid_t tid) {
+		const auto it = slots_.find(tid);
+		if (it == slots_.end()) { return; }
+
+		const auto s = it->second;
+
+		for (auto & place : places_) {
+			set_bit(place, s, false);
+		}
+		set_bit(idle_, s, false);
+
+		tids_[s] = 0;
+		free_.emplace_back(s);
+		slots_.erase(it);
+	}
+
+	// Marks the thread as idle or not (threads not placed anywhere are ignored)
+	inline void idle(const pid_t tid, const bool idle) {
+		if (const auto it = slots_.find(tid); it != slots_.end()) { set_bit(idle_, it->second, idle); }
+	}
+
+	[[nodiscard]] inline auto tids(const size_t place) const -> view {
+		return { places_[place], nullptr, tids_ };
+	}
+
+	[[nodiscard]] inline auto non_idle_tids(const size_t place) const -> view {
+		return { places_[place], &idle_, tids_ };
+	}
+
+	[[nodiscard]] inline auto tids(const size_t place, const bool ignore_idle) const -> view {
+		return ignore_idle ? non_idle_tids(place) : tids(place);
+	}
+
+	// Threads placed anywhere (ignoring the idle ones if requested)
+	[[nodiscard]] inline auto count(const bool ignore_idle) const -> size_t {
+		size_t count = 0;
+
+		for (size_t i = 0; i < words_; ++i) {
+			word_t any = 0;
+			for (const auto & place : places_) {
+				any |= place[i];
+			}
+			if (ignore_idle) { any &= ~idle_[i]; }
+
+			count += static_cast<size_t>(std::popcount(any));
+		}
+
+		return count;
+	}
+};
+
+#endif /* end of include guard: THANOS_OCCUPANCY_MAP_HPP */
@@ -0,0 +1,274 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <r.laso@usc.es> wrote this file. As long as you retain this notice you
+ * can do whatever you want with this stuff. If we meet some day, and you think
+ * this stuff is worth it, you can buy me a beer in return Ruben Laso
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef THANOS_PROC_EVENTS_HPP
+#define THANOS_PROC_EVENTS_HPP
+
+#include <array>             // for array
+#include <cerrno>            // for errno, EINTR, ENOBUFS, ETIMEDOUT
+#include <cstring>           // for memcpy, strerror
+#include <iostream>          // for operator<<, basic_ostream, cerr
+#include <linux/cn_proc.h>   // for proc_event, proc_cn_mcast_op, PROC_EVENT_*
+#include <linux/connector.h> // for cn_msg, CN_IDX_PROC, CN_VAL_PROC
+#include <linux/netlink.h>   // for nlmsghdr, sockaddr_nl, NLMSG_*
+#include <poll.h>            // for poll, pollfd, POLLIN
+#include <sys/socket.h>      // for socket, bind, send, recv
+#include <sys/syscall.h>     // for SYS_pidfd_open
+#include <tuple>             // for ignore
+#include <unistd.h>          // for close, getpid, syscall
+#include <utility>           // for exchange
+#include <vector>            // for vector
+
+#include "utils/types.hpp"   // for umap
+#include "utils/verbose.hpp" // for print_with_lvl, LVL1
+
+// Process lifecycle events (fork/exec/exit of every thread in the system) from the netlink process connector.
+// Subscribing requires CAP_NET_ADMIN, so enabled() must be checked: if it is false, new threads can only be found
+// scanning /proc (see pidfd_watch for a cheap way to notice exits)
+class proc_events {
+public:
+	enum class type_t { fork, exec, exit };
+
+	struct event_t {
+		type_t type;
+		pid_t  pid;         // TID of the thread that forked/exec'ed/exited
+		pid_t  tgid;        // Process (thread group) of pid
+		pid_t  parent_pid;  // For forks: parent thread (the parent of the process for new threads, see fork())
+		pid_t  parent_tgid; // For forks: process of the parent thread
+	};
+
+private:
+	static constexpr size_t BUFFER_SIZE = 32 * 1024;
+
+	// How long to wait for the kernel to acknowledge the subscription
+	static constexpr int ACK_TIMEOUT_MS = 100;
+
+	int sock_ = -1;
+
+	bool overflow_ = false; // Events were lost since the last poll() (the socket buffer was full)
+
+	alignas(nlmsghdr) std::array<char, BUFFER_SIZE> buffer_{};
+
+	// Sends PROC_CN_MCAST_LISTEN/IGNORE to the connector
+	[[nodiscard]] inline auto send_op(const proc_cn_mcast_op op) const -> bool {
+		alignas(nlmsghdr) std::array<char, NLMSG_SPACE(sizeof(cn_msg) + sizeof(proc_cn_mcast_op))> msg{};
+
+		auto * header        = reinterpret_cast<nlmsghdr *>(msg.data());
+		header->nlmsg_len    = NLMSG_LENGTH(sizeof(cn_msg) + sizeof(proc_cn_mcast_op));
+		header->nlmsg_type   = NLMSG_DONE;
+		header->nlmsg_pid    = static_cast<__u32>(getpid());
+		header->nlmsg_flags  = 0;
+		header->nlmsg_seq    = 0;
+		auto * connector_msg = static_cast<cn_msg *>(NLMSG_DATA(header));
+		connector_msg->id    = { CN_IDX_PROC, CN_VAL_PROC };
+		connector_msg->len   = sizeof(proc_cn_mcast_op);
+		std::memcpy(connector_msg->data, &op, sizeof(op));
+
+		return send(sock_, msg.data(), header->nlmsg_len, 0) >= 0;
+	}
+
+	// Waits for the acknowledgement of the subscription (a PROC_EVENT_NONE with the error code, if any)
+	[[nodiscard]] inline auto wait_ack() -> int {
+		pollfd pfd = { sock_, POLLIN, 0 };
+
+		while (::poll(&pfd, 1, ACK_TIMEOUT_MS) > 0) {
+			const auto len = recv(sock_, buffer_.data(), buffer_.size(), 0);
+			if (len <= 0) { break; }
+
+			auto remaining = static_cast<unsigned int>(len);
+
+			for (auto * header = reinterpret_cast<nlmsghdr *>(buffer_.data()); NLMSG_OK(header, remaining);
+			     header       = NLMSG_NEXT(header, remaining)) {
+				const auto * connector_msg = static_cast<const cn_msg *>(NLMSG_DATA(header));
+				const auto * event         = reinterpret_cast<const proc_event *>(connector_msg->data);
+
+				if (event->what == proc_event::PROC_EVENT_NONE) {
+					return static_cast<int>(event->event_data.ack.err);
+				}
+			}
+		}
+
+		return ETIMEDOUT;
+	}
+
+	inline void close_socket() {
+		if (sock_ >= 0) { close(std::exchange(sock_, -1)); }
+	}
+
+public:
+	proc_events() = default;
+
+	proc_events(const proc_events &)                     = delete;
+	auto operator=(const proc_events &) -> proc_events & = delete;
+
+	~proc_events() {
+		if (sock_ >= 0) { std::ignore = send_op(PROC_CN_MCAST_IGNORE); }
+		close_socket();
+	}
+
+	// Subscribes to the events. Returns false if they are not available (e.g., missing CAP_NET_ADMIN)
+	inline auto open() -> bool {
+		if (sock_ >= 0) { return true; }
+
+		sock_ = socket(PF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_CONNECTOR);
+
+		sockaddr_nl addr = {};
+		addr.nl_family   = AF_NETLINK;
+		addr.nl_groups   = CN_IDX_PROC;
+		addr.nl_pid      = 0;
+
+		int error = 0;
+
+		if (sock_ < 0 || bind(sock_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 ||
+		    !send_op(PROC_CN_MCAST_LISTEN)) {
+			error = errno;
+		} else {
+			error = wait_ack();
+		}
+
+		if (error != 0) {
+			if (verbose::print_with_lvl(verbose::LVL1)) {
+				std::cerr << "Process events not available (" << strerror(error) << "). Scanning /proc instead."
+				          << '\n';
+			}
+			close_socket();
+			return false;
+		}
+
+		return true;
+	}
+
+	[[nodiscard]] inline auto enabled() const -> bool {
+		return sock_ >= 0;
+	}
+
+	// Calls f(event) for every pending event, without blocking. Returns false if events were lost (the socket buffer
+	// overflowed), so the caller should look for changes by other means (e.g., scanning /proc)
+	template<typename F>
+	inline auto poll(F && f) -> bool {
+		if (sock_ < 0) { return false; }
+
+		while (true) {
+			const auto len = recv(sock_, buffer_.data(), buffer_.size(), MSG_DONTWAIT);
+
+			if (len < 0) {
+				if (errno == EINTR) { continue; }
+				if (errno == ENOBUFS) {
+					overflow_ = true;
+					continue;
+				}
+				break; // EAGAIN: no more events
+			}
+
+			auto remaining = static_cast<unsigned int>(len);
+
+			for (auto * header = reinterpret_cast<nlmsghdr *>(buffer_.data()); NLMSG_OK(header, remaining);
+			     header       = NLMSG_NEXT(header, remaining)) {
+				if (header->nlmsg_type == NLMSG_ERROR || header->nlmsg_type == NLMSG_NOOP) { continue; }
+
+				const auto * connector_msg = static_cast<const cn_msg *>(NLMSG_DATA(header));
+				const auto * event         = reinterpret_cast<const proc_event *>(connector_msg->data);
+				const auto & data          = event->event_data;
+
+				switch (event->what) {
+					case proc_event::PROC_EVENT_FORK:
+						f(event_t{ type_t::fork, data.fork.child_pid, data.fork.child_tgid, data.fork.parent_pid,
+						           data.fork.parent_tgid });
+						break;
+					case proc_event::PROC_EVENT_EXEC:
+						f(event_t{ type_t::exec, data.exec.process_pid, data.exec.process_tgid, 0, 0 });
+						break;
+					case proc_event::PROC_EVENT_EXIT:
+						f(event_t{ type_t::exit, data.exit.process_pid, data.exit.process_tgid, 0, 0 });
+						break;
+					default:
+						break;
+				}
+			}
+		}
+
+		return !std::exchange(overflow_, false);
+	}
+};
+
+// Liveness of processes through pidfds: a pidfd becomes readable when its process exits, so a single poll() tells
+// which of the watched processes are gone, without reading their /proc files. Only thread group leaders can be
+// watched (pidfd_open() fails for other threads), which is enough to notice whole processes exiting
+class pidfd_watch {
+private:
+	umap<pid_t, int> fds_{};
+
+	std::vector<pollfd> pollfds_{};
+	std::vector<pid_t>  pids_{};
+
+public:
+	pidfd_watch() = default;
+
+	pidfd_watch(const pidfd_watch &)                     = delete;
+	auto operator=(const pidfd_watch &) -> pidfd_watch & = delete;
+
+	~pidfd_watch() {
+		for (const auto & [pid, fd] : fds_) {
+			close(fd);
+		}
+	}
+
+	[[nodiscard]] inline auto size() const {
+		return fds_.size();
+	}
+
+	[[nodiscard]] inline auto watched(const pid_t pid) const -> bool {
+		return fds_.contains(pid);
+	}
+
+	// Starts watching pid. Returns false if it cannot be watched (not a thread group leader, already gone...)
+	inline auto watch(const pid_t pid) -> bool {
+		if (fds_.contains(pid)) { return true; }
+
+		const auto fd = static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+		if (fd < 0) { return false; }
+
+		fds_.emplace(pid, fd);
+
+		return true;
+	}
+
+	inline void unwatch(const pid_t pid) {
+		const auto it = fds_.find(pid);
+		if (it == fds_.end()) { return; }
+
+		close(it->second);
+		fds_.erase(it);
+	}
+
+	// Calls f(pid) for every watched process that exited (which stops being watched)
+	template<typename F>
+	inline void exited(F && f) {
+		if (fds_.empty()) { return; }
+
+		pollfds_.clear();
+		pids_.clear();
+
+		for (const auto & [pid, fd] : fds_) {
+			pollfds_.push_back({ fd, POLLIN, 0 });
+			pids_.emplace_back(pid);
+		}
+
+		if (::poll(pollfds_.data(), pollfds_.size(), 0) <= 0) { return; }
+
+		for (size_t i = 0; i < pollfds_.size(); ++i) {
+			if ((pollfds_[i].revents & (POLLIN | POLLHUP | POLLERR)) == 0) { continue; }
+
+			unwatch(pids_[i]);
+			f(pids_[i]);
+		}
+	}
+};
+
+#endif /* end of include guard: THANOS_PROC_EVENTS_HPP */
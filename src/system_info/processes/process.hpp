@@ -10,17 +10,20 @@
 #ifndef THANOS_PROCESS_HPP
 #define THANOS_PROCESS_HPP
 
+#include <array>       // for array
 #include <cerrno>      // for errno, EFAULT, EINVAL, EPERM, ESRCH
 #include <cmath>       // for isnormal
+#include <cstdint>     // for uint8_t, uint32_t
 #include <cstring>     // for strerror, size_t
 #include <ctime>       // for difftime, time
 #include <exception>   // for exception
 #include <features.h>  // for __glibc_unlikely
-#include <fstream>     // for ifstream
 #include <iomanip>     // for operator<<, setw
 #include <iostream>    // for operator<<, ifstream, basic_ostream
 #include <map>         // for allocator, map, operator==, _Rb_tree_co...
+#include <memory>      // for shared_ptr
 #include <numa.h>      // for numa_free_cpumask, numa_node_of_cpu
+#include <optional>    // for optional
 #include <ranges>      // for ranges::iota_view...
 #include <sched.h>     // for sched_setaffinity, cpu_set_t, sched_get...
 #include <string>      // for operator+, string, operator<<, to_string
@@ -28,14 +31,45 @@
 #include <sys/stat.h>  // for stat
 #include <tuple>       // for _Swallow_assign, ignore
 #include <unistd.h>    // for pid_t, getuid, sysconf, size_t, uid_t
+#include <utility>     // for move
 #include <vector>      // for vector
 
-#include "utils/cmd.hpp"        // for exec
+#include "utils/proc.hpp"       // for cmdline, proc_file, parse
 #include "utils/string.hpp"     // for percentage
 #include "utils/time.hpp"       // for time_until
 #include "utils/types.hpp"      // for real_t, cpu_t, node_t
 #include "utils/verbose.hpp"    // for lvl, LVL1, LVL_MAX
 
+// Hot fields of the processes (the ones read in every scan of the tree), stored by the process tree as parallel
+// arrays indexed by the slot of each process, apart from the rest of the (cold) information of the processes
+struct process_columns {
+	std::vector<cpu_t>   cpu{};     // CPU number last executed on
+	std::vector<node_t>  node{};    // NUMA node of cpu
+	std::vector<real_t>  cpu_use{}; // Portion of CPU time used (between 0 and 1)
+	std::vector<char>    state{};   // State of the process
+	std::vector<uint8_t> pinned{};  // Pinned to a CPU or node (not a vector<bool>, to keep plain loads)
+
+	[[nodiscard]] inline auto size() const -> size_t {
+		return cpu.size();
+	}
+
+	inline void resize(const size_t n) {
+		cpu.resize(n);
+		node.resize(n);
+		cpu_use.resize(n);
+		state.resize(n);
+		pinned.resize(n);
+	}
+
+	inline void reset(const size_t slot) {
+		cpu[slot]     = 0;
+		node[slot]    = 0;
+		cpu_use[slot] = 0;
+		state[slot]   = 0;
+		pinned[slot]  = 0;
+	}
+};
+
 class process {
 public:
 	constexpr static const std::string_view DEFAULT_PROC = "/proc";
@@ -49,9 +83,11 @@ public:
 
 	constexpr static const real_t MIN_UPDATE_TIME = 1;
 
+	constexpr static const size_t STAT_BUFFER_SIZE = 512; // /proc/<pid>/stat is usually ~300 bytes long
+
 private:
-	process *              parent_   = nullptr;
-	umap<pid_t, process *> children_ = {};
+	std::shared_ptr<process_columns> columns_{}; // Hot fields (shared with the tree, which can be moved around)
+	uint32_t                         slot_{};    // Index of the process in the columns
 
 	/* clang-format off */
 	pid_t                  pid_{};                 // The process ID.
@@ -60,14 +96,11 @@ private:
 
 	std::string            stat_file_name_{};
 
-	std::ifstream          stat_file_{};
+	utils::proc::proc_file stat_file_{};           // Kept open, so updates just pread() it
 
 	bool                   migratable_ = false;
-	bool                   pinned_     = false;
 	bool                   lwp_        = false;    // Is a Light Weight Process (or a thread). True if this process has the same command line as its parent or "ps" command is empty.
 
-	char                   state_{};               // State of the process.
-
 	pid_t                  ppid_{};                // The PID of the parent of this process.
 	unsigned int           pgrp_{};                // The process group ID of the process.
 	unsigned int           session_{};             // The session ID of the process.
@@ -96,18 +129,15 @@ private:
 	unsigned long long     starttime_{};           // The time the process started after system boot.
 
 	uid_t                  st_uid_{};              // User ID the process belongs to.
-	int                    processor_{};           // CPU number last executed on.
 	int                    pinned_processor_{};    // CPU number pinned on. There might be a delay between pinning a process and the migration is performed.
-	int                    numa_node_{};           // NUMA node of processor_ field.
 	int                    pinned_numa_node_{};    // NUMA node of pinned_processor_ field.  There might be a delay between pinning a process and the migration is performed.
 
 	time_point             last_update_{};         // Time of the last update.
 	unsigned long long     last_times_{};          // (utime + stime). Updated when the process is updated.
-	real_t                 cpu_use_{};             // Portion of CPU time used (between 0 and 1).
 
 	int                    exit_signal_{};         // The thread's exit status in the form reported by wait_pid.
 
-	unsigned long long int last_total_time_{};     // Last total time of the CPU. Used for the calculation of cpu_use_.
+	unsigned long long int last_total_time_{};     // Last total time of the CPU. Used for the calculation of cpu_use.
 
 	bool                   valid_ = false;         // Check if /proc/PID/stat has been correctly parsed or not
 	/* clang-format on */
@@ -139,151 +169,151 @@ private:
 	}
 
 	inline void obtain_cmdline() {
-		const std::string command = "ps -p " + std::to_string(pid_) + " -o args h";
-
-		try {
-			cmdline_ = utils::cmd::exec(command);
-		} catch (std::exception & e) {
-			if (verbose::print_with_lvl(verbose::LVL1)) { std::cerr << e.what() << '\n'; }
-		} catch (...) {
-			if (verbose::print_with_lvl(verbose::LVL1)) {
-				std::cerr << "Could not retrieve cmdline from PID " << pid_ << '\n';
-			}
+		cmdline_ = utils::proc::cmdline(pid_);
+
+		if (cmdline_.empty() && verbose::print_with_lvl(verbose::LVL1)) {
+			std::cerr << "Could not retrieve cmdline from PID " << pid_ << '\n';
 		}
 	}
 
-	auto read_stat_file() -> bool {
-		if (!stat_file_.is_open() || !stat_file_.good()) { return false; }
+	// Snapshot of the CPU times of /proc/stat, shared by all the processes so the file is read once per update of the
+	// process tree (see snapshot_cpu_time()) instead of once per process
+	struct cpu_time_snapshot_t {
+		utils::proc::proc_file file{ std::string(DEF_CPU_STAT) };
+		unsigned long long int total_time = 0;
+		time_point             timestamp{};
+	};
+
+	[[nodiscard]] static inline auto cpu_time_snapshot() -> cpu_time_snapshot_t & {
+		static cpu_time_snapshot_t snapshot;
+		return snapshot;
+	}
 
-		pid_t pid = 0;
-		stat_file_ >> pid;
-		if (std::cmp_not_equal(pid, pid_)) {
-			// get back to the beginning of the file for future reads
-			stat_file_.clear();
-			stat_file_.seekg(0, std::ifstream::beg);
+	// Total CPU time of the snapshot, taking a new one if it is too old (e.g., processes created between updates)
+	[[nodiscard]] static inline auto total_cpu_time() -> unsigned long long int {
+		const auto & snapshot = cpu_time_snapshot();
 
-			return false;
+		if (snapshot.total_time == 0 || utils::time::time_until_now(snapshot.timestamp) > MIN_UPDATE_TIME) {
+			snapshot_cpu_time();
 		}
 
-		std::string name;
-		std::getline(stat_file_, name, ' '); // Skip space before name
-		std::getline(stat_file_, name, ' '); // get the name in the format -> "(name)"
-
-		stat_file_ >> state_;
-		stat_file_ >> ppid_;
-		stat_file_ >> pgrp_;
-		stat_file_ >> session_;
-		stat_file_ >> tty_nr_;
-		stat_file_ >> tpgid_;
-		stat_file_ >> flags_;
-		stat_file_ >> minflt_;
-		stat_file_ >> cminflt_;
-		stat_file_ >> majflt_;
-		stat_file_ >> cmajflt_;
-		stat_file_ >> utime_;
-		stat_file_ >> stime_;
-		stat_file_ >> cutime_;
-		stat_file_ >> cstime_;
-		stat_file_ >> priority_;
-		stat_file_ >> nice_;
-		stat_file_ >> num_threads_;
+		return snapshot.total_time;
+	}
+
+	auto read_stat_file() -> bool {
+		return parse_stat_file(stat_file_.read());
+	}
+
+	// Parses the content of /proc/<pid>/stat (nullopt if it could not be read)
+	auto parse_stat_file(const std::optional<std::string_view> content) -> bool {
+		if (!content.has_value()) { return false; }
+
+		auto text = content.value();
+
+		const auto pid = utils::proc::parse<pid_t>(text);
+		if (!pid.has_value() || std::cmp_not_equal(pid.value(), pid_)) { return false; }
+
+		// The name, in the format "(name)", may contain spaces and parenthesis, so skip until the last ')'
+		const auto name_end = text.rfind(')');
+		if (name_end == std::string_view::npos) { return false; }
+		text.remove_prefix(name_end + 1);
+
+		bool valid = true;
+
+		const auto next = [&]<typename T>(T & value) {
+			auto token = utils::proc::next_token(text);
+
+			const auto parsed = utils::proc::parse<T>(token);
+
+			valid = valid && parsed.has_value();
+			value = parsed.value_or(T{});
+		};
+
+		const auto skip = [&](const size_t fields) {
+			for (size_t i = 0; i < fields; ++i) {
+				std::ignore = utils::proc::next_token(text);
+			}
+		};
+
+		const auto state = utils::proc::next_token(text);
+		if (state.empty()) { return false; }
+		columns_->state[slot_] = state.front();
+
+		next(ppid_);
+		next(pgrp_);
+		next(session_);
+		next(tty_nr_);
+		next(tpgid_);
+		next(flags_);
+		next(minflt_);
+		next(cminflt_);
+		next(majflt_);
+		next(cmajflt_);
+		next(utime_);
+		next(stime_);
+		next(cutime_);
+		next(cstime_);
+		next(priority_);
+		next(nice_);
+		next(num_threads_);
 
 		// skip (21) itrealvalue
-		int it_real_value = 0;
-		stat_file_ >> it_real_value;
+		skip(1);
 
-		stat_file_ >> starttime_;
+		next(starttime_);
 
 		// skip from (23) vsize to (37) cnswap
-		constexpr size_t skip_fields = 37 - 23;
-		for (size_t i = 0; i <= skip_fields; ++i) {
-			unsigned long skip = 0;
-			stat_file_ >> skip;
-		}
+		constexpr size_t skip_fields = 37 - 23 + 1;
+		skip(skip_fields);
+
+		int processor{};
 
-		stat_file_ >> exit_signal_;
+		next(exit_signal_);
+		next(processor);
+
+		if (!valid) { return false; }
 
 		time_ = utime_ + stime_;
 
-		stat_file_ >> processor_;
-		numa_node_ = numa_node_of_cpu(processor_);
+		columns_->cpu[slot_]  = processor;
+		columns_->node[slot_] = numa_node_of_cpu(processor);
 
-		if (!pinned_) {
-			pinned_processor_ = processor_;
-			pinned_numa_node_ = numa_node_;
+		if (!is_pinned()) {
+			pinned_processor_ = processor;
+			pinned_numa_node_ = columns_->node[slot_];
 		}
 
 		const time_point curr_time = hres_clock::now();
 		if (utils::time::time_until(last_update_, curr_time) > MIN_UPDATE_TIME) {
 			last_update_ = curr_time;
 
-			const auto period = scan_cpu_time();
+			const auto period = cpu_period();
 
-			cpu_use_ = static_cast<real_t>(time_ - last_times_) / period;
-			if (!std::isnormal(cpu_use_)) { cpu_use_ = 0.0; }
+			auto cpu_use = static_cast<real_t>(time_ - last_times_) / period;
+			if (!std::isnormal(cpu_use)) { cpu_use = 0.0; }
 
-			// Parent processes gather all children CPU usage => cpu_use_ >> 1
+			// Parent processes gather all children CPU usage => cpu_use >> 1
 			static constexpr real_t MARGIN_OF_ERROR = 1.1; // 1.1 for giving a margin of error
-			if (cpu_use_ > MARGIN_OF_ERROR) { cpu_use_ = cpu_use_ / static_cast<real_t>(num_threads_); }
+			if (cpu_use > MARGIN_OF_ERROR) { cpu_use = cpu_use / static_cast<real_t>(num_threads_); }
+
+			columns_->cpu_use[slot_] = cpu_use;
 
 			last_times_ = time_;
 		}
 
-		// get back to the beginning of the file for future reads
-		stat_file_.clear();
-		stat_file_.seekg(0, std::ifstream::beg);
-
 		return true;
 	}
 
-	auto scan_cpu_time(const std::string_view filename = DEF_CPU_STAT) -> real_t {
+	// CPU time (per CPU) elapsed since the last call, according to the shared /proc/stat snapshot
+	auto cpu_period() -> real_t {
 		static const auto N_CPUS = sysconf(_SC_NPROCESSORS_ONLN);
 
-		std::ifstream file(filename.data(), std::ios::in);
-
-		if (!file.is_open()) {
-			std::cerr << "Cannot open file: " << filename << '\n';
-			return {};
-		}
-
 		if (__glibc_unlikely(std::cmp_less_equal(N_CPUS, 0))) {
 			std::cerr << "Invalid number of CPUs: " << N_CPUS << '\n';
 			return {};
 		}
 
-		std::string cpu_str; // = "cpu "
-
-		unsigned long long int user_time   = 0;
-		unsigned long long int nice_time   = 0;
-		unsigned long long int system_time = 0;
-		unsigned long long int idle_time   = 0;
-		unsigned long long int io_wait     = 0;
-		unsigned long long int irq         = 0;
-		unsigned long long int soft_irq    = 0;
-		unsigned long long int steal       = 0;
-		unsigned long long int guest       = 0;
-		unsigned long long int guest_nice  = 0;
-
-		file >> cpu_str;
-		file >> user_time;
-		file >> nice_time;
-		file >> system_time;
-		file >> idle_time;
-		file >> io_wait;
-		file >> irq;
-		file >> soft_irq;
-		file >> steal;
-		file >> guest;
-		file >> guest_nice;
-
-		// Guest time is already accounted in user time
-		user_time = user_time - guest;
-		nice_time = nice_time - guest_nice;
-
-		const auto idle_all_time   = idle_time + io_wait;
-		const auto system_all_time = system_time + irq + soft_irq;
-		const auto virt_all_time   = guest + guest_nice;
-		const auto total_time      = user_time + nice_time + system_all_time + idle_all_time + steal + virt_all_time;
+		const auto total_time = total_cpu_time();
 
 		const auto total_period = (total_time > last_total_time_) ? (total_time - last_total_time_) : 1;
 
@@ -319,12 +349,15 @@ public:
 	auto operator=(const process & p) -> process & = delete;
 	auto operator=(process &&) -> process &        = default;
 
-	explicit process(const pid_t pid, process * parent = nullptr,
-	                 const std::string_view dirname = DEFAULT_PROC) noexcept :
-	    parent_(parent),
+	// The process is stored in the given slot of the columns. The parent (if any) is only used to know if the process
+	// is a LWP: the tree keeps the links between processes
+	process(const pid_t pid, std::shared_ptr<process_columns> columns, const uint32_t slot,
+	        const process * parent = nullptr, const std::string_view dirname = DEFAULT_PROC) noexcept :
+	    columns_(std::move(columns)),
+	    slot_(slot),
 	    pid_(pid),
 	    stat_file_name_(std::string(dirname) + "/" + std::to_string(pid) + "/stat"),
-	    stat_file_(stat_file_name_),
+	    stat_file_(stat_file_name_, STAT_BUFFER_SIZE),
 	    valid_(read_stat_file()) {
 		if (valid_) {
 			obtain_cmdline();
@@ -332,11 +365,9 @@ public:
 			migratable_ = is_migratable();
 
 			if (parent != nullptr) {
-				parent->add_children(*this);
-
 				if (cmdline_.empty() || cmdline_ == parent->cmdline_) {
 					lwp_     = true;
-					cmdline_ = parent_->cmdline_;
+					cmdline_ = parent->cmdline_;
 				}
 
 				if (verbose::print_with_lvl(verbose::LVL_MAX) && lwp_) {
@@ -354,18 +385,6 @@ public:
 		std::ignore = unpin(false);
 	};
 
-	inline void parent(process * p) {
-		parent_ = p;
-	}
-
-	[[nodiscard]] inline auto parent() -> process * {
-		return parent_;
-	}
-
-	[[nodiscard]] inline auto parent() const -> const process * {
-		return parent_;
-	}
-
 	[[nodiscard]] inline auto cmdline() const -> const std::string & {
 		return cmdline_;
 	}
@@ -382,8 +401,12 @@ public:
 		return lwp_;
 	}
 
+	[[nodiscard]] inline auto slot() const -> uint32_t {
+		return slot_;
+	}
+
 	[[nodiscard]] inline auto cpu() const -> cpu_t {
-		return processor_;
+		return columns_->cpu[slot_];
 	}
 
 	[[nodiscard]] inline auto pinned_cpu() const -> cpu_t {
@@ -391,7 +414,7 @@ public:
 	}
 
 	[[nodiscard]] inline auto node() const -> node_t {
-		return numa_node_;
+		return columns_->node[slot_];
 	}
 
 	[[nodiscard]] inline auto pinned_node() const -> node_t {
@@ -401,11 +424,11 @@ public:
 	// Usage of CPU in [0, 1]. 0 = no computation, 1 = 100% of CPU time.
 	// Values >1 can be obtained for multi-threaded processes.
 	[[nodiscard]] inline auto cpu_use() const -> real_t {
-		return cpu_use_;
+		return columns_->cpu_use[slot_];
 	}
 
 	[[nodiscard]] inline auto state() const -> char {
-		return state_;
+		return columns_->state[slot_];
 	}
 
 	[[nodiscard]] inline auto valid() const -> bool {
@@ -417,82 +440,74 @@ public:
 	}
 
 	[[nodiscard]] inline auto is_pinned() const -> bool {
-		return pinned_;
+		return columns_->pinned[slot_] != 0;
 	}
 
-	// Get direct children
-	[[nodiscard]] inline auto children() const -> std::vector<const process *> {
-		std::vector<const process *> ret_children;
-		for (const auto & [pid, child] : children_) {
-			ret_children.emplace_back(child);
-		}
-		return ret_children;
+	[[nodiscard]] inline auto is_running() const -> bool {
+		return state() == RUNNING_CHAR;
 	}
 
-	// Get direct children
-	[[nodiscard]] inline auto children() -> std::vector<process *> {
-		std::vector<process *> ret_children;
-		for (const auto & [pid, child] : children_) {
-			ret_children.emplace_back(child);
-		}
-		return ret_children;
+	[[nodiscard]] inline auto migratable() const -> bool {
+		return migratable_;
 	}
 
-	// Get children, grandchildren, great-grandchildren...
-	[[nodiscard]] inline auto all_children() const -> std::vector<const process *> {
-		std::vector<const process *> ret_children;
-		for (const auto & [pid, child_ptr] : children_) {
-			ret_children.emplace_back(child_ptr);
-			const auto & child = *child_ptr;
-			const auto   aux   = child.all_children();
-			ret_children.insert(ret_children.end(), aux.begin(), aux.end());
-		}
-		return ret_children;
-	}
+	// Reads /proc/stat once for all the processes. To be called before updating them
+	static inline void snapshot_cpu_time() {
+		auto & snapshot = cpu_time_snapshot();
+
+		auto content = snapshot.file.read().value_or(std::string_view());
 
-	// Get children, grandchildren, great-grandchildren...
-	[[nodiscard]] inline auto all_children() -> std::vector<process *> {
-		std::vector<process *> ret_children;
-		for (const auto & [pid, child] : children_) {
-			ret_children.emplace_back(child);
-			const auto aux = child->all_children();
-			ret_children.insert(ret_children.end(), aux.begin(), aux.end());
+		// First line: "cpu  user nice system idle iowait irq softirq steal guest guest_nice"
+		std::ignore = utils::proc::next_token(content);
+
+		std::array<unsigned long long int, 10> times{};
+		for (auto & time : times) {
+			auto token = utils::proc::next_token(content);
+			time       = utils::proc::parse<unsigned long long int>(token).value_or(0);
 		}
-		return ret_children;
-	}
 
-	inline void add_children(process & child) {
-		children_[child.pid_] = &child;
-	}
+		const auto [user_time, nice_time, system_time, idle_time, io_wait, irq, soft_irq, steal, guest, guest_nice] =
+		    times;
 
-	inline void remove_children(process & child) {
-		children_.erase(child.pid_);
-	}
+		if (__glibc_unlikely(user_time == 0 && idle_time == 0)) {
+			std::cerr << "Cannot read CPU times from " << snapshot.file.path() << '\n';
+			return;
+		}
 
-	[[nodiscard]] inline auto is_running() const -> bool {
-		return state_ == RUNNING_CHAR;
-	}
+		// Guest time is already accounted in user time
+		const auto user_all_time   = user_time - guest;
+		const auto nice_all_time   = nice_time - guest_nice;
+		const auto idle_all_time   = idle_time + io_wait;
+		const auto system_all_time = system_time + irq + soft_irq;
+		const auto virt_all_time   = guest + guest_nice;
 
-	[[nodiscard]] inline auto migratable() const -> bool {
-		return migratable_;
+		snapshot.total_time = user_all_time + nice_all_time + system_all_time + idle_all_time + steal + virt_all_time;
+		snapshot.timestamp  = hres_clock::now();
 	}
 
 	inline auto update() -> bool {
 		return valid_ = read_stat_file();
 	}
 
-	inline auto update_all() -> bool {
-		bool success = valid_ = read_stat_file();
+	// Updates the process with the content of its stat file, read by the caller (e.g., a batch of reads)
+	inline auto update(const std::optional<std::string_view> stat_content) -> bool {
+		return valid_ = parse_stat_file(stat_content);
+	}
 
-		for (const auto & [tid, child] : children_) {
-			success &= child->update();
-		}
+	// The process replaced its program (execve), so its command line (and whether it is a LWP) may have changed
+	inline void refresh_cmdline(const process * parent) {
+		obtain_cmdline();
+
+		lwp_ = parent != nullptr && (cmdline_.empty() || cmdline_ == parent->cmdline_);
+		if (lwp_) { cmdline_ = parent->cmdline_; }
+	}
 
-		return success;
+	[[nodiscard]] inline auto stat_file() -> utils::proc::proc_file & {
+		return stat_file_;
 	}
 
 	inline auto pin(const cpu_t cpu, const bool print = true) -> bool {
-		if (std::cmp_equal(cpu, processor_) && pinned_) { return true; }
+		if (std::cmp_equal(cpu, this->cpu()) && is_pinned()) { return true; }
 
 		cpu_set_t affinity;
 
@@ -504,9 +519,9 @@ public:
 			return false;
 		}
 
-		pinned_           = true;
-		pinned_processor_ = cpu;
-		pinned_numa_node_ = numa_node_of_cpu(processor_);
+		columns_->pinned[slot_] = 1;
+		pinned_processor_       = cpu;
+		pinned_numa_node_       = numa_node_of_cpu(this->cpu());
 
 		return true;
 	}
@@ -530,8 +545,8 @@ public:
 			return false;
 		}
 
-		pinned_           = true;
-		pinned_numa_node_ = node;
+		columns_->pinned[slot_] = 1;
+		pinned_numa_node_       = node;
 
 		for (const auto cpu : std::ranges::iota_view(0UL, cpus->size)) {
 			if (std::cmp_not_equal(numa_bitmask_isbitset(cpus, cpu), 0)) {
@@ -550,7 +565,7 @@ public:
 	}
 
 	[[nodiscard]] inline auto unpin(const bool print = true) const -> bool {
-		if (!pinned_) { return true; }
+		if (!is_pinned()) { return true; }
 
 		cpu_set_t affinity;
 		sched_getaffinity(0, sizeof(cpu_set_t), &affinity); // Gets profiler's affinity (supposed to be the default)
@@ -570,21 +585,21 @@ public:
 		/* clang-format off */
 		os << "PID: "   << std::setw(5) << p.pid_ <<
         	", PPID: "  << std::setw(5) << p.ppid_ <<
-        	", NODE: "  << std::setw(1) << p.numa_node_ <<
-        	", CPU: "   << std::setw(3) << p.processor_ <<
+        	", NODE: "  << std::setw(1) << p.node() <<
+        	", CPU: "   << std::setw(3) << p.cpu() <<
         	" (";
 		/* clang-format on */
 
-		if (p.cpu_use_ >= 1.0) {
+		if (p.cpu_use() >= 1.0) {
 			// E.g. : (113.%)
-			os << std::setw(3) << utils::string::percentage(p.cpu_use_, 0) << ".";
+			os << std::setw(3) << utils::string::percentage(p.cpu_use(), 0) << ".";
 		} else {
 			// E.g. : (73.8%)
-			os << std::setw(4) << utils::string::percentage(p.cpu_use_, 1);
+			os << std::setw(4) << utils::string::percentage(p.cpu_use(), 1);
 		}
 
 		/* clang-format off */
-		os << "%)" << ", STATE: " << p.state_ << ", LWP: " << p.lwp_ << ", CMDLINE: " << p.cmdline_;
+		os << "%)" << ", STATE: " << p.state() << ", LWP: " << p.lwp_ << ", CMDLINE: " << p.cmdline_;
 		/* clang-format on */
 
 		os << std::defaultfloat;
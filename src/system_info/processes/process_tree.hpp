@@ -10,8 +10,12 @@
 #ifndef THANOS_PROCESS_TREE_HPP
 #define THANOS_PROCESS_TREE_HPP
 
+#include <cstdint>     // for uint32_t
+#include <deque>       // for deque
+#include <limits>      // for numeric_limits
 #include <map>         // for map, operator==, _Rb_tree_iterator, _Rb_tree_...
-#include <memory>      // for unique_ptr
+#include <memory>      // for unique_ptr, make_unique, shared_ptr, make_shared
+#include <optional>    // for optional
 #include <ostream>     // for operator<<, ostream, basic_ostream, char_traits
 #include <ranges>      // for ranges::iota_view...
 #include <set>         // for set
@@ -21,7 +25,8 @@
 #include <utility>     // for pair, make_pair, move, tuple_element<>::type
 #include <vector>      // for vector
 
-#include "process.hpp" // for process, process::DEFAULT_PROC, operator<<
+#include "process.hpp"          // for process, process_columns, process::DEFAULT_PROC, operator<<
+#include "utils/proc_batch.hpp" // for batch_reader
 
 class process_tree {
 private:
@@ -43,17 +48,147 @@ private:
 	static constexpr const char * TREE_STR_SHUT = "\xe2\x94\x80"; // TREE_STR_SHUT ─
 #endif
 
-	umap<pid_t, std::unique_ptr<process>> processes_ = {};
+	static constexpr uint32_t NO_SLOT = std::numeric_limits<uint32_t>::max();
+
+	// Processes live in an arena of slots that never move and are reused once freed. The tree is stored as parallel
+	// arrays indexed by slot: the links between processes (parent, first child and siblings) are slot indices, and the
+	// hot fields of the processes (CPU, node, CPU use, state, pinned) live in the shared columns. Hence, walking the
+	// tree (or a subtree) touches contiguous arrays instead of chasing pointers through the process objects, which
+	// only keep the cold information (command line, stat file...)
+	// Mutable as before, when the tree held pointers: a const tree does not mean const processes
+	mutable std::deque<std::optional<process>> arena_{};
+
+	std::vector<pid_t>    pids_{};           // PID of each slot (0 if the slot is free)
+	std::vector<uint32_t> generations_{};    // Incremented every time a slot is freed, to detect stale IDs
+	std::vector<uint32_t> parents_{};        // Slot of the parent of each slot (NO_SLOT if none)
+	std::vector<uint32_t> first_children_{}; // Slot of the first child of each slot (NO_SLOT if none)
+	std::vector<uint32_t> next_siblings_{};  // Slot of the next child of the same parent (NO_SLOT if none)
+	std::vector<uint32_t> prev_siblings_{};  // Slot of the previous child of the same parent (NO_SLOT if none)
+	std::vector<uint32_t> free_slots_{};
+
+	std::shared_ptr<process_columns> columns_ = std::make_shared<process_columns>();
+
+	umap<pid_t, uint32_t> slots_{}; // PID -> slot
 
 	pid_t root_;
 
+	// Stat files of all the processes are read in a single batch on every update
+	std::unique_ptr<utils::proc::batch_reader> stat_reader_ = std::make_unique<utils::proc::batch_reader>();
+
+	std::vector<process *>                batch_processes_{};
+	std::vector<utils::proc::proc_file *> batch_files_{};
+
+	[[nodiscard]] inline auto allocate(const pid_t pid) -> uint32_t {
+		uint32_t slot = 0;
+
+		if (free_slots_.empty()) {
+			slot = static_cast<uint32_t>(arena_.size());
+			arena_.emplace_back();
+			pids_.emplace_back();
+			generations_.emplace_back();
+			parents_.emplace_back(NO_SLOT);
+			first_children_.emplace_back(NO_SLOT);
+			next_siblings_.emplace_back(NO_SLOT);
+			prev_siblings_.emplace_back(NO_SLOT);
+			columns_->resize(arena_.size());
+		} else {
+			slot = free_slots_.back();
+			free_slots_.pop_back();
+		}
+
+		pids_[slot] = pid;
+		slots_[pid] = slot;
+		columns_->reset(slot);
+
+		return slot;
+	}
+
+	// The slot must be unlinked (and its children released) before
+	inline void release(const uint32_t slot) {
+		slots_.erase(pids_[slot]);
+
+		arena_[slot].reset();
+		pids_[slot] = 0;
+		++generations_[slot];
+
+		free_slots_.emplace_back(slot);
+	}
+
+	inline void link(const uint32_t slot, const uint32_t parent) {
+		parents_[slot]       = parent;
+		prev_siblings_[slot] = NO_SLOT;
+		next_siblings_[slot] = first_children_[parent];
+
+		if (first_children_[parent] != NO_SLOT) { prev_siblings_[first_children_[parent]] = slot; }
+		first_children_[parent] = slot;
+	}
+
+	inline void unlink(const uint32_t slot) {
+		const auto parent = parents_[slot];
+		const auto prev   = prev_siblings_[slot];
+		const auto next   = next_siblings_[slot];
+
+		if (prev != NO_SLOT) {
+			next_siblings_[prev] = next;
+		} else if (parent != NO_SLOT) {
+			first_children_[parent] = next;
+		}
+		if (next != NO_SLOT) { prev_siblings_[next] = prev; }
+
+		parents_[slot]       = NO_SLOT;
+		prev_siblings_[slot] = NO_SLOT;
+		next_siblings_[slot] = NO_SLOT;
+	}
+
+	[[nodiscard]] inline auto slot_of(const pid_t pid) const -> uint32_t {
+		const auto it = slots_.find(pid);
+		return it == slots_.end() ? NO_SLOT : it->second;
+	}
+
+	// True if the slot is a descendant of ancestor (but not ancestor itself)
+	[[nodiscard]] inline auto slot_descends_from(uint32_t slot, const uint32_t ancestor) const -> bool {
+		for (slot = parents_[slot]; slot != NO_SLOT; slot = parents_[slot]) {
+			if (slot == ancestor) { return true; }
+		}
+		return false;
+	}
+
+	// Calls f(slot) for every descendant of ancestor (pre-order), following the first child/next sibling links: every
+	// descendant is visited once, and every link is followed at most twice
+	template<typename F>
+	inline void for_each_descendant_slot(const uint32_t ancestor, F && f) const {
+		auto slot = first_children_[ancestor];
+
+		while (slot != NO_SLOT) {
+			f(slot);
+
+			if (first_children_[slot] != NO_SLOT) {
+				slot = first_children_[slot];
+				continue;
+			}
+
+			// Go up until there is a sibling to visit (or back to the ancestor)
+			while (slot != ancestor && next_siblings_[slot] == NO_SLOT) {
+				slot = parents_[slot];
+			}
+
+			slot = slot == ancestor ? NO_SLOT : next_siblings_[slot];
+		}
+	}
+
 public:
+	// Dense identifier of a process in the tree. Slots are reused, so it is only valid while its generation matches
+	struct id_t {
+		uint32_t slot       = NO_SLOT;
+		uint32_t generation = 0;
+	};
+
 	explicit process_tree(const pid_t root = getpid(), const std::string_view dirname = process::DEFAULT_PROC) noexcept
 	    :
 	    root_(root) {
 		try {
-			std::unique_ptr<process> proc_ptr(new process{ root_, nullptr, dirname });
-			processes_.insert({ root_, std::move(proc_ptr) });
+			const auto slot = allocate(root_);
+			arena_[slot].emplace(root_, columns_, slot, nullptr, dirname);
 		} catch (std::exception & e) {
 			std::cerr << "Could not create process tree: " << e.what() << '\n';
 		} catch (...) { std::cerr << "Could not create process tree..." << '\n'; }
@@ -63,61 +198,129 @@ public:
 		return root_;
 	}
 
+	[[nodiscard]] inline auto size() const -> size_t {
+		return slots_.size();
+	}
+
+	// Hot fields of the processes, indexed by process::slot()
+	[[nodiscard]] inline auto columns() const -> const process_columns & {
+		return *columns_;
+	}
+
+	[[nodiscard]] inline auto id(const pid_t pid) const -> std::optional<id_t> {
+		const auto slot = slot_of(pid);
+		if (slot == NO_SLOT) { return std::nullopt; }
+		return id_t{ slot, generations_[slot] };
+	}
+
+	// Process of the ID (nullptr if it is not in the tree anymore)
+	[[nodiscard]] inline auto get(const id_t id) -> process * {
+		if (id.slot >= arena_.size() || generations_[id.slot] != id.generation || pids_[id.slot] == 0) {
+			return nullptr;
+		}
+		return &arena_[id.slot].value();
+	}
+
 	[[nodiscard]] inline auto retrieve(const pid_t pid, process * parent = nullptr,
 	                                   const std::string_view dirname = process::DEFAULT_PROC) -> process & {
-		const auto & proc_it = processes_.find(pid);
+		const auto slot = slot_of(pid);
 
-		if (proc_it != processes_.end()) { return *proc_it->second; }
+		if (slot != NO_SLOT) { return arena_[slot].value(); }
 
 		return insert(pid, parent, dirname);
 	}
 
 	[[nodiscard]] inline auto retrieve(const pid_t pid) const -> process & {
-		return *processes_.at(pid);
+		return arena_[slots_.at(pid)].value();
 	}
 
 	[[nodiscard]] inline auto retrieve() const -> process & {
 		return retrieve(root_);
 	}
 
+	// Parent of the process (nullptr if it has none or it is not in the tree)
+	[[nodiscard]] inline auto parent(const pid_t pid) const -> process * {
+		const auto slot = slot_of(pid);
+		if (slot == NO_SLOT || parents_[slot] == NO_SLOT) { return nullptr; }
+		return &arena_[parents_[slot]].value();
+	}
+
+	// Calls f(process) for every process of the tree
+	template<typename F>
+	inline void for_each(F && f) const {
+		for (size_t slot = 0; slot < pids_.size(); ++slot) {
+			if (pids_[slot] != 0) { f(arena_[slot].value()); }
+		}
+	}
+
+	// Calls f(process) for every direct child of pid
+	template<typename F>
+	inline void for_each_child(const pid_t pid, F && f) const {
+		const auto parent = slot_of(pid);
+		if (parent == NO_SLOT) { return; }
+
+		for (auto slot = first_children_[parent]; slot != NO_SLOT; slot = next_siblings_[slot]) {
+			f(arena_[slot].value());
+		}
+	}
+
+	// Calls f(process) for every descendant (children, grandchildren...) of pid, not including pid itself, in time
+	// linear in the size of the subtree. f must not insert or erase processes
+	template<typename F>
+	inline void for_each_descendant(const pid_t pid, F && f) const {
+		const auto ancestor = slot_of(pid);
+		if (ancestor == NO_SLOT) { return; }
+
+		for_each_descendant_slot(ancestor, [&](const uint32_t slot) { f(arena_[slot].value()); });
+	}
+
+	// True if pid is ancestor or one of its descendants
+	[[nodiscard]] inline auto descends_from(const pid_t pid, const pid_t ancestor) const -> bool {
+		const auto slot          = slot_of(pid);
+		const auto ancestor_slot = slot_of(ancestor);
+
+		if (slot == NO_SLOT || ancestor_slot == NO_SLOT) { return false; }
+
+		return slot == ancestor_slot || slot_descends_from(slot, ancestor_slot);
+	}
+
 	[[nodiscard]] inline auto retrieve_all() const -> std::vector<const process *> {
 		std::vector<const process *> processes;
+		processes.reserve(size());
 
-		for (const auto & [pid, process_ptr] : processes_) {
-			processes.emplace_back(process_ptr.get());
-		}
+		for_each([&](const process & proc) { processes.emplace_back(&proc); });
 
 		return processes;
 	}
 
 	auto insert(const pid_t pid, process * parent = nullptr, const std::string_view dirname = process::DEFAULT_PROC)
 	    -> process & {
-		const auto & proc_it = processes_.find(pid);
 		// Check if the process is already in the tree...
-		if (proc_it != processes_.end()) {
-			process & proc = *proc_it->second;
-			return proc;
-		}
+		if (const auto slot = slot_of(pid); slot != NO_SLOT) { return arena_[slot].value(); }
+
+		const auto slot = allocate(pid);
 
-		std::unique_ptr<process> proc(new process{ pid, parent, dirname });
+		// Slots never move, so the process can be referenced even if more processes are inserted
+		auto & proc = arena_[slot].emplace(pid, columns_, slot, parent, dirname);
 
 		// If parent == nullptr and PPID != 0,
 		// and PID != getpid() (no need to go up in the hierarchy)...
-		if (std::cmp_not_equal(proc->pid(), getpid()) && std::cmp_not_equal(proc->ppid(), 0) && parent == nullptr) {
+		if (std::cmp_not_equal(proc.pid(), getpid()) && std::cmp_not_equal(proc.ppid(), 0) && parent == nullptr) {
 			// search for the parent with PID == PPID
-			parent = &retrieve(proc->ppid(), nullptr, dirname);
-		}
-		// If a parent process was found...
-		if (parent != nullptr) {
-			// add this information to the corresponding structures
-			proc->parent(parent);
-			parent->add_children(*proc);
+			parent = &retrieve(proc.ppid(), nullptr, dirname);
 		}
+		// If a parent process was found, link the process to it
+		if (parent != nullptr) { link(slot, parent->slot()); }
 
-		const auto proc_ret_it = processes_.insert({ pid, std::move(proc) });
+		return proc;
+	}
+
+	// The process replaced its program (execve)
+	inline void refresh_cmdline(const pid_t pid) {
+		const auto slot = slot_of(pid);
+		if (slot == NO_SLOT) { return; }
 
-		// proc_ret_it.first = iterator<pid, proc_ptr>
-		return *(proc_ret_it.first->second);
+		arena_[slot]->refresh_cmdline(parents_[slot] != NO_SLOT ? &arena_[parents_[slot]].value() : nullptr);
 	}
 
 	auto update() -> bool {
@@ -125,14 +328,24 @@ public:
 
 		bool success = true;
 
-		for (auto & [pid, proc_ptr] : processes_) {
-			auto & proc = *proc_ptr;
-			if (!proc.update()) {
+		process::snapshot_cpu_time();
+
+		batch_processes_.clear();
+		batch_files_.clear();
+
+		for_each([&](process & proc) {
+			batch_processes_.emplace_back(&proc);
+			batch_files_.emplace_back(&proc.stat_file());
+		});
+
+		stat_reader_->read(batch_files_, [&](const size_t i, const std::optional<std::string_view> content) {
+			auto & proc = *batch_processes_[i];
+			if (!proc.update(content)) {
 				success = false;
 
 				procs_to_erase.insert(proc.pid());
 			}
-		}
+		});
 
 		for (const auto & pid : procs_to_erase) {
 			erase(pid);
@@ -141,54 +354,48 @@ public:
 		return success;
 	}
 
+	[[nodiscard]] inline auto contains(const pid_t pid) const -> bool {
+		return slots_.contains(pid);
+	}
+
 	inline auto is_alive(const pid_t pid) -> bool {
-		const auto & proc_it = processes_.find(pid);
+		const auto slot = slot_of(pid);
 
-		if (proc_it != processes_.end()) {
-			process & proc = *proc_it->second;
-			return proc.valid();
-		}
+		if (slot != NO_SLOT) { return arena_[slot]->valid(); }
 
 		return false;
 	}
 
+	// Removes the process and all its descendants
 	void erase(const pid_t pid) {
-		if (processes_.contains(pid)) {
-			// Get self-process
-			auto & process = *processes_[pid];
-
-			// Remove children
-			const auto children = process.children();
+		const auto slot = slot_of(pid);
+		if (slot == NO_SLOT) { return; }
 
-			for (const auto * child_ptr : children) {
-				// Remove children of children...
-				erase(child_ptr->pid());
-			}
+		thread_local std::vector<uint32_t> subtree;
+		subtree.clear();
 
-			// Remove self-process from parent child list
-			auto * parent = process.parent();
+		for_each_descendant_slot(slot, [&](const uint32_t descendant) { subtree.emplace_back(descendant); });
 
-			if (parent != nullptr) { parent->remove_children(process); }
+		unlink(slot);
 
-			// Remove self-process
-			processes_.erase(pid);
+		for (const auto descendant : subtree) {
+			parents_[descendant]        = NO_SLOT;
+			first_children_[descendant] = NO_SLOT;
+			next_siblings_[descendant]  = NO_SLOT;
+			prev_siblings_[descendant]  = NO_SLOT;
+			release(descendant);
 		}
+
+		first_children_[slot] = NO_SLOT;
+		release(slot);
 	}
 
 	auto erase_invalid() -> set<pid_t> {
 		set<pid_t> to_delete;
 
-		for (const auto & [pid, proc_ptr] : processes_) {
-			auto & proc = *proc_ptr;
-
-			if (!proc.valid()) {
-				const auto & parent = proc.parent();
-
-				if (parent != nullptr) { parent->remove_children(proc); }
-
-				to_delete.insert(pid);
-			}
-		}
+		for_each([&](const process & proc) {
+			if (!proc.valid()) { to_delete.insert(proc.pid()); }
+		});
 
 		for (const auto & pid : to_delete) {
 			erase(pid);
@@ -208,14 +415,11 @@ public:
 
 		os << p << '\n';
 
-		const auto children = p.children();
-		for (const auto & child : children) {
-			print_level(os, *child, level + 1);
-		}
+		for_each_child(p.pid(), [&](const process & child) { print_level(os, child, level + 1); });
 	}
 
 	friend auto operator<<(std::ostream & os, const process_tree & p) -> std::ostream & {
-		os << "Process tree with " << p.processes_.size() << " entries." << '\n';
+		os << "Process tree with " << p.size() << " entries." << '\n';
 		p.print_level(os, p.retrieve(p.root_));
 
 		return os;
@@ -13,6 +13,7 @@
 
 #include <cerrno>  // for errno
 #include <cstring> // for strerror
+#include <fstream> // for ifstream
 
 #include "types.hpp"   // for node_t, cpu_t
 #include "verbose.hpp" // for DEFAULT_LVL, lvl
@@ -30,12 +31,22 @@ namespace system_info {
 		std::vector<node_t>             cpu_node_map; // input: CPU,  output: node
 		std::vector<std::vector<cpu_t>> node_cpu_map; // input: node, output: list of CPUs
 
+		topology cpu_topology;
+
+		calibration::matrix_t calibrated;
+
 		// To know where each TID is (in terms of CPUs and node)
-		std::vector<set<pid_t>> cpu_tid_map;  // input: CPU,  output: list of TIDs
-		std::vector<set<pid_t>> node_tid_map; // input: node, output: list of TIDs
+		occupancy_map cpu_tid_map;  // input: CPU,  output: set of TIDs
+		occupancy_map node_tid_map; // input: node, output: set of TIDs
 
 		process_tree proc_tree; // processes tree
 
+		proc_events events;
+		pidfd_watch pidfds;
+		bool        rescan = false;
+
+		umap<pid_t, memory_usage_t> memory_usage;
+
 	} // namespace details
 
 	namespace auxiliary_functions {
@@ -92,6 +103,27 @@ namespace system_info {
 			return cpus_in_node;
 		}
 
+		// Fills nodes_by_distance (already sized) with the distance factors (measured, if calibrated, or the SLIT)
+		void sort_nodes_by_distance() {
+			for (const auto node : details::nodes) {
+				std::multimap<real_t, node_t> distance_nodes_map{};
+
+				for (const auto node_2 : details::nodes) {
+					distance_nodes_map.insert({ distance_factor(node, node_2), node_2 });
+				}
+
+				// Vector of nodes sorted by distances
+				std::vector<node_t> nodes_by_distance;
+				nodes_by_distance.reserve(details::nodes.size());
+
+				for (const auto & [distance, node_2] : distance_nodes_map) {
+					nodes_by_distance.emplace_back(node_2);
+				}
+
+				details::nodes_by_distance[node] = nodes_by_distance;
+			}
+		}
+
 		// Retrieve information about the architecture of the system (#nodes, #cpus, cpus at every node, etc.)
 		auto detect_system_NUMA() -> bool {
 			details::nodes = allowed_nodes();
@@ -111,26 +143,12 @@ namespace system_info {
 
 			// Compute the lists of nodes sorted by distance from a given node...
 			details::nodes_by_distance.resize(num_of_nodes(), {});
-			for (const auto node : details::nodes) {
-				std::multimap<int, node_t> distance_nodes_map{};
-
-				for (const auto node_2 : details::nodes) {
-					distance_nodes_map.insert({ numa_distance(node, node_2), node_2 });
-				}
-
-				// Vector of nodes sorted by distances
-				std::vector<node_t> nodes_by_distance;
-				nodes_by_distance.reserve(details::nodes.size());
-
-				for (const auto & [distance, node_2] : distance_nodes_map) {
-					nodes_by_distance.emplace_back(node_2);
-				}
+			sort_nodes_by_distance();
 
-				details::nodes_by_distance[node] = nodes_by_distance;
-			}
+			details::cpu_tid_map.resize(num_of_cpus());
+			details::node_tid_map.resize(num_of_nodes());
 
-			details::cpu_tid_map.resize(num_of_cpus(), {});
-			details::node_tid_map.resize(num_of_nodes(), {});
+			details::cpu_topology = topology(details::cpus, details::cpu_node_map);
 
 			return true;
 		}
@@ -151,8 +169,10 @@ namespace system_info {
 			details::nodes_by_distance.resize(max_node() + 1, {});
 			details::nodes_by_distance[0] = { 0 };
 
-			details::cpu_tid_map.resize(max_cpu() + 1, {});
-			details::node_tid_map.resize(max_node() + 1, {});
+			details::cpu_tid_map.resize(max_cpu() + 1);
+			details::node_tid_map.resize(max_node() + 1);
+
+			details::cpu_topology = topology(details::cpus, details::cpu_node_map);
 
 			return true;
 		}
@@ -175,6 +195,62 @@ namespace system_info {
 		return ret_value;
 	}
 
+	auto calibrate(const std::string & filename) -> bool {
+		const auto key = calibration::machine_key(details::nodes, num_of_cpus());
+
+		if (auto matrix = calibration::read(filename, key); matrix.has_value()) {
+			details::calibrated = std::move(matrix.value());
+
+			if (verbose::print_with_lvl(verbose::LVL1)) {
+				std::cout << "Latency/bandwidth calibration loaded from " << filename << '\n';
+			}
+		} else {
+			if (verbose::print_with_lvl(verbose::DEFAULT_LVL)) {
+				std::cout << "Measuring latency/bandwidth between nodes (cached in " << filename << ")..." << '\n';
+			}
+
+			details::calibrated = calibration::measure(details::nodes);
+
+			if (details::calibrated.empty()) {
+				std::cerr << "Latency/bandwidth calibration failed. Using SLIT distances." << '\n';
+				return false;
+			}
+
+			if (!calibration::write(filename, key, details::calibrated) && verbose::print_with_lvl(verbose::LVL1)) {
+				std::cerr << "Could not save the calibration to " << filename << '\n';
+			}
+		}
+
+		auxiliary_functions::sort_nodes_by_distance();
+
+		if (verbose::print_with_lvl(verbose::LVL1)) {
+			std::cout << "Measured latency (ns) / bandwidth (GB/s) between nodes:" << '\n';
+
+			tabulate::Table table;
+
+			std::vector<std::string> header = { "" };
+			for (const auto node : nodes()) {
+				header.emplace_back("Node " + std::to_string(node));
+			}
+			table.add_row({ header.begin(), header.end() });
+
+			for (const auto src : nodes()) {
+				std::vector<std::string> row = { "Node " + std::to_string(src) };
+				for (const auto dst : nodes()) {
+					row.emplace_back(utils::string::to_string(details::calibrated.latency_at(src, dst), 1) + " / " +
+					                 utils::string::to_string(details::calibrated.bandwidth_at(src, dst), 1));
+				}
+				table.add_row({ row.begin(), row.end() });
+			}
+
+			table.format().hide_border();
+			table.print(std::cout);
+			std::cout << '\n';
+		}
+
+		return true;
+	}
+
 	// Functions to scan files in /proc to search for children threads and processes
 	void scan_children_file(const std::filesystem::path & path, process * parent) {
 		std::ifstream file(path / "children");
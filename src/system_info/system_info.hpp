@@ -16,6 +16,7 @@
 #include <sys/sysinfo.h>      // for get_nprocs
 #include <unistd.h>           // for pid_t, getppid, size_t
 
+#include <algorithm>   // for min, fill
 #include <filesystem>  // for path
 #include <iostream>    // for operator<<, char_traits, basic...
 #include <map>         // for operator==, _Rb_tree_const_ite...
@@ -25,13 +26,21 @@
 #include <set>         // for set, set<>::const_iterator
 #include <string>      // for string, to_string, operator+
 #include <string_view> // for string_view
+#include <tuple>       // for ignore
+#include <utility>     // for exchange, cmp_equal
 #include <variant>     // for variant
 #include <vector>      // for vector, allocator
 
+#include "calibration.hpp"            // for matrix_t
+#include "occupancy_map.hpp"          // for occupancy_map
+#include "processes/proc_events.hpp"  // for proc_events, pidfd_watch
 #include "processes/process.hpp"      // for process, process::DEFAULT_PROC
 #include "processes/process_tree.hpp" // for process_tree, operator<<
 #include "tabulate/tabulate.hpp"      // for Table, Format
+#include "topology.hpp"               // for topology
+#include "utils/proc.hpp"             // for read_file, loadavg
 #include "utils/string.hpp"           // for to_string
+#include "utils/time.hpp"             // for time_until_now
 #include "utils/types.hpp"            // for node_t, cpu_t, real_t
 
 namespace system_info {
@@ -54,15 +63,72 @@ namespace system_info {
 		extern std::vector<node_t>             cpu_node_map; // input: CPU,  output: node
 		extern std::vector<std::vector<cpu_t>> node_cpu_map; // input: node, output: list of CPUs
 
+		extern topology cpu_topology; // Cores, LLCs and sockets of the CPUs
+
+		extern calibration::matrix_t calibrated; // Measured latency/bandwidth between nodes (empty if not calibrated)
+
 		// To know where each TID is (in terms of CPUs and node)
-		extern std::vector<set<pid_t>> cpu_tid_map;  // input: CPU,  output: list of TIDs
-		extern std::vector<set<pid_t>> node_tid_map; // input: node, output: list of TIDs
+		extern occupancy_map cpu_tid_map;  // input: CPU,  output: set of TIDs
+		extern occupancy_map node_tid_map; // input: node, output: set of TIDs
 
 		extern process_tree proc_tree; // processes tree
 
+		extern proc_events events; // Fork/exec/exit of threads, to update the tree as soon as they happen
+		extern pidfd_watch pidfds; // Liveness of the processes of the tree when there are no events
+		extern bool        rescan; // Events were lost, so /proc must be scanned in the next update
+
+		static constexpr real_t MEMORY_USAGE_PERIOD = 10; // Seconds between reads of numa_maps for memory_usage()
+
+		// Bytes of memory of a process in each node, adjusted as its pages are migrated and reconciled with
+		// /proc/<pid>/numa_maps every MEMORY_USAGE_PERIOD seconds (or whenever the memory regions are refreshed)
+		struct memory_usage_t {
+			std::vector<real_t> bytes{};
+			time_point          last_read{};
+		};
+
+		extern umap<pid_t, memory_usage_t> memory_usage;
+
 		extern long int default_priority;
 	} // namespace details
 
+	[[nodiscard]] inline auto is_idle(const process & process) -> bool {
+		return process.cpu_use() < IDLE_THRESHOLD;
+	}
+
+	[[nodiscard]] inline auto calibrated() -> bool {
+		return !details::calibrated.empty();
+	}
+
+	// Latency of accesses from CPUs of node src to memory of node dst, relative to local accesses: measured if the
+	// system was calibrated (see calibrate()), from the SLIT distances otherwise
+	[[nodiscard]] inline auto distance_factor(const node_t src, const node_t dst) -> real_t {
+		const auto & matrix = details::calibrated;
+
+		if (std::cmp_less(src, matrix.n_nodes) && std::cmp_less(dst, matrix.n_nodes)) {
+			const auto local  = matrix.latency_at(src, src);
+			const auto remote = matrix.latency_at(src, dst);
+
+			if (local > 0 && remote > 0) { return remote / local; }
+		}
+
+		return static_cast<real_t>(numa_distance(src, dst)) / static_cast<real_t>(local_distance());
+	}
+
+	// Bandwidth of accesses from CPUs of node src to memory of node dst, relative to local accesses (1 if the system
+	// was not calibrated: the SLIT says nothing about bandwidth)
+	[[nodiscard]] inline auto bandwidth_factor(const node_t src, const node_t dst) -> real_t {
+		const auto & matrix = details::calibrated;
+
+		if (std::cmp_less(src, matrix.n_nodes) && std::cmp_less(dst, matrix.n_nodes)) {
+			const auto local  = matrix.bandwidth_at(src, src);
+			const auto remote = matrix.bandwidth_at(src, dst);
+
+			if (local > 0 && remote > 0) { return remote / local; }
+		}
+
+		return 1;
+	}
+
 	namespace auxiliary_functions {
 		// CPU-pin/free methods
 		inline auto pin_thread_to_cpu(const pid_t tid, const cpu_t cpu, const bool print = true) -> bool {
@@ -80,12 +146,12 @@ namespace system_info {
 
 			if (proc.pin(cpu, print)) {
 				if (std::cmp_not_equal(old_cpu, proc.pinned_cpu())) {
-					details::cpu_tid_map[old_cpu].erase(tid);
-					details::cpu_tid_map[cpu].insert(tid);
+					details::cpu_tid_map.erase(old_cpu, tid);
+					details::cpu_tid_map.insert(cpu, tid, is_idle(proc));
 
 					if (std::cmp_not_equal(old_node, new_node)) {
-						details::node_tid_map[old_node].erase(tid);
-						details::node_tid_map[new_node].erase(tid);
+						details::node_tid_map.erase(old_node, tid);
+						details::node_tid_map.insert(new_node, tid, is_idle(proc));
 					}
 				}
 				return true;
@@ -96,8 +162,8 @@ namespace system_info {
 
 		inline auto pin_thread_to_cpu(process & proc, const bool print = true) -> bool {
 			if (proc.pin(print)) {
-				details::cpu_tid_map[proc.pinned_cpu()].insert(proc.pid());
-				details::node_tid_map[proc.pinned_node()].insert(proc.pid());
+				details::cpu_tid_map.insert(proc.pinned_cpu(), proc.pid(), is_idle(proc));
+				details::node_tid_map.insert(proc.pinned_node(), proc.pid(), is_idle(proc));
 				return true;
 			}
 			return false;
@@ -118,12 +184,12 @@ namespace system_info {
 
 			if (proc.pin_node(node, print)) {
 				if (std::cmp_not_equal(old_cpu, proc.pinned_cpu())) {
-					details::cpu_tid_map[old_cpu].erase(tid);
-					details::cpu_tid_map[proc.pinned_cpu()].insert(tid);
+					details::cpu_tid_map.erase(old_cpu, tid);
+					details::cpu_tid_map.insert(proc.pinned_cpu(), tid, is_idle(proc));
 
 					if (std::cmp_not_equal(old_node, node)) {
-						details::node_tid_map[old_node].erase(tid);
-						details::node_tid_map[node].erase(tid);
+						details::node_tid_map.erase(old_node, tid);
+						details::node_tid_map.insert(node, tid, is_idle(proc));
 					}
 				}
 				return true;
@@ -135,7 +201,7 @@ namespace system_info {
 		inline auto pin_thread_to_node(process & proc, const bool print = true) -> bool {
 			if (proc.pin_node(print)) {
 				const auto node = details::cpu_node_map[proc.pinned_cpu()];
-				details::node_tid_map[node].insert(proc.pid());
+				details::node_tid_map.insert(node, proc.pid(), is_idle(proc));
 				return true;
 			}
 			return false;
@@ -147,8 +213,8 @@ namespace system_info {
 			const auto old_node = proc.pinned_node();
 
 			if (proc.unpin(print)) {
-				details::cpu_tid_map[old_cpu].erase(pid);
-				details::node_tid_map[old_node].erase(pid);
+				details::cpu_tid_map.erase(old_cpu, pid);
+				details::node_tid_map.erase(old_node, pid);
 				return true;
 			}
 
@@ -179,6 +245,10 @@ namespace system_info {
 
 	auto detect_system() noexcept -> bool;
 
+	// Loads the latency/bandwidth matrix between nodes from the file or, if it was not measured in this machine (or
+	// with these BIOS settings), measures and saves it. The nodes are sorted by the measured distances afterwards
+	auto calibrate(const std::string & filename) -> bool;
+
 	[[nodiscard]] inline auto num_of_cpus() {
 		return details::cpus.size();
 	}
@@ -207,10 +277,20 @@ namespace system_info {
 
 	void scan_children_file(const std::filesystem::path & path, process * parent);
 
+	// Updates the information of the processes in the tree, and which of them are idle in the occupancy maps
+	inline void update_processes() {
+		details::proc_tree.update();
+
+		details::proc_tree.for_each([](const process & process) {
+			details::cpu_tid_map.idle(process.pid(), is_idle(process));
+			details::node_tid_map.idle(process.pid(), is_idle(process));
+		});
+	}
+
 	// Scans full /proc directory. As almost all processes are not migratable, is not efficient.
 	inline void update_tree(const bool scan_proc) {
 		if (scan_proc) { scan_dir(process::DEFAULT_PROC); }
-		details::proc_tree.update();
+		update_processes();
 	}
 
 	// Parses /proc directory from the requested pid and its children. Supposed to be efficient.
@@ -223,12 +303,14 @@ namespace system_info {
 		scan_dir(subdir, proc);
 
 		// Update inner information of PIDs in the process tree
-		details::proc_tree.update();
+		update_processes();
 	}
 
 	// Initialise the tree of processes
 	inline void start_tree(const pid_t root_pid, const std::string_view dirname = process::DEFAULT_PROC) {
 		details::proc_tree = process_tree(root_pid);
+		// Subscribe before scanning, so no thread created meanwhile is missed
+		std::ignore = details::events.open();
 		update_tree(root_pid, dirname);
 	}
 
@@ -277,19 +359,31 @@ namespace system_info {
 	}
 
 	[[nodiscard]] inline auto is_cpu_free(const cpu_t cpu) -> bool {
-		return details::cpu_tid_map[cpu].empty();
+		return details::cpu_tid_map.tids(cpu).empty();
+	}
+
+	// True if no thread is pinned to the CPU nor to its SMT siblings
+	[[nodiscard]] inline auto is_core_free(const cpu_t cpu) -> bool {
+		return std::ranges::all_of(details::cpu_topology.smt_siblings(cpu), [](const cpu_t sibling) {
+			return details::cpu_tid_map.tids(sibling).empty();
+		});
 	}
 
 	[[nodiscard]] inline auto is_cpu_free_in_node(const node_t node) -> bool {
-		return details::node_tid_map[node].size() < details::node_cpu_map[node].size();
+		return details::node_tid_map.tids(node).size() < details::node_cpu_map[node].size();
+	}
+
+	[[nodiscard]] inline auto cpu_topology() -> const topology & {
+		return details::cpu_topology;
 	}
 
-	[[nodiscard]] inline auto tids_from_cpu(const cpu_t cpu) -> const auto & {
-		return details::cpu_tid_map[cpu];
+	// Views of the TIDs in a CPU/node: cheap to get and to count, valid until the next pin/unpin
+	[[nodiscard]] inline auto tids_from_cpu(const cpu_t cpu) -> occupancy_map::view {
+		return details::cpu_tid_map.tids(cpu);
 	}
 
-	[[nodiscard]] inline auto tids_from_node(const node_t node) -> const auto & {
-		return details::node_tid_map[node];
+	[[nodiscard]] inline auto tids_from_node(const node_t node) -> occupancy_map::view {
+		return details::node_tid_map.tids(node);
 	}
 
 	// Check if PID is a Lightweight process, such as an OMP thread
@@ -305,9 +399,9 @@ namespace system_info {
 		// so, take parent's PID if it exists, if not, return PPID
 		const auto & tid_struct = details::proc_tree.retrieve(tid);
 
-		const auto * const parent = tid_struct.parent();
+		const auto * const parent = details::proc_tree.parent(tid);
 
-		return tid_struct.lwp() ? parent->pid() : tid_struct.ppid();
+		return tid_struct.lwp() && parent != nullptr ? parent->pid() : tid_struct.ppid();
 	}
 
 	[[nodiscard]] inline auto set_tid_cpu(const pid_t tid, const cpu_t cpu) -> bool {
@@ -318,10 +412,6 @@ namespace system_info {
 		return auxiliary_functions::pin_thread_to_node(tid, node);
 	}
 
-	[[nodiscard]] inline auto is_idle(const process & process) -> bool {
-		return process.cpu_use() < IDLE_THRESHOLD;
-	}
-
 	[[nodiscard]] inline auto is_idle(const pid_t tid) -> bool {
 		return is_idle(details::proc_tree.retrieve(tid));
 	}
@@ -355,44 +445,34 @@ namespace system_info {
 		return process.cmdline();
 	}
 
-	[[nodiscard]] inline auto non_idle_tids_from_cpu(const cpu_t cpu) -> set<pid_t> {
-		const auto & tids = details::cpu_tid_map[cpu];
-
-		set<pid_t> non_idle_tids;
-
-		for (const auto & tid : tids) {
-			if (!is_idle(tid)) { non_idle_tids.insert(tid); }
-		}
-
-		return non_idle_tids;
+	[[nodiscard]] inline auto non_idle_tids_from_cpu(const cpu_t cpu) -> occupancy_map::view {
+		return details::cpu_tid_map.non_idle_tids(cpu);
 	}
 
-	[[nodiscard]] inline auto non_idle_tids_from_node(const node_t node) -> set<pid_t> {
-		const auto & tids = details::node_tid_map[node];
-
-		set<pid_t> non_idle_tids;
-
-		for (const auto & tid : tids) {
-			if (!is_idle(tid)) { non_idle_tids.insert(tid); }
-		}
+	[[nodiscard]] inline auto non_idle_tids_from_node(const node_t node) -> occupancy_map::view {
+		return details::node_tid_map.non_idle_tids(node);
+	}
 
-		return non_idle_tids;
+	[[nodiscard]] inline auto tids_from_cpu(const cpu_t cpu, const bool ignore_idle) -> occupancy_map::view {
+		return details::cpu_tid_map.tids(cpu, ignore_idle);
 	}
 
-	[[nodiscard]] inline auto tids_from_cpu(const cpu_t cpu, const bool ignore_idle) {
-		return ignore_idle ? non_idle_tids_from_cpu(cpu) : tids_from_cpu(cpu);
+	[[nodiscard]] inline auto tids_from_node(const node_t node, const bool ignore_idle) -> occupancy_map::view {
+		return details::node_tid_map.tids(node, ignore_idle);
 	}
 
-	[[nodiscard]] inline auto tids_from_node(const node_t node, const bool ignore_idle) {
-		return ignore_idle ? non_idle_tids_from_node(node) : tids_from_node(node);
+	// Number of TIDs placed in any node (a popcount, without building the set)
+	[[nodiscard]] inline auto num_of_tids(const bool ignore_idle) -> size_t {
+		return details::node_tid_map.count(ignore_idle);
 	}
 
 	[[nodiscard]] inline auto non_idle_tids() -> set<pid_t> {
 		set<pid_t> tids;
 
 		for (const auto & node : system_info::nodes()) {
-			const auto node_tids = non_idle_tids_from_node(node);
-			tids.insert(node_tids.begin(), node_tids.end());
+			for (const auto tid : non_idle_tids_from_node(node)) {
+				tids.insert(tid);
+			}
 		}
 
 		return tids;
@@ -402,8 +482,9 @@ namespace system_info {
 		set<pid_t> tids;
 
 		for (const auto & node : system_info::nodes()) {
-			const auto node_tids = tids_from_node(node);
-			tids.insert(node_tids.begin(), node_tids.end());
+			for (const auto tid : tids_from_node(node)) {
+				tids.insert(tid);
+			}
 		}
 
 		return tids;
@@ -420,11 +501,9 @@ namespace system_info {
 
 		success &= auxiliary_functions::pin_thread_to_cpu(root_proc);
 
-		auto children = root_proc.all_children();
-
-		for (auto & child : children) {
-			success &= auxiliary_functions::pin_thread_to_cpu(*child);
-		}
+		details::proc_tree.for_each_descendant(root_proc.pid(), [&](process & child) {
+			success &= auxiliary_functions::pin_thread_to_cpu(child);
+		});
 
 		return success;
 	}
@@ -436,11 +515,9 @@ namespace system_info {
 
 		success &= auxiliary_functions::pin_thread_to_node(root_proc);
 
-		auto children = root_proc.all_children();
-
-		for (auto & child : children) {
-			success &= auxiliary_functions::pin_thread_to_node(*child);
-		}
+		details::proc_tree.for_each_descendant(root_proc.pid(), [&](process & child) {
+			success &= auxiliary_functions::pin_thread_to_node(child);
+		});
 
 		return success;
 	}
@@ -452,15 +529,13 @@ namespace system_info {
 
 		success &= auxiliary_functions::pin_thread_to_cpu(root_proc);
 
-		auto children = root_proc.all_children();
-
-		for (auto & child : children) {
-			if (is_idle(*child)) {
-				success &= auxiliary_functions::unpin_thread(*child);
+		details::proc_tree.for_each_descendant(root_proc.pid(), [&](process & child) {
+			if (is_idle(child)) {
+				success &= auxiliary_functions::unpin_thread(child);
 			} else {
-				success &= auxiliary_functions::pin_thread_to_cpu(*child);
+				success &= auxiliary_functions::pin_thread_to_cpu(child);
 			}
-		}
+		});
 
 		return success;
 	}
@@ -472,15 +547,13 @@ namespace system_info {
 
 		success &= auxiliary_functions::pin_thread_to_node(root_proc);
 
-		auto children = root_proc.all_children();
-
-		for (auto & child : children) {
-			if (is_idle(*child)) {
-				success &= auxiliary_functions::unpin_thread(*child);
+		details::proc_tree.for_each_descendant(root_proc.pid(), [&](process & child) {
+			if (is_idle(child)) {
+				success &= auxiliary_functions::unpin_thread(child);
 			} else {
-				success &= auxiliary_functions::pin_thread_to_node(*child);
+				success &= auxiliary_functions::pin_thread_to_node(child);
 			}
-		}
+		});
 
 		return success;
 	}
@@ -496,32 +569,24 @@ namespace system_info {
 	[[nodiscard]] inline auto unpin_all_threads(const bool print = true) -> bool {
 		bool success = true;
 
-		process & root_proc = details::proc_tree.retrieve();
-
-		auto children = root_proc.all_children();
-
-		for (auto & child : children) {
-			success &= child->unpin(print);
-		}
+		details::proc_tree.for_each_descendant(details::proc_tree.root(),
+		                                       [&](process & child) { success &= child.unpin(print); });
 
 		return success;
 	}
 
 	inline void remove_pid(const pid_t tid, const bool print = true) {
 		process & proc = details::proc_tree.retrieve(tid);
-		details::cpu_tid_map[proc.cpu()].erase(tid);
+		details::cpu_tid_map.erase(proc.cpu(), tid);
 
 		auxiliary_functions::unpin_thread(tid, print);
 	}
 
 	inline void remove_invalid_data(const set<pid_t> & invalid_pids) {
 		for (const auto pid : invalid_pids) {
-			for (auto & tids : details::cpu_tid_map) {
-				tids.erase(pid);
-			}
-			for (auto & tids : details::node_tid_map) {
-				tids.erase(pid);
-			}
+			details::cpu_tid_map.erase(pid);
+			details::node_tid_map.erase(pid);
+			details::memory_usage.erase(pid);
 		}
 	}
 
@@ -534,38 +599,27 @@ namespace system_info {
 	}
 
 	[[nodiscard]] inline auto get_children() -> set<pid_t> {
-		const auto & process       = details::proc_tree.retrieve();
-		const auto   proc_children = process.all_children();
+		const auto root = details::proc_tree.root();
 
 		set<pid_t> children;
-		children.insert(process.pid());
-		for (const auto & child_ptr : proc_children) {
-			children.insert(child_ptr->pid());
-		}
+		children.insert(root);
+		details::proc_tree.for_each_descendant(root, [&](const process & child) { children.insert(child.pid()); });
 
 		return children;
 	}
 
 	[[nodiscard]] inline auto get_children(const pid_t pid) -> set<pid_t> {
-		const auto & process       = details::proc_tree.retrieve(pid);
-		const auto   proc_children = process.all_children();
-
 		set<pid_t> children;
-		for (const auto & child_ptr : proc_children) {
-			children.insert(child_ptr->pid());
-		}
+		details::proc_tree.for_each_descendant(pid, [&](const process & child) { children.insert(child.pid()); });
 
 		return children;
 	}
 
 	[[nodiscard]] inline auto get_lwp_children(const pid_t pid) -> set<pid_t> {
-		const auto & process       = details::proc_tree.retrieve(pid);
-		const auto   proc_children = process.all_children();
-
 		set<pid_t> children;
-		for (const auto & child_ptr : proc_children) {
-			if (child_ptr->lwp()) { children.insert(child_ptr->pid()); }
-		}
+		details::proc_tree.for_each_descendant(pid, [&](const process & child) {
+			if (child.lwp()) { children.insert(child.pid()); }
+		});
 
 		return children;
 	}
@@ -573,8 +627,13 @@ namespace system_info {
 	inline auto update(const pid_t child_process) -> set<pid_t> {
 		// Save the current list of children
 		const auto last_children = get_children(child_process);
-		// Look for new child threads of the children process and update the information
-		update_tree(child_process);
+		// Look for new child threads of the children process (unless the process events already told us about them)
+		// and update the information
+		if (!details::events.enabled() || std::exchange(details::rescan, false)) {
+			update_tree(child_process);
+		} else {
+			update_processes();
+		}
 		// Get the updated list of PIDs of the children
 		const auto children = get_children(child_process);
 
@@ -586,39 +645,191 @@ namespace system_info {
 
 		remove_invalid_data(threads_to_remove);
 
+		// Without events, watch the (new) processes to notice their exits between updates
+		if (!details::events.enabled()) {
+			for (const auto & pid : threads_to_remove) {
+				details::pidfds.unwatch(pid);
+			}
+			for (const auto & pid : children) {
+				if (!details::pidfds.watched(pid) && !details::proc_tree.retrieve(pid).lwp()) {
+					std::ignore = details::pidfds.watch(pid);
+				}
+			}
+		}
+
 		return threads_to_remove;
 	}
 
+	// True if pid is root or one of its descendants in the process tree
+	[[nodiscard]] inline auto descends_from(const pid_t pid, const pid_t root) -> bool {
+		return details::proc_tree.descends_from(pid, root);
+	}
+
+	struct tree_changes_t {
+		set<pid_t> added;
+		set<pid_t> removed;
+	};
+
+	// Applies to the tree of root the threads created and finished since the last call, as told by the process events
+	// (or, without them, the processes whose pidfd says they exited). Cheap enough to be called on every iteration
+	[[nodiscard]] inline auto process_events(const pid_t root) -> tree_changes_t {
+		tree_changes_t changes;
+
+		const auto remove = [&](const pid_t pid) {
+			// The root process finishing means the end of the execution, which is handled elsewhere
+			if (std::cmp_equal(pid, root) || !descends_from(pid, root)) { return; }
+
+			details::proc_tree.for_each_descendant(pid, [&](const process & child) {
+				if (!changes.added.erase(child.pid())) { changes.removed.insert(child.pid()); }
+			});
+			// Threads that lived less than a call are neither added nor removed
+			if (!changes.added.erase(pid)) { changes.removed.insert(pid); }
+
+			details::proc_tree.erase(pid);
+		};
+
+		if (!details::events.enabled()) {
+			details::pidfds.exited(remove);
+
+			remove_invalid_data(changes.removed);
+
+			return changes;
+		}
+
+		const bool complete = details::events.poll([&](const proc_events::event_t & event) {
+			switch (event.type) {
+				case proc_events::type_t::fork: {
+					// New threads hang from their process. New processes, from the thread that forked them
+					const bool thread = event.pid != event.tgid;
+
+					pid_t parent = event.tgid;
+					if (!thread) {
+						parent = details::proc_tree.contains(event.parent_pid) ? event.parent_pid : event.parent_tgid;
+					}
+
+					if (!descends_from(parent, root)) { break; }
+
+					const auto dirname =
+					    std::string(process::DEFAULT_PROC) + (thread ? "/" + std::to_string(event.tgid) + "/task" : "");
+
+					std::ignore = details::proc_tree.insert(event.pid, &details::proc_tree.retrieve(parent), dirname);
+
+					changes.added.insert(event.pid);
+					break;
+				}
+				case proc_events::type_t::exec:
+					if (descends_from(event.pid, root)) { details::proc_tree.refresh_cmdline(event.pid); }
+					break;
+				case proc_events::type_t::exit:
+					remove(event.pid);
+					break;
+			}
+		});
+
+		// Some events were lost: find the changes scanning /proc in the next update
+		if (!complete) { details::rescan = true; }
+
+		remove_invalid_data(changes.removed);
+
+		return changes;
+	}
+
 	inline void end() {
 		std::ignore = unpin_all_threads(false); // do no print verbose messages
 		details::proc_tree.erase_invalid();
 	}
 
-	[[nodiscard]] inline auto memory_usage(const pid_t pid) {
-		static constexpr auto MB_to_B = 1024 * 1024;
+	// Bytes of memory allocated in each node (the same numbers "numastat -p" shows), from the N<node>=<pages> and
+	// kernelpagesize_kB=<size> fields of the content of a /proc/<pid>/numa_maps file
+	[[nodiscard]] inline auto parse_memory_usage(const std::string_view numa_maps) -> std::vector<real_t> {
+		static constexpr auto kB_to_B = 1024;
 
 		std::vector<real_t> mem_usage(max_node() + 1, {});
+		std::vector<size_t> pages(mem_usage.size());
 
-		// Get amount of memory allocated (in MBs)
-		const auto command = "(NUMASTAT_WIDTH=1000 numastat -p " + std::to_string(pid) + " 2> /dev/null) " +
-		                     " | tail -n 1 | grep -P -o '[0-9]+.[0-9]+'";
-		const auto output = utils::cmd::exec(command, false);
+		utils::proc::for_each_line(numa_maps, [&](std::string_view line, const size_t) {
+			std::fill(pages.begin(), pages.end(), 0);
 
-		std::istringstream is(output);
+			size_t page_kB = 4;
 
-		for (auto & mem : mem_usage) {
-			real_t amount = {};
-			is >> amount;
+			for (auto token = utils::proc::next_token(line); !token.empty(); token = utils::proc::next_token(line)) {
+				if (token.starts_with('N')) {
+					auto       value = token.substr(1);
+					const auto node  = utils::proc::parse<size_t>(value);
+					const auto n     = utils::proc::parse<size_t>(value);
 
-			mem = amount * MB_to_B;
-		}
+					if (node.has_value() && n.has_value() && node.value() < pages.size()) {
+						pages[node.value()] = n.value();
+					}
+				} else if (const auto kB = utils::proc::parse_key<size_t>(token, "kernelpagesize_kB=")) {
+					page_kB = kB.value();
+				}
+			}
+
+			for (size_t node = 0; node < pages.size(); ++node) {
+				mem_usage[node] += static_cast<real_t>(pages[node] * page_kB * kB_to_B);
+			}
+		});
 
 		return mem_usage;
 	}
 
+	// Replaces the cached memory usage of the process with the one of its numa_maps, just read by the caller
+	inline void reconcile_memory_usage(const pid_t pid, const std::string_view numa_maps) {
+		auto & usage = details::memory_usage[pid];
+
+		usage.bytes     = parse_memory_usage(numa_maps);
+		usage.last_read = hres_clock::now();
+	}
+
+	// Accounts bytes of the process moved from one node to another, so memory_usage() does not need to read
+	// numa_maps again to see them. "tid" may be any thread of the process (migrations carry the TID of the samples)
+	inline void account_memory_migration(const pid_t tid, const node_t src, const node_t dst, const size_t bytes) {
+		auto it = details::memory_usage.find(tid);
+
+		// Secondary threads account to their process (threads that already ended are not in the tree anymore)
+		if (it == details::memory_usage.end() && details::proc_tree.contains(tid) && pid_is_lwp(tid)) {
+			it = details::memory_usage.find(pid_from_tid(tid));
+		}
+
+		if (it == details::memory_usage.end() || std::cmp_equal(src, dst)) { return; }
+
+		auto & usage = it->second.bytes;
+
+		const auto valid = [&](const node_t node) { return node >= 0 && std::cmp_less(node, usage.size()); };
+		if (!valid(src) || !valid(dst)) { return; }
+
+		const auto moved = std::min(static_cast<real_t>(bytes), usage[src]);
+
+		usage[src] -= moved;
+		usage[dst] += moved;
+	}
+
+	// Bytes of memory of the process allocated in each node. Cached: numa_maps (which makes the kernel walk the page
+	// tables of the process) is only read every MEMORY_USAGE_PERIOD seconds
+	[[nodiscard]] inline auto memory_usage(const pid_t pid) -> const std::vector<real_t> & {
+		auto & usage = details::memory_usage[pid];
+
+		if (!usage.bytes.empty() && utils::time::time_until_now(usage.last_read) < details::MEMORY_USAGE_PERIOD) {
+			return usage.bytes;
+		}
+
+		thread_local std::string buffer;
+
+		const auto content = utils::proc::read_file("/proc/" + std::to_string(pid) + "/numa_maps", buffer);
+
+		if (content.has_value()) {
+			usage.bytes = parse_memory_usage(content.value());
+		} else {
+			usage.bytes.assign(max_node() + 1, {});
+		}
+		usage.last_read = hres_clock::now();
+
+		return usage.bytes;
+	}
+
 	[[nodiscard]] inline auto memory_usage(const pid_t pid, const node_t node) {
-		const auto mem_usage = memory_usage(pid);
-		return mem_usage[node];
+		return memory_usage(pid)[node];
 	}
 
 	// Formula extracted from "Optimizing Google’s Warehouse Scale Computers: The NUMA Experience"
@@ -651,8 +862,7 @@ namespace system_info {
 
 		for (const auto i : nodes()) {
 			for (const auto j : nodes()) {
-				score += cpu_usage_by_node[i] * cpu_usage_by_node[j] * static_cast<real_t>(local_distance()) /
-				         static_cast<real_t>(numa_distance(i, j));
+				score += cpu_usage_by_node[i] * cpu_usage_by_node[j] / distance_factor(i, j);
 			}
 		}
 
@@ -671,26 +881,29 @@ namespace system_info {
 		return overload_cpu() * static_cast<real_t>(num_of_cpus());
 	}
 
-	[[nodiscard]] inline auto load_per_pid() -> map<pid_t, real_t> {
-		const auto processes_ptr = details::proc_tree.retrieve_all();
+	// Calls f(process, load) for every process of the tree, in a linear scan
+	template<typename F>
+	inline void for_each_load(F && f) {
+		thread_local std::vector<size_t> cpu_processes;
+		cpu_processes.assign(num_of_cpus(), 0);
 
-		std::vector<size_t> cpu_processes(num_of_cpus());
+		details::proc_tree.for_each([&](const process & process) { ++cpu_processes[process.cpu()]; });
 
-		for (const auto * process_ptr : processes_ptr) {
-			++cpu_processes[process_ptr->cpu()];
-		}
+		details::proc_tree.for_each([&](const process & process) {
+			const auto cpu          = process.is_pinned() ? process.pinned_cpu() : process.cpu();
+			const auto max_cpu_use  = real_t(1.0) / static_cast<real_t>(cpu_processes[cpu]);
+			const auto real_cpu_use = process.cpu_use() / max_cpu_use;
+			const auto weight       = auxiliary_functions::priority_to_weight(process.priority());
 
-		map<pid_t, real_t> pid_load_map;
+			f(process, static_cast<real_t>(weight) * real_cpu_use /
+			               static_cast<real_t>(auxiliary_functions::priority_to_weight()));
+		});
+	}
 
-		for (const auto * process_ptr : processes_ptr) {
-			const auto cpu          = process_ptr->is_pinned() ? process_ptr->pinned_cpu() : process_ptr->cpu();
-			const auto max_cpu_use  = real_t(1.0) / static_cast<real_t>(cpu_processes[cpu]);
-			const auto real_cpu_use = process_ptr->cpu_use() / max_cpu_use;
-			const auto weight       = auxiliary_functions::priority_to_weight(process_ptr->priority());
+	[[nodiscard]] inline auto load_per_pid() -> map<pid_t, real_t> {
+		map<pid_t, real_t> pid_load_map;
 
-			pid_load_map[process_ptr->pid()] = static_cast<real_t>(weight) * real_cpu_use /
-			                                   static_cast<real_t>(auxiliary_functions::priority_to_weight());
-		}
+		for_each_load([&](const process & process, const real_t load) { pid_load_map[process.pid()] = load; });
 
 		return pid_load_map;
 	}
@@ -708,7 +921,13 @@ namespace system_info {
 	}
 
 	[[nodiscard]] inline auto load_per_cpu(const bool only_pinned = false) -> std::vector<real_t> {
-		return load_per_cpu(load_per_pid(), only_pinned);
+		std::vector<real_t> cpu_load_map(num_of_cpus(), {});
+
+		for_each_load([&](const process & process, const real_t load) {
+			if (!only_pinned || process.is_pinned()) { cpu_load_map[process.pinned_cpu()] += load; }
+		});
+
+		return cpu_load_map;
 	}
 
 	[[nodiscard]] inline auto load_per_node(const map<pid_t, real_t> & pid_load_map, const bool only_pinned = false)
@@ -724,7 +943,13 @@ namespace system_info {
 	}
 
 	[[nodiscard]] inline auto load_per_node(const bool only_pinned = false) -> std::vector<real_t> {
-		return load_per_node(load_per_pid(), only_pinned);
+		std::vector<real_t> node_load_map(max_node() + 1, {});
+
+		for_each_load([&](const process & process, const real_t load) {
+			if (!only_pinned || process.is_pinned()) { node_load_map[process.pinned_node()] += load; }
+		});
+
+		return node_load_map;
 	}
 
 	[[nodiscard]] inline auto load_cpu(const map<pid_t, real_t> & pid_load_map, const cpu_t cpu,
@@ -741,7 +966,13 @@ namespace system_info {
 	}
 
 	[[nodiscard]] inline auto load_cpu(const cpu_t cpu, const bool only_pinned = false) {
-		return load_cpu(load_per_pid(), cpu, only_pinned);
+		real_t cpu_load{};
+
+		for_each_load([&](const process & process, const real_t load) {
+			if ((!only_pinned || process.is_pinned()) && process.pinned_cpu() == cpu) { cpu_load += load; }
+		});
+
+		return cpu_load;
 	}
 
 	[[nodiscard]] inline auto load_node(const map<pid_t, real_t> & pid_load_map, const node_t node,
@@ -758,7 +989,13 @@ namespace system_info {
 	}
 
 	[[nodiscard]] inline auto load_node(const node_t node, const bool only_pinned = false) {
-		return load_node(load_per_pid(), node, only_pinned);
+		real_t node_load{};
+
+		for_each_load([&](const process & process, const real_t load) {
+			if ((!only_pinned || process.is_pinned()) && process.pinned_node() == node) { node_load += load; }
+		});
+
+		return node_load;
 	}
 
 	[[nodiscard]] inline auto load_system(const map<pid_t, real_t> & pid_load_map, const bool only_pinned = false) {
@@ -772,7 +1009,13 @@ namespace system_info {
 	}
 
 	[[nodiscard]] inline auto load_system(const bool only_pinned = false) {
-		return load_system(load_per_pid(), only_pinned);
+		real_t system_load{};
+
+		for_each_load([&](const process & process, const real_t load) {
+			if (!only_pinned || process.is_pinned()) { system_load += load; }
+		});
+
+		return system_load;
 	}
 
 	inline void print_system_topology(std::ostream & os = std::cout) {
@@ -835,10 +1078,17 @@ namespace system_info {
 		node_cpus_table.print(os);
 
 		os << '\n';
+
+		const auto & topo = cpu_topology();
+		os << "Topology: " << topo.n_sockets() << " sockets, " << topo.n_llcs() << " LLC domains, " << topo.n_cores()
+		   << " cores" << (topo.smt() ? " (SMT)" : "") << (topo.sub_numa() ? ", sub-NUMA clustering" : "") << "."
+		   << '\n';
+
+		os << '\n';
 	}
 
 	inline void print_system_status(std::ostream & os = std::cout) {
-		details::proc_tree.retrieve().update_all();
+		details::proc_tree.update();
 
 		// Print processes tree
 		os << "Processes tree..." << '\n';
@@ -851,19 +1101,17 @@ namespace system_info {
 
 		real_t system_use{};
 
-		const auto children = details::proc_tree.retrieve_all();
-
-		for (const auto & process_ptr : children) {
-			const auto pid  = process_ptr->pid();
-			const auto cpu  = process_ptr->cpu();
-			const auto node = process_ptr->node();
-			const auto use  = process_ptr->cpu_use();
+		details::proc_tree.for_each([&](const process & process) {
+			const auto pid  = process.pid();
+			const auto cpu  = process.cpu();
+			const auto node = process.node();
+			const auto use  = process.cpu_use();
 
 			cpu_tid_set[cpu].insert(pid);
 			cpu_use[cpu] += use;
 			node_use[node] += use;
 			system_use += use;
-		}
+		});
 
 		// Print CPU - TID map
 		tabulate::Table cpu_tid_table;
@@ -885,8 +1133,9 @@ namespace system_info {
 		os << '\n' << '\n';
 
 		// Print total system load
-		os << "Load avg (1m / 5m / 15m): " << utils::cmd::exec(R"(cat /proc/loadavg | awk '{print($1" / "$2" / "$3)}')")
-		   << '\n';
+		const auto loadavg = utils::proc::loadavg();
+		os << "Load avg (1m / 5m / 15m): " << utils::string::to_string(loadavg[0]) << " / "
+		   << utils::string::to_string(loadavg[1]) << " / " << utils::string::to_string(loadavg[2]) << '\n';
 
 		const auto pid_load_map  = load_per_pid();
 		const auto cpu_load_map  = load_per_cpu(pid_load_map);
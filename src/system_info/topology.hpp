@@ -0,0 +1,233 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <r.laso@usc.es> wrote this file. As long as you retain this notice you
+ * can do whatever you want with this stuff. If we meet some day, and you think
+ * this stuff is worth it, you can buy me a beer in return Ruben Laso
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef THANOS_TOPOLOGY_HPP
+#define THANOS_TOPOLOGY_HPP
+
+#include <algorithm>   // for ranges::find, ranges::sort, ranges::unique
+#include <optional>    // for optional
+#include <string>      // for string, to_string
+#include <string_view> // for string_view
+#include <utility>     // for cmp_less
+#include <vector>      // for vector
+
+#include "utils/proc.hpp"  // for read_file, next_token, parse
+#include "utils/types.hpp" // for cpu_t, node_t, map
+
+// Hierarchy of the CPUs of the system: SMT siblings share a core, cores share a last level cache (LLC), LLCs belong
+// to a NUMA node and nodes to a socket (several of them with sub-NUMA clustering, SNC/NPS). Built once from
+// /sys/devices/system/cpu/cpu<N>/topology and cache/index<N>; lookups are indexed by CPU and do not allocate
+class topology {
+private:
+	static constexpr std::string_view SYS_CPU = "/sys/devices/system/cpu/cpu";
+
+	struct cpu_info_t {
+		int    core   = -1; // Dense ids (0..n_cores()-1, 0..n_llcs()-1, 0..n_sockets()-1)
+		int    llc    = -1;
+		int    socket = -1;
+		node_t node   = -1;
+	};
+
+	std::vector<cpu_info_t> cpus_{}; // cpus_[cpu]
+
+	std::vector<std::vector<cpu_t>>  core_cpus_{};    // core_cpus_[core]     = SMT siblings
+	std::vector<std::vector<cpu_t>>  llc_cpus_{};     // llc_cpus_[llc]       = CPUs sharing the LLC
+	std::vector<std::vector<cpu_t>>  socket_cpus_{};  // socket_cpus_[socket] = CPUs of the socket
+	std::vector<std::vector<node_t>> socket_nodes_{}; // socket_nodes_[socket] = nodes of the socket
+
+	[[nodiscard]] static inline auto read(const std::string & path) -> std::optional<std::string_view> {
+		thread_local std::string buffer;
+		return utils::proc::read_file(path, buffer);
+	}
+
+	// CPUs of a sysfs list (e.g., "0-3,8,10-11")
+	[[nodiscard]] static inline auto parse_cpu_list(std::string_view list) -> std::vector<cpu_t> {
+		std::vector<cpu_t> cpus;
+
+		if (!list.empty() && list.back() == '\n') { list.remove_suffix(1); }
+
+		for (auto range = utils::proc::next_token(list, ','); !range.empty();
+		     range      = utils::proc::next_token(list, ',')) {
+			const auto first = utils::proc::parse<cpu_t>(range);
+			if (!first.has_value()) { continue; }
+
+			const auto last = range.empty() ? first : utils::proc::parse<cpu_t>(range);
+
+			for (auto cpu = first.value(); cpu <= last.value_or(first.value()); ++cpu) {
+				cpus.emplace_back(cpu);
+			}
+		}
+
+		return cpus;
+	}
+
+	// CPUs sharing the cache of highest level (data or unified) with the CPU, if sysfs reports caches
+	[[nodiscard]] static inline auto llc_list(const cpu_t cpu) -> std::optional<std::string> {
+		const auto dir = std::string(SYS_CPU) + std::to_string(cpu) + "/cache/index";
+
+		int                        best_level = 0;
+		std::optional<std::string> best_list;
+
+		for (int index = 0;; ++index) {
+			const auto type = read(dir + std::to_string(index) + "/type");
+			if (!type.has_value()) { break; }
+			if (type.value().starts_with("Instruction")) { continue; }
+
+			auto       level_str = read(dir + std::to_string(index) + "/level").value_or(std::string_view());
+			const auto level     = utils::proc::parse<int>(level_str).value_or(0);
+			if (level <= best_level) { continue; }
+
+			const auto list = read(dir + std::to_string(index) + "/shared_cpu_list");
+			if (!list.has_value()) { continue; }
+
+			best_level = level;
+			best_list  = std::string(list.value());
+		}
+
+		return best_list;
+	}
+
+	// Dense id of a key (the first CPU of a list, a package id...), adding it if it is new
+	[[nodiscard]] static inline auto dense_id(map<int, int> & ids, const int key) -> int {
+		return ids.try_emplace(key, static_cast<int>(ids.size())).first->second;
+	}
+
+	// Keeps in "cpus" only the ones of the system (e.g., allowed by the cpuset)
+	static inline void filter(std::vector<cpu_t> & cpus, const std::vector<cpu_t> & system_cpus) {
+		std::erase_if(cpus, [&](const cpu_t cpu) { return std::ranges::find(system_cpus, cpu) == system_cpus.end(); });
+	}
+
+	template<typename T>
+	static inline void add(std::vector<std::vector<T>> & groups, const int id, const T value) {
+		if (std::cmp_less(groups.size(), id + 1)) { groups.resize(id + 1); }
+		if (std::ranges::find(groups[id], value) == groups[id].end()) { groups[id].emplace_back(value); }
+	}
+
+public:
+	topology() = default;
+
+	// cpu_node_map[cpu] = node of the CPU. Missing sysfs information is replaced by the coarser level available: a
+	// CPU without SMT information is its own core, the LLC defaults to the socket and the socket to the node
+	topology(const std::vector<cpu_t> & cpus, const std::vector<node_t> & cpu_node_map) {
+		if (cpus.empty()) { return; }
+
+		cpus_.resize(*std::ranges::max_element(cpus) + 1);
+
+		map<int, int> core_ids;
+		map<int, int> llc_ids;
+		map<int, int> socket_ids;
+
+		for (const auto cpu : cpus) {
+			const auto dir = std::string(SYS_CPU) + std::to_string(cpu) + "/topology/";
+
+			auto & info = cpus_[cpu];
+			info.node   = std::cmp_less(cpu, cpu_node_map.size()) ? cpu_node_map[cpu] : 0;
+
+			auto       package_str = read(dir + "physical_package_id").value_or(std::string_view());
+			const auto package     = utils::proc::parse<int>(package_str);
+			// Without package information, each node is a socket (ids after the real packages cannot collide)
+			info.socket = dense_id(socket_ids, package.has_value() ? package.value() : -1 - info.node);
+
+			// Groups are identified by their first CPU
+			auto siblings = parse_cpu_list(read(dir + "thread_siblings_list").value_or(std::string_view()));
+			filter(siblings, cpus);
+			info.core = dense_id(core_ids, siblings.empty() ? cpu : std::ranges::min(siblings));
+
+			const auto llc = llc_list(cpu);
+			auto       llc_cpus = parse_cpu_list(llc.value_or(std::string()));
+			filter(llc_cpus, cpus);
+			// Without cache information, the socket is the LLC domain (ids after the CPUs cannot collide)
+			info.llc = dense_id(llc_ids, llc_cpus.empty() ? static_cast<int>(cpus_.size()) + info.socket
+			                                               : std::ranges::min(llc_cpus));
+		}
+
+		for (const auto cpu : cpus) {
+			const auto & info = cpus_[cpu];
+
+			add(core_cpus_, info.core, cpu);
+			add(llc_cpus_, info.llc, cpu);
+			add(socket_cpus_, info.socket, cpu);
+			add(socket_nodes_, info.socket, info.node);
+		}
+
+		for (auto & nodes : socket_nodes_) {
+			std::ranges::sort(nodes);
+		}
+	}
+
+	[[nodiscard]] inline auto core(const cpu_t cpu) const -> int {
+		return cpus_[cpu].core;
+	}
+
+	[[nodiscard]] inline auto llc(const cpu_t cpu) const -> int {
+		return cpus_[cpu].llc;
+	}
+
+	[[nodiscard]] inline auto socket(const cpu_t cpu) const -> int {
+		return cpus_[cpu].socket;
+	}
+
+	[[nodiscard]] inline auto node(const cpu_t cpu) const -> node_t {
+		return cpus_[cpu].node;
+	}
+
+	// CPUs of the core of the CPU (itself included)
+	[[nodiscard]] inline auto smt_siblings(const cpu_t cpu) const -> const std::vector<cpu_t> & {
+		return core_cpus_[core(cpu)];
+	}
+
+	// CPUs sharing the last level cache with the CPU (itself included)
+	[[nodiscard]] inline auto llc_cpus(const cpu_t cpu) const -> const std::vector<cpu_t> & {
+		return llc_cpus_[llc(cpu)];
+	}
+
+	[[nodiscard]] inline auto socket_cpus(const cpu_t cpu) const -> const std::vector<cpu_t> & {
+		return socket_cpus_[socket(cpu)];
+	}
+
+	[[nodiscard]] inline auto socket_nodes(const int socket) const -> const std::vector<node_t> & {
+		return socket_nodes_[socket];
+	}
+
+	[[nodiscard]] inline auto same_core(const cpu_t cpu_1, const cpu_t cpu_2) const -> bool {
+		return core(cpu_1) == core(cpu_2);
+	}
+
+	[[nodiscard]] inline auto same_llc(const cpu_t cpu_1, const cpu_t cpu_2) const -> bool {
+		return llc(cpu_1) == llc(cpu_2);
+	}
+
+	[[nodiscard]] inline auto same_socket(const cpu_t cpu_1, const cpu_t cpu_2) const -> bool {
+		return socket(cpu_1) == socket(cpu_2);
+	}
+
+	[[nodiscard]] inline auto n_cores() const -> size_t {
+		return core_cpus_.size();
+	}
+
+	[[nodiscard]] inline auto n_llcs() const -> size_t {
+		return llc_cpus_.size();
+	}
+
+	[[nodiscard]] inline auto n_sockets() const -> size_t {
+		return socket_cpus_.size();
+	}
+
+	// True if some core runs several hardware threads
+	[[nodiscard]] inline auto smt() const -> bool {
+		return std::ranges::any_of(core_cpus_, [](const auto & cpus) { return cpus.size() > 1; });
+	}
+
+	// True if some socket is split in several NUMA nodes (SNC/NPS modes)
+	[[nodiscard]] inline auto sub_numa() const -> bool {
+		return std::ranges::any_of(socket_nodes_, [](const auto & nodes) { return nodes.size() > 1; });
+	}
+};
+
+#endif /* end of include guard: THANOS_TOPOLOGY_HPP */
@@ -0,0 +1,304 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <r.laso@usc.es> wrote this file. As long as you retain this notice you
+ * can do whatever you want with this stuff. If we meet some day, and you think
+ * this stuff is worth it, you can buy me a beer in return Ruben Laso
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef THANOS_PROC_HPP
+#define THANOS_PROC_HPP
+
+#include <algorithm>    // for replace
+#include <array>        // for array
+#include <atomic>       // for atomic, memory_order_relaxed
+#include <cerrno>       // for errno, EINTR, EMFILE, ENFILE
+#include <charconv>     // for from_chars
+#include <cstdint>      // for uint64_t
+#include <cstring>      // for strerror
+#include <fcntl.h>      // for open, O_RDONLY, O_CLOEXEC
+#include <optional>     // for optional
+#include <stdexcept>    // for runtime_error
+#include <string>       // for string
+#include <string_view>  // for string_view
+#include <sys/types.h>  // for pid_t, off_t
+#include <system_error> // for errc
+#include <type_traits>  // for is_floating_point_v
+#include <unistd.h>     // for pread, close
+#include <utility>      // for exchange, move
+
+#include "utils/types.hpp" // for real_t
+
+namespace utils::proc {
+	static constexpr size_t INITIAL_BUFFER_SIZE = 4096;
+
+	// Reads the whole file behind fd (from the beginning) into buffer, growing it if needed
+	[[nodiscard]] inline auto read_fd(const int fd, std::string & buffer) -> std::optional<std::string_view> {
+		if (fd < 0) { return std::nullopt; }
+
+		if (buffer.empty()) { buffer.resize(INITIAL_BUFFER_SIZE); }
+
+		size_t size = 0;
+
+		while (true) {
+			if (size == buffer.size()) { buffer.resize(buffer.size() * 2); }
+
+			const auto ret = pread(fd, buffer.data() + size, buffer.size() - size, static_cast<off_t>(size));
+
+			if (ret < 0) {
+				if (errno == EINTR) { continue; }
+				return std::nullopt;
+			}
+
+			if (ret == 0) { break; }
+
+			size += static_cast<size_t>(ret);
+		}
+
+		return std::string_view(buffer.data(), size);
+	}
+
+	// Reads a file that is not worth keeping open (e.g., /proc/<pid>/cmdline of a new thread) into buffer
+	[[nodiscard]] inline auto read_file(const std::string & path, std::string & buffer)
+	    -> std::optional<std::string_view> {
+		const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0) { return std::nullopt; }
+
+		const auto content = read_fd(fd, buffer);
+
+		close(fd);
+
+		return content;
+	}
+
+	// A /proc (or sysfs) file that is kept open and read from the beginning with pread() into a reused buffer, so
+	// reading it again does not open the file nor allocate memory (once the buffer is big enough)
+	class proc_file {
+	private:
+		std::string path_{};
+		int         fd_ = -1;
+
+		// Out of file descriptors when it was opened (EMFILE/ENFILE): the file is opened on every read instead
+		bool on_demand_ = false;
+
+		// Identity of the open file: fd numbers are reused once closed, so they do not tell two files apart
+		uint64_t id_ = next_id();
+
+		std::string buffer_{};
+
+		[[nodiscard]] static inline auto next_id() -> uint64_t {
+			static std::atomic<uint64_t> ids{ 0 };
+			return ids.fetch_add(1, std::memory_order_relaxed) + 1;
+		}
+
+	public:
+		proc_file() = default;
+
+		// buffer_size = initial size of the buffer (it grows if the file does not fit). Small files that are opened for
+		// many processes (e.g., /proc/<pid>/stat) should use a small one
+		explicit proc_file(std::string path, const size_t buffer_size = INITIAL_BUFFER_SIZE) :
+		    path_(std::move(path)),
+		    fd_(open(path_.c_str(), O_RDONLY | O_CLOEXEC)),
+		    on_demand_(fd_ < 0 && (errno == EMFILE || errno == ENFILE)),
+		    buffer_(buffer_size, '\0') {
+		}
+
+		proc_file(const proc_file &)                     = delete;
+		auto operator=(const proc_file &) -> proc_file & = delete;
+
+		proc_file(proc_file && other) noexcept :
+		    path_(std::move(other.path_)),
+		    fd_(std::exchange(other.fd_, -1)),
+		    on_demand_(std::exchange(other.on_demand_, false)),
+		    id_(std::exchange(other.id_, 0)),
+		    buffer_(std::move(other.buffer_)) {
+		}
+
+		auto operator=(proc_file && other) noexcept -> proc_file & {
+			if (this != &other) {
+				if (fd_ >= 0) { close(fd_); }
+				path_      = std::move(other.path_);
+				fd_        = std::exchange(other.fd_, -1);
+				on_demand_ = std::exchange(other.on_demand_, false);
+				id_        = std::exchange(other.id_, 0);
+				buffer_    = std::move(other.buffer_);
+			}
+			return *this;
+		}
+
+		~proc_file() {
+			if (fd_ >= 0) { close(fd_); }
+		}
+
+		[[nodiscard]] inline auto good() const {
+			return fd_ >= 0 || on_demand_;
+		}
+
+		[[nodiscard]] inline auto path() const -> const auto & {
+			return path_;
+		}
+
+		// -1 if the file is not kept open (so batched reads fall back to read())
+		[[nodiscard]] inline auto fd() const -> int {
+			return fd_;
+		}
+
+		[[nodiscard]] inline auto id() const -> uint64_t {
+			return id_;
+		}
+
+		// Buffer the file is read into, for reads not done through read() (see batch_reader)
+		[[nodiscard]] inline auto buffer() -> std::string & {
+			return buffer_;
+		}
+
+		// Whole content of the file (nullopt on error). The view is valid until the next read()
+		[[nodiscard]] inline auto read() -> std::optional<std::string_view> {
+			if (on_demand_) { return read_file(path_, buffer_); }
+			return read_fd(fd_, buffer_);
+		}
+
+		// Same as read(), but throwing if the file cannot be read
+		[[nodiscard]] inline auto read_or_throw() -> std::string_view {
+			const auto content = read();
+
+			if (!content.has_value()) {
+				const auto error = "Cannot read file " + path_ + ": " + strerror(errno);
+				throw std::runtime_error(error);
+			}
+
+			return content.value();
+		}
+	};
+
+	// Calls f(line, index) for every line of the text (without the trailing '\n')
+	template<typename F>
+	inline void for_each_line(std::string_view text, F && f) {
+		size_t index = 0;
+
+		while (!text.empty()) {
+			const auto pos  = text.find('\n');
+			const auto line = text.substr(0, pos);
+
+			f(line, index++);
+
+			if (pos == std::string_view::npos) { break; }
+			text.remove_prefix(pos + 1);
+		}
+	}
+
+	// Removes and returns the next token (delimited by "sep") of the text, skipping leading separators
+	[[nodiscard]] inline auto next_token(std::string_view & text, const char sep = ' ') -> std::string_view {
+		const auto begin = text.find_first_not_of(sep);
+		if (begin == std::string_view::npos) {
+			text = {};
+			return {};
+		}
+
+		text.remove_prefix(begin);
+
+		const auto end   = text.find(sep);
+		const auto token = text.substr(0, end);
+
+		text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+
+		return token;
+	}
+
+	// Parses a number at the beginning of the text, removing it (and the following character, if any) from the text
+	template<typename T>
+	[[nodiscard]] inline auto parse(std::string_view & text, const int base = 10) -> std::optional<T> {
+		T value{};
+
+		const auto [ptr, ec] = [&] {
+			if constexpr (std::is_floating_point_v<T>) {
+				return std::from_chars(text.data(), text.data() + text.size(), value);
+			} else {
+				return std::from_chars(text.data(), text.data() + text.size(), value, base);
+			}
+		}();
+
+		if (ec != std::errc()) { return std::nullopt; }
+
+		text.remove_prefix(static_cast<size_t>(ptr - text.data()));
+		if (!text.empty()) { text.remove_prefix(1); }
+
+		return value;
+	}
+
+	// Parses the value of a "<key><value>" token (e.g., "anon=12" with key "anon="), if the token has such key
+	template<typename T>
+	[[nodiscard]] inline auto parse_key(std::string_view token, const std::string_view key, const int base = 10)
+	    -> std::optional<T> {
+		if (!token.starts_with(key)) { return std::nullopt; }
+
+		token.remove_prefix(key.size());
+
+		return parse<T>(token, base);
+	}
+
+	// Command line of a process or thread, with the arguments separated by spaces (as "ps -o args" shows it).
+	// Kernel threads have no command line, so their name is shown between brackets
+	[[nodiscard]] inline auto cmdline(const pid_t pid) -> std::string {
+		thread_local std::string buffer;
+
+		const auto path = "/proc/" + std::to_string(pid);
+
+		auto content = read_file(path + "/cmdline", buffer).value_or(std::string_view());
+
+		while (!content.empty() && content.back() == '\0') {
+			content.remove_suffix(1);
+		}
+
+		if (!content.empty()) {
+			std::string cmdline(content);
+			std::replace(cmdline.begin(), cmdline.end(), '\0', ' ');
+			return cmdline;
+		}
+
+		auto comm = read_file(path + "/comm", buffer).value_or(std::string_view());
+		if (comm.empty()) { return {}; }
+		if (comm.back() == '\n') { comm.remove_suffix(1); }
+
+		return "[" + std::string(comm) + "]";
+	}
+
+	// System load averages of the last 1, 5 and 15 minutes (from /proc/loadavg)
+	[[nodiscard]] inline auto loadavg() -> std::array<real_t, 3> {
+		static proc_file file("/proc/loadavg");
+
+		std::array<real_t, 3> load{};
+
+		auto content = file.read().value_or(std::string_view());
+
+		for (auto & value : load) {
+			auto token = next_token(content);
+			value      = parse<real_t>(token).value_or(0);
+		}
+
+		return load;
+	}
+
+	// Value of a field of /proc/meminfo (e.g., "Hugepagesize"), in kB
+	[[nodiscard]] inline auto meminfo(const std::string_view key) -> std::optional<size_t> {
+		static proc_file file("/proc/meminfo");
+
+		const auto content = file.read();
+		if (!content.has_value()) { return std::nullopt; }
+
+		std::optional<size_t> value;
+
+		for_each_line(content.value(), [&](std::string_view line, const size_t) {
+			if (value.has_value() || !line.starts_with(key) || !line.substr(key.size()).starts_with(':')) { return; }
+
+			line.remove_prefix(key.size() + 1);
+			auto token = next_token(line);
+			value      = parse<size_t>(token);
+		});
+
+		return value;
+	}
+} // namespace utils::proc
+
+#endif /* end of include guard: THANOS_PROC_HPP */
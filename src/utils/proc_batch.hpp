@@ -0,0 +1,340 @@
+/*
+ * ----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * <r.laso@usc.es> wrote this file. As long as you retain this notice you
+ * can do whatever you want with this stuff. If we meet some day, and you think
+ * this stuff is worth it, you can buy me a beer in return Ruben Laso
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef THANOS_PROC_BATCH_HPP
+#define THANOS_PROC_BATCH_HPP
+
+#include <cstddef>     // for size_t
+#include <optional>    // for optional
+#include <span>        // for span
+#include <string_view> // for string_view
+
+#ifdef USE_IO_URING
+	#include <algorithm>        // for min, max, equal
+	#include <atomic>           // for atomic_ref, memory_order
+	#include <cerrno>           // for errno, EINTR, EINVAL
+	#include <cstdint>          // for uint64_t
+	#include <cstring>          // for memset, strerror
+	#include <iostream>         // for operator<<, basic_ostream, cerr
+	#include <linux/io_uring.h> // for io_uring_params, io_uring_sqe, io_uring_cqe, IORING_*
+	#include <sys/mman.h>       // for mmap, munmap
+	#include <sys/syscall.h>    // for __NR_io_uring_setup, __NR_io_uring_enter, __NR_io_uring_register
+	#include <unistd.h>         // for syscall, close
+	#include <utility>          // for cmp_greater_equal
+	#include <vector>           // for vector
+
+	#include "utils/verbose.hpp" // for print_with_lvl, LVL1
+#endif
+
+#include "utils/proc.hpp" // for proc_file
+
+namespace utils::proc {
+	// Reads many proc_files at once, calling f(index, content) for each of them (content = nullopt on error).
+	// If thanos is built with USE_IO_URING, the reads of all the files are submitted to an io_uring in a single batch
+	// (with the files registered to the ring) and the contents are parsed as the completions arrive. Otherwise, or if
+	// io_uring is not available at runtime (old kernel, disabled by sysctl/seccomp...), the files are read one by one.
+	class batch_reader {
+	private:
+#ifdef USE_IO_URING
+		static constexpr unsigned RING_ENTRIES = 256;
+
+		int ring_fd_ = -1;
+
+		void *         sq_ptr_  = nullptr;
+		void *         cq_ptr_  = nullptr;
+		io_uring_sqe * sqes_    = nullptr;
+		size_t         sq_size_ = 0;
+		size_t         cq_size_ = 0;
+
+		unsigned * sq_tail_  = nullptr;
+		unsigned * sq_mask_  = nullptr;
+		unsigned * sq_array_ = nullptr;
+		unsigned * cq_head_  = nullptr;
+		unsigned * cq_tail_  = nullptr;
+		unsigned * cq_mask_  = nullptr;
+
+		io_uring_cqe * cqes_ = nullptr;
+
+		unsigned entries_ = 0;
+
+		std::vector<int>      registered_fds_{}; // Files registered in the ring (index = position in the batch)
+		std::vector<uint64_t> registered_ids_{}; // Identities of those files (see proc_file::id)
+		bool                  fixed_files_ = false;
+
+		std::vector<char> delivered_{}; // Files of the batch already passed to f (for falling back midway)
+
+		[[nodiscard]] static inline auto load(unsigned * ptr) -> unsigned {
+			return std::atomic_ref<unsigned>(*ptr).load(std::memory_order_acquire);
+		}
+
+		static inline void store(unsigned * ptr, const unsigned value) {
+			std::atomic_ref<unsigned>(*ptr).store(value, std::memory_order_release);
+		}
+
+		inline auto setup() -> bool {
+			io_uring_params params{};
+
+			ring_fd_ = static_cast<int>(syscall(__NR_io_uring_setup, RING_ENTRIES, &params));
+			if (ring_fd_ < 0) { return false; }
+
+			sq_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+			cq_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+			const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+			if (single_mmap) { sq_size_ = cq_size_ = std::max(sq_size_, cq_size_); }
+
+			constexpr int prot  = PROT_READ | PROT_WRITE;
+			constexpr int flags = MAP_SHARED | MAP_POPULATE;
+
+			sq_ptr_ = mmap(nullptr, sq_size_, prot, flags, ring_fd_, IORING_OFF_SQ_RING);
+			if (sq_ptr_ == MAP_FAILED) {
+				sq_ptr_ = nullptr;
+				return false;
+			}
+
+			cq_ptr_ = single_mmap ? sq_ptr_ : mmap(nullptr, cq_size_, prot, flags, ring_fd_, IORING_OFF_CQ_RING);
+			if (cq_ptr_ == MAP_FAILED) {
+				cq_ptr_ = nullptr;
+				return false;
+			}
+
+			void * sqes = mmap(nullptr, params.sq_entries * sizeof(io_uring_sqe), prot, flags, ring_fd_,
+			                   IORING_OFF_SQES);
+			if (sqes == MAP_FAILED) { return false; }
+			sqes_ = static_cast<io_uring_sqe *>(sqes);
+
+			auto * sq = static_cast<char *>(sq_ptr_);
+			auto * cq = static_cast<char *>(cq_ptr_);
+
+			sq_tail_  = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+			sq_mask_  = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+			sq_array_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+			cq_head_  = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+			cq_tail_  = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+			cq_mask_  = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+			cqes_     = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+
+			entries_ = params.sq_entries;
+
+			return true;
+		}
+
+		inline void teardown() {
+			if (sqes_ != nullptr) { munmap(sqes_, entries_ * sizeof(io_uring_sqe)); }
+			if (cq_ptr_ != nullptr && cq_ptr_ != sq_ptr_) { munmap(cq_ptr_, cq_size_); }
+			if (sq_ptr_ != nullptr) { munmap(sq_ptr_, sq_size_); }
+			if (ring_fd_ >= 0) { close(ring_fd_); }
+
+			sqes_    = nullptr;
+			cq_ptr_  = nullptr;
+			sq_ptr_  = nullptr;
+			ring_fd_ = -1;
+		}
+
+		// Replaces the registered files of the slots that changed, keeping the rest of the table
+		inline auto update_files(std::span<proc_file * const> files) -> bool {
+			size_t slot = 0;
+
+			while (slot < files.size()) {
+				if (files[slot]->id() == registered_ids_[slot]) {
+					++slot;
+					continue;
+				}
+
+				// Run of consecutive slots with new files
+				const auto first = slot;
+				for (; slot < files.size() && files[slot]->id() != registered_ids_[slot]; ++slot) {
+					registered_fds_[slot] = files[slot]->fd();
+					registered_ids_[slot] = files[slot]->id();
+				}
+
+				io_uring_files_update update{};
+				update.offset = static_cast<unsigned>(first);
+				update.fds    = reinterpret_cast<unsigned long long>(registered_fds_.data() + first);
+
+				const auto n   = static_cast<unsigned>(slot - first);
+				const auto ret = syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_FILES_UPDATE, &update, n);
+				if (std::cmp_not_equal(ret, n)) { return false; }
+			}
+
+			return true;
+		}
+
+		// Registers the fds of the batch in the ring, so the kernel does not look them up on every read.
+		// Nothing is done if the files did not change since the last batch (the usual case). The files are compared by
+		// identity, not by fd: a thread that ends and a new one may get the same fd, and the registered table would
+		// keep reading the file of the former
+		inline void register_files(std::span<proc_file * const> files) {
+			const bool same = std::equal(files.begin(), files.end(), registered_ids_.begin(), registered_ids_.end(),
+			                             [](const proc_file * file, const uint64_t id) { return file->id() == id; });
+			if (same) { return; }
+
+			// Same number of slots: only the files of the slots that changed are replaced
+			if (fixed_files_ && registered_ids_.size() == files.size() && update_files(files)) { return; }
+
+			if (fixed_files_) { syscall(__NR_io_uring_register, ring_fd_, IORING_UNREGISTER_FILES, nullptr, 0); }
+
+			registered_fds_.clear();
+			registered_ids_.clear();
+			for (const auto * file : files) {
+				registered_fds_.emplace_back(file->fd());
+				registered_ids_.emplace_back(file->id());
+			}
+
+			// Invalid fds (files that could not be opened) are registered as -1 (sparse) and fail on read
+			fixed_files_ = !registered_fds_.empty() &&
+			               syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_FILES, registered_fds_.data(),
+			                       static_cast<unsigned>(registered_fds_.size())) == 0;
+		}
+
+		// Submits the reads of files[first, first + n) and waits for their completions. Returns false if io_uring
+		// itself failed, so the caller can fall back to the synchronous reads
+		template<typename F>
+		inline auto read_chunk(std::span<proc_file * const> files, const size_t first, const unsigned n, F & f)
+		    -> bool {
+			auto tail = *sq_tail_;
+
+			for (unsigned i = 0; i < n; ++i) {
+				const auto index = first + i;
+				auto &     file  = *files[index];
+				auto &     buf   = file.buffer();
+
+				const auto   sq_index = tail & *sq_mask_;
+				auto &       sqe      = sqes_[sq_index];
+				const size_t size     = buf.size();
+
+				std::memset(&sqe, 0, sizeof(sqe));
+				sqe.opcode    = IORING_OP_READ;
+				sqe.fd        = fixed_files_ ? static_cast<int>(index) : file.fd();
+				sqe.flags     = fixed_files_ ? IOSQE_FIXED_FILE : 0;
+				sqe.addr      = reinterpret_cast<unsigned long long>(buf.data());
+				sqe.len       = static_cast<unsigned>(size);
+				sqe.off       = 0;
+				sqe.user_data = index;
+
+				sq_array_[sq_index] = sq_index;
+				++tail;
+			}
+
+			store(sq_tail_, tail);
+
+			unsigned to_submit = n;
+			unsigned pending   = n;
+			bool     disabled  = false;
+
+			while (pending > 0) {
+				const auto ret =
+				    syscall(__NR_io_uring_enter, ring_fd_, to_submit, pending, IORING_ENTER_GETEVENTS, nullptr, 0);
+
+				if (ret < 0) {
+					if (errno == EINTR) { continue; }
+					return false;
+				}
+
+				to_submit -= std::min(to_submit, static_cast<unsigned>(ret));
+
+				auto       head    = *cq_head_;
+				const auto cq_tail = load(cq_tail_);
+
+				for (; head != cq_tail; ++head) {
+					const auto & cqe   = cqes_[head & *cq_mask_];
+					const auto   index = static_cast<size_t>(cqe.user_data);
+					auto &       file  = *files[index];
+
+					--pending;
+					delivered_[index] = 1;
+
+					// IORING_OP_READ not supported by the kernel
+					if (cqe.res == -EINVAL) { disabled = true; }
+
+					if (cqe.res < 0 || std::cmp_greater_equal(cqe.res, file.buffer().size())) {
+						// Error or the file did not fit in the buffer: read it synchronously (growing the buffer)
+						f(index, file.read());
+					} else {
+						f(index, std::string_view(file.buffer().data(), static_cast<size_t>(cqe.res)));
+					}
+				}
+
+				store(cq_head_, head);
+			}
+
+			return !disabled;
+		}
+#endif
+
+		bool enabled_ = false;
+
+	public:
+		batch_reader() {
+#ifdef USE_IO_URING
+			enabled_ = setup();
+
+			if (!enabled_) {
+				if (verbose::print_with_lvl(verbose::LVL1)) {
+					std::cerr << "io_uring not available (" << strerror(errno) << "). Reading /proc files one by one."
+					          << '\n';
+				}
+				teardown();
+			}
+#endif
+		}
+
+		batch_reader(const batch_reader &)                     = delete;
+		auto operator=(const batch_reader &) -> batch_reader & = delete;
+
+		~batch_reader() {
+#ifdef USE_IO_URING
+			teardown();
+#endif
+		}
+
+		// True if the reads are batched with io_uring
+		[[nodiscard]] inline auto batched() const -> bool {
+			return enabled_;
+		}
+
+		template<typename F>
+		inline void read(std::span<proc_file * const> files, F && f) {
+#ifdef USE_IO_URING
+			if (enabled_ && !files.empty()) {
+				register_files(files);
+
+				delivered_.assign(files.size(), 0);
+
+				for (size_t first = 0; first < files.size(); first += entries_) {
+					const auto n = static_cast<unsigned>(std::min<size_t>(entries_, files.size() - first));
+
+					if (!read_chunk(files, first, n, f)) {
+						if (verbose::print_with_lvl(verbose::LVL1)) {
+							std::cerr << "io_uring reads failed. Reading /proc files one by one." << '\n';
+						}
+						teardown();
+						enabled_ = false;
+						break;
+					}
+				}
+
+				if (enabled_) { return; }
+
+				// Read synchronously the files whose completions were not delivered
+				for (size_t i = 0; i < files.size(); ++i) {
+					if (delivered_[i] == 0) { f(i, files[i]->read()); }
+				}
+
+				return;
+			}
+#endif
+			for (size_t i = 0; i < files.size(); ++i) {
+				f(i, files[i]->read());
+			}
+		}
+	};
+} // namespace utils::proc
+
+#endif /* end of include guard: THANOS_PROC_BATCH_HPP */